@@ -51,6 +51,7 @@ enum req_lib_lck_resource_types {
 	MESSAGE_REQ_LCK_RESOURCEUNLOCKASYNC = 6,
 	MESSAGE_REQ_LCK_LOCKPURGE = 7,
 	MESSAGE_REQ_LCK_LIMITGET = 8,
+	MESSAGE_REQ_LCK_LOCKSETASYNC = 9,
 };
 
 enum res_lib_lck_resource_types {
@@ -67,6 +68,7 @@ enum res_lib_lck_resource_types {
 	MESSAGE_RES_LCK_LOCKGRANT_CALLBACK = 10,
 	MESSAGE_RES_LCK_LOCKWAITER_CALLBACK = 11,
 	MESSAGE_RES_LCK_RESOURCEUNLOCK_CALLBACK = 12,
+	MESSAGE_RES_LCK_LOCKSETASYNC = 13,
 };
 
 /*
@@ -77,6 +79,11 @@ enum res_lib_lck_resource_types {
  */
 #define LCK_MAX_NUM_LOCKS 4096
 
+/*
+ * Maximum number of resources named by one saLckResourceLockSetAsync.
+ */
+#define LCK_MAX_LOCKSET_SIZE 64
+
 struct req_lib_lck_resourceopen {
 	coroipc_request_header_t header __attribute__((aligned(8)));
 	mar_name_t resource_name __attribute__((aligned(8)));
@@ -189,6 +196,29 @@ struct res_lib_lck_limitget {
 	mar_uint64_t value __attribute__((aligned(8)));
 } __attribute__((aligned(8)));
 
+/*
+ * One resource of a lock set request.
+ */
+struct lck_lockset_entry {
+	hdb_handle_t resource_id __attribute__((aligned(8)));
+	mar_name_t resource_name __attribute__((aligned(8)));
+	mar_uint64_t resource_handle __attribute__((aligned(8)));
+	mar_uint64_t lock_id __attribute__((aligned(8)));
+	mar_uint32_t lock_mode __attribute__((aligned(8)));
+} __attribute__((aligned(8)));
+
+struct req_lib_lck_locksetasync {
+	coroipc_request_header_t header __attribute__((aligned(8)));
+	mar_invocation_t invocation __attribute__((aligned(8)));
+	mar_uint32_t lock_flags __attribute__((aligned(8)));
+	mar_uint32_t lock_count __attribute__((aligned(8)));
+	/* followed by lock_count struct lck_lockset_entry entries */
+} __attribute__((aligned(8)));
+
+struct res_lib_lck_locksetasync {
+	coroipc_response_header_t header __attribute__((aligned(8)));
+} __attribute__((aligned(8)));
+
 struct res_lib_lck_resourceopen_callback {
 	coroipc_response_header_t header __attribute__((aligned(8)));
 	mar_uint64_t resource_handle __attribute__((aligned(8)));
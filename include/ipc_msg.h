@@ -65,7 +65,8 @@ enum req_lib_msg_queue_types {
 	MESSAGE_REQ_MSG_QUEUECAPACITYTHRESHOLDSSET = 21,
 	MESSAGE_REQ_MSG_QUEUECAPACITYTHRESHOLDSGET = 22,
 	MESSAGE_REQ_MSG_METADATASIZEGET = 23,
-	MESSAGE_REQ_MSG_LIMITGET = 24
+	MESSAGE_REQ_MSG_LIMITGET = 24,
+	MESSAGE_REQ_MSG_MESSAGEGETMANY = 25
 };
 
 enum res_lib_msg_queue_types {
@@ -97,7 +98,8 @@ enum res_lib_msg_queue_types {
 	MESSAGE_RES_MSG_QUEUEOPEN_CALLBACK = 25,
 	MESSAGE_RES_MSG_QUEUEGROUPTRACK_CALLBACK = 26,
 	MESSAGE_RES_MSG_MESSAGEDELIVERED_CALLBACK = 27,
-	MESSAGE_RES_MSG_MESSAGERECEIVED_CALLBACK = 28
+	MESSAGE_RES_MSG_MESSAGERECEIVED_CALLBACK = 28,
+	MESSAGE_RES_MSG_MESSAGEGETMANY = 29
 };
 
 /*
@@ -114,6 +116,14 @@ enum res_lib_msg_queue_types {
 #define MSG_MAX_MESSAGE_SIZE          32
 #define MSG_MAX_REPLY_SIZE            32
 
+/*
+ * Limits on the number of messages and the packed size of one
+ * saMsgMessageGetMany reply. Each packed message is padded to 8 bytes.
+ */
+#define MSG_MAX_GET_MANY_MESSAGES    256
+#define MSG_MAX_GET_MANY_SIZE      32768
+#define MSG_GET_MANY_ALIGN(size)   (((size) + 7) & ~7)
+
 struct req_lib_msg_queueopen {
 	coroipc_request_header_t header __attribute__((aligned(8)));
 	mar_msg_queue_handle_t queue_handle __attribute__((aligned(8)));
@@ -291,6 +301,30 @@ struct res_lib_msg_messageget {
 	mar_msg_message_t message __attribute__((aligned(8)));
 } __attribute__((aligned(8)));
 
+struct req_lib_msg_messagegetmany {
+	coroipc_request_header_t header __attribute__((aligned(8)));
+	mar_name_t queue_name __attribute__((aligned(8)));
+	mar_uint32_t queue_id __attribute__((aligned(8)));
+	mar_time_t timeout __attribute__((aligned(8)));
+	mar_uint32_t max_messages __attribute__((aligned(8)));
+	mar_size_t max_bytes __attribute__((aligned(8)));
+} __attribute__((aligned(8)));
+
+struct res_lib_msg_messagegetmany {
+	coroipc_response_header_t header __attribute__((aligned(8)));
+	mar_uint32_t number_of_messages __attribute__((aligned(8)));
+} __attribute__((aligned(8)));
+
+/*
+ * Each message in a res_lib_msg_messagegetmany reply starts with this
+ * header and is followed by its data, padded to 8 bytes.
+ */
+struct res_lib_msg_messagegetmany_entry {
+	mar_time_t send_time __attribute__((aligned(8)));
+	mar_msg_sender_id_t sender_id __attribute__((aligned(8)));
+	mar_msg_message_t message __attribute__((aligned(8)));
+} __attribute__((aligned(8)));
+
 struct req_lib_msg_messagedatafree {
 	coroipc_request_header_t header __attribute__((aligned(8)));
 } __attribute__((aligned(8)));
@@ -375,6 +409,7 @@ struct req_lib_msg_metadatasizeget {
 
 struct res_lib_msg_metadatasizeget {
 	coroipc_response_header_t header __attribute__((aligned(8)));
+	mar_uint32_t metadata_size __attribute__((aligned(8)));
 } __attribute__((aligned(8)));
 
 struct req_lib_msg_limitget {
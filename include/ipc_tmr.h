@@ -73,6 +73,7 @@ struct res_lib_tmr_timerstart {
 	coroipc_response_header_t header;
 	SaTmrTimerIdT timer_id;
 	SaTimeT call_time;
+	SaTimeT expiration_time;
 };
 
 struct req_lib_tmr_timerreschedule {
@@ -84,6 +85,7 @@ struct req_lib_tmr_timerreschedule {
 struct res_lib_tmr_timerreschedule {
 	coroipc_response_header_t header;
 	SaTimeT call_time;
+	SaTimeT expiration_time;
 };
 
 struct req_lib_tmr_timercancel {
@@ -147,11 +149,24 @@ struct req_lib_tmr_timerexpiredcallback {
 	coroipc_response_header_t header;
 };
 
-struct res_lib_tmr_timerexpiredcallback {
-	coroipc_response_header_t header;
+/*
+ * expiration_time is when a periodic timer is next due.
+ */
+struct tmr_expiration {
 	SaTmrTimerIdT timer_id;
 	SaUint64T expiration_count;
+	SaTimeT expiration_time;
 	void *timer_data;
 };
 
+/*
+ * Carries the expirations of all the timers of a connection that
+ * expired together.  Followed by expiration_entries struct
+ * tmr_expiration.
+ */
+struct res_lib_tmr_timerexpiredcallback {
+	coroipc_response_header_t header;
+	SaUint32T expiration_entries;
+};
+
 #endif /* IPC_TMR_H_DEFINED  */
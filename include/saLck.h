@@ -53,6 +53,13 @@ typedef SaUint32T SaLckLockFlagsT;
 
 #define SA_LCK_RESOURCE_CREATE 0x1
 
+/*
+ * Grant order of a new resource, taken from the open that creates it.
+ * By default shared locks are granted while exclusive locks wait.
+ */
+#define SA_LCK_RESOURCE_WRITER_PREFERENCE 0x100
+#define SA_LCK_RESOURCE_FIFO 0x200
+
 typedef SaUint32T SaLckResourceOpenFlagsT;
 
 typedef enum {
@@ -80,6 +87,12 @@ typedef enum {
 	SA_LCK_MAX_NUM_LOCKS_ID = 1,
 } SaLckLimitIdT;
 
+typedef struct {
+	SaLckResourceHandleT lckResourceHandle;
+	SaLckLockModeT lockMode;
+	SaLckLockIdT lockId;
+} SaLckLockSetEntryT;
+
 typedef void (*SaLckResourceOpenCallbackT) (
 	SaInvocationT invocation,
 	SaLckResourceHandleT lockResourceHandle,
@@ -170,6 +183,13 @@ saLckResourceLockAsync (
 	SaLckLockFlagsT lockFlags,
 	SaLckWaiterSignalT waiterSignal);
 
+SaAisErrorT
+saLckResourceLockSetAsync (
+	SaInvocationT invocation,
+	SaLckLockSetEntryT *lockSet,
+	SaUint32T numberOfLocks,
+	SaLckLockFlagsT lockFlags);
+
 SaAisErrorT
 saLckResourceUnlock (
 	SaLckLockIdT lockId,
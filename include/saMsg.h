@@ -290,6 +290,24 @@ saMsgMessageGet (
 	SaMsgSenderIdT *senderId,
 	SaTimeT timeout);
 
+/*
+ * openais extension: take up to maxMessages messages (and up to maxBytes
+ * of packed message data, 0 for no limit) off a queue in priority order
+ * with one call. If the queue is empty, waits up to timeout for a
+ * message like saMsgMessageGet. The data of each returned message is
+ * allocated by the library and is released with saMsgMessageDataFree.
+ */
+SaAisErrorT
+saMsgMessageGetMany (
+	SaMsgQueueHandleT queueHandle,
+	SaMsgMessageT *messages,
+	SaTimeT *sendTimes,
+	SaMsgSenderIdT *senderIds,
+	SaUint32T maxMessages,
+	SaSizeT maxBytes,
+	SaUint32T *numberOfMessages,
+	SaTimeT timeout);
+
 SaAisErrorT
 saMsgMessageDataFree (
 	SaMsgHandleT msgHandle,
@@ -66,12 +66,31 @@
 
 #include "util.h"
 
+/*
+ * Maximum number of idle blocking connections kept per lock handle
+ */
+#define LCK_BLOCKING_POOL_MAX 8
+
 struct lckInstance {
 	hdb_handle_t ipc_handle;
 	SaLckHandleT lck_handle;
 	SaLckCallbacksT callbacks;
 	int finalize;
 	struct list_head resource_list;
+	pthread_mutex_t blocking_mutex;
+	struct list_head blocking_list;
+	unsigned int blocking_count;
+};
+
+/*
+ * Connection used by saLckResourceLock so that a lock request waiting
+ * in the executive does not hold up the main connection of the lock
+ * handle.  Idle connections are kept on the blocking_list of the
+ * lckInstance and reused.
+ */
+struct lckBlockingConnection {
+	hdb_handle_t ipc_handle;
+	struct list_head list;
 };
 
 struct lckResourceInstance {
@@ -138,6 +157,93 @@ static void lckResourceInstanceFinalize (struct lckResourceInstance *lckResource
 	return;
 }
 
+static SaAisErrorT lckBlockingConnectionGet (
+	struct lckInstance *lckInstance,
+	hdb_handle_t *ipc_handle)
+{
+	struct lckBlockingConnection *connection = NULL;
+	SaAisErrorT error = SA_AIS_OK;
+
+	pthread_mutex_lock (&lckInstance->blocking_mutex);
+	if (!list_empty (&lckInstance->blocking_list)) {
+		connection = list_entry (lckInstance->blocking_list.next,
+			struct lckBlockingConnection, list);
+		list_del (&connection->list);
+		lckInstance->blocking_count -= 1;
+	}
+	pthread_mutex_unlock (&lckInstance->blocking_mutex);
+
+	if (connection != NULL) {
+		*ipc_handle = connection->ipc_handle;
+		free (connection);
+		return (SA_AIS_OK);
+	}
+
+	error = coroipcc_service_connect (
+		COROSYNC_SOCKET_NAME,
+		LCK_SERVICE,
+		IPC_REQUEST_SIZE,
+		IPC_RESPONSE_SIZE,
+		IPC_DISPATCH_SIZE,
+		ipc_handle);
+
+	return (error);
+}
+
+/*
+ * Return a blocking connection to the pool.  Connections on which the
+ * request/response exchange failed are not reused since their state is
+ * unknown, nor are connections beyond LCK_BLOCKING_POOL_MAX or returned
+ * after the handle was finalized.
+ */
+static void lckBlockingConnectionPut (
+	struct lckInstance *lckInstance,
+	hdb_handle_t ipc_handle,
+	int reusable)
+{
+	struct lckBlockingConnection *connection = NULL;
+
+	if (reusable) {
+		connection = malloc (sizeof (struct lckBlockingConnection));
+	}
+	if (connection != NULL) {
+		connection->ipc_handle = ipc_handle;
+		list_init (&connection->list);
+
+		pthread_mutex_lock (&lckInstance->blocking_mutex);
+		if (lckInstance->finalize == 0 &&
+		    lckInstance->blocking_count < LCK_BLOCKING_POOL_MAX) {
+			list_add (&connection->list, &lckInstance->blocking_list);
+			lckInstance->blocking_count += 1;
+			connection = NULL;
+		}
+		pthread_mutex_unlock (&lckInstance->blocking_mutex);
+
+		if (connection == NULL) {
+			return;
+		}
+		free (connection);
+	}
+
+	coroipcc_service_disconnect (ipc_handle);
+}
+
+static void lckBlockingConnectionFlush (struct lckInstance *lckInstance)
+{
+	struct lckBlockingConnection *connection;
+
+	pthread_mutex_lock (&lckInstance->blocking_mutex);
+	while (!list_empty (&lckInstance->blocking_list)) {
+		connection = list_entry (lckInstance->blocking_list.next,
+			struct lckBlockingConnection, list);
+		list_del (&connection->list);
+		coroipcc_service_disconnect (connection->ipc_handle);
+		free (connection);
+	}
+	lckInstance->blocking_count = 0;
+	pthread_mutex_unlock (&lckInstance->blocking_mutex);
+}
+
 static void lckInstanceFinalize (struct lckInstance *lckInstance)
 {
 	struct lckResourceInstance *lckResourceInstance;
@@ -206,6 +312,9 @@ saLckInitialize (
 	}
 
 	list_init (&lckInstance->resource_list);
+	list_init (&lckInstance->blocking_list);
+	pthread_mutex_init (&lckInstance->blocking_mutex, NULL);
+	lckInstance->blocking_count = 0;
 
 	lckInstance->lck_handle = *lckHandle;
 
@@ -536,10 +645,14 @@ saLckFinalize (
 		goto error_exit;
 	}
 
+	pthread_mutex_lock (&lckInstance->blocking_mutex);
 	lckInstance->finalize = 1;
+	pthread_mutex_unlock (&lckInstance->blocking_mutex);
 
 	coroipcc_service_disconnect (lckInstance->ipc_handle);
 
+	lckBlockingConnectionFlush (lckInstance);
+
 	lckInstanceFinalize (lckInstance);
 
 	hdb_handle_put (&lckHandleDatabase, lckHandle);
@@ -573,7 +686,8 @@ saLckResourceOpen (
 		goto error_exit;
 	}
 
-	if ((resourceFlags & (~SA_LCK_RESOURCE_CREATE)) != 0) {
+	if ((resourceFlags & (~SA_LCK_RESOURCE_CREATE) &
+	    (~SA_LCK_RESOURCE_WRITER_PREFERENCE) & (~SA_LCK_RESOURCE_FIFO)) != 0) {
 		error = SA_AIS_ERR_BAD_FLAGS;
 		goto error_exit;
 	}
@@ -677,7 +791,8 @@ saLckResourceOpenAsync (
 		goto error_exit;
 	}
 
-	if ((resourceFlags & (~SA_LCK_RESOURCE_CREATE)) != 0) {
+	if ((resourceFlags & (~SA_LCK_RESOURCE_CREATE) &
+	    (~SA_LCK_RESOURCE_WRITER_PREFERENCE) & (~SA_LCK_RESOURCE_FIFO)) != 0) {
 		error = SA_AIS_ERR_BAD_FLAGS;
 		goto error_exit;
 	}
@@ -835,6 +950,7 @@ saLckResourceLock (
 	SaTimeT timeout,
 	SaLckLockStatusT *lockStatus)
 {
+	struct lckInstance *lckInstance;
 	struct lckLockIdInstance *lckLockIdInstance;
 	struct lckResourceInstance *lckResourceInstance;
 	struct req_lib_lck_resourcelock req_lib_lck_resourcelock;
@@ -843,6 +959,7 @@ saLckResourceLock (
 	SaAisErrorT error = SA_AIS_OK;
 
 	hdb_handle_t ipc_handle;
+	int reusable = 0;
 
 	if ((lockMode != SA_LCK_PR_LOCK_MODE) && (lockMode != SA_LCK_EX_LOCK_MODE)) {
 		error = SA_AIS_ERR_INVALID_PARAM;
@@ -881,17 +998,17 @@ saLckResourceLock (
 		goto error_destroy;
 	}
 
-	error = coroipcc_service_connect (
-		COROSYNC_SOCKET_NAME,
-		LCK_SERVICE,
-		IPC_REQUEST_SIZE,
-		IPC_RESPONSE_SIZE,
-		IPC_DISPATCH_SIZE,
-		&ipc_handle);
+	error = hdb_error_to_sa (hdb_handle_get (&lckHandleDatabase,
+		lckResourceInstance->lck_handle, (void *)&lckInstance));
 	if (error != SA_AIS_OK) {
 		goto error_put_destroy;
 	}
 
+	error = lckBlockingConnectionGet (lckInstance, &ipc_handle);
+	if (error != SA_AIS_OK) {
+		goto error_lck_put;
+	}
+
 	lckLockIdInstance->ipc_handle = lckResourceInstance->ipc_handle;
 	lckLockIdInstance->resource_id = lckResourceInstance->resource_id;
 	lckLockIdInstance->lck_handle = lckResourceInstance->lck_handle;
@@ -925,13 +1042,16 @@ saLckResourceLock (
 		goto error_disconnect;
 	}
 
+	reusable = 1;
+
 	if (res_lib_lck_resourcelock.header.error != SA_AIS_OK) {
 		*lockStatus = res_lib_lck_resourcelock.lock_status;
 		error = res_lib_lck_resourcelock.header.error;
 		goto error_disconnect;
 	}
 
-	coroipcc_service_disconnect (ipc_handle);
+	lckBlockingConnectionPut (lckInstance, ipc_handle, reusable);
+	hdb_handle_put (&lckHandleDatabase, lckResourceInstance->lck_handle);
 
 	list_init (&lckLockIdInstance->list);
 	list_add_tail (&lckLockIdInstance->list, &lckResourceInstance->lock_id_list);
@@ -944,7 +1064,9 @@ saLckResourceLock (
 	return (error);
 
 error_disconnect:
-	coroipcc_service_disconnect (ipc_handle);
+	lckBlockingConnectionPut (lckInstance, ipc_handle, reusable);
+error_lck_put:
+	hdb_handle_put (&lckHandleDatabase, lckResourceInstance->lck_handle);
 error_put_destroy:
 	hdb_handle_put (&lckLockIdHandleDatabase, *lockId);
 error_destroy:
@@ -1084,6 +1206,180 @@ error_exit:
 	return (error);
 }
 
+SaAisErrorT
+saLckResourceLockSetAsync (
+	SaInvocationT invocation,
+	SaLckLockSetEntryT *lockSet,
+	SaUint32T numberOfLocks,
+	SaLckLockFlagsT lockFlags)
+{
+	struct lckInstance *lckInstance;
+	struct lckLockIdInstance *lckLockIdInstance[LCK_MAX_LOCKSET_SIZE];
+	struct lckResourceInstance *lckResourceInstance[LCK_MAX_LOCKSET_SIZE];
+	struct lck_lockset_entry *lck_lockset_entry;
+	struct req_lib_lck_locksetasync req_lib_lck_locksetasync;
+	struct res_lib_lck_locksetasync res_lib_lck_locksetasync;
+	struct iovec iov[2];
+	SaLckHandleT lckHandle = 0;
+	SaAisErrorT error = SA_AIS_OK;
+	unsigned int held = 0;
+	unsigned int i;
+
+	if ((lockSet == NULL) || (numberOfLocks == 0) ||
+	    (numberOfLocks > LCK_MAX_LOCKSET_SIZE)) {
+		error = SA_AIS_ERR_INVALID_PARAM;
+		goto error_exit;
+	}
+
+	for (i = 0; i < numberOfLocks; i++) {
+		if ((lockSet[i].lockMode != SA_LCK_PR_LOCK_MODE) &&
+		    (lockSet[i].lockMode != SA_LCK_EX_LOCK_MODE)) {
+			error = SA_AIS_ERR_INVALID_PARAM;
+			goto error_exit;
+		}
+	}
+
+	if ((lockFlags & (~SA_LCK_LOCK_NO_QUEUE) & (~SA_LCK_LOCK_ORPHAN)) != 0) {
+		error = SA_AIS_ERR_BAD_FLAGS;
+		goto error_exit;
+	}
+
+	lck_lockset_entry = malloc (sizeof (struct lck_lockset_entry) * numberOfLocks);
+	if (lck_lockset_entry == NULL) {
+		error = SA_AIS_ERR_NO_MEMORY;
+		goto error_exit;
+	}
+	memset (lck_lockset_entry, 0, sizeof (struct lck_lockset_entry) * numberOfLocks);
+
+	/*
+	 * All resources of a lock set must be open through the same
+	 * lock service handle, since one grant callback is sent for
+	 * the whole set.
+	 */
+	for (i = 0; i < numberOfLocks; i++) {
+		error = hdb_error_to_sa (hdb_handle_get (&lckResourceHandleDatabase,
+			lockSet[i].lckResourceHandle, (void *)&lckResourceInstance[i]));
+		if (error != SA_AIS_OK) {
+			goto error_release;
+		}
+
+		if ((i != 0) && (lckResourceInstance[i]->lck_handle != lckHandle)) {
+			hdb_handle_put (&lckResourceHandleDatabase,
+				lockSet[i].lckResourceHandle);
+			error = SA_AIS_ERR_INVALID_PARAM;
+			goto error_release;
+		}
+		lckHandle = lckResourceInstance[i]->lck_handle;
+
+		error = hdb_error_to_sa (hdb_handle_create (&lckLockIdHandleDatabase,
+			sizeof (struct lckLockIdInstance), &lockSet[i].lockId));
+		if (error != SA_AIS_OK) {
+			hdb_handle_put (&lckResourceHandleDatabase,
+				lockSet[i].lckResourceHandle);
+			goto error_release;
+		}
+
+		error = hdb_error_to_sa (hdb_handle_get (&lckLockIdHandleDatabase,
+			lockSet[i].lockId, (void *)&lckLockIdInstance[i]));
+		if (error != SA_AIS_OK) {
+			hdb_handle_destroy (&lckLockIdHandleDatabase, lockSet[i].lockId);
+			hdb_handle_put (&lckResourceHandleDatabase,
+				lockSet[i].lckResourceHandle);
+			goto error_release;
+		}
+
+		held = i + 1;
+
+		lckLockIdInstance[i]->ipc_handle = lckResourceInstance[i]->ipc_handle;
+		lckLockIdInstance[i]->resource_id = lckResourceInstance[i]->resource_id;
+		lckLockIdInstance[i]->lck_handle = lckResourceInstance[i]->lck_handle;
+		lckLockIdInstance[i]->resource_handle = lockSet[i].lckResourceHandle;
+		lckLockIdInstance[i]->lock_id = lockSet[i].lockId;
+
+		marshall_SaNameT_to_mar_name_t (
+			&lck_lockset_entry[i].resource_name,
+			&lckResourceInstance[i]->resource_name);
+
+		lck_lockset_entry[i].resource_id = lckResourceInstance[i]->resource_id;
+		lck_lockset_entry[i].resource_handle = lockSet[i].lckResourceHandle;
+		lck_lockset_entry[i].lock_id = lockSet[i].lockId;
+		lck_lockset_entry[i].lock_mode = lockSet[i].lockMode;
+	}
+
+	error = hdb_error_to_sa (hdb_handle_get (&lckHandleDatabase,
+		lckHandle, (void *)&lckInstance));
+	if (error != SA_AIS_OK) {
+		goto error_release;
+	}
+
+	/*
+	 * Check that saLckLockGrantCallback is defined.
+	 */
+	if (lckInstance->callbacks.saLckLockGrantCallback == NULL) {
+		hdb_handle_put (&lckHandleDatabase, lckHandle);
+		error = SA_AIS_ERR_INIT;
+		goto error_release;
+	}
+
+	hdb_handle_put (&lckHandleDatabase, lckHandle);
+
+	req_lib_lck_locksetasync.header.size =
+		sizeof (struct req_lib_lck_locksetasync) +
+		sizeof (struct lck_lockset_entry) * numberOfLocks;
+	req_lib_lck_locksetasync.header.id =
+		MESSAGE_REQ_LCK_LOCKSETASYNC;
+
+	req_lib_lck_locksetasync.invocation = invocation;
+	req_lib_lck_locksetasync.lock_flags = lockFlags;
+	req_lib_lck_locksetasync.lock_count = numberOfLocks;
+
+	iov[0].iov_base = (void *)&req_lib_lck_locksetasync;
+	iov[0].iov_len = sizeof (struct req_lib_lck_locksetasync);
+	iov[1].iov_base = (void *)lck_lockset_entry;
+	iov[1].iov_len = sizeof (struct lck_lockset_entry) * numberOfLocks;
+
+	error = coroipcc_msg_send_reply_receive (
+		lckResourceInstance[0]->ipc_handle,
+		iov,
+		2,
+		&res_lib_lck_locksetasync,
+		sizeof (struct res_lib_lck_locksetasync));
+
+	if (error != SA_AIS_OK) {
+		goto error_release;
+	}
+
+	if (res_lib_lck_locksetasync.header.error != SA_AIS_OK) {
+		error = res_lib_lck_locksetasync.header.error;
+		goto error_release;
+	}
+
+	for (i = 0; i < numberOfLocks; i++) {
+		list_init (&lckLockIdInstance[i]->list);
+		list_add_tail (&lckLockIdInstance[i]->list,
+			&lckResourceInstance[i]->lock_id_list);
+
+		hdb_handle_put (&lckLockIdHandleDatabase, lockSet[i].lockId);
+		hdb_handle_put (&lckResourceHandleDatabase,
+			lockSet[i].lckResourceHandle);
+	}
+
+	free (lck_lockset_entry);
+
+	return (error);
+
+error_release:
+	for (i = 0; i < held; i++) {
+		hdb_handle_put (&lckLockIdHandleDatabase, lockSet[i].lockId);
+		hdb_handle_destroy (&lckLockIdHandleDatabase, lockSet[i].lockId);
+		hdb_handle_put (&lckResourceHandleDatabase,
+			lockSet[i].lckResourceHandle);
+	}
+	free (lck_lockset_entry);
+error_exit:
+	return (error);
+}
+
 SaAisErrorT
 saLckResourceUnlock (
 	SaLckLockIdT lockId,
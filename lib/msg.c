@@ -66,12 +66,31 @@
 
 #include "util.h"
 
+/*
+ * Maximum number of idle blocking connections kept per message handle
+ */
+#define MSG_BLOCKING_POOL_MAX 8
+
 struct msgInstance {
 	hdb_handle_t ipc_handle;
 	SaMsgHandleT msg_handle;
 	SaMsgCallbacksT callbacks;
 	int finalize;
 	struct list_head queue_list;
+	pthread_mutex_t blocking_mutex;
+	struct list_head blocking_list;
+	unsigned int blocking_count;
+};
+
+/*
+ * Connection used for calls that may block in the executive
+ * (saMsgMessageGet and saMsgMessageSendReceive) so that they do not
+ * hold up the main connection of the message handle.  Idle connections
+ * are kept on the blocking_list of the msgInstance and reused.
+ */
+struct blockingConnection {
+	hdb_handle_t ipc_handle;
+	struct list_head list;
 };
 
 struct queueInstance {
@@ -106,6 +125,93 @@ static void queueInstanceFinalize (struct queueInstance *queueInstance)
 	return;
 }
 
+static SaAisErrorT msgBlockingConnectionGet (
+	struct msgInstance *msgInstance,
+	hdb_handle_t *ipc_handle)
+{
+	struct blockingConnection *connection = NULL;
+	SaAisErrorT error = SA_AIS_OK;
+
+	pthread_mutex_lock (&msgInstance->blocking_mutex);
+	if (!list_empty (&msgInstance->blocking_list)) {
+		connection = list_entry (msgInstance->blocking_list.next,
+			struct blockingConnection, list);
+		list_del (&connection->list);
+		msgInstance->blocking_count -= 1;
+	}
+	pthread_mutex_unlock (&msgInstance->blocking_mutex);
+
+	if (connection != NULL) {
+		*ipc_handle = connection->ipc_handle;
+		free (connection);
+		return (SA_AIS_OK);
+	}
+
+	error = coroipcc_service_connect (
+		COROSYNC_SOCKET_NAME,
+		MSG_SERVICE,
+		IPC_REQUEST_SIZE,
+		IPC_RESPONSE_SIZE,
+		IPC_DISPATCH_SIZE,
+		ipc_handle);
+
+	return (error);
+}
+
+/*
+ * Return a blocking connection to the pool.  Connections on which the
+ * request/response exchange failed are not reused since their state is
+ * unknown, nor are connections beyond MSG_BLOCKING_POOL_MAX or returned
+ * after the handle was finalized.
+ */
+static void msgBlockingConnectionPut (
+	struct msgInstance *msgInstance,
+	hdb_handle_t ipc_handle,
+	int reusable)
+{
+	struct blockingConnection *connection = NULL;
+
+	if (reusable) {
+		connection = malloc (sizeof (struct blockingConnection));
+	}
+	if (connection != NULL) {
+		connection->ipc_handle = ipc_handle;
+		list_init (&connection->list);
+
+		pthread_mutex_lock (&msgInstance->blocking_mutex);
+		if (msgInstance->finalize == 0 &&
+		    msgInstance->blocking_count < MSG_BLOCKING_POOL_MAX) {
+			list_add (&connection->list, &msgInstance->blocking_list);
+			msgInstance->blocking_count += 1;
+			connection = NULL;
+		}
+		pthread_mutex_unlock (&msgInstance->blocking_mutex);
+
+		if (connection == NULL) {
+			return;
+		}
+		free (connection);
+	}
+
+	coroipcc_service_disconnect (ipc_handle);
+}
+
+static void msgBlockingConnectionFlush (struct msgInstance *msgInstance)
+{
+	struct blockingConnection *connection;
+
+	pthread_mutex_lock (&msgInstance->blocking_mutex);
+	while (!list_empty (&msgInstance->blocking_list)) {
+		connection = list_entry (msgInstance->blocking_list.next,
+			struct blockingConnection, list);
+		list_del (&connection->list);
+		coroipcc_service_disconnect (connection->ipc_handle);
+		free (connection);
+	}
+	msgInstance->blocking_count = 0;
+	pthread_mutex_unlock (&msgInstance->blocking_mutex);
+}
+
 static void msgInstanceFinalize (struct msgInstance *msgInstance)
 {
 	struct queueInstance *queueInstance;
@@ -175,6 +281,9 @@ saMsgInitialize (
 	}
 
 	list_init (&msgInstance->queue_list);
+	list_init (&msgInstance->blocking_list);
+	pthread_mutex_init (&msgInstance->blocking_mutex, NULL);
+	msgInstance->blocking_count = 0;
 
 	msgInstance->msg_handle = *msgHandle;
 
@@ -441,10 +550,14 @@ saMsgFinalize (
 		goto error_exit;
 	}
 
+	pthread_mutex_lock (&msgInstance->blocking_mutex);
 	msgInstance->finalize = 1;
+	pthread_mutex_unlock (&msgInstance->blocking_mutex);
 
 	coroipcc_service_disconnect (msgInstance->ipc_handle);
 
+	msgBlockingConnectionFlush (msgInstance);
+
 	msgInstanceFinalize (msgInstance);
 
 	hdb_handle_put (&msgHandleDatabase, msgHandle);
@@ -983,6 +1096,12 @@ saMsgQueueGroupCreate (
 		goto error_exit;
 	}
 
+	if ((queueGroupPolicy < SA_MSG_QUEUE_GROUP_ROUND_ROBIN) ||
+	    (queueGroupPolicy > SA_MSG_QUEUE_GROUP_BROADCAST)) {
+		error = SA_AIS_ERR_INVALID_PARAM;
+		goto error_exit;
+	}
+
 	error = hdb_error_to_sa (hdb_handle_get (&msgHandleDatabase,
 		msgHandle, (void *)&msgInstance));
 	if (error != SA_AIS_OK) {
@@ -1553,6 +1672,7 @@ saMsgMessageGet (
 	SaMsgSenderIdT *senderId,
 	SaTimeT timeout)
 {
+	struct msgInstance *msgInstance;
 	struct queueInstance *queueInstance;
 	struct req_lib_msg_messageget req_lib_msg_messageget;
 	struct res_lib_msg_messageget *res_lib_msg_messageget;
@@ -1563,6 +1683,7 @@ saMsgMessageGet (
 	void *buffer = NULL;
 
 	hdb_handle_t ipc_handle;
+	int reusable = 0;
 
 	if (message == NULL || senderId == NULL) {
 		error = SA_AIS_ERR_INVALID_PARAM;
@@ -1575,18 +1696,17 @@ saMsgMessageGet (
 		goto error_exit;
 	}
 
-	error = coroipcc_service_connect (
-		COROSYNC_SOCKET_NAME,
-		MSG_SERVICE,
-		IPC_REQUEST_SIZE,
-		IPC_RESPONSE_SIZE,
-		IPC_DISPATCH_SIZE,
-		&ipc_handle);
-
+	error = hdb_error_to_sa(hdb_handle_get (&msgHandleDatabase,
+		queueInstance->msg_handle, (void *)&msgInstance));
 	if (error != SA_AIS_OK) {
 		goto error_hdb_put;
 	}
 
+	error = msgBlockingConnectionGet (msgInstance, &ipc_handle);
+	if (error != SA_AIS_OK) {
+		goto error_msg_put;
+	}
+
 	req_lib_msg_messageget.header.size =
 		sizeof (struct req_lib_msg_messageget);
 	req_lib_msg_messageget.header.id =
@@ -1612,6 +1732,8 @@ saMsgMessageGet (
 		goto error_disconnect;
 	}
 
+	reusable = 1;
+
 	res_lib_msg_messageget = buffer;
 
 	if (res_lib_msg_messageget->header.error != SA_AIS_OK) {
@@ -1652,7 +1774,152 @@ saMsgMessageGet (
 error_ipc_put:
 	coroipcc_msg_send_reply_receive_in_buf_put (ipc_handle);
 error_disconnect:
-	coroipcc_service_disconnect (ipc_handle);
+	msgBlockingConnectionPut (msgInstance, ipc_handle, reusable);
+error_msg_put:
+	hdb_handle_put (&msgHandleDatabase, queueInstance->msg_handle);
+error_hdb_put:
+	hdb_handle_put (&queueHandleDatabase, queueHandle);
+error_exit:
+	return (error);
+}
+
+SaAisErrorT
+saMsgMessageGetMany (
+	SaMsgQueueHandleT queueHandle,
+	SaMsgMessageT *messages,
+	SaTimeT *sendTimes,
+	SaMsgSenderIdT *senderIds,
+	SaUint32T maxMessages,
+	SaSizeT maxBytes,
+	SaUint32T *numberOfMessages,
+	SaTimeT timeout)
+{
+	struct msgInstance *msgInstance;
+	struct queueInstance *queueInstance;
+	struct req_lib_msg_messagegetmany req_lib_msg_messagegetmany;
+	struct res_lib_msg_messagegetmany *res_lib_msg_messagegetmany;
+	struct res_lib_msg_messagegetmany_entry *entry;
+	struct iovec iov;
+
+	SaAisErrorT error = SA_AIS_OK;
+
+	void *buffer = NULL;
+	char *data;
+	unsigned int i;
+	unsigned int j;
+
+	hdb_handle_t ipc_handle;
+	int reusable = 0;
+
+	if (messages == NULL || senderIds == NULL || numberOfMessages == NULL) {
+		error = SA_AIS_ERR_INVALID_PARAM;
+		goto error_exit;
+	}
+
+	if (maxMessages == 0) {
+		error = SA_AIS_ERR_INVALID_PARAM;
+		goto error_exit;
+	}
+
+	*numberOfMessages = 0;
+
+	error = hdb_error_to_sa(hdb_handle_get (&queueHandleDatabase,
+		queueHandle, (void *)&queueInstance));
+	if (error != SA_AIS_OK) {
+		goto error_exit;
+	}
+
+	error = hdb_error_to_sa(hdb_handle_get (&msgHandleDatabase,
+		queueInstance->msg_handle, (void *)&msgInstance));
+	if (error != SA_AIS_OK) {
+		goto error_hdb_put;
+	}
+
+	error = msgBlockingConnectionGet (msgInstance, &ipc_handle);
+	if (error != SA_AIS_OK) {
+		goto error_msg_put;
+	}
+
+	req_lib_msg_messagegetmany.header.size =
+		sizeof (struct req_lib_msg_messagegetmany);
+	req_lib_msg_messagegetmany.header.id =
+		MESSAGE_REQ_MSG_MESSAGEGETMANY;
+
+	req_lib_msg_messagegetmany.queue_id = queueInstance->queue_id;
+	req_lib_msg_messagegetmany.timeout = timeout;
+	req_lib_msg_messagegetmany.max_messages = maxMessages;
+	req_lib_msg_messagegetmany.max_bytes = maxBytes;
+
+	marshall_SaNameT_to_mar_name_t (
+		&req_lib_msg_messagegetmany.queue_name,
+		(SaNameT *)(&queueInstance->queue_name));
+
+	iov.iov_base = (void *)&req_lib_msg_messagegetmany;
+	iov.iov_len = sizeof (struct req_lib_msg_messagegetmany);
+
+	error = coroipcc_msg_send_reply_receive_in_buf_get (
+		ipc_handle,
+		&iov,
+		1,
+		&buffer);
+
+	if (error != SA_AIS_OK) {
+		goto error_disconnect;
+	}
+
+	reusable = 1;
+
+	res_lib_msg_messagegetmany = buffer;
+
+	if (res_lib_msg_messagegetmany->header.error != SA_AIS_OK) {
+		error = res_lib_msg_messagegetmany->header.error;
+		goto error_ipc_put;
+	}
+
+	/*
+	 * The messages have already been taken off the queue, so the
+	 * data of every message is allocated here rather than copied
+	 * into caller buffers that could turn out to be too small.
+	 */
+	data = (char *)(buffer) + sizeof (struct res_lib_msg_messagegetmany);
+
+	for (i = 0; i < res_lib_msg_messagegetmany->number_of_messages; i++) {
+		entry = (struct res_lib_msg_messagegetmany_entry *)(data);
+
+		messages[i].type = entry->message.type;
+		messages[i].version = entry->message.version;
+		messages[i].priority = entry->message.priority;
+		messages[i].size = entry->message.size;
+		messages[i].data = malloc (entry->message.size);
+		if (messages[i].data == NULL) {
+			for (j = 0; j < i; j++) {
+				free (messages[j].data);
+				messages[j].data = NULL;
+			}
+			error = SA_AIS_ERR_NO_MEMORY;
+			goto error_ipc_put;
+		}
+
+		memcpy (messages[i].data, entry + 1, entry->message.size);
+
+		if (sendTimes != NULL) {
+			sendTimes[i] = entry->send_time;
+		}
+
+		senderIds[i] = entry->sender_id;
+
+		data += sizeof (struct res_lib_msg_messagegetmany_entry) +
+			MSG_GET_MANY_ALIGN (entry->message.size);
+	}
+
+	*numberOfMessages = res_lib_msg_messagegetmany->number_of_messages;
+
+error_ipc_put:
+	coroipcc_msg_send_reply_receive_in_buf_put (ipc_handle);
+error_disconnect:
+	msgBlockingConnectionPut (msgInstance, ipc_handle, reusable);
+error_msg_put:
+	hdb_handle_put (&msgHandleDatabase, queueInstance->msg_handle);
 error_hdb_put:
 	hdb_handle_put (&queueHandleDatabase, queueHandle);
 error_exit:
@@ -1758,6 +2025,7 @@ saMsgMessageSendReceive (
 
 	hdb_handle_t ipc_handle;
 	void *buffer = NULL;
+	int reusable = 0;
 
 	if (destination == NULL || sendMessage == NULL || receiveMessage == NULL) {
 		error = SA_AIS_ERR_INVALID_PARAM;
@@ -1770,14 +2038,7 @@ saMsgMessageSendReceive (
 		goto error_exit;
 	}	
 
-	error = coroipcc_service_connect (
-		COROSYNC_SOCKET_NAME,
-		MSG_SERVICE,
-		IPC_REQUEST_SIZE,
-		IPC_RESPONSE_SIZE,
-		IPC_DISPATCH_SIZE,
-		&ipc_handle);
-
+	error = msgBlockingConnectionGet (msgInstance, &ipc_handle);
 	if (error != SA_AIS_OK) {
 		goto error_hdb_put;
 	}
@@ -1819,6 +2080,8 @@ saMsgMessageSendReceive (
 		goto error_disconnect;
 	}
 
+	reusable = 1;
+
 	res_lib_msg_messagesendreceive = buffer;
 
 	if (res_lib_msg_messagesendreceive->header.error != SA_AIS_OK) {
@@ -1852,7 +2115,7 @@ saMsgMessageSendReceive (
 error_ipc_put:
 	coroipcc_msg_send_reply_receive_in_buf_put (ipc_handle);
 error_disconnect:
-	coroipcc_service_disconnect (ipc_handle);
+	msgBlockingConnectionPut (msgInstance, ipc_handle, reusable);
 error_hdb_put:
 	hdb_handle_put (&msgHandleDatabase, msgHandle);
 error_exit:
@@ -2169,6 +2432,8 @@ saMsgMetadataSizeGet (
 		goto error_put;
 	}
 
+	*metadataSize = res_lib_msg_metadatasizeget.metadata_size;
+
 error_put:
 	hdb_handle_put (&msgHandleDatabase, msgHandle);
 error_exit:
@@ -61,11 +61,26 @@
 #include "../include/ipc_tmr.h"
 #include "util.h"
 
+/*
+ * Timers started through this handle, so that the remaining time
+ * of a timer can be worked out without asking the executive.
+ */
+#define TMR_TIMER_HASH_SIZE 256
+
+struct tmrTimer {
+	SaTmrTimerIdT timer_id;
+	SaTimeT period;
+	SaTimeT expiration_time;
+	struct list_head list;
+};
+
 struct tmrInstance {
 	hdb_handle_t ipc_handle;
 	SaTmrCallbacksT callbacks;
 	int finalize;
 	SaTmrHandleT tmrHandle;
+	pthread_mutex_t timer_mutex;
+	struct list_head timer_hash[TMR_TIMER_HASH_SIZE];
 };
 
 DECLARE_HDB_DATABASE (tmrHandleDatabase, NULL);
@@ -79,6 +94,106 @@ static struct saVersionDatabase tmrVersionDatabase = {
 	tmrVersionsSupported
 };
 
+/*
+ * Same clock as the executive's timer_time_get, in nanoseconds
+ * since the epoch.
+ */
+static SaTimeT tmr_time_get (void)
+{
+	struct timeval tv;
+
+	gettimeofday (&tv, NULL);
+
+	return ((SaTimeT)(tv.tv_sec) * SA_TIME_ONE_SECOND +
+		(SaTimeT)(tv.tv_usec) * SA_TIME_ONE_MICROSECOND);
+}
+
+static struct tmrTimer *tmr_timer_find (
+	struct tmrInstance *tmrInstance,
+	SaTmrTimerIdT timerId)
+{
+	struct list_head *head;
+	struct list_head *list;
+	struct tmrTimer *tmrTimer;
+
+	head = &tmrInstance->timer_hash[timerId % TMR_TIMER_HASH_SIZE];
+
+	for (list = head->next; list != head; list = list->next) {
+		tmrTimer = list_entry (list, struct tmrTimer, list);
+
+		if (tmrTimer->timer_id == timerId) {
+			return (tmrTimer);
+		}
+	}
+	return (NULL);
+}
+
+static void tmr_timer_set (
+	struct tmrInstance *tmrInstance,
+	SaTmrTimerIdT timerId,
+	SaTimeT period,
+	SaTimeT expiration_time)
+{
+	struct tmrTimer *tmrTimer;
+
+	pthread_mutex_lock (&tmrInstance->timer_mutex);
+
+	tmrTimer = tmr_timer_find (tmrInstance, timerId);
+	if (tmrTimer == NULL) {
+		tmrTimer = malloc (sizeof (struct tmrTimer));
+		if (tmrTimer == NULL) {
+			/*
+			 * The remaining time of this timer is then
+			 * asked from the executive.
+			 */
+			goto error_unlock;
+		}
+		tmrTimer->timer_id = timerId;
+		list_init (&tmrTimer->list);
+		list_add (&tmrTimer->list,
+			&tmrInstance->timer_hash[timerId % TMR_TIMER_HASH_SIZE]);
+	}
+
+	tmrTimer->period = period;
+	tmrTimer->expiration_time = expiration_time;
+
+error_unlock:
+	pthread_mutex_unlock (&tmrInstance->timer_mutex);
+}
+
+static void tmr_timer_del (
+	struct tmrInstance *tmrInstance,
+	SaTmrTimerIdT timerId)
+{
+	struct tmrTimer *tmrTimer;
+
+	pthread_mutex_lock (&tmrInstance->timer_mutex);
+
+	tmrTimer = tmr_timer_find (tmrInstance, timerId);
+	if (tmrTimer != NULL) {
+		list_del (&tmrTimer->list);
+		free (tmrTimer);
+	}
+
+	pthread_mutex_unlock (&tmrInstance->timer_mutex);
+}
+
+static void tmr_timer_expired (
+	struct tmrInstance *tmrInstance,
+	const struct tmr_expiration *expiration)
+{
+	struct tmrTimer *tmrTimer;
+
+	pthread_mutex_lock (&tmrInstance->timer_mutex);
+
+	tmrTimer = tmr_timer_find (tmrInstance, expiration->timer_id);
+	if (tmrTimer != NULL) {
+		tmrTimer->expiration_time = expiration->expiration_time;
+	}
+
+	pthread_mutex_unlock (&tmrInstance->timer_mutex);
+}
+
 SaAisErrorT
 saTmrInitialize (
 	SaTmrHandleT *tmrHandle,
@@ -87,6 +202,7 @@ saTmrInitialize (
 {
 	struct tmrInstance *tmrInstance;
 	SaAisErrorT error = SA_AIS_OK;
+	unsigned int i;
 
 	if (tmrHandle == NULL) {
 		error = SA_AIS_ERR_INVALID_PARAM;
@@ -127,6 +243,12 @@ saTmrInitialize (
 
 	tmrInstance->tmrHandle = *tmrHandle;
 
+	pthread_mutex_init (&tmrInstance->timer_mutex, NULL);
+
+	for (i = 0; i < TMR_TIMER_HASH_SIZE; i++) {
+		list_init (&tmrInstance->timer_hash[i]);
+	}
+
 	hdb_handle_put (&tmrHandleDatabase, *tmrHandle);
 
 	return (SA_AIS_OK);
@@ -180,6 +302,8 @@ saTmrDispatch (
 	int cont = 1;
 
 	struct res_lib_tmr_timerexpiredcallback *res_lib_tmr_timerexpiredcallback;
+	struct tmr_expiration *expiration;
+	unsigned int i;
 
 	if (dispatchFlags != SA_DISPATCH_ONE &&
 	    dispatchFlags != SA_DISPATCH_ALL &&
@@ -231,11 +355,24 @@ saTmrDispatch (
 
 			res_lib_tmr_timerexpiredcallback =
 				(struct res_lib_tmr_timerexpiredcallback *) dispatch_data;
-
-			callbacks.saTmrTimerExpiredCallback (
-				res_lib_tmr_timerexpiredcallback->timer_id,
-				res_lib_tmr_timerexpiredcallback->timer_data,
-				res_lib_tmr_timerexpiredcallback->expiration_count);
+			expiration = (struct tmr_expiration *)
+				(res_lib_tmr_timerexpiredcallback + 1);
+
+			/*
+			 * The unit of SA_DISPATCH_ONE is one dispatch message,
+			 * as in the other libraries, so all the timers that
+			 * expired together call back here. Keeping part of a
+			 * batch back would leave it pending behind a selection
+			 * object that is no longer readable.
+			 */
+			for (i = 0; i < res_lib_tmr_timerexpiredcallback->expiration_entries; i++) {
+				tmr_timer_expired (tmrInstance, &expiration[i]);
+
+				callbacks.saTmrTimerExpiredCallback (
+					expiration[i].timer_id,
+					expiration[i].timer_data,
+					expiration[i].expiration_count);
+			}
 
 			break;
 		default:
@@ -266,7 +403,9 @@ saTmrFinalize (
 	SaTmrHandleT tmrHandle)
 {
 	struct tmrInstance *tmrInstance;
+	struct tmrTimer *tmrTimer;
 	SaAisErrorT error = SA_AIS_OK;
+	unsigned int i;
 
 	error = hdb_error_to_sa(hdb_handle_get (&tmrHandleDatabase, tmrHandle, (void *)&tmrInstance));
 	if (error != SA_AIS_OK) {
@@ -283,6 +422,19 @@ saTmrFinalize (
 
 	coroipcc_service_disconnect (tmrInstance->ipc_handle);
 
+	pthread_mutex_lock (&tmrInstance->timer_mutex);
+
+	for (i = 0; i < TMR_TIMER_HASH_SIZE; i++) {
+		while (!list_empty (&tmrInstance->timer_hash[i])) {
+			tmrTimer = list_entry (tmrInstance->timer_hash[i].next,
+				struct tmrTimer, list);
+			list_del (&tmrTimer->list);
+			free (tmrTimer);
+		}
+	}
+
+	pthread_mutex_unlock (&tmrInstance->timer_mutex);
+
 	hdb_handle_put (&tmrHandleDatabase, tmrHandle);
 
 error_exit:
@@ -361,6 +513,12 @@ saTmrTimerStart (
 		error = res_lib_tmr_timerstart.header.error;
 	}
 
+	if (error == SA_AIS_OK) {
+		tmr_timer_set (tmrInstance, *timerId,
+			timerAttributes->timerPeriodDuration,
+			res_lib_tmr_timerstart.expiration_time);
+	}
+
 error_put:
 	hdb_handle_put (&tmrHandleDatabase, tmrHandle);
 error_exit:
@@ -421,6 +579,14 @@ saTmrTimerReschedule (
 		error = res_lib_tmr_timerreschedule.header.error;
 	}
 
+	if (error == SA_AIS_OK) {
+		*callTime = res_lib_tmr_timerreschedule.call_time;
+
+		tmr_timer_set (tmrInstance, timerId,
+			timerAttributes->timerPeriodDuration,
+			res_lib_tmr_timerreschedule.expiration_time);
+	}
+
 	hdb_handle_put (&tmrHandleDatabase, tmrHandle);
 
 error_exit:
@@ -472,8 +638,12 @@ saTmrTimerCancel (
 
 	if (error == SA_AIS_OK) {
 		*timerDataP = res_lib_tmr_timercancel.timer_data;
+
+		tmr_timer_del (tmrInstance, timerId);
 	}
 
+	hdb_handle_put (&tmrHandleDatabase, tmrHandle);
+
 error_exit:
 	return (error);
 }
@@ -526,7 +696,9 @@ saTmrTimerRemainingTimeGet (
 	SaTimeT *remainingTime)
 {
 	struct tmrInstance *tmrInstance;
+	struct tmrTimer *tmrTimer;
 	SaAisErrorT error = SA_AIS_OK;
+	SaTimeT current_time;
 
 	struct req_lib_tmr_timerremainingtimeget req_lib_tmr_timerremainingtimeget;
 	struct res_lib_tmr_timerremainingtimeget res_lib_tmr_timerremainingtimeget;
@@ -542,6 +714,37 @@ saTmrTimerRemainingTimeGet (
 		goto error_exit;
 	}
 
+	current_time = tmr_time_get ();
+
+	pthread_mutex_lock (&tmrInstance->timer_mutex);
+
+	tmrTimer = tmr_timer_find (tmrInstance, timerId);
+	if (tmrTimer != NULL) {
+		/*
+		 * A periodic timer whose expiration has not been
+		 * dispatched yet is already running its next period.
+		 */
+		if (tmrTimer->period > 0 &&
+		    tmrTimer->expiration_time <= current_time)
+		{
+			tmrTimer->expiration_time += tmrTimer->period *
+				((current_time - tmrTimer->expiration_time) /
+				 tmrTimer->period + 1);
+		}
+
+		if (tmrTimer->expiration_time > current_time) {
+			*remainingTime = tmrTimer->expiration_time - current_time;
+		} else {
+			*remainingTime = 0;
+		}
+	}
+
+	pthread_mutex_unlock (&tmrInstance->timer_mutex);
+
+	if (tmrTimer != NULL) {
+		goto error_put;
+	}
+
 	req_lib_tmr_timerremainingtimeget.header.size =
 		sizeof (struct req_lib_tmr_timerremainingtimeget);
 	req_lib_tmr_timerremainingtimeget.header.id =
@@ -564,6 +767,8 @@ saTmrTimerRemainingTimeGet (
 
 	*remainingTime = res_lib_tmr_timerremainingtimeget.remaining_time;
 
+error_put:
+	hdb_handle_put (&tmrHandleDatabase, tmrHandle);
 error_exit:
 	return (error);
 }
@@ -626,10 +831,6 @@ saTmrTimeGet (
 	struct tmrInstance *tmrInstance;
 	SaAisErrorT error = SA_AIS_OK;
 
-	struct req_lib_tmr_timeget req_lib_tmr_timeget;
-	struct res_lib_tmr_timeget res_lib_tmr_timeget;
-	struct iovec iov;
-
 	if (currentTime == NULL) {
 		error = SA_AIS_ERR_INVALID_PARAM;
 		goto error_exit;
@@ -640,26 +841,9 @@ saTmrTimeGet (
 		goto error_exit;
 	}
 
-	req_lib_tmr_timeget.header.size =
-		sizeof (struct req_lib_tmr_timeget);
-	req_lib_tmr_timeget.header.id =
-		MESSAGE_REQ_TMR_TIMEGET;
-
-	iov.iov_base = (void *)&req_lib_tmr_timeget,
-	iov.iov_len = sizeof (struct req_lib_tmr_timeget);
+	*currentTime = tmr_time_get ();
 
-	error = coroipcc_msg_send_reply_receive (tmrInstance->ipc_handle,
-		&iov,
-		1,
-		&res_lib_tmr_timeget,
-		sizeof (struct res_lib_tmr_timeget));
-
-	if (res_lib_tmr_timeget.header.error != SA_AIS_OK) {
-		error = res_lib_tmr_timeget.header.error;
-	}
-
-	memcpy (currentTime, &res_lib_tmr_timeget.current_time,
-		sizeof (SaTimeT));
+	hdb_handle_put (&tmrHandleDatabase, tmrHandle);
 
 error_exit:
 	return (error);
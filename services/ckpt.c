@@ -64,6 +64,7 @@
 #include "../include/saEvt.h"
 #include "../include/ipc_ckpt.h"
 #include "../include/mar_ckpt.h"
+#include "refcount.h"
 
 LOGSYS_DECLARE_SUBSYS ("CKPT");
 
@@ -108,59 +109,6 @@ enum iteration_state {
 	ITERATION_STATE_SECTION
 };
 
-struct refcount_set {
-	unsigned int refcount;
-	unsigned int nodeid;
-};
-
-typedef struct {
-	unsigned int refcount __attribute__((aligned(8)));
-	unsigned int nodeid __attribute__((aligned(8)));
-} mar_refcount_set_t;
-
-static inline void marshall_to_mar_refcount_set_t (
-	mar_refcount_set_t *dest,
-	struct refcount_set *src)
-{
-	dest->refcount = src->refcount;
-	dest->nodeid = src->nodeid;
-}
-
-static inline void marshall_to_mar_refcount_set_t_all (
-	mar_refcount_set_t *dest,
-	struct refcount_set *src)
-{
-	unsigned int i;
-	for (i = 0; i < PROCESSOR_COUNT_MAX; i++) {
-		marshall_to_mar_refcount_set_t (&dest[i], &src[i]);
-	}
-}
-
-static inline void marshall_from_mar_refcount_set_t (
-	struct refcount_set *dest,
-	mar_refcount_set_t *src)
-{
-	dest->refcount = src->refcount;
-	dest->nodeid = src->nodeid;
-}
-
-static inline void marshall_from_mar_refcount_set_t_all (
-	struct refcount_set *dest,
-	mar_refcount_set_t *src)
-{
-	unsigned int i;
-
-	for (i = 0; i < PROCESSOR_COUNT_MAX; i++) {
-		marshall_from_mar_refcount_set_t (&dest[i], &src[i]);
-	}
-}
-
-static inline void swab_mar_refcount_set_t (mar_refcount_set_t *to_swab)
-{
-	swab_mar_uint32_t (&to_swab->refcount);
-	swab_mar_uint32_t (&to_swab->nodeid);
-}
-
 struct checkpoint {
 	struct list_head list;
 	struct list_head expiry_list;
@@ -173,7 +121,7 @@ struct checkpoint {
 	corosync_timer_handle_t retention_timer;
 	int active_replica_set;
 	int section_count;
-	struct refcount_set refcount_set[PROCESSOR_COUNT_MAX];
+	struct refcount_vector refcount_set;
 };
 
 struct iteration_entry {
@@ -758,7 +706,8 @@ struct req_exec_ckpt_sync_checkpoint_refcount {
 	struct memb_ring_id ring_id __attribute__((aligned(8)));
 	mar_name_t checkpoint_name __attribute__((aligned(8)));
 	mar_uint32_t ckpt_id __attribute__((aligned(8)));
-	mar_refcount_set_t refcount_set[PROCESSOR_COUNT_MAX] __attribute__((aligned(8)));
+	mar_uint32_t refcount_set_count __attribute__((aligned(8)));
+	/* followed by refcount_set_count mar_refcount_set_t entries */
 };
 
 static int first_configuration = 1;
@@ -1007,6 +956,7 @@ static void checkpoint_release (struct checkpoint *checkpoint)
 		checkpoint_section_release (section);
 	}
 	list_del (&checkpoint->list);
+	refcount_vector_free (&checkpoint->refcount_set);
 	free (checkpoint);
 }
 
@@ -1295,8 +1245,7 @@ static void message_handler_req_exec_ckpt_checkpointopen (
 			checkpoint->active_replica_set = 0;
 		}
 
-		memset (&checkpoint->refcount_set, 0,
-			sizeof (struct refcount_set) * PROCESSOR_COUNT_MAX);
+		refcount_vector_init (&checkpoint->refcount_set);
 
 		/*
 		 * Create default section id if max_sections is 1
@@ -3348,36 +3297,14 @@ static void sync_refcount_increment (
 	struct checkpoint *checkpoint,
 	unsigned int nodeid)
 {
-	unsigned int i;
-
-	for (i = 0; i < PROCESSOR_COUNT_MAX; i++) {
-		if (checkpoint->refcount_set[i].nodeid == 0) {
-			checkpoint->refcount_set[i].nodeid = nodeid;
-			checkpoint->refcount_set[i].refcount = 1;
-			break;
-		}
-		if (checkpoint->refcount_set[i].nodeid == nodeid) {
-			checkpoint->refcount_set[i].refcount += 1;
-			break;
-		}
-	}
+	refcount_vector_increment (&checkpoint->refcount_set, nodeid);
 }
 
 static void sync_refcount_decrement (
 	struct checkpoint *checkpoint,
 	unsigned int nodeid)
 {
-	unsigned int i;
-
-	for (i = 0; i < PROCESSOR_COUNT_MAX; i++) {
-		if (checkpoint->refcount_set[i].nodeid == 0) {
-			break;
-		}
-		if (checkpoint->refcount_set[i].nodeid == nodeid) {
-			checkpoint->refcount_set[i].refcount -= 1;
-			break;
-		}
-	}
+	refcount_vector_decrement (&checkpoint->refcount_set, nodeid);
 }
 
 /*
@@ -3386,17 +3313,8 @@ static void sync_refcount_decrement (
 static void sync_refcount_calculate (
 	struct checkpoint *checkpoint)
 {
-	unsigned int i;
-
-	checkpoint->reference_count = 0;
-
-	for (i = 0; i < PROCESSOR_COUNT_MAX; i++) {
-		if (checkpoint->refcount_set[i].nodeid == 0) {
-			break;
-		}
-
-		checkpoint->reference_count += checkpoint->refcount_set[i].refcount;
-	}
+	checkpoint->reference_count =
+		refcount_vector_total (&checkpoint->refcount_set);
 }
 
 static void sync_checkpoints_free (struct list_head *ckpt_list_head)
@@ -3558,13 +3476,17 @@ static int sync_checkpoint_refcount_transmit (
 	struct checkpoint *checkpoint)
 {
 	struct req_exec_ckpt_sync_checkpoint_refcount req_exec_ckpt_sync_checkpoint_refcount;
-	struct iovec iovec;
+	mar_refcount_set_t refcount_set[PROCESSOR_COUNT_MAX];
+	struct iovec iovecs[2];
 
 	ENTER();
 
 	TRACE1 ("transmitting refcounts for checkpoints\n");
+	assert (checkpoint->refcount_set.count <= PROCESSOR_COUNT_MAX);
+
 	req_exec_ckpt_sync_checkpoint_refcount.header.size =
-		sizeof (struct req_exec_ckpt_sync_checkpoint_refcount);
+		sizeof (struct req_exec_ckpt_sync_checkpoint_refcount) +
+		sizeof (mar_refcount_set_t) * checkpoint->refcount_set.count;
 	req_exec_ckpt_sync_checkpoint_refcount.header.id =
 		SERVICE_ID_MAKE (CKPT_SERVICE,
 			MESSAGE_REQ_EXEC_CKPT_SYNCCHECKPOINTREFCOUNT);
@@ -3577,15 +3499,19 @@ static int sync_checkpoint_refcount_transmit (
 
 	req_exec_ckpt_sync_checkpoint_refcount.ckpt_id = checkpoint->ckpt_id;
 
-	marshall_to_mar_refcount_set_t_all (
-		req_exec_ckpt_sync_checkpoint_refcount.refcount_set,
-		checkpoint->refcount_set);
+	req_exec_ckpt_sync_checkpoint_refcount.refcount_set_count =
+		checkpoint->refcount_set.count;
+
+	marshall_to_mar_refcount_set_t_all (refcount_set,
+		&checkpoint->refcount_set);
 
-	iovec.iov_base = (void *)&req_exec_ckpt_sync_checkpoint_refcount;
-	iovec.iov_len = sizeof (struct req_exec_ckpt_sync_checkpoint_refcount);
+	iovecs[0].iov_base = (void *)&req_exec_ckpt_sync_checkpoint_refcount;
+	iovecs[0].iov_len = sizeof (struct req_exec_ckpt_sync_checkpoint_refcount);
+	iovecs[1].iov_base = (void *)refcount_set;
+	iovecs[1].iov_len = sizeof (mar_refcount_set_t) * checkpoint->refcount_set.count;
 
 	LEAVE();
-	return (api->totem_mcast (&iovec, 1, TOTEM_AGREED));
+	return (api->totem_mcast (iovecs, 2, TOTEM_AGREED));
 }
 
 static unsigned int sync_checkpoints_iterate (void)
@@ -3820,8 +3746,7 @@ static void message_handler_req_exec_ckpt_sync_checkpoint (
 			&req_exec_ckpt_sync_checkpoint->checkpoint_creation_attributes,
 			sizeof (mar_ckpt_checkpoint_creation_attributes_t));
 
-		memset (&checkpoint->refcount_set, 0,
-			sizeof (struct refcount_set) * PROCESSOR_COUNT_MAX);
+		refcount_vector_init (&checkpoint->refcount_set);
 
 		checkpoint->ckpt_id = req_exec_ckpt_sync_checkpoint->ckpt_id;
 
@@ -3836,9 +3761,6 @@ static void message_handler_req_exec_ckpt_sync_checkpoint (
 		list_init (&checkpoint->sections_list_head);
 		list_init (&checkpoint->expiry_list);
 		list_add (&checkpoint->list, &sync_checkpoint_list_head);
-
-		memset (checkpoint->refcount_set, 0,
-			sizeof (struct refcount_set) * PROCESSOR_COUNT_MAX);
 	}
 
 	if (checkpoint->ckpt_id >= global_ckpt_id) {
@@ -3985,8 +3907,10 @@ static void message_handler_req_exec_ckpt_sync_checkpoint_refcount (
 	unsigned int nodeid)
 {
 	const struct req_exec_ckpt_sync_checkpoint_refcount *req_exec_ckpt_sync_checkpoint_refcount = message;
+	const mar_refcount_set_t *refcount_set =
+		(const mar_refcount_set_t *)(req_exec_ckpt_sync_checkpoint_refcount + 1);
 	struct checkpoint *checkpoint;
-	unsigned int i, j;
+	unsigned int i;
 
 	ENTER();
 
@@ -4023,48 +3947,15 @@ static void message_handler_req_exec_ckpt_sync_checkpoint_refcount (
 
 	assert (checkpoint != NULL);
 
-	for (i = 0; i < PROCESSOR_COUNT_MAX; i++) {
-		/*
-		 * If nodeid is zero, done processing list
-		 */
-		if (req_exec_ckpt_sync_checkpoint_refcount->refcount_set[i].nodeid == 0) {
-			break;
-		}
-
+	for (i = 0; i < req_exec_ckpt_sync_checkpoint_refcount->refcount_set_count; i++) {
 		/*
 		 * if nodeid not in membership, check next one
 		 */
-		if (nodeid_in_membership (req_exec_ckpt_sync_checkpoint_refcount->refcount_set[i].nodeid) == 0) {
+		if (nodeid_in_membership (refcount_set[i].nodeid) == 0) {
 			continue;
 		}
-		for (j = 0; j < PROCESSOR_COUNT_MAX; j++) {
-			/*
-			 * If new entry in the new checkpoint (nodeid=0) then add it
-			 */
-			if (checkpoint->refcount_set[j].nodeid == 0) {
-
-				checkpoint->refcount_set[j].nodeid =
-					req_exec_ckpt_sync_checkpoint_refcount->refcount_set[i].nodeid;
-				checkpoint->refcount_set[j].refcount =
-					req_exec_ckpt_sync_checkpoint_refcount->refcount_set[i].refcount;
-				/*
-				 * No match found, added processor reference count
-				 */
-				break;
-			}
-
-			/*
-			 * If old entry in checkpoint equals messages nodeid, add it to reference count
-			 */
-			if (req_exec_ckpt_sync_checkpoint_refcount->refcount_set[i].nodeid == checkpoint->refcount_set[j].nodeid) {
-				checkpoint->refcount_set[j].refcount +=
-					req_exec_ckpt_sync_checkpoint_refcount->refcount_set[i].refcount;
-				/*
-				 * Found match, so look at next processor ref count
-				 */
-				break;
-			}
-		}
+		refcount_vector_add (&checkpoint->refcount_set,
+			refcount_set[i].nodeid, refcount_set[i].refcount);
 	}
 
 	sync_refcount_calculate (checkpoint);
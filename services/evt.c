@@ -101,7 +101,8 @@ struct libevt_pd {
 enum evt_message_req_types {
 	MESSAGE_REQ_EXEC_EVT_EVENTDATA = 0,
 	MESSAGE_REQ_EXEC_EVT_CHANCMD = 1,
-	MESSAGE_REQ_EXEC_EVT_RECOVERY_EVENTDATA = 2
+	MESSAGE_REQ_EXEC_EVT_RECOVERY_EVENTDATA = 2,
+	MESSAGE_REQ_EXEC_EVT_RECOVERY_PACK = 3
 };
 
 static void lib_evt_open_channel(void *conn, const void *message);
@@ -139,6 +140,7 @@ static void evt_sync_abort(void);
 
 static void convert_event(void *msg);
 static void convert_chan_packet(void *msg);
+static void convert_recovery_pack(void *msg);
 
 struct corosync_api_v1 *api;
 
@@ -189,6 +191,7 @@ static struct corosync_lib_handler evt_lib_engine[] = {
 static void evt_remote_evt(const void *msg, unsigned int nodeid);
 static void evt_remote_recovery_evt(const void *msg, unsigned int nodeid);
 static void evt_remote_chan_op(const void *msg, unsigned int nodeid);
+static void evt_remote_recovery_pack(const void *msg, unsigned int nodeid);
 
 static struct corosync_exec_handler evt_exec_engine[] = {
 	{
@@ -202,6 +205,10 @@ static struct corosync_exec_handler evt_exec_engine[] = {
 	{
 		.exec_handler_fn		= evt_remote_recovery_evt,
 		.exec_endian_convert_fn = convert_event
+	},
+	{
+		.exec_handler_fn		= evt_remote_recovery_pack,
+		.exec_endian_convert_fn = convert_recovery_pack
 	}
 };
 
@@ -342,6 +349,38 @@ struct req_evt_chan_command {
 	} u;
 };
 
+/*
+ * MESSAGE_REQ_EXEC_EVT_RECOVERY_PACK
+ *
+ * Used during recovery to send many records of the same kind in one
+ * totem message instead of one message per record.
+ */
+enum evt_recovery_pack_ops {
+	EVT_PACK_LAST_IDS,		/* struct evt_set_id records */
+	EVT_PACK_OPEN_COUNTS,	/* struct evt_set_opens records */
+	EVT_PACK_EVENTS			/* struct lib_event_data records */
+};
+
+/*
+ * rp_head:		Request head
+ * rp_op:		Type of the records that follow
+ * rp_count:	Number of records in rp_body
+ * rp_body:		Records, each one padded to an 8 byte boundary
+ */
+struct req_evt_recovery_pack {
+	coroipc_request_header_t	rp_head __attribute__((aligned(8)));
+	mar_uint32_t		rp_op __attribute__((aligned(8)));
+	mar_uint32_t		rp_count __attribute__((aligned(8)));
+	mar_uint8_t			rp_body[0] __attribute__((aligned(8)));
+};
+
+/*
+ * Records are added to a recovery pack until it reaches this size.
+ * A single record larger than this is sent in a pack of its own.
+ */
+#define EVT_RECOVERY_PACK_SIZE	(128 * 1024)
+#define EVT_PACK_ALIGN(size)	(((size) + 7) & ~7)
+
 /*
  * list of all retained events
  *		struct event_data
@@ -442,6 +481,43 @@ static int				add_count = 0;
 static unsigned int *add_list = 0;
 static int				processed_open_counts = 0;
 
+/*
+ * Buffer used to build recovery packs and per configuration change
+ * recovery statistics.
+ *
+ * recovery_pack:			pack currently being built
+ * recovery_pack_size:		allocated size of recovery_pack
+ * recovery_msgs_sent:		recovery messages sent by this node
+ * recovery_events_sent:	retained events sent by this node
+ * recovery_events_skipped:	retained events all members already have
+ * recovery_opens_sent:		open count records sent by this node
+ * recovery_count:			recoveries completed by this node
+ */
+static struct req_evt_recovery_pack *recovery_pack = 0;
+static size_t			recovery_pack_size = 0;
+static unsigned int		recovery_msgs_sent = 0;
+static unsigned int		recovery_events_sent = 0;
+static unsigned int		recovery_events_skipped = 0;
+static unsigned int		recovery_opens_sent = 0;
+static unsigned int		recovery_count = 0;
+
+/*
+ * The statistics of the last completed recovery are published as keys
+ * of the runtime.evt object, where confdb clients can read them.
+ */
+static hdb_handle_t		evt_runtime_handle = 0;
+
+static struct {
+	const char *key;
+	unsigned int *value;
+} evt_runtime_keys[] = {
+	{ "recovery_count", &recovery_count },
+	{ "recovery_msgs_sent", &recovery_msgs_sent },
+	{ "recovery_events_sent", &recovery_events_sent },
+	{ "recovery_events_skipped", &recovery_events_skipped },
+	{ "recovery_opens_sent", &recovery_opens_sent }
+};
+
 /*
  * Structure to track pending channel open requests.
  *	ocp_async:			1 for async open
@@ -698,6 +774,9 @@ struct event_svr_channel_subscr {
  * Member node data
  * mn_node_info:		cluster node info from membership
  * mn_last_msg_id:		last seen message ID for this node
+ * mn_recovery_reports:	How many members reported a last seen message
+ *						ID for this node during recovery.
+ * mn_recovery_last_id:	lowest of the reported last seen message IDs.
  * mn_started:			Indicates that event service has started
  *						on this node.
  * mn_next:				pointer to the next node in the hash chain.
@@ -707,6 +786,8 @@ struct member_node_data {
 	unsigned int		mn_nodeid;
 	SaClmClusterNodeT	mn_node_info;
 	mar_evteventid_t		mn_last_msg_id;
+	mar_uint32_t		mn_recovery_reports;
+	mar_evteventid_t		mn_recovery_last_id;
 	mar_uint32_t		mn_started;
 	struct member_node_data	*mn_next;
 	struct list_head	mn_entry;
@@ -3089,6 +3170,74 @@ static int evt_lib_exit(void *conn)
 	return 0;
 }
 
+/*
+ * Create the runtime.evt object and its recovery statistics keys.
+ * The statistics are only for information, so failures are ignored.
+ */
+static void evt_runtime_init(void)
+{
+	hdb_handle_t object_find_handle;
+	hdb_handle_t object_runtime_handle;
+	int i;
+
+	api->object_find_create (
+		OBJECT_PARENT_HANDLE,
+		"runtime",
+		strlen ("runtime"),
+		&object_find_handle);
+
+	if (api->object_find_next (
+		object_find_handle,
+		&object_runtime_handle) != 0) {
+
+		if (api->object_create (OBJECT_PARENT_HANDLE,
+			&object_runtime_handle,
+			"runtime", strlen ("runtime")) != 0) {
+
+			api->object_find_destroy (object_find_handle);
+			return;
+		}
+	}
+	api->object_find_destroy (object_find_handle);
+
+	if (api->object_create (object_runtime_handle,
+		&evt_runtime_handle,
+		"evt", strlen ("evt")) != 0) {
+
+		evt_runtime_handle = 0;
+		return;
+	}
+
+	for (i = 0; i < sizeof (evt_runtime_keys) / sizeof (evt_runtime_keys[0]); i++) {
+		api->object_key_create (evt_runtime_handle,
+			evt_runtime_keys[i].key,
+			strlen (evt_runtime_keys[i].key),
+			evt_runtime_keys[i].value,
+			sizeof (unsigned int));
+	}
+}
+
+/*
+ * Update the runtime.evt keys with the statistics of the recovery that
+ * just completed.
+ */
+static void evt_runtime_publish(void)
+{
+	int i;
+
+	if (evt_runtime_handle == 0) {
+		return;
+	}
+
+	for (i = 0; i < sizeof (evt_runtime_keys) / sizeof (evt_runtime_keys[0]); i++) {
+		api->object_key_replace (evt_runtime_handle,
+			evt_runtime_keys[i].key,
+			strlen (evt_runtime_keys[i].key),
+			evt_runtime_keys[i].value,
+			sizeof (unsigned int));
+	}
+}
+
 /*
  * Called at service start time.
  */
@@ -3140,6 +3289,8 @@ static int evt_exec_init(struct corosync_api_v1 *corosync_api)
 		}
 	}
 
+	evt_runtime_init();
+
 	/*
 	 * Create an event to be sent when we have to drop messages
 	 * for an application.
@@ -3322,9 +3473,10 @@ static inline mar_time_t calc_retention_time(mar_time_t retention,
 }
 
 /*
- * Receive a recovery network event message and save it in the retained list
+ * Save a retained event received during recovery in the retained list
  */
-static void evt_remote_recovery_evt(const void *msg, unsigned int nodeid)
+static void recover_retained_event(const struct lib_event_data *evtpkt,
+	mar_time_t now)
 {
 	/*
 	 * - calculate remaining retention time
@@ -3333,31 +3485,12 @@ static void evt_remote_recovery_evt(const void *msg, unsigned int nodeid)
 	 * - Apply filters
 	 * - Deliver events that pass the filter test
 	 */
-	const struct lib_event_data *evtpkt = msg;
 	struct event_svr_channel_instance *eci;
 	struct event_data *evt;
 	struct member_node_data *md;
 	int num_delivered;
-	mar_time_t now;
 	mar_time_t evtpkt_retention_time;
 
-	now = clust_time_now();
-
-	log_printf(RECOVERY_EVENT_DEBUG,
-			"Remote recovery event data received from nodeid %d\n", nodeid);
-
-	if (recovery_phase == evt_recovery_complete) {
-		log_printf(RECOVERY_EVENT_DEBUG,
-			"Received recovery data, not in recovery mode\n");
-		return;
-	}
-
-	log_printf(RECOVERY_EVENT_DEBUG,
-		"Processing recovery of retained events\n");
-	if (recovery_node) {
-		log_printf(RECOVERY_EVENT_DEBUG, "This node is the recovery node\n");
-	}
-
 	log_printf(RECOVERY_EVENT_DEBUG, "(1)EVT ID: %llx, Time: %llx\n",
 		(unsigned long long)evtpkt->led_event_id,
 		(unsigned long long)evtpkt->led_retention_time);
@@ -3405,6 +3538,15 @@ static void evt_remote_recovery_evt(const void *msg, unsigned int nodeid)
 			(unsigned long long)evtpkt->led_chan_unlink_id);
 		eci = find_channel(&evtpkt->led_chan_name, evtpkt->led_chan_unlink_id);
 
+		/*
+		 * Open counts are only sent for channels that are open somewhere,
+		 * so a joining node may not know about an active channel that
+		 * only holds retained events yet.
+		 */
+		if (!eci && (evtpkt->led_chan_unlink_id == EVT_CHAN_ACTIVE)) {
+			eci = create_channel(&evtpkt->led_chan_name);
+		}
+
 		/*
 		 * We shouldn't normally see an event for a channel that we don't
 		 * know about.
@@ -3433,6 +3575,31 @@ static void evt_remote_recovery_evt(const void *msg, unsigned int nodeid)
 	}
 }
 
+/*
+ * Receive a recovery network event message and save it in the retained list
+ */
+static void evt_remote_recovery_evt(const void *msg, unsigned int nodeid)
+{
+	const struct lib_event_data *evtpkt = msg;
+
+	log_printf(RECOVERY_EVENT_DEBUG,
+			"Remote recovery event data received from nodeid %d\n", nodeid);
+
+	if (recovery_phase == evt_recovery_complete) {
+		log_printf(RECOVERY_EVENT_DEBUG,
+			"Received recovery data, not in recovery mode\n");
+		return;
+	}
+
+	log_printf(RECOVERY_EVENT_DEBUG,
+		"Processing recovery of retained events\n");
+	if (recovery_node) {
+		log_printf(RECOVERY_EVENT_DEBUG, "This node is the recovery node\n");
+	}
+
+	recover_retained_event(evtpkt, clust_time_now());
+}
+
 
 /*
  * Timeout handler for event channel open.  We flag the structure
@@ -3663,6 +3830,93 @@ convert_chan_packet(void *msg)
 }
 
 
+/*
+ * Set our next event ID based on the largest event ID seen
+ * by others in the cluster.  This way, if we've left and re-joined, we'll
+ * start using an event ID that is unique.
+ *
+ * The reports are also collected for every node so that the recovery
+ * node knows which retained events all of the members have already seen.
+ */
+static void recover_last_id(unsigned int nodeid, unsigned int my_id,
+	const struct evt_set_id *set_id)
+{
+	struct member_node_data *md;
+	int log_level = LOGSYS_LEVEL_DEBUG;
+
+	if (set_id->chc_nodeid == my_id) {
+		log_level = RECOVERY_DEBUG;
+	}
+	log_printf(log_level,
+		"Received Set event ID OP from nodeid %x to %llx for %x my addr %s base %llx\n",
+		nodeid,
+		(unsigned long long)set_id->chc_last_id,
+		set_id->chc_nodeid,
+		api->totem_ifaces_print (my_id),
+		(unsigned long long)base_id);
+	if (set_id->chc_nodeid == my_id) {
+		if (set_id->chc_last_id >= base_id) {
+			log_printf(RECOVERY_DEBUG,
+				"Set event ID from nodeid %s to %llx\n",
+				api->totem_ifaces_print (nodeid),
+				(unsigned long long)set_id->chc_last_id);
+			base_id = set_id->chc_last_id + 1;
+		}
+	}
+
+	md = evt_find_node(set_id->chc_nodeid);
+	if (md == NULL) {
+		return;
+	}
+	if ((md->mn_recovery_reports == 0) ||
+			(set_id->chc_last_id < md->mn_recovery_last_id)) {
+		md->mn_recovery_last_id = set_id->chc_last_id;
+	}
+	md->mn_recovery_reports++;
+}
+
+/*
+ * Receive the open count for a particular channel during recovery.
+ * This insures that everyone has the same notion of who has a channel
+ * open so that it can be removed when no one else has it open anymore.
+ */
+static void recover_open_count(struct member_node_data *mn,
+	const struct evt_set_opens *set_opens)
+{
+	struct event_svr_channel_instance *eci;
+
+	/*
+	 * Zero out all open counts because we're setting then based
+	 * on each nodes local counts.
+	 */
+	if (!processed_open_counts) {
+		zero_chan_open_counts();
+		processed_open_counts = 1;
+	}
+	log_printf(RECOVERY_DEBUG,
+			"Open channel count %s is %d for node %s\n",
+			set_opens->chc_chan_name.value,
+			set_opens->chc_open_count,
+			api->totem_ifaces_print (mn->mn_node_info.nodeId));
+
+	eci = find_channel(&set_opens->chc_chan_name, EVT_CHAN_ACTIVE);
+	if (!eci) {
+		eci = create_channel(&set_opens->chc_chan_name);
+	}
+	if (!eci) {
+		log_printf(LOGSYS_LEVEL_WARNING, "Could not create channel %s\n",
+			   get_mar_name_t(&set_opens->chc_chan_name));
+		return;
+	}
+	if (set_open_count(eci, mn->mn_node_info.nodeId,
+		set_opens->chc_open_count)) {
+		log_printf(LOGSYS_LEVEL_ERROR,
+			"Error setting Open channel count %s for node %s\n",
+			set_opens->chc_chan_name.value,
+			api->totem_ifaces_print (mn->mn_node_info.nodeId));
+	}
+}
+
 /*
  * Receive and process remote event operations.
  * Used to communicate channel opens/closes, clear retention time,
@@ -3868,32 +4122,11 @@ static void evt_remote_chan_op(const void *msg, unsigned int nodeid)
 
 	/*
 	 * Set our next event ID based on the largest event ID seen
-	 * by others in the cluster.  This way, if we've left and re-joined, we'll
-	 * start using an event ID that is unique.
+	 * by others in the cluster.
 	 */
-	case EVT_SET_ID_OP: {
-		int log_level = LOGSYS_LEVEL_DEBUG;
-		if (cpkt->u.chc_set_id.chc_nodeid == my_node->nodeId) {
-			log_level = RECOVERY_DEBUG;
-		}
-		log_printf(log_level,
-			"Received Set event ID OP from nodeid %x to %llx for %x my addr %s base %llx\n",
-			nodeid,
-			(unsigned long long)cpkt->u.chc_set_id.chc_last_id,
-			cpkt->u.chc_set_id.chc_nodeid,
-			api->totem_ifaces_print (my_node->nodeId),
-			(unsigned long long)base_id);
-		if (cpkt->u.chc_set_id.chc_nodeid == my_node->nodeId) {
-			if (cpkt->u.chc_set_id.chc_last_id >= base_id) {
-				log_printf(RECOVERY_DEBUG,
-					"Set event ID from nodeid %s to %llx\n",
-					api->totem_ifaces_print (nodeid),
-					(unsigned long long)cpkt->u.chc_set_id.chc_last_id);
-				base_id = cpkt->u.chc_set_id.chc_last_id + 1;
-			}
-		}
+	case EVT_SET_ID_OP:
+		recover_last_id(nodeid, my_node->nodeId, &cpkt->u.chc_set_id);
 		break;
-	}
 
 	/*
 	 * Receive the open count for a particular channel during recovery.
@@ -3906,38 +4139,7 @@ static void evt_remote_chan_op(const void *msg, unsigned int nodeid)
 				"Evt open count msg from nodeid %s, but not in membership change\n",
 				api->totem_ifaces_print (nodeid));
 		}
-
-		/*
-		 * Zero out all open counts because we're setting then based
-		 * on each nodes local counts.
-		 */
-		if (!processed_open_counts) {
-			zero_chan_open_counts();
-			processed_open_counts = 1;
-		}
-		log_printf(RECOVERY_DEBUG,
-				"Open channel count %s is %d for node %s\n",
-				cpkt->u.chc_set_opens.chc_chan_name.value,
-				cpkt->u.chc_set_opens.chc_open_count,
-				api->totem_ifaces_print (mn->mn_node_info.nodeId));
-
-		eci = find_channel(&cpkt->u.chc_set_opens.chc_chan_name,
-					EVT_CHAN_ACTIVE);
-		if (!eci) {
-			eci = create_channel(&cpkt->u.chc_set_opens.chc_chan_name);
-		}
-		if (!eci) {
-			log_printf(LOGSYS_LEVEL_WARNING, "Could not create channel %s\n",
-				   get_mar_name_t(&cpkt->u.chc_set_opens.chc_chan_name));
-			break;
-		}
-		if (set_open_count(eci, mn->mn_node_info.nodeId,
-			cpkt->u.chc_set_opens.chc_open_count)) {
-			log_printf(LOGSYS_LEVEL_ERROR,
-				"Error setting Open channel count %s for node %s\n",
-				cpkt->u.chc_set_opens.chc_chan_name.value,
-				api->totem_ifaces_print (mn->mn_node_info.nodeId));
-		}
+		recover_open_count(mn, &cpkt->u.chc_set_opens);
 		break;
 
 	/*
@@ -3958,6 +4160,16 @@ static void evt_remote_chan_op(const void *msg, unsigned int nodeid)
 				"NO NODE DATA AVAILABLE FOR nodeid %s\n", api->totem_ifaces_print (nodeid));
 		}
 
+		/*
+		 * Open counts are only sent for channels a node has open, so
+		 * a node with nothing open may check in before any counts
+		 * have been received.
+		 */
+		if (!processed_open_counts) {
+			zero_chan_open_counts();
+			processed_open_counts = 1;
+		}
+
 		if (++checked_in == total_member_count) {
 			/*
 			 * We're all here, now figure out who should send the
@@ -3993,6 +4205,13 @@ static void evt_remote_chan_op(const void *msg, unsigned int nodeid)
 			 * All recovery complete, carry on.
 			 */
 			recovery_phase = evt_recovery_complete;
+			recovery_count++;
+			evt_runtime_publish();
+			log_printf(LOGSYS_LEVEL_NOTICE,
+				"Evt recovery sent %u messages: %u retained events "
+				"(%u already held by all members), %u open counts\n",
+				recovery_msgs_sent, recovery_events_sent,
+				recovery_events_skipped, recovery_opens_sent);
 #ifdef DUMP_CHAN_INFO
 			dump_all_chans();
 #endif
@@ -4008,6 +4227,216 @@ static void evt_remote_chan_op(const void *msg, unsigned int nodeid)
 	}
 }
 
+/*
+ * Take a recovery pack and swap the elements of each record so they
+ * match our architectures word order.
+ */
+static void
+convert_recovery_pack(void *msg)
+{
+	struct req_evt_recovery_pack *pack = (struct req_evt_recovery_pack *)msg;
+	struct evt_set_id *set_id;
+	struct evt_set_opens *set_opens;
+	struct lib_event_data *evtpkt;
+	mar_uint8_t *rec;
+	int i;
+
+	pack->rp_op = swab32(pack->rp_op);
+	pack->rp_count = swab32(pack->rp_count);
+
+	rec = pack->rp_body;
+	for (i = 0; i < pack->rp_count; i++) {
+		switch (pack->rp_op) {
+		case EVT_PACK_LAST_IDS:
+			set_id = (struct evt_set_id *)rec;
+			set_id->chc_nodeid = swab32(set_id->chc_nodeid);
+			set_id->chc_last_id = swab64(set_id->chc_last_id);
+			rec += EVT_PACK_ALIGN(sizeof(*set_id));
+			break;
+
+		case EVT_PACK_OPEN_COUNTS:
+			set_opens = (struct evt_set_opens *)rec;
+			swab_mar_name_t (&set_opens->chc_chan_name);
+			set_opens->chc_open_count = swab32(set_opens->chc_open_count);
+			rec += EVT_PACK_ALIGN(sizeof(*set_opens));
+			break;
+
+		case EVT_PACK_EVENTS:
+			/*
+			 * Only the header of the whole message is converted
+			 * by the main deliver_fn.
+			 */
+			evtpkt = (struct lib_event_data *)rec;
+			evtpkt->led_head.size = swab32(evtpkt->led_head.size);
+			evtpkt->led_head.id = swab32(evtpkt->led_head.id);
+			convert_event(evtpkt);
+			rec += EVT_PACK_ALIGN(evtpkt->led_head.size);
+			break;
+
+		/*
+		 * Make sure that this function is updated when new ops are added.
+		 */
+		default:
+			assert(0);
+		}
+	}
+}
+
+/*
+ * Receive a pack of recovery records and process each of them the same
+ * way as the single record messages.
+ */
+static void evt_remote_recovery_pack(const void *msg, unsigned int nodeid)
+{
+	const struct req_evt_recovery_pack *pack = msg;
+	unsigned int local_node = {SA_CLM_LOCAL_NODE_ID};
+	const struct lib_event_data *evtpkt;
+	const mar_uint8_t *rec;
+	SaClmClusterNodeT *cn, *my_node;
+	struct member_node_data *mn;
+	mar_time_t now;
+	int i;
+
+	log_printf(RECOVERY_DEBUG,
+		"Remote recovery pack op %u with %u records from nodeid %s\n",
+		pack->rp_op, pack->rp_count, api->totem_ifaces_print (nodeid));
+
+	if (recovery_phase == evt_recovery_complete) {
+		log_printf(LOGSYS_LEVEL_ERROR,
+			"Evt recovery pack from nodeid %s, but not in membership change\n",
+			api->totem_ifaces_print (nodeid));
+		return;
+	}
+
+	my_node = clmapi->nodeid_saf_get(local_node);
+
+	mn = evt_find_node(nodeid);
+	if (mn == NULL) {
+		cn = clmapi->nodeid_saf_get(nodeid);
+		if (cn == NULL) {
+			log_printf(LOGSYS_LEVEL_WARNING,
+				"Evt recovery pack: Node data for nodeid %d is NULL\n",
+				nodeid);
+			return;
+		}
+		evt_add_node(nodeid, cn);
+		mn = evt_find_node(nodeid);
+	}
+
+	now = clust_time_now();
+	rec = pack->rp_body;
+	for (i = 0; i < pack->rp_count; i++) {
+		switch (pack->rp_op) {
+		case EVT_PACK_LAST_IDS:
+			recover_last_id(nodeid, my_node->nodeId,
+				(const struct evt_set_id *)rec);
+			rec += EVT_PACK_ALIGN(sizeof(struct evt_set_id));
+			break;
+
+		case EVT_PACK_OPEN_COUNTS:
+			recover_open_count(mn, (const struct evt_set_opens *)rec);
+			rec += EVT_PACK_ALIGN(sizeof(struct evt_set_opens));
+			break;
+
+		case EVT_PACK_EVENTS:
+			evtpkt = (const struct lib_event_data *)rec;
+			recover_retained_event(evtpkt, now);
+			rec += EVT_PACK_ALIGN(evtpkt->led_head.size);
+			break;
+
+		default:
+			log_printf(LOGSYS_LEVEL_NOTICE, "Invalid recovery pack op %d\n",
+							pack->rp_op);
+			return;
+		}
+	}
+}
+
+/*
+ * Start a new recovery pack of the given type.  The pack is kept
+ * around between configuration changes.
+ */
+static struct req_evt_recovery_pack *recovery_pack_init(
+	enum evt_recovery_pack_ops op)
+{
+	if (recovery_pack == NULL) {
+		recovery_pack = malloc(EVT_RECOVERY_PACK_SIZE);
+		if (recovery_pack == NULL) {
+			return NULL;
+		}
+		recovery_pack_size = EVT_RECOVERY_PACK_SIZE;
+	}
+	memset(recovery_pack, 0, sizeof(*recovery_pack));
+	recovery_pack->rp_head.id =
+		SERVICE_ID_MAKE(EVT_SERVICE, MESSAGE_REQ_EXEC_EVT_RECOVERY_PACK);
+	recovery_pack->rp_head.size = sizeof(*recovery_pack);
+	recovery_pack->rp_op = op;
+	return recovery_pack;
+}
+
+/*
+ * Reserve space for a record of the given size at the end of the pack.
+ * Returns NULL if the record doesn't fit and the pack already holds
+ * records.  A single record that is larger than the pack grows it.
+ */
+static void *recovery_pack_reserve(size_t size)
+{
+	struct req_evt_recovery_pack *pack;
+	size_t new_size;
+	void *rec;
+
+	new_size = recovery_pack->rp_head.size + EVT_PACK_ALIGN(size);
+	if (new_size > recovery_pack_size) {
+		if (recovery_pack->rp_count) {
+			return NULL;
+		}
+		pack = realloc(recovery_pack, new_size);
+		if (pack == NULL) {
+			return NULL;
+		}
+		recovery_pack = pack;
+		recovery_pack_size = new_size;
+	}
+
+	rec = (char *)recovery_pack + recovery_pack->rp_head.size;
+	memset(rec, 0, EVT_PACK_ALIGN(size));
+	recovery_pack->rp_head.size = new_size;
+	recovery_pack->rp_count++;
+	return rec;
+}
+
+/*
+ * Multicast the current recovery pack.
+ */
+static int recovery_pack_send(void)
+{
+	struct iovec pack_iovec;
+	int res;
+
+	pack_iovec.iov_base = (void *)recovery_pack;
+	pack_iovec.iov_len = recovery_pack->rp_head.size;
+	res = api->totem_mcast (&pack_iovec, 1, TOTEM_AGREED);
+	if (res == 0) {
+		recovery_msgs_sent++;
+	}
+	return res;
+}
+
+/*
+ * Check if every member of the new configuration reported that it has
+ * already seen this event.  Those members would discard it anyway.
+ */
+static int retained_event_seen(const struct event_data *evt)
+{
+	struct member_node_data *md;
+
+	md = evt_find_node(evt->ed_event.led_nodeid);
+	if (md == NULL || md->mn_recovery_reports < total_member_count) {
+		return 0;
+	}
+	return evt->ed_event.led_msg_id <= md->mn_recovery_last_id;
+}
+
 /*
  * Set up initial conditions for processing event service
  * recovery.
@@ -4019,6 +4448,7 @@ static void evt_sync_init(
 {
 	SaClmClusterNodeT *cn;
 	struct member_node_data *md;
+	struct list_head *l;
 	unsigned int my_node = {SA_CLM_LOCAL_NODE_ID};
 	int left_list_entries = left_member_count;
 	unsigned int *left_list = left_member_list;
@@ -4079,6 +4509,20 @@ static void evt_sync_init(
 	 */
 	next_retained = retained_list.next;
 
+	/*
+	 * Forget the last seen message IDs reported during the previous
+	 * recovery and reset the recovery statistics.
+	 */
+	for (l = mnd.next; l != &mnd; l = l->next) {
+		md = list_entry(l, struct member_node_data, mn_entry);
+		md->mn_recovery_reports = 0;
+		md->mn_recovery_last_id = 0;
+	}
+	recovery_msgs_sent = 0;
+	recovery_events_sent = 0;
+	recovery_events_skipped = 0;
+	recovery_opens_sent = 0;
+
 	/*
 	 * Member check in counts for open channel counts and
 	 * retained events.
@@ -4091,12 +4535,15 @@ static void evt_sync_init(
  * finish the recovery.
  *
  * First, the node broadcasts the highest event ID that it has seen for any
- * joinig node.  This helps to make sure that rejoining nodes don't re-use
- * event IDs that have already been seen.
+ * node.  This helps to make sure that rejoining nodes don't re-use
+ * event IDs that have already been seen, and lets the recovery node
+ * skip retained events that all members have already seen.
  *
  * Next, The node broadcasts its open channel information to the other nodes.
  * This makes sure that any joining nodes have complete data on any channels
- * already open.
+ * already open.  Only channels open on this node are sent.
+ *
+ * All of this data is packed into as few messages as possible.
  *
  * Once done sending open channel information the node waits in a state for
  * the rest of the nodes to finish sending their data.  When the last node
@@ -4121,45 +4568,15 @@ static int evt_sync_process(void)
 	case evt_send_event_id:
 	{
 		struct member_node_data *md;
+		struct evt_set_id *set_id;
 		SaClmClusterNodeT *cn;
-		struct req_evt_chan_command cpkt;
-		struct iovec chn_iovec;
-		int res;
+		struct list_head *l;
 
 		log_printf(RECOVERY_DEBUG, "Send max event ID updates\n");
 		while (add_count) {
-			/*
-			 * If we've seen this node before, send out the last msg ID
-			 * that we've seen from him.  He will set his base ID for
-			 * generating event and message IDs to the highest one seen.
-			 */
 			md = evt_find_node(*add_list);
 			if (md != NULL) {
-				log_printf(RECOVERY_DEBUG,
-					"Send set evt ID %llx to %s\n",
-					(unsigned long long)md->mn_last_msg_id,
-					api->totem_ifaces_print (*add_list));
 				md->mn_started = 1;
-				memset(&cpkt, 0, sizeof(cpkt));
-				cpkt.chc_head.id =
-					SERVICE_ID_MAKE (EVT_SERVICE, MESSAGE_REQ_EXEC_EVT_CHANCMD);
-				cpkt.chc_head.size = sizeof(cpkt);
-				cpkt.chc_op = EVT_SET_ID_OP;
-				cpkt.u.chc_set_id.chc_nodeid = *add_list;
-				cpkt.u.chc_set_id.chc_last_id = md->mn_last_msg_id;
-				chn_iovec.iov_base = (void *)&cpkt;
-				chn_iovec.iov_len = cpkt.chc_head.size;
-				res = api->totem_mcast(&chn_iovec, 1, TOTEM_AGREED);
-				if (res != 0) {
-					log_printf(RECOVERY_DEBUG,
-						"Unable to send event id to %s\n",
-						api->totem_ifaces_print (*add_list));
-					/*
-					 * We'll try again later.
-					 */
-					return 1;
-				}
-
 			} else {
 				/*
 				 * Not seen before, add it to our list of nodes.
@@ -4181,19 +4598,57 @@ static int evt_sync_process(void)
 			add_list++;
 			add_count--;
 		}
+
+		/*
+		 * Send out the last msg ID that we've seen from every node we
+		 * know about.  A node will set its base ID for generating event
+		 * and message IDs to the highest one seen, and the recovery node
+		 * uses them to skip retained events everyone already has.
+		 * One record per node always fits in a single pack.
+		 */
+		if (recovery_pack_init(EVT_PACK_LAST_IDS) == NULL) {
+			return 1;
+		}
+		for (l = mnd.next; l != &mnd; l = l->next) {
+			md = list_entry(l, struct member_node_data, mn_entry);
+			if (md->mn_last_msg_id == 0) {
+				continue;
+			}
+			log_printf(RECOVERY_DEBUG,
+				"Send set evt ID %llx to %s\n",
+				(unsigned long long)md->mn_last_msg_id,
+				api->totem_ifaces_print (md->mn_nodeid));
+			set_id = recovery_pack_reserve(sizeof(*set_id));
+			if (set_id == NULL) {
+				break;
+			}
+			set_id->chc_nodeid = md->mn_nodeid;
+			set_id->chc_last_id = md->mn_last_msg_id;
+		}
+		if (recovery_pack->rp_count && recovery_pack_send() != 0) {
+			log_printf(RECOVERY_DEBUG, "Unable to send event ids\n");
+			/*
+			 * We'll try again later.
+			 */
+			return 1;
+		}
 		recovery_phase = evt_send_open_count;
 		return 1;
 	}
 
 	/*
 	 * Send channel open counts so all members have the same channel open
-	 * counts.
+	 * counts.  Everyone zeroes the counts first, so only the channels
+	 * this node has open need to be sent.
 	 */
 	case evt_send_open_count:
 	{
 		struct req_evt_chan_command cpkt;
 		struct iovec chn_iovec;
 		struct event_svr_channel_instance *eci;
+		struct evt_set_opens *set_opens;
+		struct list_head *l;
+		unsigned int opens;
 		int res;
 
 		log_printf(RECOVERY_DEBUG, "Send open count updates\n");
@@ -4201,28 +4656,33 @@ static int evt_sync_process(void)
 		 * Process messages.  When we're done, send the done message
 		 * to the nodes.
 		 */
-		memset(&cpkt, 0, sizeof(cpkt));
-		for (;next_chan != &esc_head;
-								next_chan = next_chan->next) {
-			log_printf(RECOVERY_DEBUG, "Sending next open count\n");
-			eci = list_entry(next_chan, struct event_svr_channel_instance,
-					esc_entry);
-			cpkt.chc_head.id =
-				SERVICE_ID_MAKE(EVT_SERVICE, MESSAGE_REQ_EXEC_EVT_CHANCMD);
-			cpkt.chc_head.size = sizeof(cpkt);
-			cpkt.chc_op = EVT_OPEN_COUNT;
-			cpkt.u.chc_set_opens.chc_chan_name = eci->esc_channel_name;
-			cpkt.u.chc_set_opens.chc_open_count = eci->esc_local_opens;
-			chn_iovec.iov_base = (void *)&cpkt;
-			chn_iovec.iov_len = cpkt.chc_head.size;
-			res = api->totem_mcast (&chn_iovec, 1, TOTEM_AGREED);
-
-			if (res != 0) {
+		while (next_chan != &esc_head) {
+			if (recovery_pack_init(EVT_PACK_OPEN_COUNTS) == NULL) {
+				return 1;
+			}
+			opens = 0;
+			for (l = next_chan; l != &esc_head; l = l->next) {
+				eci = list_entry(l, struct event_svr_channel_instance,
+						esc_entry);
+				if (eci->esc_local_opens == 0) {
+					continue;
+				}
+				set_opens = recovery_pack_reserve(sizeof(*set_opens));
+				if (set_opens == NULL) {
+					break;
+				}
+				set_opens->chc_chan_name = eci->esc_channel_name;
+				set_opens->chc_open_count = eci->esc_local_opens;
+				opens++;
+			}
+			if (opens && recovery_pack_send() != 0) {
 			/*
 			 * Try again later.
 			 */
 				return 1;
 			}
+			recovery_opens_sent += opens;
+			next_chan = l;
 		}
 		memset(&cpkt, 0, sizeof(cpkt));
 		cpkt.chc_head.id =
@@ -4238,6 +4698,7 @@ static int evt_sync_process(void)
 		 */
 			return 1;
 		}
+		recovery_msgs_sent++;
 		log_printf(RECOVERY_DEBUG, "DONE Sending open counts\n");
 
 		recovery_phase = evt_wait_open_count_done;
@@ -4261,32 +4722,61 @@ static int evt_sync_process(void)
 	 */
 	case evt_send_retained_events:
 	{
-		struct iovec chn_iovec;
+		struct lib_event_data *evtpkt;
 		struct event_data *evt;
-		int res;
+		struct list_head *l;
+		unsigned int events;
+		unsigned int skipped;
 
 		log_printf(RECOVERY_DEBUG, "Send retained event updates\n");
 
 		/*
 		 * Process messages.  When we're done, send the done message
-		 * to the nodes.
+		 * to the nodes.  Events that every member has already seen
+		 * are skipped.
 		 */
-		for (;next_retained != &retained_list;
-								next_retained = next_retained->next) {
-			log_printf(LOGSYS_LEVEL_DEBUG, "Sending next retained event\n");
-			evt = list_entry(next_retained, struct event_data, ed_retained);
-			evt->ed_event.led_head.id =
-				SERVICE_ID_MAKE(EVT_SERVICE, MESSAGE_REQ_EXEC_EVT_RECOVERY_EVENTDATA);
-			chn_iovec.iov_base = (void *)&evt->ed_event;
-			chn_iovec.iov_len = evt->ed_event.led_head.size;
-			res = api->totem_mcast (&chn_iovec, 1, TOTEM_AGREED);
-
-			if (res != 0) {
+		while (next_retained != &retained_list) {
+			if (recovery_pack_init(EVT_PACK_EVENTS) == NULL) {
+				return 1;
+			}
+			events = 0;
+			skipped = 0;
+			for (l = next_retained; l != &retained_list; l = l->next) {
+				evt = list_entry(l, struct event_data, ed_retained);
+				if (retained_event_seen(evt)) {
+					skipped++;
+					continue;
+				}
+				evtpkt = recovery_pack_reserve(evt->ed_event.led_head.size);
+				if (evtpkt == NULL) {
+					break;
+				}
+				log_printf(LOGSYS_LEVEL_DEBUG, "Sending next retained event\n");
+				memcpy(evtpkt, &evt->ed_event, evt->ed_event.led_head.size);
+				evtpkt->led_head.id =
+					SERVICE_ID_MAKE(EVT_SERVICE, MESSAGE_REQ_EXEC_EVT_RECOVERY_EVENTDATA);
+				events++;
+			}
+			if (l != &retained_list && recovery_pack->rp_count == 0) {
+			/*
+			 * The pack couldn't grow to hold a single event, so
+			 * retrying would never make progress.
+			 */
+				log_printf(LOGSYS_LEVEL_ERROR,
+					"Can't allocate a recovery pack of %u bytes\n",
+					evt->ed_event.led_head.size);
+				api->error_memory_failure ();
+				return -1;
+			}
+			if (events && recovery_pack_send() != 0) {
 			/*
 			 * Try again later.
 			 */
 				return -1;
 			}
+			recovery_events_sent += events;
+			recovery_events_skipped += skipped;
+			next_retained = l;
 		}
 
 		recovery_phase = evt_send_retained_events_done;
@@ -4308,6 +4798,9 @@ static int evt_sync_process(void)
 		chn_iovec.iov_base = (void *)&cpkt;
 		chn_iovec.iov_len = cpkt.chc_head.size;
 		res = api->totem_mcast (&chn_iovec, 1, TOTEM_AGREED);
+		if (res == 0) {
+			recovery_msgs_sent++;
+		}
 
 		recovery_phase = evt_wait_send_retained_events;
 		return 1;
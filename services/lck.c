@@ -67,6 +67,7 @@
 #include "../include/saAis.h"
 #include "../include/saLck.h"
 #include "../include/ipc_lck.h"
+#include "refcount.h"
 
 LOGSYS_DECLARE_SUBSYS ("LCK");
 
@@ -84,6 +85,8 @@ enum lck_message_req_types {
 	MESSAGE_REQ_EXEC_LCK_SYNC_RESOURCE = 10,
 	MESSAGE_REQ_EXEC_LCK_SYNC_RESOURCE_LOCK = 11,
 	MESSAGE_REQ_EXEC_LCK_SYNC_RESOURCE_REFCOUNT = 12,
+	MESSAGE_REQ_EXEC_LCK_CACHE_RELEASE = 13,
+	MESSAGE_REQ_EXEC_LCK_LOCKSETASYNC = 14,
 };
 
 enum lck_sync_state {
@@ -92,33 +95,51 @@ enum lck_sync_state {
 	LCK_SYNC_STATE_RESOURCE,
 };
 
+/*
+ * Order in which waiting locks of a resource are granted.
+ */
+enum lck_lock_policy {
+	LCK_LOCK_POLICY_READER,
+	LCK_LOCK_POLICY_WRITER,
+	LCK_LOCK_POLICY_FIFO,
+};
+
 enum lck_sync_iteration_state {
 	LCK_SYNC_ITERATION_STATE_RESOURCE,
 	LCK_SYNC_ITERATION_STATE_RESOURCE_LOCK,
 	LCK_SYNC_ITERATION_STATE_RESOURCE_REFCOUNT,
 };
 
-struct refcount_set {
-	unsigned int refcount;
-	unsigned int nodeid;
+/*
+ * Contention seen by this node since it started.  Waits are timed
+ * from the moment a request is queued until it is granted.
+ */
+struct resource_stats {
+	unsigned int waits;
+	unsigned int grants;
+	unsigned long long wait_total;
+	unsigned long long wait_max;
+	unsigned int lockwaiter_callbacks;
 };
 
-typedef struct {
-	unsigned int refcount __attribute__((aligned(8)));
-	unsigned int nodeid __attribute__((aligned(8)));
-} mar_refcount_set_t;
-
 struct resource {
 	mar_name_t resource_name;
 	mar_uint32_t refcount;
-	struct refcount_set refcount_set[PROCESSOR_COUNT_MAX];
+	struct refcount_vector refcount_set;
 	struct resource_lock *ex_lock_granted;
 	struct list_head resource_lock_list_head;
 	struct list_head pr_lock_granted_list_head;
 	struct list_head pr_lock_pending_list_head;
 	struct list_head ex_lock_pending_list_head;
 	struct list_head resource_list;
+	struct list_head hash_list;
 	mar_message_source_t source;
+	unsigned int cache_nodeid;
+	unsigned int cache_revoke;
+	unsigned int cache_release_pending;
+	mar_uint32_t lock_policy;
+	mar_uint32_t lock_sequence;
+	struct resource_stats stats;
 };
 
 struct resource_lock {
@@ -131,33 +152,262 @@ struct resource_lock {
 	mar_invocation_t invocation;
 	mar_uint8_t orphan_flag;
 	mar_time_t timeout;
+	mar_uint32_t lock_sequence;
+	unsigned int deadlock_generation;
+	unsigned long long queue_time;
+	unsigned long long timeout_expire;
+	unsigned int timeout_state;
 	struct resource *resource;
+	struct lck_lock_set *lock_set;
 	struct list_head resource_lock_list;
+	struct list_head hash_list;
+	struct list_head waiter_list;
+	struct list_head timeout_list;
 	struct list_head list;
 	mar_message_source_t response_source;
 	mar_message_source_t callback_source;
-	corosync_timer_handle_t timer_handle;
 };
 
 struct resource_cleanup {
 	mar_name_t resource_name;
 	hdb_handle_t resource_id;
+	void *conn;
 	struct list_head cleanup_list;
+	struct list_head hash_list;
 };
 
 struct resource_instance {
 	mar_message_source_t source;
 };
 
+/*
+ * Requests held back while the node that cached a resource
+ * hands its lock state back to the cluster.
+ */
+struct lck_cache_deferred {
+	struct list_head list;
+	unsigned int nodeid;
+	mar_name_t resource_name;
+	void *message;
+};
+
+/*
+ * A lock set that could not be granted as a whole when it was
+ * requested. Each of its locks is queued on its resource like a
+ * single request, sorted by resource name. resource_handle and
+ * lock_id are those of the first entry the caller gave.
+ */
+struct lck_lock_set {
+	struct list_head list;
+	mar_message_source_t source;
+	mar_message_source_t callback_source;
+	mar_invocation_t invocation;
+	mar_uint32_t lock_flags;
+	mar_uint64_t resource_handle;
+	mar_uint64_t lock_id;
+	unsigned int set_sequence;
+	unsigned int lock_count;
+	struct resource_lock *lock[LCK_MAX_LOCKSET_SIZE];
+};
+
 unsigned int global_lock_count = 0;
 unsigned int sync_lock_count = 0;
 
+/*
+ * Lock requests made by local clients and the totem messages this
+ * node sent for them, reported by lck_exec_dump_fn.
+ */
+static unsigned long long lck_stats_lock_requests = 0;
+static unsigned long long lck_stats_lock_requests_cached = 0;
+static unsigned long long lck_stats_totem_messages = 0;
+
 DECLARE_HDB_DATABASE (resource_hdb, NULL);
 
 DECLARE_LIST_INIT(resource_list_head);
 
 DECLARE_LIST_INIT(sync_resource_list_head);
 
+DECLARE_LIST_INIT(lck_cache_deferred_list_head);
+
+DECLARE_LIST_INIT(lck_lock_set_list_head);
+
+/*
+ * Resources are also hashed by name, locks by resource and lock id
+ * and cleanup entries by connection and resource name, so that
+ * requests are not resolved by scanning the lists above.  Pending
+ * locks are hashed by their owner for deadlock detection.
+ */
+#define LCK_HASH_SIZE 4096
+
+static struct list_head resource_hash[LCK_HASH_SIZE];
+static struct list_head lock_hash[LCK_HASH_SIZE];
+static struct list_head cleanup_hash[LCK_HASH_SIZE];
+static struct list_head waiter_hash[LCK_HASH_SIZE];
+
+static unsigned int deadlock_generation = 0;
+static unsigned int deadlock_cache_nodeid = 0;
+
+static unsigned int lock_set_sequence = 0;
+
+/*
+ * A cache release that totem could not take is sent again from a
+ * timer, so that a full totem queue never stops an exec handler.
+ */
+#define LCK_CACHE_RELEASE_RETRY (10ULL * 1000000ULL)
+
+static corosync_timer_handle_t cache_release_timer_handle = 0;
+
+static struct list_head sync_resource_hash[LCK_HASH_SIZE];
+
+/*
+ * Synchronous lock requests waiting with a timeout are kept on a
+ * timer wheel of LCK_TIMEOUT_TICK slots driven by a single timer.
+ * Every tick the locks that expired are multicast together, at
+ * most LCK_TIMEOUT_BATCH_MAX of them in one message.
+ */
+#define LCK_TIMEOUT_WHEEL_SIZE 512
+#define LCK_TIMEOUT_TICK (10ULL * 1000000ULL)
+#define LCK_TIMEOUT_BATCH_MAX 64
+
+enum lck_timeout_state {
+	LCK_TIMEOUT_NONE = 0,
+	LCK_TIMEOUT_WHEEL = 1,
+	LCK_TIMEOUT_EXPIRED = 2,
+};
+
+static struct list_head timeout_wheel[LCK_TIMEOUT_WHEEL_SIZE];
+static unsigned long long timeout_tick = 0;
+static unsigned int timeout_count = 0;
+static corosync_timer_handle_t timeout_timer_handle = 0;
+
+static void lck_hash_init (
+	struct list_head *hash)
+{
+	int i;
+
+	for (i = 0; i < LCK_HASH_SIZE; i++) {
+		list_init (&hash[i]);
+	}
+}
+
+static void lck_hash_move (
+	struct list_head *hash,
+	struct list_head *sync_hash)
+{
+	int i;
+
+	for (i = 0; i < LCK_HASH_SIZE; i++) {
+		if (!list_empty (&sync_hash[i])) {
+			list_splice (&sync_hash[i], &hash[i]);
+		}
+		list_init (&sync_hash[i]);
+	}
+}
+
+static struct list_head *lck_hash_key (
+	struct list_head *hash,
+	mar_uint64_t value)
+{
+	unsigned int key = (unsigned int)(value ^ (value >> 32)) * 2654435761U;
+
+	return (&hash[(key >> 16) & (LCK_HASH_SIZE - 1)]);
+}
+
+static unsigned int lck_name_key (
+	const mar_name_t *name)
+{
+	unsigned int key = 2166136261U;
+	unsigned int i;
+
+	for (i = 0; i < name->length && i < SA_MAX_NAME_LENGTH; i++) {
+		key = (key ^ name->value[i]) * 16777619U;
+	}
+
+	return (key);
+}
+
+static struct list_head *lck_hash_name (
+	struct list_head *hash,
+	const mar_name_t *name)
+{
+	return (&hash[lck_name_key (name) & (LCK_HASH_SIZE - 1)]);
+}
+
+static struct list_head *lck_hash_lock (
+	const struct resource *resource,
+	mar_uint64_t lock_id)
+{
+	return (lck_hash_key (lock_hash,
+		(mar_uint64_t)(uintptr_t)(resource) ^ lock_id));
+}
+
+static struct list_head *lck_hash_cleanup (
+	const void *conn,
+	const mar_name_t *resource_name)
+{
+	return (lck_hash_key (cleanup_hash,
+		(mar_uint64_t)(uintptr_t)(conn) ^ lck_name_key (resource_name)));
+}
+
+static struct list_head *lck_hash_waiter (
+	const mar_message_source_t *owner)
+{
+	return (lck_hash_key (waiter_hash,
+		((mar_uint64_t)(owner->nodeid) << 32) ^
+		(mar_uint64_t)(uintptr_t)(owner->conn)));
+}
+
+static void lck_waiter_add (
+	struct resource_lock *resource_lock)
+{
+	list_add (&resource_lock->waiter_list,
+		lck_hash_waiter (&resource_lock->callback_source));
+}
+
+static void lck_waiter_del (
+	struct resource_lock *resource_lock)
+{
+	list_del (&resource_lock->waiter_list);
+	list_init (&resource_lock->waiter_list);
+}
+
+/*
+ * Sync replaces every lock, so the pending ones are hashed again
+ * once the new lock state is in place.
+ */
+static void lck_waiter_hash_rebuild (void)
+{
+	struct resource *resource;
+	struct resource_lock *resource_lock;
+	struct list_head *resource_list;
+	struct list_head *list;
+
+	lck_hash_init (waiter_hash);
+
+	for (resource_list = resource_list_head.next;
+	     resource_list != &resource_list_head;
+	     resource_list = resource_list->next)
+	{
+		resource = list_entry (resource_list, struct resource, resource_list);
+
+		for (list = resource->pr_lock_pending_list_head.next;
+		     list != &resource->pr_lock_pending_list_head;
+		     list = list->next)
+		{
+			resource_lock = list_entry (list, struct resource_lock, list);
+			lck_waiter_add (resource_lock);
+		}
+
+		for (list = resource->ex_lock_pending_list_head.next;
+		     list != &resource->ex_lock_pending_list_head;
+		     list = list->next)
+		{
+			resource_lock = list_entry (list, struct resource_lock, list);
+			lck_waiter_add (resource_lock);
+		}
+	}
+}
+
 static struct corosync_api_v1 *api;
 
 static void lck_exec_dump_fn (void);
@@ -218,6 +468,14 @@ static void message_handler_req_exec_lck_sync_resource_refcount (
 	const void *message,
 	unsigned int nodeid);
 
+static void message_handler_req_exec_lck_cache_release (
+	const void *message,
+	unsigned int nodeid);
+
+static void message_handler_req_exec_lck_locksetasync (
+	const void *message,
+	unsigned int nodeid);
+
 static void message_handler_req_lib_lck_resourceopen (
 	void *conn,
 	const void *msg);
@@ -254,6 +512,10 @@ static void message_handler_req_lib_lck_limitget (
 	void *conn,
 	const void *msg);
 
+static void message_handler_req_lib_lck_locksetasync (
+	void *conn,
+	const void *msg);
+
 static void exec_lck_resourceopen_endian_convert (void *msg);
 static void exec_lck_resourceopenasync_endian_convert (void *msg);
 static void exec_lck_resourceclose_endian_convert (void *msg);
@@ -267,6 +529,8 @@ static void exec_lck_resourcelock_timeout_endian_convert (void *msg);
 static void exec_lck_sync_resource_endian_convert (void *msg);
 static void exec_lck_sync_resource_lock_endian_convert (void *msg);
 static void exec_lck_sync_resource_refcount_endian_convert (void *msg);
+static void exec_lck_cache_release_endian_convert (void *msg);
+static void exec_lck_locksetasync_endian_convert (void *msg);
 
 static void lck_sync_init (
 	const unsigned int *member_list,
@@ -276,6 +540,10 @@ static int  lck_sync_process (void);
 static void lck_sync_activate (void);
 static void lck_sync_abort (void);
 
+static struct resource *lck_resource_find (
+	struct list_head *resource_head,
+	const mar_name_t *resource_name);
+
 static enum lck_sync_state lck_sync_state = LCK_SYNC_STATE_NOT_STARTED;
 static enum lck_sync_iteration_state lck_sync_iteration_state;
 
@@ -289,6 +557,15 @@ static void lck_sync_refcount_decrement (
 static void lck_sync_refcount_calculate (
 	struct resource *resource);
 
+static int lck_cache_local (const mar_name_t *resource_name);
+static void lck_cache_deferred_abort (void);
+
+static int lck_lock_set_pending (const struct resource *resource);
+static void lck_lock_set_retry (const struct resource *resource);
+static void lck_lock_set_cancel (struct lck_lock_set *lock_set,
+	struct resource_lock *resource_lock);
+static void lck_lock_set_abort (void);
+
 static unsigned int lck_member_list[PROCESSOR_COUNT_MAX];
 static unsigned int lck_member_list_entries = 0;
 static unsigned int lowest_nodeid = 0;
@@ -345,6 +622,10 @@ struct corosync_lib_handler lck_lib_engine[] =
 		.lib_handler_fn		= message_handler_req_lib_lck_limitget,
 		.flow_control		= COROSYNC_LIB_FLOW_CONTROL_REQUIRED
 	},
+	{
+		.lib_handler_fn		= message_handler_req_lib_lck_locksetasync,
+		.flow_control		= COROSYNC_LIB_FLOW_CONTROL_REQUIRED
+	},
 };
 
 static struct corosync_exec_handler lck_exec_engine[] =
@@ -401,6 +682,14 @@ static struct corosync_exec_handler lck_exec_engine[] =
 		.exec_handler_fn	= message_handler_req_exec_lck_sync_resource_refcount,
 		.exec_endian_convert_fn = exec_lck_sync_resource_refcount_endian_convert
 	},
+	{
+		.exec_handler_fn	= message_handler_req_exec_lck_cache_release,
+		.exec_endian_convert_fn = exec_lck_cache_release_endian_convert
+	},
+	{
+		.exec_handler_fn	= message_handler_req_exec_lck_locksetasync,
+		.exec_endian_convert_fn = exec_lck_locksetasync_endian_convert
+	},
 };
 
 struct corosync_service_engine lck_service_engine = {
@@ -547,19 +836,27 @@ struct req_exec_lck_limitget {
 	mar_uint64_t limit_id __attribute__((aligned(8)));
 };
 
-struct req_exec_lck_resourcelock_timeout {
-	coroipc_request_header_t header __attribute__((aligned(8)));
+struct lck_timeout_entry {
 	mar_name_t resource_name __attribute__((aligned(8)));
 	mar_uint64_t lock_id __attribute__((aligned(8)));
 	mar_message_source_t response_source __attribute__((aligned(8)));
 	mar_message_source_t callback_source __attribute__((aligned(8)));
 };
 
+/*
+ * Followed by timeout_count struct lck_timeout_entry.
+ */
+struct req_exec_lck_resourcelock_timeout {
+	coroipc_request_header_t header __attribute__((aligned(8)));
+	mar_uint32_t timeout_count __attribute__((aligned(8)));
+};
+
 struct req_exec_lck_sync_resource {
 	coroipc_request_header_t header __attribute__((aligned(8)));
 	struct memb_ring_id ring_id __attribute__((aligned(8)));
 	mar_name_t resource_name __attribute__((aligned(8)));
 	mar_message_source_t source __attribute__((aligned(8)));
+	mar_uint32_t lock_policy __attribute__((aligned(8)));
 };
 
 struct req_exec_lck_sync_resource_lock {
@@ -583,7 +880,38 @@ struct req_exec_lck_sync_resource_refcount {
 	coroipc_request_header_t header __attribute__((aligned(8)));
 	struct memb_ring_id ring_id __attribute__((aligned(8)));
 	mar_name_t resource_name __attribute__((aligned(8)));
-	mar_refcount_set_t refcount_set[PROCESSOR_COUNT_MAX] __attribute__((aligned(8)));
+	mar_uint32_t refcount_set_count __attribute__((aligned(8)));
+	/* followed by refcount_set_count mar_refcount_set_t entries */
+};
+
+struct lck_cache_lock_record {
+	mar_uint64_t lock_id __attribute__((aligned(8)));
+	mar_uint32_t lock_mode __attribute__((aligned(8)));
+	mar_uint32_t lock_flags __attribute__((aligned(8)));
+	mar_uint32_t lock_status __attribute__((aligned(8)));
+	mar_uint64_t waiter_signal __attribute__((aligned(8)));
+	mar_uint64_t resource_handle __attribute__((aligned(8)));
+	mar_invocation_t invocation __attribute__((aligned(8)));
+	mar_uint8_t orphan_flag __attribute__((aligned(8)));
+	mar_message_source_t response_source __attribute__((aligned(8)));
+	mar_message_source_t callback_source __attribute__((aligned(8)));
+};
+
+struct req_exec_lck_cache_release {
+	coroipc_request_header_t header __attribute__((aligned(8)));
+	mar_name_t resource_name __attribute__((aligned(8)));
+	mar_uint32_t lock_count __attribute__((aligned(8)));
+	/* followed by lock_count struct lck_cache_lock_record entries */
+};
+
+struct req_exec_lck_locksetasync {
+	coroipc_request_header_t header __attribute__((aligned(8)));
+	mar_message_source_t source __attribute__((aligned(8)));
+	mar_message_source_t callback_source __attribute__((aligned(8)));
+	mar_invocation_t invocation __attribute__((aligned(8)));
+	mar_uint32_t lock_flags __attribute__((aligned(8)));
+	mar_uint32_t lock_count __attribute__((aligned(8)));
+	/* followed by lock_count struct lck_lockset_entry entries */
 };
 
 static void exec_lck_resourceopen_endian_convert (void *msg)
@@ -722,12 +1050,19 @@ static void exec_lck_resourcelock_timeout_endian_convert (void *msg)
 {
 	struct req_exec_lck_resourcelock_timeout *to_swab =
 		(struct req_exec_lck_resourcelock_timeout *)msg;
+	struct lck_timeout_entry *entry =
+		(struct lck_timeout_entry *)(to_swab + 1);
+	unsigned int i;
 
 	swab_coroipc_request_header_t (&to_swab->header);
-	swab_mar_name_t (&to_swab->resource_name);
-	swab_mar_uint64_t (&to_swab->lock_id);
-	swab_mar_message_source_t (&to_swab->response_source);
-	swab_mar_message_source_t (&to_swab->callback_source);
+	swab_mar_uint32_t (&to_swab->timeout_count);
+
+	for (i = 0; i < to_swab->timeout_count; i++) {
+		swab_mar_name_t (&entry[i].resource_name);
+		swab_mar_uint64_t (&entry[i].lock_id);
+		swab_mar_message_source_t (&entry[i].response_source);
+		swab_mar_message_source_t (&entry[i].callback_source);
+	}
 
 	return;
 }
@@ -756,6 +1091,58 @@ static void exec_lck_sync_resource_refcount_endian_convert (void *msg)
 	return;
 }
 
+static void exec_lck_cache_release_endian_convert (void *msg)
+{
+	struct req_exec_lck_cache_release *to_swab =
+		(struct req_exec_lck_cache_release *)msg;
+	struct lck_cache_lock_record *record =
+		(struct lck_cache_lock_record *)(to_swab + 1);
+	unsigned int i;
+
+	swab_coroipc_request_header_t (&to_swab->header);
+	swab_mar_name_t (&to_swab->resource_name);
+	swab_mar_uint32_t (&to_swab->lock_count);
+
+	for (i = 0; i < to_swab->lock_count; i++) {
+		swab_mar_uint64_t (&record[i].lock_id);
+		swab_mar_uint32_t (&record[i].lock_mode);
+		swab_mar_uint32_t (&record[i].lock_flags);
+		swab_mar_uint32_t (&record[i].lock_status);
+		swab_mar_uint64_t (&record[i].waiter_signal);
+		swab_mar_uint64_t (&record[i].resource_handle);
+		swab_mar_invocation_t (&record[i].invocation);
+		swab_mar_message_source_t (&record[i].response_source);
+		swab_mar_message_source_t (&record[i].callback_source);
+	}
+
+	return;
+}
+
+static void exec_lck_locksetasync_endian_convert (void *msg)
+{
+	struct req_exec_lck_locksetasync *to_swab =
+		(struct req_exec_lck_locksetasync *)msg;
+	struct lck_lockset_entry *entry =
+		(struct lck_lockset_entry *)(to_swab + 1);
+	unsigned int i;
+
+	swab_coroipc_request_header_t (&to_swab->header);
+	swab_mar_message_source_t (&to_swab->source);
+	swab_mar_message_source_t (&to_swab->callback_source);
+	swab_mar_invocation_t (&to_swab->invocation);
+	swab_mar_uint32_t (&to_swab->lock_flags);
+	swab_mar_uint32_t (&to_swab->lock_count);
+
+	for (i = 0; i < to_swab->lock_count; i++) {
+		swab_mar_name_t (&entry[i].resource_name);
+		swab_mar_uint64_t (&entry[i].resource_handle);
+		swab_mar_uint64_t (&entry[i].lock_id);
+		swab_mar_uint32_t (&entry[i].lock_mode);
+	}
+
+	return;
+}
+
 static int lck_find_member_nodeid (
 	unsigned int nodeid)
 {
@@ -773,51 +1160,20 @@ void lck_sync_refcount_increment (
 	struct resource *resource,
 	unsigned int nodeid)
 {
-	unsigned int i;
-
-	for (i = 0; i < PROCESSOR_COUNT_MAX; i++) {
-		if (resource->refcount_set[i].nodeid == 0) {
-			resource->refcount_set[i].nodeid = nodeid;
-			resource->refcount_set[i].refcount = 1;
-			break;
-		}
-		if (resource->refcount_set[i].nodeid == nodeid) {
-			resource->refcount_set[i].refcount += 1;
-			break;
-		}
-	}
+	refcount_vector_increment (&resource->refcount_set, nodeid);
 }
 
 void lck_sync_refcount_decrement (
 	struct resource *resource,
 	unsigned int nodeid)
 {
-	unsigned int i;
-
-	for (i = 0; i < PROCESSOR_COUNT_MAX; i++) {
-		if (resource->refcount_set[i].nodeid == 0) {
-			break;
-		}
-		if (resource->refcount_set[i].nodeid == nodeid) {
-			resource->refcount_set[i].refcount -= 1;
-			break;
-		}
-	}
+	refcount_vector_decrement (&resource->refcount_set, nodeid);
 }
 
 void lck_sync_refcount_calculate (
 	struct resource *resource)
 {
-	unsigned int i;
-
-	resource->refcount = 0;
-
-	for (i = 0; i < PROCESSOR_COUNT_MAX; i++) {
-		if (resource->refcount_set[i].nodeid == 0) {
-			break;
-		}
-		resource->refcount += resource->refcount_set[i].refcount;
-	}
+	resource->refcount = refcount_vector_total (&resource->refcount_set);
 }
 
 static void lck_confchg_fn (
@@ -980,6 +1336,16 @@ static void lck_print_resource_list (
 }
 #endif /* _LCK_DEBUG_ */
 
+static int lck_totem_mcast (
+	const struct iovec *iovec,
+	unsigned int iov_len,
+	unsigned int guarantee)
+{
+	lck_stats_totem_messages += 1;
+
+	return (api->totem_mcast (iovec, iov_len, guarantee));
+}
+
 static void lck_resource_close (
 	const mar_name_t *resource_name,
 	const hdb_handle_t resource_id,
@@ -1008,71 +1374,238 @@ static void lck_resource_close (
 	iovec.iov_base = (void *)&req_exec_lck_resourceclose;
 	iovec.iov_len = sizeof (struct req_exec_lck_resourceclose);
 
-	assert (api->totem_mcast (&iovec, 1, TOTEM_AGREED) == 0);
+	assert (lck_totem_mcast (&iovec, 1, TOTEM_AGREED) == 0);
 }
 
-static void lck_resourcelock_timeout (void *data)
+static void lck_timeout_tick_fn (void *data);
+
+static void lck_timeout_add (
+	struct resource_lock *lock,
+	unsigned long long expire)
 {
-	struct req_exec_lck_resourcelock_timeout req_exec_lck_resourcelock_timeout;
-	struct iovec iovec;
+	unsigned long long tick;
 
-	struct resource_lock *lock = (struct resource_lock *)data;
+	/*
+	 * Round up, so that every lock in a slot the tick walks is due.
+	 */
+	tick = (expire + LCK_TIMEOUT_TICK - 1) / LCK_TIMEOUT_TICK;
 
-	/* DEBUG */
-	log_printf (LOGSYS_LEVEL_DEBUG, "[DEBUG]: lck_resourcelock_timeout { id=%u }\n",
-		    (unsigned int)(lock->lock_id));
+	if (timeout_count == 0) {
+		timeout_tick = api->timer_time_get () / LCK_TIMEOUT_TICK;
+	}
 
-	req_exec_lck_resourcelock_timeout.header.size =
-		sizeof (struct req_exec_lck_resourcelock_timeout);
-	req_exec_lck_resourcelock_timeout.header.id =
-		SERVICE_ID_MAKE (LCK_SERVICE, MESSAGE_REQ_EXEC_LCK_RESOURCELOCK_TIMEOUT);
+	/*
+	 * A lock that is already due goes into the next slot to be
+	 * walked.
+	 */
+	if (tick < timeout_tick) {
+		tick = timeout_tick;
+	}
 
-	memcpy (&req_exec_lck_resourcelock_timeout.resource_name,
-		&lock->resource->resource_name, sizeof (mar_name_t));
-	memcpy (&req_exec_lck_resourcelock_timeout.response_source,
-		&lock->response_source, sizeof (mar_message_source_t));
-	memcpy (&req_exec_lck_resourcelock_timeout.callback_source,
-		&lock->callback_source, sizeof (mar_message_source_t));
+	lock->timeout_expire = expire;
+	lock->timeout_state = LCK_TIMEOUT_WHEEL;
 
-	req_exec_lck_resourcelock_timeout.lock_id = lock->lock_id;
+	list_add_tail (&lock->timeout_list,
+		&timeout_wheel[tick % LCK_TIMEOUT_WHEEL_SIZE]);
 
-	iovec.iov_base = (void *)&req_exec_lck_resourcelock_timeout;
-	iovec.iov_len = sizeof (struct req_exec_lck_resourcelock_timeout);
+	timeout_count += 1;
 
-	assert (api->totem_mcast (&iovec, 1, TOTEM_AGREED) == 0);
+	if (timeout_timer_handle == 0) {
+		api->timer_add_duration (LCK_TIMEOUT_TICK, NULL,
+			lck_timeout_tick_fn, &timeout_timer_handle);
+	}
 }
 
-static inline void lck_sync_resource_lock_timer_stop (void)
+/*
+ * Returns 1 when a synchronous request with a timeout was waiting
+ * on this lock, even if its timeout already expired and is being
+ * multicast.
+ */
+static int lck_timeout_del (
+	struct resource_lock *lock)
 {
-	struct resource *resource;
-	struct list_head *resource_list;
+	unsigned int timeout_state = lock->timeout_state;
 
-	struct resource_lock *resource_lock;
-	struct list_head *resource_lock_list;
+	if (timeout_state == LCK_TIMEOUT_WHEEL) {
+		list_del (&lock->timeout_list);
+		timeout_count -= 1;
+	}
 
-	/* DEBUG */
-	log_printf (LOGSYS_LEVEL_DEBUG, "[DEBUG]: lck_sync_resource_lock_timer_stop\n");
+	lock->timeout_state = LCK_TIMEOUT_NONE;
 
-	for (resource_list = resource_list_head.next;
-	     resource_list != &resource_list_head;
-	     resource_list = resource_list->next)
-	{
-		resource = list_entry (resource_list,
-			struct resource, resource_list);
+	return (timeout_state != LCK_TIMEOUT_NONE);
+}
 
-		for (resource_lock_list = resource->resource_lock_list_head.next;
-		     resource_lock_list != &resource->resource_lock_list_head;
-		     resource_lock_list = resource_lock_list->next)
+static void lck_timeout_entry_set (
+	struct lck_timeout_entry *entry,
+	const struct resource_lock *lock)
+{
+	memcpy (&entry->resource_name,
+		&lock->resource->resource_name, sizeof (mar_name_t));
+	memcpy (&entry->response_source,
+		&lock->response_source, sizeof (mar_message_source_t));
+	memcpy (&entry->callback_source,
+		&lock->callback_source, sizeof (mar_message_source_t));
+
+	entry->lock_id = lock->lock_id;
+}
+
+static void lck_timeout_header_set (
+	struct req_exec_lck_resourcelock_timeout *req_exec_lck_resourcelock_timeout,
+	unsigned int timeout_count)
+{
+	req_exec_lck_resourcelock_timeout->header.size =
+		sizeof (struct req_exec_lck_resourcelock_timeout) +
+		sizeof (struct lck_timeout_entry) * timeout_count;
+	req_exec_lck_resourcelock_timeout->header.id =
+		SERVICE_ID_MAKE (LCK_SERVICE, MESSAGE_REQ_EXEC_LCK_RESOURCELOCK_TIMEOUT);
+
+	req_exec_lck_resourcelock_timeout->timeout_count = timeout_count;
+}
+
+static void lck_timeout_batch_send (
+	struct lck_timeout_entry *entry,
+	unsigned int count)
+{
+	struct req_exec_lck_resourcelock_timeout req_exec_lck_resourcelock_timeout;
+	struct iovec iovec[2];
+
+	if (count == 0) {
+		return;
+	}
+
+	lck_timeout_header_set (&req_exec_lck_resourcelock_timeout, count);
+
+	iovec[0].iov_base = (void *)&req_exec_lck_resourcelock_timeout;
+	iovec[0].iov_len = sizeof (struct req_exec_lck_resourcelock_timeout);
+	iovec[1].iov_base = (void *)entry;
+	iovec[1].iov_len = sizeof (struct lck_timeout_entry) * count;
+
+	assert (lck_totem_mcast (iovec, 2, TOTEM_AGREED) == 0);
+}
+
+static void lck_timeout_expire (
+	struct resource_lock *lock,
+	struct lck_timeout_entry *batch,
+	unsigned int *batch_count)
+{
+	struct {
+		struct req_exec_lck_resourcelock_timeout req;
+		struct lck_timeout_entry entry;
+	} req_exec_lck_resourcelock_timeout;
+
+	/* DEBUG */
+	log_printf (LOGSYS_LEVEL_DEBUG, "[DEBUG]: lck_timeout_expire { id=%u }\n",
+		    (unsigned int)(lock->lock_id));
+
+	list_del (&lock->timeout_list);
+	timeout_count -= 1;
+
+	lock->timeout_state = LCK_TIMEOUT_EXPIRED;
+
+	if (lck_cache_local (&lock->resource->resource_name)) {
+		lck_timeout_header_set (&req_exec_lck_resourcelock_timeout.req, 1);
+		lck_timeout_entry_set (&req_exec_lck_resourcelock_timeout.entry, lock);
+
+		message_handler_req_exec_lck_resourcelock_timeout (
+			&req_exec_lck_resourcelock_timeout, api->totem_nodeid_get ());
+		return;
+	}
+
+	lck_timeout_entry_set (&batch[*batch_count], lock);
+	*batch_count += 1;
+
+	if (*batch_count == LCK_TIMEOUT_BATCH_MAX) {
+		lck_timeout_batch_send (batch, *batch_count);
+		*batch_count = 0;
+	}
+}
+
+static void lck_timeout_tick_fn (void *data)
+{
+	struct lck_timeout_entry batch[LCK_TIMEOUT_BATCH_MAX];
+	unsigned int batch_count = 0;
+	struct resource_lock *lock;
+	struct list_head *timeout_list;
+	struct list_head *timeout_head;
+	unsigned long long now;
+	unsigned long long now_tick;
+	unsigned long long tick;
+	unsigned long long last_tick;
+
+	timeout_timer_handle = 0;
+
+	now = api->timer_time_get ();
+	now_tick = now / LCK_TIMEOUT_TICK;
+
+	/*
+	 * Walk every slot passed since the last tick, but each slot
+	 * only once when the timer ran late by more than a rotation.
+	 */
+	last_tick = now_tick;
+	if (last_tick - timeout_tick >= LCK_TIMEOUT_WHEEL_SIZE) {
+		last_tick = timeout_tick + LCK_TIMEOUT_WHEEL_SIZE - 1;
+	}
+
+	for (tick = timeout_tick; tick <= last_tick; tick++) {
+		timeout_head = &timeout_wheel[tick % LCK_TIMEOUT_WHEEL_SIZE];
+
+		timeout_list = timeout_head->next;
+
+		while (timeout_list != timeout_head) {
+			lock = list_entry (timeout_list,
+				struct resource_lock, timeout_list);
+			timeout_list = timeout_list->next;
+
+			/*
+			 * Locks due in a later rotation stay in the slot.
+			 */
+			if (lock->timeout_expire <= now) {
+				lck_timeout_expire (lock, batch, &batch_count);
+			}
+		}
+	}
+
+	timeout_tick = now_tick + 1;
+
+	lck_timeout_batch_send (batch, batch_count);
+
+	if ((timeout_count != 0) && (timeout_timer_handle == 0)) {
+		api->timer_add_duration (LCK_TIMEOUT_TICK, NULL,
+			lck_timeout_tick_fn, &timeout_timer_handle);
+	}
+}
+
+static inline void lck_sync_resource_lock_timer_stop (void)
+{
+	struct resource *resource;
+	struct list_head *resource_list;
+
+	struct resource_lock *resource_lock;
+	struct list_head *resource_lock_list;
+
+	/* DEBUG */
+	log_printf (LOGSYS_LEVEL_DEBUG, "[DEBUG]: lck_sync_resource_lock_timer_stop\n");
+
+	for (resource_list = resource_list_head.next;
+	     resource_list != &resource_list_head;
+	     resource_list = resource_list->next)
+	{
+		resource = list_entry (resource_list,
+			struct resource, resource_list);
+
+		for (resource_lock_list = resource->resource_lock_list_head.next;
+		     resource_lock_list != &resource->resource_lock_list_head;
+		     resource_lock_list = resource_lock_list->next)
 		{
 			resource_lock = list_entry (resource_lock_list,
 				struct resource_lock, resource_lock_list);
 
-			if (resource_lock->timer_handle != 0)
+			if (resource_lock->timeout_state == LCK_TIMEOUT_WHEEL)
 			{
-				resource_lock->timeout =
-					api->timer_expire_time_get (resource_lock->timer_handle);
+				resource_lock->timeout = resource_lock->timeout_expire;
 
-				api->timer_delete (resource_lock->timer_handle);
+				lck_timeout_del (resource_lock);
 
 				/* DEBUG */
 				log_printf (LOGSYS_LEVEL_DEBUG, "[DEBUG]:\t resource_name = %s\n",
@@ -1111,9 +1644,7 @@ static inline void lck_sync_resource_lock_timer_start (void)
 			if ((resource_lock->timeout != 0) &&
 			    (api->ipc_source_is_local (&resource_lock->response_source)))
 			{
-				api->timer_add_absolute (
-					resource_lock->timeout, (void *)(resource_lock),
-					lck_resourcelock_timeout, &resource_lock->timer_handle);
+				lck_timeout_add (resource_lock, resource_lock->timeout);
 
 				resource_lock->timeout = 0;
 
@@ -1162,11 +1693,15 @@ static inline void lck_sync_resource_free (
 				    (unsigned int)(resource_lock->lock_id));
 
 			list_del (&resource_lock->resource_lock_list);
+			list_del (&resource_lock->hash_list);
+			lck_timeout_del (resource_lock);
 			free (resource_lock);
 
 		}
 
 		list_del (&resource->resource_list);
+		list_del (&resource->hash_list);
+		refcount_vector_free (&resource->refcount_set);
 		free (resource);
 	}
 
@@ -1192,10 +1727,12 @@ static int lck_sync_resource_transmit (
 	memcpy (&req_exec_lck_sync_resource.resource_name,
 		&resource->resource_name, sizeof (mar_name_t));
 
+	req_exec_lck_sync_resource.lock_policy = resource->lock_policy;
+
 	iovec.iov_base = (void *)&req_exec_lck_sync_resource;
 	iovec.iov_len = sizeof (req_exec_lck_sync_resource);
 
-	return (api->totem_mcast (&iovec, 1, TOTEM_AGREED));
+	return (lck_totem_mcast (&iovec, 1, TOTEM_AGREED));
 }
 
 static int lck_sync_resource_lock_transmit (
@@ -1235,21 +1772,24 @@ static int lck_sync_resource_lock_transmit (
 	iovec.iov_base = (void *)&req_exec_lck_sync_resource_lock;
 	iovec.iov_len = sizeof (req_exec_lck_sync_resource_lock);
 
-	return (api->totem_mcast (&iovec, 1, TOTEM_AGREED));
+	return (lck_totem_mcast (&iovec, 1, TOTEM_AGREED));
 }
 
 static int lck_sync_resource_refcount_transmit (
 	struct resource *resource)
 {
 	struct req_exec_lck_sync_resource_refcount req_exec_lck_sync_resource_refcount;
-	struct iovec iovec;
-	unsigned int i;
+	mar_refcount_set_t refcount_set[PROCESSOR_COUNT_MAX];
+	struct iovec iovec[2];
+
+	assert (resource->refcount_set.count <= PROCESSOR_COUNT_MAX);
 
 	memset (&req_exec_lck_sync_resource_refcount, 0,
 		sizeof (struct req_exec_lck_sync_resource_refcount));
 
 	req_exec_lck_sync_resource_refcount.header.size =
-		sizeof (struct req_exec_lck_sync_resource_refcount);
+		sizeof (struct req_exec_lck_sync_resource_refcount) +
+		sizeof (mar_refcount_set_t) * resource->refcount_set.count;
 	req_exec_lck_sync_resource_refcount.header.id =
 		SERVICE_ID_MAKE (LCK_SERVICE, MESSAGE_REQ_EXEC_LCK_SYNC_RESOURCE_REFCOUNT);
 
@@ -1258,17 +1798,33 @@ static int lck_sync_resource_refcount_transmit (
 	memcpy (&req_exec_lck_sync_resource_refcount.resource_name,
 		&resource->resource_name, sizeof (mar_name_t));
 
-	for (i = 0; i < PROCESSOR_COUNT_MAX; i++) {
-		req_exec_lck_sync_resource_refcount.refcount_set[i].refcount =
-			resource->refcount_set[i].refcount;
-		req_exec_lck_sync_resource_refcount.refcount_set[i].nodeid =
-			resource->refcount_set[i].nodeid;
-	}
+	req_exec_lck_sync_resource_refcount.refcount_set_count =
+		resource->refcount_set.count;
+
+	marshall_to_mar_refcount_set_t_all (refcount_set,
+		&resource->refcount_set);
+
+	iovec[0].iov_base = (void *)&req_exec_lck_sync_resource_refcount;
+	iovec[0].iov_len = sizeof (req_exec_lck_sync_resource_refcount);
+	iovec[1].iov_base = (void *)refcount_set;
+	iovec[1].iov_len = sizeof (mar_refcount_set_t) * resource->refcount_set.count;
 
-	iovec.iov_base = (void *)&req_exec_lck_sync_resource_refcount;
-	iovec.iov_len = sizeof (req_exec_lck_sync_resource_refcount);
+	return (lck_totem_mcast (iovec, 2, TOTEM_AGREED));
+}
 
-	return (api->totem_mcast (&iovec, 1, TOTEM_AGREED));
+/*
+ * While a resource is cached only the caching node knows its locks,
+ * so that node sends them.  Otherwise the lowest node sends them.
+ */
+static unsigned int lck_sync_resource_lock_sender (
+	struct resource *resource)
+{
+	if ((resource->cache_nodeid != 0) &&
+	    (lck_find_member_nodeid (resource->cache_nodeid)))
+	{
+		return (resource->cache_nodeid);
+	}
+	return (lowest_nodeid);
 }
 
 static int lck_sync_resource_iterate (void)
@@ -1290,24 +1846,29 @@ static int lck_sync_resource_iterate (void)
 
 		if (lck_sync_iteration_state == LCK_SYNC_ITERATION_STATE_RESOURCE)
 		{
-			result = lck_sync_resource_transmit (resource);
-			if (result != 0) {
-				return (-1);
+			if (lowest_nodeid == api->totem_nodeid_get()) {
+				result = lck_sync_resource_transmit (resource);
+				if (result != 0) {
+					return (-1);
+				}
 			}
 			lck_sync_iteration_state = LCK_SYNC_ITERATION_STATE_RESOURCE_REFCOUNT;
 		}
 
 		if (lck_sync_iteration_state == LCK_SYNC_ITERATION_STATE_RESOURCE_REFCOUNT)
 		{
-			result = lck_sync_resource_refcount_transmit (resource);
-			if (result != 0) {
-				return (-1);
+			if (lowest_nodeid == api->totem_nodeid_get()) {
+				result = lck_sync_resource_refcount_transmit (resource);
+				if (result != 0) {
+					return (-1);
+				}
 			}
 			lck_sync_iteration_resource_lock = resource->resource_lock_list_head.next;
 			lck_sync_iteration_state = LCK_SYNC_ITERATION_STATE_RESOURCE_LOCK;
 		}
 
-		if (lck_sync_iteration_state == LCK_SYNC_ITERATION_STATE_RESOURCE_LOCK)
+		if ((lck_sync_iteration_state == LCK_SYNC_ITERATION_STATE_RESOURCE_LOCK) &&
+		    (lck_sync_resource_lock_sender (resource) == api->totem_nodeid_get()))
 		{
 			for (resource_lock_list = lck_sync_iteration_resource_lock;
 			     resource_lock_list != &resource->resource_lock_list_head;
@@ -1352,8 +1913,20 @@ static void lck_sync_init (
 	/* DEBUG */
 	log_printf (LOGSYS_LEVEL_DEBUG, "[DEBUG]: lck_sync_init\n");
 
+	/*
+	 * Lock sets are not synchronized, so the waiting ones are
+	 * failed and have to be requested again. Their queued locks
+	 * go before the resources are walked.
+	 */
+	lck_lock_set_abort ();
+
 	lck_sync_resource_enter ();
 
+	/*
+	 * Requests waiting for a cache release will not see one now.
+	 */
+	lck_cache_deferred_abort ();
+
 	/*
 	 * Stop timers for pending lock requests.
 	 */
@@ -1382,13 +1955,14 @@ static int lck_sync_process (void)
 		iterate_finish = 1;
 		continue_process = 1;
 
-		if (lowest_nodeid == api->totem_nodeid_get()) {
-			TRACE1 ("transmit resources because lowest member in old configuration.\n");
-
-			iterate_result = lck_sync_resource_iterate ();
-			if (iterate_result != 0) {
-				iterate_finish = 0;
-			}
+		/*
+		 * The lowest member transmits the resources.  Every member
+		 * walks the list since it may have to send the locks of
+		 * the resources it cached.
+		 */
+		iterate_result = lck_sync_resource_iterate ();
+		if (iterate_result != 0) {
+			iterate_finish = 0;
 		}
 
 		if (iterate_finish == 1) {
@@ -1403,17 +1977,49 @@ static int lck_sync_process (void)
 	return (continue_process);
 }
 
+/*
+ * The resources are rebuilt by every sync, keep the contention
+ * counters of the ones that survive it.
+ */
+static void lck_sync_resource_stats_copy (void)
+{
+	struct resource *sync_resource;
+	struct resource *resource;
+	struct list_head *sync_resource_list;
+
+	for (sync_resource_list = sync_resource_list_head.next;
+	     sync_resource_list != &sync_resource_list_head;
+	     sync_resource_list = sync_resource_list->next)
+	{
+		sync_resource = list_entry (sync_resource_list,
+			struct resource, resource_list);
+
+		resource = lck_resource_find (resource_hash,
+			&sync_resource->resource_name);
+		if (resource != NULL) {
+			memcpy (&sync_resource->stats, &resource->stats,
+				sizeof (struct resource_stats));
+		}
+	}
+}
+
 static void lck_sync_activate (void)
 {
 	/* DEBUG */
 	log_printf (LOGSYS_LEVEL_DEBUG, "[DEBUG]: lck_sync_activate\n");
 
+	lck_sync_resource_stats_copy ();
+
 	lck_sync_resource_free (&resource_list_head);
 
 	if (!list_empty (&sync_resource_list_head)) {
 		list_splice (&sync_resource_list_head, &resource_list_head);
 	}
 
+	lck_hash_move (resource_hash, sync_resource_hash);
+
+	lck_waiter_hash_rebuild ();
+
 	list_init (&sync_resource_list_head);
 
 	/*
@@ -1443,19 +2049,66 @@ static void lck_sync_abort (void)
 
 	list_init (&sync_resource_list_head);
 
+	lck_hash_init (sync_resource_hash);
+
+	lck_waiter_hash_rebuild ();
+
 	return;
 }
 
 static void lck_exec_dump_fn (void)
 {
+	struct resource *resource;
+	struct list_head *resource_list;
+	struct resource_stats *stats;
+	unsigned int uncontended = 0;
+
 	/* DEBUG */
 	log_printf (LOGSYS_LEVEL_DEBUG, "[DEBUG]: lck_exec_dump_fn\n");
 
+	log_printf (LOGSYS_LEVEL_NOTICE,
+		"lck: %llu lock requests from local clients, %llu granted from the local cache\n",
+		lck_stats_lock_requests, lck_stats_lock_requests_cached);
+	log_printf (LOGSYS_LEVEL_NOTICE,
+		"lck: %llu totem messages sent, %.2f per lock request\n",
+		lck_stats_totem_messages,
+		(lck_stats_lock_requests != 0) ?
+			(double)(lck_stats_totem_messages) / lck_stats_lock_requests : 0.0);
+	log_printf (LOGSYS_LEVEL_NOTICE,
+		"lck: %u locks, contended resources:\n", global_lock_count);
+
+	for (resource_list = resource_list_head.next;
+	     resource_list != &resource_list_head;
+	     resource_list = resource_list->next)
+	{
+		resource = list_entry (resource_list, struct resource, resource_list);
+		stats = &resource->stats;
+
+		if ((stats->waits == 0) && (stats->lockwaiter_callbacks == 0)) {
+			uncontended += 1;
+			continue;
+		}
+
+		log_printf (LOGSYS_LEVEL_NOTICE,
+			"lck: %s waits=%u granted=%u wait_avg=%llu us wait_max=%llu us lockwaiter_callbacks=%u\n",
+			(char *)(resource->resource_name.value),
+			stats->waits, stats->grants,
+			(stats->grants != 0) ?
+				(stats->wait_total / stats->grants) / 1000ULL : 0ULL,
+			stats->wait_max / 1000ULL,
+			stats->lockwaiter_callbacks);
+	}
+
+	log_printf (LOGSYS_LEVEL_NOTICE,
+		"lck: %u resources without contention\n", uncontended);
+
 	return;
 }
 
 static int lck_exec_init_fn (struct corosync_api_v1 *corosync_api)
 {
+	unsigned int i;
+
 #ifdef OPENAIS_SOLARIS
 	logsys_subsys_init();
 #endif
@@ -1465,6 +2118,17 @@ static int lck_exec_init_fn (struct corosync_api_v1 *corosync_api)
 
 	api = corosync_api;
 
+	lck_hash_init (resource_hash);
+	lck_hash_init (lock_hash);
+	lck_hash_init (cleanup_hash);
+	lck_hash_init (waiter_hash);
+
+	lck_hash_init (sync_resource_hash);
+
+	for (i = 0; i < LCK_TIMEOUT_WHEEL_SIZE; i++) {
+		list_init (&timeout_wheel[i]);
+	}
+
 	return (0);
 }
 
@@ -1507,6 +2171,7 @@ static int lck_lib_exit_fn (void *conn)
 			&source);
 
 		list_del (&cleanup->cleanup_list);
+		list_del (&cleanup->hash_list);
 		free (cleanup);
 	}
 
@@ -1548,11 +2213,13 @@ static struct resource *lck_resource_find (
 	struct resource *resource;
 	struct list_head *resource_list;
 
+	resource_head = lck_hash_name (resource_head, resource_name);
+
 	for (resource_list = resource_head->next;
 	     resource_list != resource_head;
 	     resource_list = resource_list->next)
 	{
-		resource = list_entry (resource_list, struct resource, resource_list);
+		resource = list_entry (resource_list, struct resource, hash_list);
 
 		if (mar_name_match (resource_name, &resource->resource_name)) {
 			return (resource);
@@ -1568,14 +2235,18 @@ static struct resource_lock *lck_resource_lock_find (
 {
 	struct resource_lock *resource_lock;
 	struct list_head *resource_lock_list;
+	struct list_head *lock_head;
 
-	for (resource_lock_list = resource->resource_lock_list_head.next;
-	     resource_lock_list != &resource->resource_lock_list_head;
+	lock_head = lck_hash_lock (resource, lock_id);
+
+	for (resource_lock_list = lock_head->next;
+	     resource_lock_list != lock_head;
 	     resource_lock_list = resource_lock_list->next)
 	{
-		resource_lock = list_entry (resource_lock_list, struct resource_lock, resource_lock_list);
+		resource_lock = list_entry (resource_lock_list, struct resource_lock, hash_list);
 
-		if ((memcmp (&resource_lock->callback_source, source,
+		if ((resource_lock->resource == resource) &&
+		    (memcmp (&resource_lock->callback_source, source,
 			    sizeof (mar_message_source_t)) == 0) &&
 		    (lock_id == resource_lock->lock_id))
 		{
@@ -1585,22 +2256,59 @@ static struct resource_lock *lck_resource_lock_find (
 	return (0);
 }
 
+/*
+ * Determine the list that this lock should be added to
+ */
+static void lck_resource_lock_list_add (
+	struct resource *resource,
+	struct resource_lock *resource_lock)
+{
+	resource_lock->lock_sequence = resource->lock_sequence++;
+
+	/*
+	 * Requests that were refused are only kept until they are
+	 * unlocked and are not in any of the lock lists.
+	 */
+	if ((resource_lock->lock_status == SA_LCK_LOCK_NOT_QUEUED) ||
+	    (resource_lock->lock_status == SA_LCK_LOCK_DEADLOCK)) {
+		return;
+	}
+
+	if (resource_lock->lock_mode == SA_LCK_PR_LOCK_MODE) {
+		if (resource_lock->lock_status == SA_LCK_LOCK_GRANTED) {
+			list_add_tail (&resource_lock->list, &resource->pr_lock_granted_list_head);
+		} else {
+			list_add_tail (&resource_lock->list, &resource->pr_lock_pending_list_head);
+		}
+	}
+
+	if (resource_lock->lock_mode == SA_LCK_EX_LOCK_MODE) {
+		if (resource_lock->lock_status == SA_LCK_LOCK_GRANTED) {
+			resource->ex_lock_granted = resource_lock;
+		} else {
+			list_add_tail (&resource_lock->list, &resource->ex_lock_pending_list_head);
+		}
+	}
+}
+
 static struct resource_cleanup *lck_resource_cleanup_find (
 	void *conn,
 	const mar_name_t *resource_name)
 {
-	struct lck_pd *lck_pd = (struct lck_pd *)api->ipc_private_data_get (conn);
-
 	struct resource_cleanup *cleanup;
 	struct list_head *cleanup_list;
+	struct list_head *cleanup_head;
+
+	cleanup_head = lck_hash_cleanup (conn, resource_name);
 
-	for (cleanup_list = lck_pd->resource_cleanup_list.next;
-	     cleanup_list != &lck_pd->resource_cleanup_list;
+	for (cleanup_list = cleanup_head->next;
+	     cleanup_list != cleanup_head;
 	     cleanup_list = cleanup_list->next)
 	{
-		cleanup = list_entry (cleanup_list, struct resource_cleanup, cleanup_list);
+		cleanup = list_entry (cleanup_list, struct resource_cleanup, hash_list);
 
-		if (mar_name_match (resource_name, &cleanup->resource_name)) {
+		if ((cleanup->conn == conn) &&
+		    (mar_name_match (resource_name, &cleanup->resource_name))) {
 			return (cleanup);
 		}
 	}
@@ -1645,6 +2353,8 @@ static void lck_lockwaiter_callback_send (
 	if ((api->ipc_source_is_local (&grant_lock->callback_source)) &&
 	    (grant_lock->orphan_flag == 0))
 	{
+		grant_lock->resource->stats.lockwaiter_callbacks += 1;
+
 		res_lib_lck_lockwaiter_callback.header.size =
 			sizeof (struct res_lib_lck_lockwaiter_callback);
 		res_lib_lck_lockwaiter_callback.header.id =
@@ -1736,281 +2446,1460 @@ static void lck_grant_lock (
 	}
 }
 
-static void lck_queue_lock (
-	struct resource *resource,
-	struct resource_lock *resource_lock)
+static int lck_lock_older (
+	const struct resource_lock *lock,
+	const struct resource_lock *other)
 {
-	if (resource_lock->lock_flags & SA_LCK_LOCK_NO_QUEUE) {
-		resource_lock->lock_status = SA_LCK_LOCK_NOT_QUEUED;
-	}
-	else {
-		if (lck_resource_orphan_check (resource)) {
-			resource_lock->lock_status = SA_LCK_LOCK_ORPHANED;
-		}
-		if (resource_lock->lock_mode == SA_LCK_PR_LOCK_MODE) {
-			list_add_tail (&resource_lock->list,
-				&resource->pr_lock_pending_list_head);
+	return ((int)(lock->lock_sequence - other->lock_sequence) < 0);
+}
 
-			global_lock_count += 1;
+static int lck_deadlock_lock_waits (
+	const struct resource_lock *resource_lock,
+	const mar_message_source_t *requester);
 
-			lck_lockwaiter_callback_send (
-				resource_lock,
-				resource->ex_lock_granted);
+/*
+ * True when one of the pending requests of owner waits, directly
+ * or through other owners, for a lock held or requested ahead of
+ * it by the requester.
+ */
+static int lck_deadlock_owner_waits (
+	const mar_message_source_t *owner,
+	const mar_message_source_t *requester)
+{
+	struct resource_lock *resource_lock;
+	struct list_head *waiter_head;
+	struct list_head *list;
+
+	waiter_head = lck_hash_waiter (owner);
+
+	for (list = waiter_head->next; list != waiter_head; list = list->next) {
+		resource_lock = list_entry (list, struct resource_lock, waiter_list);
+
+		if ((memcmp (&resource_lock->callback_source, owner,
+			     sizeof (mar_message_source_t)) != 0) ||
+		    (resource_lock->deadlock_generation == deadlock_generation))
+		{
+			continue;
 		}
-		else if (resource_lock->lock_mode == SA_LCK_EX_LOCK_MODE) {
-			list_add_tail (&resource_lock->list,
-				&resource->ex_lock_pending_list_head);
 
-			global_lock_count += 1;
+		/*
+		 * Only the caching node has the current locks of a cached
+		 * resource, the other nodes hold a frozen copy. A search
+		 * that runs on every node must not look into any cached
+		 * resource, or the nodes could reach different verdicts.
+		 * A search run by the caching node alone, for a request
+		 * on a resource it caches, may look into the resources
+		 * it caches itself.
+		 */
+		if ((resource_lock->resource->cache_nodeid != 0) &&
+		    (resource_lock->resource->cache_nodeid != deadlock_cache_nodeid))
+		{
+			continue;
+		}
 
-			if (resource->ex_lock_granted != NULL) {
-				lck_lockwaiter_callback_send (
-					resource_lock,
-					resource->ex_lock_granted);
-			}
-			else {
-				lck_lockwaiter_callback_list_send (
-					resource_lock,
-					&resource->pr_lock_granted_list_head);
-			}
+		resource_lock->deadlock_generation = deadlock_generation;
+
+		if (lck_deadlock_lock_waits (resource_lock, requester)) {
+			return (1);
 		}
 	}
+	return (0);
 }
 
-static void lck_lock (
-	struct resource *resource,
-	struct resource_lock *lock)
+static int lck_deadlock_blocker (
+	const struct resource_lock *resource_lock,
+	const struct resource_lock *blocker,
+	const mar_message_source_t *requester)
 {
-	lock->lock_status = 0;
+	/*
+	 * Locks of the same owner do not wait for each other, since
+	 * the owner may be using several threads.
+	 */
+	if ((blocker == resource_lock) ||
+	    (memcmp (&blocker->callback_source, &resource_lock->callback_source,
+		     sizeof (mar_message_source_t)) == 0))
+	{
+		return (0);
+	}
 
-	if (resource->ex_lock_granted != NULL) {
-		/*
-		 * Exclusive lock is granted on this resource.
-		 * Add this lock request to the pending lock list.
-		 */
-		lck_queue_lock (resource, lock);
+	if (memcmp (&blocker->callback_source, requester,
+		    sizeof (mar_message_source_t)) == 0)
+	{
+		return (1);
 	}
-	else {
-		/*
-		 * Exclusive lock is not granted on this resource.
-		 */
-		if (lock->lock_mode == SA_LCK_EX_LOCK_MODE) {
-			if (list_empty (&resource->pr_lock_granted_list_head) == 0) {
-				/*
-				 * This lock request is for an exclusive lock and
-				 * shared locks are granted on this resource.
-				 * Add this lock request to the pending lock list.
-				 */
-				lck_queue_lock (resource, lock);
-			}
-			else {
-				/*
-				 * This lock request is for an exclusive lock and
+
+	return (lck_deadlock_owner_waits (&blocker->callback_source, requester));
+}
+
+/*
+ * A waiting request waits for the conflicting granted locks and
+ * for the conflicting requests that will be granted before it.
+ */
+static int lck_deadlock_lock_waits (
+	const struct resource_lock *resource_lock,
+	const mar_message_source_t *requester)
+{
+	struct resource *resource = resource_lock->resource;
+	struct resource_lock *blocker;
+	struct list_head *list;
+
+	if ((resource->ex_lock_granted != NULL) &&
+	    (lck_deadlock_blocker (resource_lock, resource->ex_lock_granted,
+		requester)))
+	{
+		return (1);
+	}
+
+	if (resource_lock->lock_mode == SA_LCK_EX_LOCK_MODE) {
+		for (list = resource->pr_lock_granted_list_head.next;
+		     list != &resource->pr_lock_granted_list_head;
+		     list = list->next)
+		{
+			blocker = list_entry (list, struct resource_lock, list);
+
+			if (lck_deadlock_blocker (resource_lock, blocker, requester)) {
+				return (1);
+			}
+		}
+	}
+
+	for (list = resource->ex_lock_pending_list_head.next;
+	     list != &resource->ex_lock_pending_list_head;
+	     list = list->next)
+	{
+		blocker = list_entry (list, struct resource_lock, list);
+
+		if (lck_lock_older (blocker, resource_lock) == 0) {
+			break;
+		}
+		if (lck_deadlock_blocker (resource_lock, blocker, requester)) {
+			return (1);
+		}
+	}
+
+	if ((resource_lock->lock_mode == SA_LCK_EX_LOCK_MODE) &&
+	    (resource->lock_policy == LCK_LOCK_POLICY_FIFO))
+	{
+		for (list = resource->pr_lock_pending_list_head.next;
+		     list != &resource->pr_lock_pending_list_head;
+		     list = list->next)
+		{
+			blocker = list_entry (list, struct resource_lock, list);
+
+			if (lck_lock_older (blocker, resource_lock) == 0) {
+				break;
+			}
+			if (lck_deadlock_blocker (resource_lock, blocker, requester)) {
+				return (1);
+			}
+		}
+	}
+
+	return (0);
+}
+
+/*
+ * Called before a request is queued. Owners are the library
+ * connections the locks belong to, and a cycle can only appear
+ * through the request being queued, so the search starts there.
+ * Requests that are granted right away never get here.
+ */
+static int lck_deadlock_detect (
+	struct resource_lock *resource_lock)
+{
+	deadlock_generation += 1;
+	deadlock_cache_nodeid = resource_lock->resource->cache_nodeid;
+
+	resource_lock->deadlock_generation = deadlock_generation;
+
+	return (lck_deadlock_lock_waits (resource_lock,
+		&resource_lock->callback_source));
+}
+
+/*
+ * Put a request on the pending list of its resource.
+ */
+static void lck_queue_lock_pending (
+	struct resource *resource,
+	struct resource_lock *resource_lock)
+{
+	lck_waiter_add (resource_lock);
+
+	resource_lock->queue_time = api->timer_time_get ();
+	resource->stats.waits += 1;
+
+	if (resource_lock->lock_mode == SA_LCK_PR_LOCK_MODE) {
+		list_add_tail (&resource_lock->list,
+			&resource->pr_lock_pending_list_head);
+
+		global_lock_count += 1;
+
+		/*
+		 * A shared lock can also wait behind a pending
+		 * exclusive lock, in which case nobody holds a
+		 * conflicting lock.
+		 */
+		if (resource->ex_lock_granted != NULL) {
+			lck_lockwaiter_callback_send (
+				resource_lock,
+				resource->ex_lock_granted);
+		}
+	}
+	else if (resource_lock->lock_mode == SA_LCK_EX_LOCK_MODE) {
+		list_add_tail (&resource_lock->list,
+			&resource->ex_lock_pending_list_head);
+
+		global_lock_count += 1;
+
+		if (resource->ex_lock_granted != NULL) {
+			lck_lockwaiter_callback_send (
+				resource_lock,
+				resource->ex_lock_granted);
+		}
+		else {
+			lck_lockwaiter_callback_list_send (
+				resource_lock,
+				&resource->pr_lock_granted_list_head);
+		}
+	}
+}
+
+static void lck_queue_lock (
+	struct resource *resource,
+	struct resource_lock *resource_lock)
+{
+	if (resource_lock->lock_flags & SA_LCK_LOCK_NO_QUEUE) {
+		resource_lock->lock_status = SA_LCK_LOCK_NOT_QUEUED;
+	}
+	else if (lck_deadlock_detect (resource_lock)) {
+		/*
+		 * Queueing this request would close a cycle of owners
+		 * waiting for each other. It is the youngest request
+		 * in that cycle, so it is the one that fails.
+		 */
+		resource_lock->lock_status = SA_LCK_LOCK_DEADLOCK;
+	}
+	else {
+		if (lck_resource_orphan_check (resource)) {
+			resource_lock->lock_status = SA_LCK_LOCK_ORPHANED;
+		}
+
+		lck_queue_lock_pending (resource, resource_lock);
+	}
+}
+
+/*
+ * True when a shared lock request must wait for the exclusive
+ * lock requests already pending on the resource.
+ */
+static int lck_lock_pr_blocked (
+	struct resource *resource)
+{
+	return ((resource->lock_policy != LCK_LOCK_POLICY_READER) &&
+		(list_empty (&resource->ex_lock_pending_list_head) == 0));
+}
+
+/*
+ * True when an exclusive lock request on a resource nobody holds
+ * must still wait. That only happens while a lock set holds its
+ * place in the queue for resources it is still waiting for.
+ */
+static int lck_lock_ex_blocked (
+	struct resource *resource)
+{
+	return ((list_empty (&resource->ex_lock_pending_list_head) == 0) ||
+		((resource->lock_policy == LCK_LOCK_POLICY_FIFO) &&
+		 (list_empty (&resource->pr_lock_pending_list_head) == 0)));
+}
+
+static void lck_lock_granted (
+	struct resource_lock *lock)
+{
+	struct resource_stats *stats = &lock->resource->stats;
+	unsigned long long wait;
+
+	lck_waiter_del (lock);
+
+	/*
+	 * Locks queued before the last configuration change were
+	 * rebuilt by sync and carry no queue time.
+	 */
+	if (lock->queue_time != 0) {
+		wait = api->timer_time_get () - lock->queue_time;
+
+		stats->grants += 1;
+		stats->wait_total += wait;
+		if (wait > stats->wait_max) {
+			stats->wait_max = wait;
+		}
+		lock->queue_time = 0;
+	}
+
+	lock->lock_status = SA_LCK_LOCK_GRANTED;
+}
+
+static void lck_lock_granted_send (
+	struct resource_lock *lock)
+{
+	lck_lock_granted (lock);
+
+	if (lck_timeout_del (lock)) {
+		lck_resourcelock_response_send (lock, SA_AIS_OK);
+	}
+	else {
+		lck_lockgrant_callback_send (lock, SA_AIS_OK);
+	}
+}
+
+static void lck_lock (
+	struct resource *resource,
+	struct resource_lock *lock)
+{
+	lock->lock_status = 0;
+	lock->lock_sequence = resource->lock_sequence++;
+
+	if (resource->ex_lock_granted != NULL) {
+		/*
+		 * Exclusive lock is granted on this resource.
+		 * Add this lock request to the pending lock list.
+		 */
+		lck_queue_lock (resource, lock);
+	}
+	else {
+		/*
+		 * Exclusive lock is not granted on this resource.
+		 */
+		if (lock->lock_mode == SA_LCK_EX_LOCK_MODE) {
+			if (list_empty (&resource->pr_lock_granted_list_head) == 0) {
+				/*
+				 * This lock request is for an exclusive lock and
+				 * shared locks are granted on this resource.
+				 * Add this lock request to the pending lock list.
+				 */
+				lck_queue_lock (resource, lock);
+			}
+			else if (lck_lock_ex_blocked (resource)) {
+				/*
+				 * This lock request is for an exclusive lock and
+				 * a lock set waiting for other resources keeps
+				 * its place ahead of it.
+				 * Add this lock request to the pending lock list.
+				 */
+				lck_queue_lock (resource, lock);
+			}
+			else {
+				/*
+				 * This lock request is for an exclusive lock and
 				 * no locks are currently granted on this resource.
 				 * Acquire an exclusive lock on the resource.
 				 */
 				lck_grant_lock (resource, lock);
 			}
 		}
-		else {
-			/*
-			 * This lock request is for a shared lock.
-			 * Acquire a shared lock on the resource.
-			 */
-			lck_grant_lock (resource, lock);
+		else if (lck_lock_pr_blocked (resource)) {
+			/*
+			 * This lock request is for a shared lock and the
+			 * policy of this resource lets the pending exclusive
+			 * lock requests go first.
+			 * Add this lock request to the pending lock list.
+			 */
+			lck_queue_lock (resource, lock);
+		}
+		else {
+			/*
+			 * This lock request is for a shared lock.
+			 * Acquire a shared lock on the resource.
+			 */
+			lck_grant_lock (resource, lock);
+		}
+	}
+}
+
+/*
+ * Grant the pending requests that nothing held or queued ahead of
+ * them blocks any more, after a lock left the resource.
+ */
+static void lck_grant_pending (
+	struct resource *resource)
+{
+	struct resource_lock *lock;
+	struct resource_lock *ex_lock = NULL;
+	struct list_head *list;
+
+	if ((resource->ex_lock_granted == NULL) &&
+	    (list_empty (&resource->pr_lock_granted_list_head)))
+	{
+		/*
+		 * There is no exclusive lock being held for this resource
+		 * and there are no granted shared locks.
+		 * Check if there are any pending exclusive lock requests.
+		 */
+		if (list_empty (&resource->ex_lock_pending_list_head) == 0) {
+			/*
+			 * There are pending exclusive lock requests.
+			 * Grant the first request on the list, unless the
+			 * resource is strictly FIFO and an older shared lock
+			 * request is waiting.
+			 */
+			lock = list_entry (
+				resource->ex_lock_pending_list_head.next,
+				struct resource_lock, list);
+
+			/*
+			 * A lock of a lock set is granted with the rest of
+			 * its set, below, and keeps its place until then.
+			 */
+			if ((lock->lock_set == NULL) &&
+			    ((resource->lock_policy != LCK_LOCK_POLICY_FIFO) ||
+			     (list_empty (&resource->pr_lock_pending_list_head)) ||
+			     (lck_lock_older (lock, list_entry (
+				resource->pr_lock_pending_list_head.next,
+				struct resource_lock, list)))))
+			{
+				list_del (&lock->list);
+
+				resource->ex_lock_granted = lock;
+
+				lck_lock_granted_send (lock);
+			}
+		}
+	}
+
+	if (resource->ex_lock_granted == NULL) {
+		/*
+		 * There is no exclusive lock being held on this resource.
+		 * Grant the pending shared lock requests, except for those
+		 * that the policy of this resource puts behind a pending
+		 * exclusive lock request.
+		 */
+		if (list_empty (&resource->ex_lock_pending_list_head) == 0) {
+			ex_lock = list_entry (
+				resource->ex_lock_pending_list_head.next,
+				struct resource_lock, list);
+		}
+
+		list = resource->pr_lock_pending_list_head.next;
+
+		while (list != &resource->pr_lock_pending_list_head) {
+			lock = list_entry (list, struct resource_lock, list);
+			list = list->next;
+
+			if ((ex_lock != NULL) &&
+			    (resource->lock_policy != LCK_LOCK_POLICY_READER) &&
+			    ((resource->lock_policy == LCK_LOCK_POLICY_WRITER) ||
+			     (lck_lock_older (lock, ex_lock) == 0)))
+			{
+				break;
+			}
+
+			if (lock->lock_set != NULL) {
+				continue;
+			}
+
+			/*
+			 * Move pending shared lock to granted list.
+			 */
+			list_del (&lock->list);
+			list_add_tail (&lock->list,
+				&resource->pr_lock_granted_list_head);
+
+			lck_lock_granted_send (lock);
+		}
+	}
+
+	/*
+	 * Lock sets waiting on this resource may now be granted.
+	 */
+	lck_lock_set_retry (resource);
+}
+
+static void lck_unlock (
+	struct resource *resource,
+	struct resource_lock *resource_lock)
+{
+	/*
+	 * Unlocking one lock of a waiting lock set gives up the
+	 * whole set.
+	 */
+	if (resource_lock->lock_set != NULL) {
+		lck_lock_set_cancel (resource_lock->lock_set, resource_lock);
+	}
+
+	if (resource_lock == resource->ex_lock_granted) {
+		/*
+		 * We are unlocking the exclusive lock.
+		 * Reset the exclusive lock and continue.
+		 */
+		resource->ex_lock_granted = NULL;
+	}
+	else {
+		/*
+		 * We are not unlocking the exclusive lock, therefore
+		 * this lock must be in one of the lock lists.
+		 * Remove the lock from the list.
+		 */
+		list_del (&resource_lock->list);
+
+		/*
+		 * If we are unlocking a lock that was queued, we must
+		 * send a response/callback to the library.
+		 */
+		if (resource_lock->lock_status == 0) {
+			if (lck_timeout_del (resource_lock)) {
+				lck_resourcelock_response_send (resource_lock, SA_AIS_OK);
+			}
+		}
+	}
+
+	/*
+	 * All locks are in the resource_lock_list.
+	 * Remove the lock from the list.
+	 */
+	list_del (&resource_lock->resource_lock_list);
+	list_del (&resource_lock->hash_list);
+	lck_waiter_del (resource_lock);
+
+	lck_grant_pending (resource);
+}
+
+static void lck_purge (
+	struct resource *resource)
+{
+	struct resource_lock *resource_lock;
+	struct list_head *resource_lock_list;
+
+	/* DEBUG */
+	log_printf (LOGSYS_LEVEL_DEBUG, "[DEBUG]: lck_purge { name=%s }\n",
+		    (char *)(resource->resource_name.value));
+
+	resource_lock_list = resource->resource_lock_list_head.next;
+
+	while (resource_lock_list != &resource->resource_lock_list_head)
+	{
+		resource_lock = list_entry (resource_lock_list, struct resource_lock, resource_lock_list);
+		resource_lock_list = resource_lock_list->next;
+
+		if (resource_lock->orphan_flag == 1) {
+			lck_unlock (resource, resource_lock);
+			global_lock_count -= 1;
+			free (resource_lock);
+		}
+	}
+	return;
+}
+
+static void lck_resourcelock_release (
+	struct resource *resource,
+	const unsigned int exit_flag,
+	const mar_message_source_t *source)
+{
+	struct resource_lock *resource_lock;
+	struct list_head *resource_lock_list;
+
+	/* DEBUG */
+	log_printf (LOGSYS_LEVEL_DEBUG, "[DEBUG]: lck_resourcelock_release { name=%s } [%u]\n",
+		    (char *)(resource->resource_name.value),
+		    (unsigned int)(exit_flag));
+
+	resource_lock_list = resource->resource_lock_list_head.next;
+
+	while (resource_lock_list != &resource->resource_lock_list_head)
+	{
+		resource_lock = list_entry (resource_lock_list, struct resource_lock, resource_lock_list);
+		resource_lock_list = resource_lock_list->next;
+
+		if (memcmp (&resource_lock->callback_source,
+			    source, sizeof (mar_message_source_t)) == 0)
+		{
+			/*
+			 * This is a hack to prevent lck_unlock from sending
+			 * a callback (or response) to the library.
+			 */
+			if (exit_flag) {
+				memset (&resource_lock->response_source, 0, sizeof (mar_message_source_t));
+				memset (&resource_lock->callback_source, 0, sizeof (mar_message_source_t));
+			}
+
+			if (resource_lock->lock_status == SA_LCK_LOCK_GRANTED) {
+				if (resource_lock->lock_flags & SA_LCK_LOCK_ORPHAN) {
+					resource_lock->orphan_flag = 1;
+				}
+				else {
+					lck_unlock (resource, resource_lock);
+					global_lock_count -= 1;
+					free (resource_lock);
+				}
+			}
+			else {
+				lck_unlock (resource, resource_lock);
+				global_lock_count -= 1;
+				free (resource_lock);
+			}
+		}
+	}
+	return;
+}
+
+static mar_uint32_t lck_lock_policy_get (
+	mar_uint32_t open_flags)
+{
+	if (open_flags & SA_LCK_RESOURCE_FIFO) {
+		return (LCK_LOCK_POLICY_FIFO);
+	}
+	if (open_flags & SA_LCK_RESOURCE_WRITER_PREFERENCE) {
+		return (LCK_LOCK_POLICY_WRITER);
+	}
+	return (LCK_LOCK_POLICY_READER);
+}
+
+static int lck_cache_local (
+	const mar_name_t *resource_name)
+{
+	struct resource *resource;
+
+	resource = lck_resource_find (resource_hash, resource_name);
+
+	return ((resource != NULL) &&
+		(resource->cache_nodeid == api->totem_nodeid_get()) &&
+		(resource->cache_revoke == 0));
+}
+
+/*
+ * A resource is cached by a node when that node is the only one
+ * that has it open and all of its locks belong to that node.
+ * From then on lock requests from the caching node are handled
+ * there without going through totem.
+ */
+static void lck_cache_acquire (
+	struct resource *resource,
+	unsigned int nodeid)
+{
+	struct resource_lock *resource_lock;
+	struct list_head *resource_lock_list;
+
+	if ((resource->cache_nodeid != 0) ||
+	    (resource->refcount_set.count != 1) ||
+	    (resource->refcount_set.set[0].nodeid != nodeid) ||
+	    (lck_lock_set_pending (resource)))
+	{
+		return;
+	}
+
+	for (resource_lock_list = resource->resource_lock_list_head.next;
+	     resource_lock_list != &resource->resource_lock_list_head;
+	     resource_lock_list = resource_lock_list->next)
+	{
+		resource_lock = list_entry (resource_lock_list,
+			struct resource_lock, resource_lock_list);
+
+		if (resource_lock->callback_source.nodeid != nodeid) {
+			return;
+		}
+	}
+
+	resource->cache_nodeid = nodeid;
+
+	/* DEBUG */
+	log_printf (LOGSYS_LEVEL_DEBUG, "[DEBUG]: lck_cache_acquire { name=%s nodeid=%x }\n",
+		    (char *)(resource->resource_name.value), nodeid);
+}
+
+static int lck_cache_release_send (
+	struct resource *resource)
+{
+	struct req_exec_lck_cache_release req_exec_lck_cache_release;
+	struct lck_cache_lock_record *record = NULL;
+	struct resource_lock *resource_lock;
+	struct list_head *resource_lock_list;
+	struct iovec iovec[2];
+	unsigned int lock_count = 0;
+	int result;
+
+	/* DEBUG */
+	log_printf (LOGSYS_LEVEL_DEBUG, "[DEBUG]: lck_cache_release_send { name=%s }\n",
+		    (char *)(resource->resource_name.value));
+
+	for (resource_lock_list = resource->resource_lock_list_head.next;
+	     resource_lock_list != &resource->resource_lock_list_head;
+	     resource_lock_list = resource_lock_list->next)
+	{
+		lock_count += 1;
+	}
+
+	if (lock_count != 0) {
+		record = malloc (sizeof (struct lck_cache_lock_record) * lock_count);
+		if (record == NULL) {
+			api->error_memory_failure ();
+		}
+		memset (record, 0, sizeof (struct lck_cache_lock_record) * lock_count);
+	}
+
+	lock_count = 0;
+
+	for (resource_lock_list = resource->resource_lock_list_head.next;
+	     resource_lock_list != &resource->resource_lock_list_head;
+	     resource_lock_list = resource_lock_list->next)
+	{
+		resource_lock = list_entry (resource_lock_list,
+			struct resource_lock, resource_lock_list);
+
+		record[lock_count].lock_id = resource_lock->lock_id;
+		record[lock_count].lock_mode = resource_lock->lock_mode;
+		record[lock_count].lock_flags = resource_lock->lock_flags;
+		record[lock_count].lock_status = resource_lock->lock_status;
+		record[lock_count].waiter_signal = resource_lock->waiter_signal;
+		record[lock_count].resource_handle = resource_lock->resource_handle;
+		record[lock_count].invocation = resource_lock->invocation;
+		record[lock_count].orphan_flag = resource_lock->orphan_flag;
+
+		memcpy (&record[lock_count].response_source,
+			&resource_lock->response_source, sizeof (mar_message_source_t));
+		memcpy (&record[lock_count].callback_source,
+			&resource_lock->callback_source, sizeof (mar_message_source_t));
+
+		lock_count += 1;
+	}
+
+	memset (&req_exec_lck_cache_release, 0,
+		sizeof (struct req_exec_lck_cache_release));
+
+	req_exec_lck_cache_release.header.size =
+		sizeof (struct req_exec_lck_cache_release) +
+		sizeof (struct lck_cache_lock_record) * lock_count;
+	req_exec_lck_cache_release.header.id =
+		SERVICE_ID_MAKE (LCK_SERVICE, MESSAGE_REQ_EXEC_LCK_CACHE_RELEASE);
+
+	memcpy (&req_exec_lck_cache_release.resource_name,
+		&resource->resource_name, sizeof (mar_name_t));
+
+	req_exec_lck_cache_release.lock_count = lock_count;
+
+	iovec[0].iov_base = (void *)&req_exec_lck_cache_release;
+	iovec[0].iov_len = sizeof (struct req_exec_lck_cache_release);
+	iovec[1].iov_base = (void *)record;
+	iovec[1].iov_len = sizeof (struct lck_cache_lock_record) * lock_count;
+
+	result = lck_totem_mcast (iovec, 2, TOTEM_AGREED);
+
+	free (record);
+
+	return (result);
+}
+
+static void lck_cache_release_retry_fn (void *data)
+{
+	struct resource *resource;
+	struct list_head *resource_list;
+
+	cache_release_timer_handle = 0;
+
+	/*
+	 * The locks are collected again, which is fine since requests
+	 * on a resource being revoked are held back until the release.
+	 */
+	for (resource_list = resource_list_head.next;
+	     resource_list != &resource_list_head;
+	     resource_list = resource_list->next)
+	{
+		resource = list_entry (resource_list,
+			struct resource, resource_list);
+
+		if (resource->cache_release_pending == 0) {
+			continue;
+		}
+		if (lck_cache_release_send (resource) != 0) {
+			api->timer_add_duration (LCK_CACHE_RELEASE_RETRY, NULL,
+				lck_cache_release_retry_fn, &cache_release_timer_handle);
+			return;
+		}
+		resource->cache_release_pending = 0;
+	}
+}
+
+static void lck_cache_revoke (
+	struct resource *resource)
+{
+	if (resource->cache_revoke == 0) {
+		resource->cache_revoke = 1;
+
+		if ((resource->cache_nodeid == api->totem_nodeid_get()) &&
+		    (lck_cache_release_send (resource) != 0))
+		{
+			resource->cache_release_pending = 1;
+
+			if (cache_release_timer_handle == 0) {
+				api->timer_add_duration (LCK_CACHE_RELEASE_RETRY, NULL,
+					lck_cache_release_retry_fn, &cache_release_timer_handle);
+			}
+		}
+	}
+}
+
+static void lck_cache_deferred_add (
+	struct resource *resource,
+	const void *message,
+	unsigned int nodeid)
+{
+	const coroipc_request_header_t *header = message;
+	struct lck_cache_deferred *deferred;
+
+	deferred = malloc (sizeof (struct lck_cache_deferred));
+	if (deferred == NULL) {
+		api->error_memory_failure ();
+	}
+	deferred->message = malloc (header->size);
+	if (deferred->message == NULL) {
+		api->error_memory_failure ();
+	}
+	memcpy (deferred->message, message, header->size);
+	memcpy (&deferred->resource_name, &resource->resource_name,
+		sizeof (mar_name_t));
+
+	deferred->nodeid = nodeid;
+
+	list_init (&deferred->list);
+	list_add_tail (&deferred->list, &lck_cache_deferred_list_head);
+}
+
+/*
+ * Called by the exec handlers that change the locks of a resource.
+ * Returns 1 when the request must not be processed now.
+ */
+static int lck_cache_defer (
+	struct resource *resource,
+	const void *message,
+	unsigned int nodeid)
+{
+	const coroipc_request_header_t *header = message;
+
+	if (resource->cache_nodeid == 0) {
+		return (0);
+	}
+
+	if ((nodeid == resource->cache_nodeid) &&
+	    (resource->cache_revoke == 0) &&
+	    ((header->id & 0xffff) != MESSAGE_REQ_EXEC_LCK_RESOURCECLOSE))
+	{
+		/*
+		 * Only the caching node has the current locks of this
+		 * resource. The other nodes ignore the request and get
+		 * the result when the cache is released.
+		 */
+		return (resource->cache_nodeid != api->totem_nodeid_get());
+	}
+
+	/*
+	 * Another node wants the resource (or the caching node is
+	 * closing it). Hold the request back until the caching node
+	 * has sent its locks to everyone.
+	 */
+	lck_cache_revoke (resource);
+
+	lck_cache_deferred_add (resource, message, nodeid);
+
+	return (1);
+}
+
+static void lck_cache_deferred_replay (
+	const mar_name_t *resource_name)
+{
+	struct lck_cache_deferred *deferred;
+	struct list_head *deferred_list;
+	struct list_head replay_list_head;
+	const coroipc_request_header_t *header;
+
+	list_init (&replay_list_head);
+
+	deferred_list = lck_cache_deferred_list_head.next;
+
+	while (deferred_list != &lck_cache_deferred_list_head) {
+		deferred = list_entry (deferred_list,
+			struct lck_cache_deferred, list);
+		deferred_list = deferred_list->next;
+
+		if (mar_name_match (resource_name, &deferred->resource_name)) {
+			list_del (&deferred->list);
+			list_add_tail (&deferred->list, &replay_list_head);
+		}
+	}
+
+	/*
+	 * A replayed request can cache the resource again, in which
+	 * case the requests after it are deferred once more, in order.
+	 */
+	while (!list_empty (&replay_list_head)) {
+		deferred = list_entry (replay_list_head.next,
+			struct lck_cache_deferred, list);
+		list_del (&deferred->list);
+
+		header = deferred->message;
+
+		lck_exec_engine[header->id & 0xffff].exec_handler_fn (
+			deferred->message, deferred->nodeid);
+
+		free (deferred->message);
+		free (deferred);
+	}
+}
+
+/*
+ * Process a held back request right away, without deferring it again.
+ */
+static void lck_cache_deferred_bypass (
+	struct lck_cache_deferred *deferred)
+{
+	const coroipc_request_header_t *header = deferred->message;
+	struct resource *resource;
+	unsigned int cache_nodeid = 0;
+
+	resource = lck_resource_find (resource_hash,
+		&deferred->resource_name);
+	if (resource != NULL) {
+		cache_nodeid = resource->cache_nodeid;
+		resource->cache_nodeid = 0;
+	}
+
+	lck_exec_engine[header->id & 0xffff].exec_handler_fn (
+		deferred->message, deferred->nodeid);
+
+	resource = lck_resource_find (resource_hash,
+		&deferred->resource_name);
+	if (resource != NULL) {
+		resource->cache_nodeid = cache_nodeid;
+	}
+}
+
+static void lck_cache_deferred_abort (void)
+{
+	const coroipc_request_header_t *header;
+	const mar_message_source_t *source;
+	const struct req_exec_lck_resourceclose *req_exec_lck_resourceclose;
+	const struct req_exec_lck_resourcelock_timeout *req_exec_lck_resourcelock_timeout;
+	const struct lck_timeout_entry *timeout_entry;
+	struct lck_cache_deferred *deferred;
+	union {
+		coroipc_response_header_t header;
+		struct res_lib_lck_resourceclose resourceclose;
+		struct res_lib_lck_resourcelock resourcelock;
+		struct res_lib_lck_resourcelockasync resourcelockasync;
+		struct res_lib_lck_resourceunlock resourceunlock;
+		struct res_lib_lck_resourceunlockasync resourceunlockasync;
+		struct res_lib_lck_lockpurge lockpurge;
+		struct res_lib_lck_locksetasync locksetasync;
+	} res_lib;
+
+	while (!list_empty (&lck_cache_deferred_list_head)) {
+		deferred = list_entry (lck_cache_deferred_list_head.next,
+			struct lck_cache_deferred, list);
+		list_del (&deferred->list);
+
+		header = deferred->message;
+		source = NULL;
+
+		memset (&res_lib, 0, sizeof (res_lib));
+
+		switch (header->id & 0xffff) {
+		case MESSAGE_REQ_EXEC_LCK_RESOURCECLOSE:
+			req_exec_lck_resourceclose = deferred->message;
+
+			if (req_exec_lck_resourceclose->exit_flag == 0) {
+				source = &req_exec_lck_resourceclose->source;
+				res_lib.header.size = sizeof (struct res_lib_lck_resourceclose);
+				res_lib.header.id = MESSAGE_RES_LCK_RESOURCECLOSE;
+				break;
+			}
+
+			/*
+			 * The library is gone, so the close cannot be retried.
+			 * Process it now, against the state that sync replaces.
+			 */
+			lck_cache_deferred_bypass (deferred);
+			break;
+		case MESSAGE_REQ_EXEC_LCK_RESOURCELOCK:
+			source = &((const struct req_exec_lck_resourcelock *)
+				deferred->message)->source;
+			res_lib.header.size = sizeof (struct res_lib_lck_resourcelock);
+			res_lib.header.id = MESSAGE_RES_LCK_RESOURCELOCK;
+			break;
+		case MESSAGE_REQ_EXEC_LCK_RESOURCELOCKASYNC:
+			source = &((const struct req_exec_lck_resourcelockasync *)
+				deferred->message)->source;
+			res_lib.header.size = sizeof (struct res_lib_lck_resourcelockasync);
+			res_lib.header.id = MESSAGE_RES_LCK_RESOURCELOCKASYNC;
+			break;
+		case MESSAGE_REQ_EXEC_LCK_RESOURCEUNLOCK:
+			source = &((const struct req_exec_lck_resourceunlock *)
+				deferred->message)->source;
+			res_lib.header.size = sizeof (struct res_lib_lck_resourceunlock);
+			res_lib.header.id = MESSAGE_RES_LCK_RESOURCEUNLOCK;
+			break;
+		case MESSAGE_REQ_EXEC_LCK_RESOURCEUNLOCKASYNC:
+			source = &((const struct req_exec_lck_resourceunlockasync *)
+				deferred->message)->source;
+			res_lib.header.size = sizeof (struct res_lib_lck_resourceunlockasync);
+			res_lib.header.id = MESSAGE_RES_LCK_RESOURCEUNLOCKASYNC;
+			break;
+		case MESSAGE_REQ_EXEC_LCK_LOCKPURGE:
+			source = &((const struct req_exec_lck_lockpurge *)
+				deferred->message)->source;
+			res_lib.header.size = sizeof (struct res_lib_lck_lockpurge);
+			res_lib.header.id = MESSAGE_RES_LCK_LOCKPURGE;
+			break;
+		case MESSAGE_REQ_EXEC_LCK_LOCKSETASYNC:
+			source = &((const struct req_exec_lck_locksetasync *)
+				deferred->message)->source;
+			res_lib.header.size = sizeof (struct res_lib_lck_locksetasync);
+			res_lib.header.id = MESSAGE_RES_LCK_LOCKSETASYNC;
+			break;
+		case MESSAGE_REQ_EXEC_LCK_RESOURCELOCK_TIMEOUT:
+			req_exec_lck_resourcelock_timeout = deferred->message;
+			timeout_entry = (const struct lck_timeout_entry *)
+				(req_exec_lck_resourcelock_timeout + 1);
+
+			/*
+			 * The timed out lock is only known to the caching
+			 * node, which is also the one sending it during sync.
+			 * Deferred timeouts carry a single lock.
+			 */
+			if (api->ipc_source_is_local (
+				&timeout_entry->response_source))
+			{
+				lck_cache_deferred_bypass (deferred);
+			}
+			break;
+		default:
+			break;
+		}
+
+		if ((source != NULL) && (api->ipc_source_is_local (source))) {
+			res_lib.header.error = SA_AIS_ERR_TRY_AGAIN;
+
+			api->ipc_response_send (source->conn,
+				&res_lib, res_lib.header.size);
+		}
+
+		free (deferred->message);
+		free (deferred);
+	}
+}
+
+/*
+ * Lock set entries are kept in a canonical order, by resource name,
+ * so every node walks the resources of a set the same way.
+ */
+static int lck_lock_set_compare (
+	const void *a,
+	const void *b)
+{
+	const struct lck_lockset_entry *entry_a = a;
+	const struct lck_lockset_entry *entry_b = b;
+	unsigned int length;
+	int result;
+
+	length = entry_a->resource_name.length;
+	if (length > entry_b->resource_name.length) {
+		length = entry_b->resource_name.length;
+	}
+
+	result = memcmp (entry_a->resource_name.value,
+		entry_b->resource_name.value, length);
+	if (result != 0) {
+		return (result);
+	}
+
+	return ((int)(entry_a->resource_name.length) -
+		(int)(entry_b->resource_name.length));
+}
+
+static int lck_lock_set_member (
+	const struct lck_lock_set *lock_set,
+	const struct resource *resource)
+{
+	unsigned int i;
+
+	for (i = 0; i < lock_set->lock_count; i++) {
+		if (lock_set->lock[i]->resource == resource) {
+			return (1);
+		}
+	}
+	return (0);
+}
+
+static int lck_lock_set_pending (
+	const struct resource *resource)
+{
+	struct lck_lock_set *lock_set;
+	struct list_head *lock_set_list;
+
+	for (lock_set_list = lck_lock_set_list_head.next;
+	     lock_set_list != &lck_lock_set_list_head;
+	     lock_set_list = lock_set_list->next)
+	{
+		lock_set = list_entry (lock_set_list, struct lck_lock_set, list);
+
+		if (lck_lock_set_member (lock_set, resource)) {
+			return (1);
+		}
+	}
+	return (0);
+}
+
+/*
+ * A new lock set is granted at once only when every one of its
+ * locks would be granted at once as a single request.
+ */
+static int lck_lock_set_grantable (
+	const struct lck_lock_set *lock_set)
+{
+	struct resource *resource;
+	unsigned int i;
+
+	for (i = 0; i < lock_set->lock_count; i++) {
+		resource = lock_set->lock[i]->resource;
+
+		if (resource->ex_lock_granted != NULL) {
+			return (0);
+		}
+
+		if ((lock_set->lock[i]->lock_mode == SA_LCK_EX_LOCK_MODE) &&
+		    ((list_empty (&resource->pr_lock_granted_list_head) == 0) ||
+		     (lck_lock_ex_blocked (resource)))) {
+			return (0);
+		}
+
+		if ((lock_set->lock[i]->lock_mode == SA_LCK_PR_LOCK_MODE) &&
+		    (lck_lock_pr_blocked (resource))) {
+			return (0);
+		}
+	}
+	return (1);
+}
+
+/*
+ * True when a queued lock of a lock set has reached the head of
+ * its resource, that is when lck_grant_pending would grant it if
+ * it were a single request. Locks of younger lock sets are not
+ * counted, so that two sets that wait for each other under the
+ * writer policy cannot both hold their place forever. The oldest
+ * set always goes first.
+ */
+static int lck_lock_set_lock_ready (
+	const struct lck_lock_set *lock_set,
+	const struct resource_lock *resource_lock)
+{
+	struct resource *resource = resource_lock->resource;
+	struct resource_lock *lock;
+	struct list_head *list;
+
+	if (resource->ex_lock_granted != NULL) {
+		return (0);
+	}
+
+	if (resource_lock->lock_mode == SA_LCK_EX_LOCK_MODE) {
+		if ((list_empty (&resource->pr_lock_granted_list_head) == 0) ||
+		    (resource->ex_lock_pending_list_head.next !=
+		     &resource_lock->list))
+		{
+			return (0);
+		}
+
+		if ((resource->lock_policy == LCK_LOCK_POLICY_FIFO) &&
+		    (list_empty (&resource->pr_lock_pending_list_head) == 0) &&
+		    (lck_lock_older (list_entry (
+			resource->pr_lock_pending_list_head.next,
+			struct resource_lock, list), resource_lock)))
+		{
+			return (0);
+		}
+		return (1);
+	}
+
+	if (resource->lock_policy == LCK_LOCK_POLICY_READER) {
+		return (1);
+	}
+
+	for (list = resource->ex_lock_pending_list_head.next;
+	     list != &resource->ex_lock_pending_list_head;
+	     list = list->next)
+	{
+		lock = list_entry (list, struct resource_lock, list);
+
+		if ((lock->lock_set != NULL) &&
+		    ((int)(lock->lock_set->set_sequence -
+			   lock_set->set_sequence) > 0))
+		{
+			continue;
+		}
+
+		if ((resource->lock_policy == LCK_LOCK_POLICY_WRITER) ||
+		    (lck_lock_older (lock, resource_lock)))
+		{
+			return (0);
 		}
 	}
+	return (1);
 }
 
-static void lck_unlock (
-	struct resource *resource,
-	struct resource_lock *resource_lock)
+static int lck_lock_set_ready (
+	const struct lck_lock_set *lock_set)
+{
+	unsigned int i;
+
+	for (i = 0; i < lock_set->lock_count; i++) {
+		if (lck_lock_set_lock_ready (lock_set, lock_set->lock[i]) == 0) {
+			return (0);
+		}
+	}
+	return (1);
+}
+
+static void lck_lock_set_link (
+	struct lck_lock_set *lock_set)
 {
 	struct resource_lock *lock;
-	struct list_head *list;
+	unsigned int i;
 
-	if (resource_lock == resource->ex_lock_granted) {
-		/*
-		 * We are unlocking the exclusive lock.
-		 * Reset the exclusive lock and continue.
-		 */
-		resource->ex_lock_granted = NULL;
+	for (i = 0; i < lock_set->lock_count; i++) {
+		lock = lock_set->lock[i];
+
+		list_add_tail (&lock->resource_lock_list,
+			&lock->resource->resource_lock_list_head);
+		list_add (&lock->hash_list,
+			lck_hash_lock (lock->resource, lock->lock_id));
 	}
-	else {
-		/*
-		 * We are not unlocking the exclusive lock, therefore
-		 * this lock must be in one of the lock lists.
-		 * Remove the lock from the list.
-		 */
-		list_del (&resource_lock->list);
+}
 
-		/*
-		 * If we are unlocking a lock that was queued, we must
-		 * send a response/callback to the library.
-		 */
-		if (resource_lock->lock_status == 0) {
-			if (resource_lock->timer_handle != 0) {
-				api->timer_delete (resource_lock->timer_handle);
-				lck_resourcelock_response_send (resource_lock, SA_AIS_OK);
-			}
+/*
+ * Take the locks of a queued lock set off their resources,
+ * except for skip, which the caller releases itself.
+ */
+static void lck_lock_set_unlink (
+	struct lck_lock_set *lock_set,
+	const struct resource_lock *skip)
+{
+	struct resource_lock *lock;
+	unsigned int i;
+
+	for (i = 0; i < lock_set->lock_count; i++) {
+		lock = lock_set->lock[i];
+
+		if (lock == skip) {
+			lock->lock_set = NULL;
+			continue;
 		}
+
+		list_del (&lock->list);
+		list_del (&lock->resource_lock_list);
+		list_del (&lock->hash_list);
+		lck_waiter_del (lock);
+
+		global_lock_count -= 1;
+		free (lock);
 	}
+}
 
-	/*
-	 * All locks are in the resource_lock_list.
-	 * Remove the lock from the list.
-	 */
-	list_del (&resource_lock->resource_lock_list);
+static void lck_lock_set_free (
+	struct lck_lock_set *lock_set,
+	unsigned int lock_count)
+{
+	unsigned int i;
 
-	if ((resource->ex_lock_granted == NULL) &&
-	    (list_empty (&resource->pr_lock_granted_list_head)))
+	for (i = 0; i < lock_count; i++) {
+		free (lock_set->lock[i]);
+	}
+	free (lock_set);
+}
+
+/*
+ * One grant callback is sent for the whole set. It carries the
+ * resource handle and lock id of the first entry the caller gave,
+ * which the library uses to check that the set is still wanted.
+ */
+static void lck_lock_set_callback_send (
+	const struct lck_lock_set *lock_set,
+	mar_uint32_t lock_status,
+	SaAisErrorT error)
+{
+	struct res_lib_lck_lockgrant_callback res_lib_lck_lockgrant_callback;
+
+	if (api->ipc_source_is_local (&lock_set->callback_source))
 	{
-		/*
-		 * There is no exclusive lock being held for this resource
-		 * and there are no granted shared locks.
-		 * Check if there are any pending exclusive lock requests.
-		 */
-		if (list_empty (&resource->ex_lock_pending_list_head) == 0) {
-			/*
-			 * There are pending exclusive lock requests.
-			 * Grant the first request on the list.
-			 */
-			lock = list_entry (
-				resource->ex_lock_pending_list_head.next,
-				struct resource_lock, list);
+		res_lib_lck_lockgrant_callback.header.size =
+			sizeof (struct res_lib_lck_lockgrant_callback);
+		res_lib_lck_lockgrant_callback.header.id =
+			MESSAGE_RES_LCK_LOCKGRANT_CALLBACK;
+		res_lib_lck_lockgrant_callback.header.error = error;
 
-			list_del (&lock->list);
+		res_lib_lck_lockgrant_callback.resource_handle =
+			lock_set->resource_handle;
+		res_lib_lck_lockgrant_callback.lock_id =
+			lock_set->lock_id;
+		res_lib_lck_lockgrant_callback.invocation =
+			lock_set->invocation;
+		res_lib_lck_lockgrant_callback.lock_status = lock_status;
+
+		api->ipc_dispatch_send (
+			lock_set->callback_source.conn,
+			&res_lib_lck_lockgrant_callback,
+			sizeof (struct res_lib_lck_lockgrant_callback));
+	}
+}
 
-			resource->ex_lock_granted = lock;
+/*
+ * Grant every lock of a new lock set at once.
+ */
+static void lck_lock_set_grant (
+	struct lck_lock_set *lock_set)
+{
+	unsigned int i;
 
-			lock->lock_status = SA_LCK_LOCK_GRANTED;
+	lck_lock_set_link (lock_set);
 
-			if (lock->timer_handle != 0) {
-				api->timer_delete (lock->timer_handle);
-				lck_resourcelock_response_send (lock, SA_AIS_OK);
-			}
-			else {
-				lck_lockgrant_callback_send (lock, SA_AIS_OK);
-			}
+	for (i = 0; i < lock_set->lock_count; i++) {
+		lck_grant_lock (lock_set->lock[i]->resource, lock_set->lock[i]);
+	}
+}
+
+/*
+ * Queue every lock of a new lock set on its resource, where it
+ * holds its place like a single request until the whole set can
+ * be granted.
+ */
+static void lck_lock_set_queue (
+	struct lck_lock_set *lock_set)
+{
+	struct resource_lock *lock;
+	unsigned int i;
+
+	lock_set->set_sequence = lock_set_sequence++;
+
+	lck_lock_set_link (lock_set);
+
+	for (i = 0; i < lock_set->lock_count; i++) {
+		lock = lock_set->lock[i];
+
+		lock->lock_set = lock_set;
+		lck_queue_lock_pending (lock->resource, lock);
+	}
+
+	list_init (&lock_set->list);
+	list_add_tail (&lock_set->list, &lck_lock_set_list_head);
+}
+
+/*
+ * Move the queued locks of a lock set to the granted locks of
+ * their resources.
+ */
+static void lck_lock_set_granted (
+	struct lck_lock_set *lock_set)
+{
+	struct resource_lock *lock;
+	unsigned int i;
+
+	list_del (&lock_set->list);
+
+	for (i = 0; i < lock_set->lock_count; i++) {
+		lock = lock_set->lock[i];
+
+		list_del (&lock->list);
+
+		if (lock->lock_mode == SA_LCK_EX_LOCK_MODE) {
+			lock->resource->ex_lock_granted = lock;
+		}
+		else {
+			list_add_tail (&lock->list,
+				&lock->resource->pr_lock_granted_list_head);
 		}
+
+		lock->lock_set = NULL;
+		lck_lock_granted (lock);
 	}
 
-	if (resource->ex_lock_granted == NULL) {
-		/*
-		 * There is no exclusive lock being held on this resource.
-		 * Check if there are any pending shared lock requests.
-		 */
-		if (list_empty (&resource->pr_lock_pending_list_head) == 0) {
-			/*
-			 * There are pending shared lock requests.
-			 * Grant all of requests in the list.
-			 */
-			for (list = resource->pr_lock_pending_list_head.next;
-			     list != &resource->pr_lock_pending_list_head;
-			     list = list->next)
-			{
-				lock = list_entry (list, struct resource_lock, list);
-				lock->lock_status = SA_LCK_LOCK_GRANTED;
+	lck_lock_set_callback_send (lock_set, SA_LCK_LOCK_GRANTED, SA_AIS_OK);
+	lck_lock_set_free (lock_set, 0);
+}
 
-				if (lock->timer_handle != 0) {
-					api->timer_delete (lock->timer_handle);
-					lck_resourcelock_response_send (lock, SA_AIS_OK);
-				}
-				else {
-					lck_lockgrant_callback_send (lock, SA_AIS_OK);
-				}
-			}
+/*
+ * Grant the waiting lock sets with a lock on this resource whose
+ * locks have all reached the head of their resources, oldest
+ * set first.
+ */
+static void lck_lock_set_retry (
+	const struct resource *resource)
+{
+	struct lck_lock_set *lock_set;
+	struct list_head *lock_set_list;
 
-			/*
-			 * Move pending shared locks to granted list.
-			 */
-			list_splice (&resource->pr_lock_pending_list_head,
-				&resource->pr_lock_granted_list_head);
+	lock_set_list = lck_lock_set_list_head.next;
+
+	while (lock_set_list != &lck_lock_set_list_head) {
+		lock_set = list_entry (lock_set_list, struct lck_lock_set, list);
+		lock_set_list = lock_set_list->next;
 
-			list_init (&resource->pr_lock_pending_list_head);
+		if ((lck_lock_set_member (lock_set, resource) == 0) ||
+		    (lck_lock_set_ready (lock_set) == 0)) {
+			continue;
 		}
+
+		lck_lock_set_granted (lock_set);
 	}
 }
 
-static void lck_purge (
-	struct resource *resource)
+/*
+ * Give up a waiting lock set because one of its locks, resource_lock,
+ * is being released. The caller releases that lock, the others are
+ * dropped here and their resources may grant what queued behind them.
+ */
+static void lck_lock_set_cancel (
+	struct lck_lock_set *lock_set,
+	struct resource_lock *resource_lock)
 {
-	struct resource_lock *resource_lock;
-	struct list_head *resource_lock_list;
+	struct resource *resource[LCK_MAX_LOCKSET_SIZE];
+	unsigned int lock_count = lock_set->lock_count;
+	unsigned int i;
 
-	/* DEBUG */
-	log_printf (LOGSYS_LEVEL_DEBUG, "[DEBUG]: lck_purge { name=%s }\n",
-		    (char *)(resource->resource_name.value));
+	list_del (&lock_set->list);
 
-	resource_lock_list = resource->resource_lock_list_head.next;
+	for (i = 0; i < lock_count; i++) {
+		resource[i] = lock_set->lock[i]->resource;
+	}
 
-	while (resource_lock_list != &resource->resource_lock_list_head)
-	{
-		resource_lock = list_entry (resource_lock_list, struct resource_lock, resource_lock_list);
-		resource_lock_list = resource_lock_list->next;
+	lck_lock_set_unlink (lock_set, resource_lock);
+	lck_lock_set_free (lock_set, 0);
 
-		if (resource_lock->orphan_flag == 1) {
-			lck_unlock (resource, resource_lock);
-			global_lock_count -= 1;
-			free (resource_lock);
+	for (i = 0; i < lock_count; i++) {
+		if (resource[i] != resource_lock->resource) {
+			lck_grant_pending (resource[i]);
 		}
 	}
-	return;
 }
 
-static void lck_resourcelock_release (
-	struct resource *resource,
-	const unsigned int exit_flag,
-	const mar_message_source_t *source)
+static void lck_lock_set_abort (void)
 {
-	struct resource_lock *resource_lock;
-	struct list_head *resource_lock_list;
+	struct resource *resource[LCK_MAX_LOCKSET_SIZE];
+	struct lck_lock_set *lock_set;
+	unsigned int lock_count;
+	unsigned int i;
 
-	/* DEBUG */
-	log_printf (LOGSYS_LEVEL_DEBUG, "[DEBUG]: lck_resourcelock_release { name=%s } [%u]\n",
-		    (char *)(resource->resource_name.value),
-		    (unsigned int)(exit_flag));
+	while (!list_empty (&lck_lock_set_list_head)) {
+		lock_set = list_entry (lck_lock_set_list_head.next,
+			struct lck_lock_set, list);
+		list_del (&lock_set->list);
 
-	resource_lock_list = resource->resource_lock_list_head.next;
+		lock_count = lock_set->lock_count;
 
-	while (resource_lock_list != &resource->resource_lock_list_head)
-	{
-		resource_lock = list_entry (resource_lock_list, struct resource_lock, resource_lock_list);
-		resource_lock_list = resource_lock_list->next;
+		for (i = 0; i < lock_count; i++) {
+			resource[i] = lock_set->lock[i]->resource;
+		}
 
-		if (memcmp (&resource_lock->callback_source,
-			    source, sizeof (mar_message_source_t)) == 0)
-		{
-			/*
-			 * This is a hack to prevent lck_unlock from sending
-			 * a callback (or response) to the library.
-			 */
-			if (exit_flag) {
-				memset (&resource_lock->response_source, 0, sizeof (mar_message_source_t));
-				memset (&resource_lock->callback_source, 0, sizeof (mar_message_source_t));
-			}
+		lck_lock_set_unlink (lock_set, NULL);
+		lck_lock_set_callback_send (lock_set, 0, SA_AIS_ERR_TRY_AGAIN);
+		lck_lock_set_free (lock_set, 0);
 
-			if (resource_lock->lock_status == SA_LCK_LOCK_GRANTED) {
-				if (resource_lock->lock_flags & SA_LCK_LOCK_ORPHAN) {
-					resource_lock->orphan_flag = 1;
-				}
-				else {
-					lck_unlock (resource, resource_lock);
-					global_lock_count -= 1;
-					free (resource_lock);
-				}
-			}
-			else {
-/* 				if (resource_lock->timer_handle != 0) { */
-/* 					api->timer_delete (resource_lock->timer_handle); */
-/* 				} */
-				lck_unlock (resource, resource_lock);
-				global_lock_count -= 1;
-				free (resource_lock);
-			}
+		for (i = 0; i < lock_count; i++) {
+			lck_grant_pending (resource[i]);
 		}
 	}
-	return;
 }
 
 static void message_handler_req_exec_lck_resourceopen (
@@ -2039,7 +3928,7 @@ static void message_handler_req_exec_lck_resourceopen (
 		}
 	}
 
-	resource = lck_resource_find (&resource_list_head,
+	resource = lck_resource_find (resource_hash,
 		&req_exec_lck_resourceopen->resource_name);
 
 	if (resource == NULL) {
@@ -2059,6 +3948,8 @@ static void message_handler_req_exec_lck_resourceopen (
 			sizeof (mar_name_t));
 
 		resource->ex_lock_granted = NULL;
+		resource->lock_policy = lck_lock_policy_get (
+			req_exec_lck_resourceopen->open_flags);
 
 		list_init (&resource->resource_lock_list_head);
 		list_init (&resource->pr_lock_granted_list_head);
@@ -2067,6 +3958,8 @@ static void message_handler_req_exec_lck_resourceopen (
 
 		list_init (&resource->resource_list);
 		list_add_tail (&resource->resource_list, &resource_list_head);
+		list_add (&resource->hash_list,
+			lck_hash_name (resource_hash, &resource->resource_name));
 	}
 
 	lck_sync_refcount_increment (resource, nodeid);
@@ -2096,8 +3989,11 @@ error_exit:
 				&resource->resource_name, sizeof (mar_name_t));
 
 			cleanup->resource_id = resource_id;
+			cleanup->conn = req_exec_lck_resourceopen->source.conn;
 			list_init (&cleanup->cleanup_list);
 			list_add_tail (&cleanup->cleanup_list, &lck_pd->resource_cleanup_list);
+			list_add (&cleanup->hash_list,
+				lck_hash_cleanup (cleanup->conn, &cleanup->resource_name));
 		}
 		else {
 			free (cleanup);
@@ -2144,7 +4040,7 @@ static void message_handler_req_exec_lck_resourceopenasync (
 		}
 	}
 
-	resource = lck_resource_find (&resource_list_head,
+	resource = lck_resource_find (resource_hash,
 		&req_exec_lck_resourceopenasync->resource_name);
 
 	if (resource == NULL) {
@@ -2164,6 +4060,8 @@ static void message_handler_req_exec_lck_resourceopenasync (
 			sizeof (mar_name_t));
 
 		resource->ex_lock_granted = NULL;
+		resource->lock_policy = lck_lock_policy_get (
+			req_exec_lck_resourceopenasync->open_flags);
 
 		list_init (&resource->resource_lock_list_head);
 		list_init (&resource->pr_lock_granted_list_head);
@@ -2172,6 +4070,8 @@ static void message_handler_req_exec_lck_resourceopenasync (
 
 		list_init (&resource->resource_list);
 		list_add_tail (&resource->resource_list, &resource_list_head);
+		list_add (&resource->hash_list,
+			lck_hash_name (resource_hash, &resource->resource_name));
 	}
 
 	lck_sync_refcount_increment (resource, nodeid);
@@ -2201,8 +4101,11 @@ error_exit:
 				&resource->resource_name, sizeof (mar_name_t));
 
 			cleanup->resource_id = resource_id;
+			cleanup->conn = req_exec_lck_resourceopenasync->source.conn;
 			list_init (&cleanup->cleanup_list);
 			list_add_tail (&cleanup->cleanup_list, &lck_pd->resource_cleanup_list);
+			list_add (&cleanup->hash_list,
+				lck_hash_cleanup (cleanup->conn, &cleanup->resource_name));
 		}
 		else {
 			free (cleanup);
@@ -2259,7 +4162,7 @@ static void message_handler_req_exec_lck_resourceclose (
 	/* DEBUG */
 	log_printf (LOGSYS_LEVEL_DEBUG, "EXEC request: saLckResourceClose\n");
 
-	resource = lck_resource_find (&resource_list_head,
+	resource = lck_resource_find (resource_hash,
 		&req_exec_lck_resourceclose->resource_name);
 
 	if (resource == NULL) {
@@ -2267,6 +4170,10 @@ static void message_handler_req_exec_lck_resourceclose (
 		goto error_exit;
 	}
 
+	if (lck_cache_defer (resource, message, nodeid)) {
+		return;
+	}
+
 	lck_sync_refcount_decrement (resource, nodeid);
 	lck_sync_refcount_calculate (resource);
 
@@ -2283,6 +4190,8 @@ static void message_handler_req_exec_lck_resourceclose (
 	    (list_empty (&resource->pr_lock_granted_list_head)))
 	{
 		list_del (&resource->resource_list);
+		list_del (&resource->hash_list);
+		refcount_vector_free (&resource->refcount_set);
 		free (resource);
 	}
 
@@ -2312,6 +4221,7 @@ error_exit:
 
 			if (cleanup != NULL) {
 				list_del (&cleanup->cleanup_list);
+				list_del (&cleanup->hash_list);
 				free (cleanup);
 			}
 
@@ -2341,7 +4251,7 @@ static void message_handler_req_exec_lck_resourcelock (
 		goto error_exit;
 	}
 
-	resource = lck_resource_find (&resource_list_head,
+	resource = lck_resource_find (resource_hash,
 		&req_exec_lck_resourcelock->resource_name);
 
 	if (resource == NULL) {
@@ -2349,6 +4259,10 @@ static void message_handler_req_exec_lck_resourcelock (
 		goto error_exit;
 	}
 
+	if (lck_cache_defer (resource, message, nodeid)) {
+		return;
+	}
+
 	lock = malloc (sizeof (struct resource_lock));
 	if (lock == NULL) {
 		error = SA_AIS_ERR_NO_MEMORY;
@@ -2374,21 +4288,25 @@ static void message_handler_req_exec_lck_resourcelock (
 	lock->resource_handle = req_exec_lck_resourcelock->resource_handle;
 
 	list_init (&lock->list);
+	list_init (&lock->waiter_list);
 	list_init (&lock->resource_lock_list);
 	list_add_tail (&lock->resource_lock_list, &resource->resource_lock_list_head);
+	list_add (&lock->hash_list, lck_hash_lock (resource, lock->lock_id));
 
 	lck_lock (resource, lock);
 
+	lck_cache_acquire (resource, nodeid);
+
 error_exit:
 	if (api->ipc_source_is_local (&req_exec_lck_resourcelock->source))
 	{
 		if ((lock != NULL) &&
 		    (lock->lock_status != SA_LCK_LOCK_GRANTED) &&
-		    (lock->lock_status != SA_LCK_LOCK_NOT_QUEUED))
+		    (lock->lock_status != SA_LCK_LOCK_NOT_QUEUED) &&
+		    (lock->lock_status != SA_LCK_LOCK_DEADLOCK))
 		{
-			api->timer_add_duration (
-				req_exec_lck_resourcelock->timeout, (void *)(lock),
-				lck_resourcelock_timeout, &lock->timer_handle);
+			lck_timeout_add (lock, api->timer_time_get () +
+				req_exec_lck_resourcelock->timeout);
 		}
 		else {
 			res_lib_lck_resourcelock.header.size =
@@ -2430,7 +4348,7 @@ static void message_handler_req_exec_lck_resourcelockasync (
 		goto error_exit;
 	}
 
-	resource = lck_resource_find (&resource_list_head,
+	resource = lck_resource_find (resource_hash,
 		&req_exec_lck_resourcelockasync->resource_name);
 
 	if (resource == NULL) {
@@ -2438,6 +4356,10 @@ static void message_handler_req_exec_lck_resourcelockasync (
 		goto error_exit;
 	}
 
+	if (lck_cache_defer (resource, message, nodeid)) {
+		return;
+	}
+
 	lock = malloc (sizeof (struct resource_lock));
 	if (lock == NULL) {
 		error = SA_AIS_ERR_NO_MEMORY;
@@ -2463,11 +4385,15 @@ static void message_handler_req_exec_lck_resourcelockasync (
 	lock->resource_handle = req_exec_lck_resourcelockasync->resource_handle;
 
 	list_init (&lock->list);
+	list_init (&lock->waiter_list);
 	list_init (&lock->resource_lock_list);
 	list_add_tail (&lock->resource_lock_list, &resource->resource_lock_list_head);
+	list_add (&lock->hash_list, lck_hash_lock (resource, lock->lock_id));
 
 	lck_lock (resource, lock);
 
+	lck_cache_acquire (resource, nodeid);
+
 error_exit:
 	if (api->ipc_source_is_local (&req_exec_lck_resourcelockasync->source))
 	{
@@ -2503,7 +4429,7 @@ static void message_handler_req_exec_lck_resourceunlock (
 	/* DEBUG */
 	log_printf (LOGSYS_LEVEL_DEBUG, "EXEC request: saLckResourceUnlock\n");
 
-	resource = lck_resource_find (&resource_list_head,
+	resource = lck_resource_find (resource_hash,
 		&req_exec_lck_resourceunlock->resource_name);
 
 	if (resource == NULL) {
@@ -2511,6 +4437,10 @@ static void message_handler_req_exec_lck_resourceunlock (
 		goto error_exit;
 	}
 
+	if (lck_cache_defer (resource, message, nodeid)) {
+		return;
+	}
+
 	resource_lock = lck_resource_lock_find (resource,
 		&req_exec_lck_resourceunlock->source,
 		req_exec_lck_resourceunlock->lock_id);
@@ -2562,13 +4492,17 @@ static void message_handler_req_exec_lck_resourceunlockasync (
 	/* DEBUG */
 	log_printf (LOGSYS_LEVEL_DEBUG, "EXEC request: saLckResourceUnlockAsync\n");
 
-	resource = lck_resource_find (&resource_list_head,
+	resource = lck_resource_find (resource_hash,
 		&req_exec_lck_resourceunlockasync->resource_name);
 	if (resource == NULL) {
 		error = SA_AIS_ERR_NOT_EXIST;
 		goto error_exit;
 	}
 
+	if (lck_cache_defer (resource, message, nodeid)) {
+		return;
+	}
+
 	resource_lock = lck_resource_lock_find (resource,
 		&req_exec_lck_resourceunlockasync->source,
 		req_exec_lck_resourceunlockasync->lock_id);
@@ -2636,7 +4570,7 @@ static void message_handler_req_exec_lck_lockpurge (
 	/* DEBUG */
 	log_printf (LOGSYS_LEVEL_DEBUG, "EXEC request: saLckResourceLockPurge\n");
 
-	resource = lck_resource_find (&resource_list_head,
+	resource = lck_resource_find (resource_hash,
 		&req_exec_lck_lockpurge->resource_name);
 
 	if (resource == NULL) {
@@ -2648,6 +4582,10 @@ static void message_handler_req_exec_lck_lockpurge (
 		goto error_exit;
 	}
 
+	if (lck_cache_defer (resource, message, nodeid)) {
+		return;
+	}
+
 	lck_purge (resource);
 
 error_exit:
@@ -2693,30 +4631,54 @@ static void message_handler_req_exec_lck_limitget (
 	}
 }
 
-static void message_handler_req_exec_lck_resourcelock_timeout (
-	const void *message,
+static void lck_lock_timeout (
+	const struct lck_timeout_entry *entry,
 	unsigned int nodeid)
 {
-	const struct req_exec_lck_resourcelock_timeout *req_exec_lck_resourcelock_timeout =
-		message;
+	struct {
+		struct req_exec_lck_resourcelock_timeout req;
+		struct lck_timeout_entry entry;
+	} req_exec_lck_resourcelock_timeout;
 	struct res_lib_lck_resourcelock res_lib_lck_resourcelock;
 
 	struct resource *resource = NULL;
 	struct resource_lock *resource_lock = NULL;
 
-	resource = lck_resource_find (&resource_list_head,
-		&req_exec_lck_resourcelock_timeout->resource_name);
+	resource = lck_resource_find (resource_hash,
+		&entry->resource_name);
 
 	assert (resource != NULL);
 
+	/*
+	 * A deferred timeout is kept as a message of its own, so that
+	 * the other locks of the batch are not held back with it.
+	 */
+	lck_timeout_header_set (&req_exec_lck_resourcelock_timeout.req, 1);
+	memcpy (&req_exec_lck_resourcelock_timeout.entry, entry,
+		sizeof (struct lck_timeout_entry));
+
+	if (lck_cache_defer (resource, &req_exec_lck_resourcelock_timeout, nodeid)) {
+		return;
+	}
+
 	resource_lock = lck_resource_lock_find (
 		resource,
-		&req_exec_lck_resourcelock_timeout->callback_source,
-		req_exec_lck_resourcelock_timeout->lock_id);
+		&entry->callback_source,
+		entry->lock_id);
+
+	/*
+	 * The lock was granted or unlocked while its timeout was
+	 * being multicast.
+	 */
+	if ((resource_lock == NULL) ||
+	    (resource_lock->lock_status == SA_LCK_LOCK_GRANTED))
+	{
+		return;
+	}
 
-	assert (resource_lock != NULL);
+	lck_timeout_del (resource_lock);
 
-	if (api->ipc_source_is_local (&req_exec_lck_resourcelock_timeout->response_source))
+	if (api->ipc_source_is_local (&entry->response_source))
 	{
 		res_lib_lck_resourcelock.header.size =
 			sizeof (struct res_lib_lck_resourcelock);
@@ -2728,15 +4690,72 @@ static void message_handler_req_exec_lck_resourcelock_timeout (
 			resource_lock->lock_status;
 
 		api->ipc_response_send (
-			req_exec_lck_resourcelock_timeout->response_source.conn,
+			entry->response_source.conn,
 			&res_lib_lck_resourcelock,
 			sizeof (struct res_lib_lck_resourcelock));
 	}
 
 	list_del (&resource_lock->list);
 	list_del (&resource_lock->resource_lock_list);
+	list_del (&resource_lock->hash_list);
+	lck_waiter_del (resource_lock);
+
+	global_lock_count -= 1;
 
 	free (resource_lock);
+
+	/*
+	 * A pending exclusive request may have held back shared
+	 * requests behind it.
+	 */
+	lck_grant_pending (resource);
+}
+
+static void message_handler_req_exec_lck_resourcelock_timeout (
+	const void *message,
+	unsigned int nodeid)
+{
+	const struct req_exec_lck_resourcelock_timeout *req_exec_lck_resourcelock_timeout =
+		message;
+	const struct lck_timeout_entry *entry =
+		(const struct lck_timeout_entry *)(req_exec_lck_resourcelock_timeout + 1);
+	unsigned int i;
+
+	/* DEBUG */
+	log_printf (LOGSYS_LEVEL_DEBUG, "EXEC request: lock timeout { count=%u }\n",
+		    (unsigned int)(req_exec_lck_resourcelock_timeout->timeout_count));
+
+	for (i = 0; i < req_exec_lck_resourcelock_timeout->timeout_count; i++) {
+		lck_lock_timeout (&entry[i], nodeid);
+	}
+}
+
+static struct resource *lck_sync_resource_create (
+	const mar_name_t *resource_name)
+{
+	struct resource *resource;
+
+	resource = malloc (sizeof (struct resource));
+	if (resource == NULL) {
+		api->error_memory_failure();
+	}
+
+	memset (resource, 0, sizeof (struct resource));
+	memcpy (&resource->resource_name, resource_name, sizeof (mar_name_t));
+
+	resource->ex_lock_granted = NULL;
+
+	list_init (&resource->resource_lock_list_head);
+	list_init (&resource->pr_lock_granted_list_head);
+	list_init (&resource->pr_lock_pending_list_head);
+	list_init (&resource->ex_lock_pending_list_head);
+
+	list_init (&resource->resource_list);
+	list_add_tail (&resource->resource_list, &sync_resource_list_head);
+	list_add (&resource->hash_list,
+		lck_hash_name (sync_resource_hash, &resource->resource_name));
+
+	return (resource);
 }
 
 static void message_handler_req_exec_lck_sync_resource (
@@ -2759,36 +4778,23 @@ static void message_handler_req_exec_lck_sync_resource (
 		return;
 	}
 
-	resource = lck_resource_find (&sync_resource_list_head,
+	resource = lck_resource_find (sync_resource_hash,
 		&req_exec_lck_sync_resource->resource_name);
 
 	/*
-	 * This resource should not exist.
+	 * The locks of a cached resource come from the node that
+	 * cached it and may have created the resource already.
 	 */
-	assert (resource == NULL);
-
-	resource = malloc (sizeof (struct resource));
 	if (resource == NULL) {
-		api->error_memory_failure();
+		resource = lck_sync_resource_create (
+			&req_exec_lck_sync_resource->resource_name);
 	}
 
-	memset (resource, 0, sizeof (struct resource));
-	memcpy (&resource->resource_name,
-		&req_exec_lck_sync_resource->resource_name,
-		sizeof (mar_name_t));
 	memcpy (&resource->source,
 		&req_exec_lck_sync_resource->source,
 		sizeof (mar_message_source_t));
 
-	resource->ex_lock_granted = NULL;
-
-	list_init (&resource->resource_lock_list_head);
-	list_init (&resource->pr_lock_granted_list_head);
-	list_init (&resource->pr_lock_pending_list_head);
-	list_init (&resource->ex_lock_pending_list_head);
-
-	list_init (&resource->resource_list);
-	list_add_tail (&resource->resource_list, &sync_resource_list_head);
+	resource->lock_policy = req_exec_lck_sync_resource->lock_policy;
 
 	return;
 }
@@ -2814,13 +4820,16 @@ static void message_handler_req_exec_lck_sync_resource_lock (
 		return;
 	}
 
-	resource = lck_resource_find (&sync_resource_list_head,
+	resource = lck_resource_find (sync_resource_hash,
 		&req_exec_lck_sync_resource_lock->resource_name);
 
 	/*
-	 * This resource should exist.
+	 * Locks of a cached resource may arrive before the resource.
 	 */
-	assert (resource != NULL);
+	if (resource == NULL) {
+		resource = lck_sync_resource_create (
+			&req_exec_lck_sync_resource_lock->resource_name);
+	}
 
 	/* TODO: check to make sure the lock doesn't already exist */
 
@@ -2838,6 +4847,7 @@ static void message_handler_req_exec_lck_sync_resource_lock (
 		sizeof (mar_message_source_t));
 
 	list_init (&resource_lock->list);
+	list_init (&resource_lock->waiter_list);
 	list_init (&resource_lock->resource_lock_list);
 
 	list_add_tail (&resource_lock->resource_lock_list, &resource->resource_lock_list_head);
@@ -2853,24 +4863,10 @@ static void message_handler_req_exec_lck_sync_resource_lock (
 	resource_lock->invocation = req_exec_lck_sync_resource_lock->invocation;
 	resource_lock->timeout = req_exec_lck_sync_resource_lock->timeout;
 
-	/*
-	 * Determine the list that this lock should be added to
-	 */
-	if (resource_lock->lock_mode == SA_LCK_PR_LOCK_MODE) {
-		if (resource_lock->lock_status == SA_LCK_LOCK_GRANTED) {
-			list_add_tail (&resource_lock->list, &resource->pr_lock_granted_list_head);
-		} else {
-			list_add_tail (&resource_lock->list, &resource->pr_lock_pending_list_head);
-		}
-	}
+	list_add (&resource_lock->hash_list,
+		lck_hash_lock (resource, resource_lock->lock_id));
 
-	if (resource_lock->lock_mode == SA_LCK_EX_LOCK_MODE) {
-		if (resource_lock->lock_status == SA_LCK_LOCK_GRANTED) {
-			resource->ex_lock_granted = resource_lock;
-		} else {
-			list_add_tail (&resource_lock->list, &resource->ex_lock_pending_list_head);
-		}
-	}
+	lck_resource_lock_list_add (resource, resource_lock);
 
 	/*
 	 * Increment the lock count.
@@ -2886,10 +4882,11 @@ static void message_handler_req_exec_lck_sync_resource_refcount (
 {
 	const struct req_exec_lck_sync_resource_refcount *req_exec_lck_sync_resource_refcount =
 		message;
+	const mar_refcount_set_t *refcount_set =
+		(const mar_refcount_set_t *)(req_exec_lck_sync_resource_refcount + 1);
 	struct resource *resource;
 
 	unsigned int i;
-	unsigned int j;
 
 	/* DEBUG */
 	log_printf (LOGSYS_LEVEL_DEBUG, "EXEC request: sync_resource_refcount\n");
@@ -2903,7 +4900,7 @@ static void message_handler_req_exec_lck_sync_resource_refcount (
 		return;
 	}
 
-	resource = lck_resource_find (&sync_resource_list_head,
+	resource = lck_resource_find (sync_resource_hash,
 		&req_exec_lck_sync_resource_refcount->resource_name);
 
 	/*
@@ -2911,39 +4908,304 @@ static void message_handler_req_exec_lck_sync_resource_refcount (
 	 */
 	assert (resource != NULL);
 
-	for (i = 0; i < PROCESSOR_COUNT_MAX; i++)
+	for (i = 0; i < req_exec_lck_sync_resource_refcount->refcount_set_count; i++)
 	{
-		if (req_exec_lck_sync_resource_refcount->refcount_set[i].nodeid == 0) {
-			break;
+		if (lck_find_member_nodeid (refcount_set[i].nodeid) == 0) {
+			continue;
 		}
 
-		if (lck_find_member_nodeid (req_exec_lck_sync_resource_refcount->refcount_set[i].nodeid) == 0) {
-			continue;
+		refcount_vector_add (&resource->refcount_set,
+			refcount_set[i].nodeid, refcount_set[i].refcount);
+	}
+
+	lck_sync_refcount_calculate (resource);
+
+	return;
+}
+
+static void message_handler_req_exec_lck_cache_release (
+	const void *message,
+	unsigned int nodeid)
+{
+	const struct req_exec_lck_cache_release *req_exec_lck_cache_release =
+		message;
+	const struct lck_cache_lock_record *record =
+		(const struct lck_cache_lock_record *)(req_exec_lck_cache_release + 1);
+	struct resource *resource;
+	struct resource_lock *resource_lock;
+	struct list_head *resource_lock_list;
+
+	unsigned int i;
+
+	/* DEBUG */
+	log_printf (LOGSYS_LEVEL_DEBUG, "EXEC request: cache_release\n");
+
+	resource = lck_resource_find (resource_hash,
+		&req_exec_lck_cache_release->resource_name);
+
+	if ((resource == NULL) || (resource->cache_nodeid != nodeid)) {
+		return;
+	}
+
+	/*
+	 * The caching node already has these locks. Everyone else
+	 * replaces the locks they knew of with the ones sent here.
+	 */
+	if (nodeid != api->totem_nodeid_get()) {
+		resource_lock_list = resource->resource_lock_list_head.next;
+
+		while (resource_lock_list != &resource->resource_lock_list_head) {
+			resource_lock = list_entry (resource_lock_list,
+				struct resource_lock, resource_lock_list);
+			resource_lock_list = resource_lock_list->next;
+
+			list_del (&resource_lock->hash_list);
+			lck_waiter_del (resource_lock);
+			lck_timeout_del (resource_lock);
+			global_lock_count -= 1;
+			free (resource_lock);
 		}
 
-		for (j = 0; j < PROCESSOR_COUNT_MAX; j++)
-		{
-			if (resource->refcount_set[j].nodeid == 0)
-			{
-				resource->refcount_set[j].nodeid =
-					req_exec_lck_sync_resource_refcount->refcount_set[i].nodeid;
-				resource->refcount_set[j].refcount =
-					req_exec_lck_sync_resource_refcount->refcount_set[i].refcount;
-				break;
+		resource->ex_lock_granted = NULL;
+
+		list_init (&resource->resource_lock_list_head);
+		list_init (&resource->pr_lock_granted_list_head);
+		list_init (&resource->pr_lock_pending_list_head);
+		list_init (&resource->ex_lock_pending_list_head);
+
+		for (i = 0; i < req_exec_lck_cache_release->lock_count; i++) {
+			resource_lock = malloc (sizeof (struct resource_lock));
+			if (resource_lock == NULL) {
+				api->error_memory_failure ();
 			}
 
-			if (req_exec_lck_sync_resource_refcount->refcount_set[i].nodeid == resource->refcount_set[j].nodeid)
-			{
-				resource->refcount_set[j].refcount +=
-					req_exec_lck_sync_resource_refcount->refcount_set[i].refcount;
+			memset (resource_lock, 0, sizeof (struct resource_lock));
+			memcpy (&resource_lock->response_source,
+				&record[i].response_source, sizeof (mar_message_source_t));
+			memcpy (&resource_lock->callback_source,
+				&record[i].callback_source, sizeof (mar_message_source_t));
+
+			list_init (&resource_lock->list);
+			list_init (&resource_lock->waiter_list);
+			list_init (&resource_lock->resource_lock_list);
+
+			list_add_tail (&resource_lock->resource_lock_list,
+				&resource->resource_lock_list_head);
+
+			resource_lock->resource = resource;
+
+			resource_lock->lock_id = record[i].lock_id;
+			resource_lock->lock_mode = record[i].lock_mode;
+			resource_lock->lock_flags = record[i].lock_flags;
+			resource_lock->lock_status = record[i].lock_status;
+			resource_lock->waiter_signal = record[i].waiter_signal;
+			resource_lock->resource_handle = record[i].resource_handle;
+			resource_lock->orphan_flag = record[i].orphan_flag;
+			resource_lock->invocation = record[i].invocation;
+
+			list_add (&resource_lock->hash_list,
+				lck_hash_lock (resource, resource_lock->lock_id));
+
+			lck_resource_lock_list_add (resource, resource_lock);
+
+			if ((resource_lock->lock_status != SA_LCK_LOCK_GRANTED) &&
+			    (resource_lock->lock_status != SA_LCK_LOCK_NOT_QUEUED) &&
+			    (resource_lock->lock_status != SA_LCK_LOCK_DEADLOCK)) {
+				lck_waiter_add (resource_lock);
+			}
+
+			global_lock_count += 1;
+		}
+	}
+
+	resource->cache_nodeid = 0;
+	resource->cache_revoke = 0;
+	resource->cache_release_pending = 0;
+
+	lck_cache_deferred_replay (&req_exec_lck_cache_release->resource_name);
+}
+
+static void message_handler_req_exec_lck_locksetasync (
+	const void *message,
+	unsigned int nodeid)
+{
+	const struct req_exec_lck_locksetasync *req_exec_lck_locksetasync =
+		message;
+	const struct lck_lockset_entry *entry =
+		(const struct lck_lockset_entry *)(req_exec_lck_locksetasync + 1);
+	struct res_lib_lck_locksetasync res_lib_lck_locksetasync;
+	SaAisErrorT error = SA_AIS_OK;
+
+	struct lck_lockset_entry sorted[LCK_MAX_LOCKSET_SIZE];
+	struct resource *resource = NULL;
+	struct resource *cached = NULL;
+	struct lck_lock_set *lock_set = NULL;
+	struct resource_lock *lock;
+	mar_uint32_t lock_status = 0;
+	unsigned int i;
+
+	/* DEBUG */
+	log_printf (LOGSYS_LEVEL_DEBUG, "EXEC request: saLckResourceLockSetAsync\n");
+
+	if ((req_exec_lck_locksetasync->lock_count == 0) ||
+	    (req_exec_lck_locksetasync->lock_count > LCK_MAX_LOCKSET_SIZE))
+	{
+		error = SA_AIS_ERR_INVALID_PARAM;
+		goto error_exit;
+	}
+
+	if (global_lock_count + req_exec_lck_locksetasync->lock_count > LCK_MAX_NUM_LOCKS)
+	{
+		error = SA_AIS_ERR_NO_RESOURCES;
+		goto error_exit;
+	}
+
+	for (i = 0; i < req_exec_lck_locksetasync->lock_count; i++) {
+		resource = lck_resource_find (resource_hash,
+			&entry[i].resource_name);
+
+		if (resource == NULL) {
+			error = SA_AIS_ERR_LIBRARY;
+			goto error_exit;
+		}
+
+		/*
+		 * A cached resource is handed back to the cluster before
+		 * the set is looked at, since only the caching node knows
+		 * its locks.
+		 */
+		if (resource->cache_nodeid != 0) {
+			lck_cache_revoke (resource);
+			cached = resource;
+		}
+	}
+
+	if (cached != NULL) {
+		lck_cache_deferred_add (cached, message, nodeid);
+		return;
+	}
+
+	lock_set = malloc (sizeof (struct lck_lock_set));
+	if (lock_set == NULL) {
+		error = SA_AIS_ERR_NO_MEMORY;
+		goto error_exit;
+	}
+	memset (lock_set, 0, sizeof (struct lck_lock_set));
+
+	memcpy (sorted, entry, sizeof (struct lck_lockset_entry) *
+		req_exec_lck_locksetasync->lock_count);
+
+	memcpy (&lock_set->source,
+		&req_exec_lck_locksetasync->source,
+		sizeof (mar_message_source_t));
+	memcpy (&lock_set->callback_source,
+		&req_exec_lck_locksetasync->callback_source,
+		sizeof (mar_message_source_t));
+
+	lock_set->invocation = req_exec_lck_locksetasync->invocation;
+	lock_set->lock_flags = req_exec_lck_locksetasync->lock_flags;
+	lock_set->resource_handle = entry[0].resource_handle;
+	lock_set->lock_id = entry[0].lock_id;
+
+	qsort (sorted, req_exec_lck_locksetasync->lock_count,
+		sizeof (struct lck_lockset_entry), lck_lock_set_compare);
+
+	for (i = 0; i < req_exec_lck_locksetasync->lock_count; i++) {
+		if (((sorted[i].lock_mode != SA_LCK_PR_LOCK_MODE) &&
+		     (sorted[i].lock_mode != SA_LCK_EX_LOCK_MODE)) ||
+		    ((i != 0) && (lck_lock_set_compare (&sorted[i - 1],
+			&sorted[i]) == 0)))
+		{
+			error = SA_AIS_ERR_INVALID_PARAM;
+			goto error_free;
+		}
+
+		lock = malloc (sizeof (struct resource_lock));
+		if (lock == NULL) {
+			error = SA_AIS_ERR_NO_MEMORY;
+			goto error_free;
+		}
+		memset (lock, 0, sizeof (struct resource_lock));
+
+		lock_set->lock[i] = lock;
+		lock_set->lock_count = i + 1;
+
+		memcpy (&lock->response_source,
+			&lock_set->source, sizeof (mar_message_source_t));
+		memcpy (&lock->callback_source,
+			&lock_set->callback_source, sizeof (mar_message_source_t));
+
+		lock->resource = lck_resource_find (resource_hash,
+			&sorted[i].resource_name);
+		lock->orphan_flag = 0;
+		lock->invocation = lock_set->invocation;
+		lock->lock_id = sorted[i].lock_id;
+		lock->lock_mode = sorted[i].lock_mode;
+		lock->lock_flags = lock_set->lock_flags;
+		lock->lock_sequence = lock->resource->lock_sequence++;
+		lock->resource_handle = sorted[i].resource_handle;
+
+		list_init (&lock->list);
+		list_init (&lock->waiter_list);
+		list_init (&lock->resource_lock_list);
+	}
+
+	/*
+	 * All of the locks are granted together, or all of them are
+	 * queued and the set is granted once each of them reaches the
+	 * head of its resource.
+	 */
+	if (lck_lock_set_grantable (lock_set)) {
+		lck_lock_set_grant (lock_set);
+		lock_status = SA_LCK_LOCK_GRANTED;
+	}
+	else if (lock_set->lock_flags & SA_LCK_LOCK_NO_QUEUE) {
+		lock_status = SA_LCK_LOCK_NOT_QUEUED;
+	}
+	else {
+		for (i = 0; i < lock_set->lock_count; i++) {
+			if (lck_deadlock_detect (lock_set->lock[i])) {
+				lock_status = SA_LCK_LOCK_DEADLOCK;
 				break;
 			}
 		}
+		if (lock_status == 0) {
+			lck_lock_set_queue (lock_set);
+		}
 	}
 
-	lck_sync_refcount_calculate (resource);
+error_exit:
+	if (api->ipc_source_is_local (&req_exec_lck_locksetasync->source))
+	{
+		res_lib_lck_locksetasync.header.size =
+			sizeof (struct res_lib_lck_locksetasync);
+		res_lib_lck_locksetasync.header.id =
+			MESSAGE_RES_LCK_LOCKSETASYNC;
+		res_lib_lck_locksetasync.header.error = error;
+
+		api->ipc_response_send (
+			req_exec_lck_locksetasync->source.conn,
+			&res_lib_lck_locksetasync,
+			sizeof (struct res_lib_lck_locksetasync));
 
+		if ((lock_set != NULL) && (lock_status != 0)) {
+			lck_lock_set_callback_send (lock_set, lock_status, error);
+		}
+	}
+
+	if ((lock_set != NULL) && (lock_status != 0)) {
+		/*
+		 * Granted locks now belong to their resources.
+		 */
+		lck_lock_set_free (lock_set,
+			(lock_status == SA_LCK_LOCK_GRANTED) ? 0 : lock_set->lock_count);
+	}
 	return;
+
+error_free:
+	lck_lock_set_free (lock_set, lock_set->lock_count);
+	lock_set = NULL;
+	goto error_exit;
 }
 
 static void message_handler_req_lib_lck_resourceopen (
@@ -2976,7 +5238,7 @@ static void message_handler_req_lib_lck_resourceopen (
 	iovec.iov_base = (void *)&req_exec_lck_resourceopen;
 	iovec.iov_len = sizeof (struct req_exec_lck_resourceopen);
 
-	assert (api->totem_mcast (&iovec, 1, TOTEM_AGREED) == 0);
+	assert (lck_totem_mcast (&iovec, 1, TOTEM_AGREED) == 0);
 }
 
 static void message_handler_req_lib_lck_resourceopenasync (
@@ -3011,7 +5273,7 @@ static void message_handler_req_lib_lck_resourceopenasync (
 	iovec.iov_base = (void *)&req_exec_lck_resourceopenasync;
 	iovec.iov_len = sizeof (struct req_exec_lck_resourceopenasync);
 
-	assert (api->totem_mcast (&iovec, 1, TOTEM_AGREED) == 0);
+	assert (lck_totem_mcast (&iovec, 1, TOTEM_AGREED) == 0);
 }
 
 static void message_handler_req_lib_lck_resourceclose (
@@ -3044,7 +5306,7 @@ static void message_handler_req_lib_lck_resourceclose (
 	iovec.iov_base = (void *)&req_exec_lck_resourceclose;
 	iovec.iov_len = sizeof (struct req_exec_lck_resourceclose);
 
-	assert (api->totem_mcast (&iovec, 1, TOTEM_AGREED) == 0);
+	assert (lck_totem_mcast (&iovec, 1, TOTEM_AGREED) == 0);
 }
 
 static void message_handler_req_lib_lck_resourcelock (
@@ -3093,10 +5355,20 @@ static void message_handler_req_lib_lck_resourcelock (
 
 	hdb_handle_put (&resource_hdb, req_lib_lck_resourcelock->resource_id);
 
+	lck_stats_lock_requests += 1;
+
+	if (lck_cache_local (&req_exec_lck_resourcelock.resource_name)) {
+		lck_stats_lock_requests_cached += 1;
+
+		message_handler_req_exec_lck_resourcelock (
+			&req_exec_lck_resourcelock, api->totem_nodeid_get());
+		return;
+	}
+
 	iovec.iov_base = (void *)&req_exec_lck_resourcelock;
 	iovec.iov_len = sizeof (struct req_exec_lck_resourcelock);
 
-	assert (api->totem_mcast (&iovec, 1, TOTEM_AGREED) == 0);
+	assert (lck_totem_mcast (&iovec, 1, TOTEM_AGREED) == 0);
 }
 
 static void message_handler_req_lib_lck_resourcelockasync (
@@ -3145,10 +5417,20 @@ static void message_handler_req_lib_lck_resourcelockasync (
 
 	hdb_handle_put (&resource_hdb, req_lib_lck_resourcelockasync->resource_id);
 
+	lck_stats_lock_requests += 1;
+
+	if (lck_cache_local (&req_exec_lck_resourcelockasync.resource_name)) {
+		lck_stats_lock_requests_cached += 1;
+
+		message_handler_req_exec_lck_resourcelockasync (
+			&req_exec_lck_resourcelockasync, api->totem_nodeid_get());
+		return;
+	}
+
 	iovec.iov_base = (void *)&req_exec_lck_resourcelockasync;
 	iovec.iov_len = sizeof (struct req_exec_lck_resourcelockasync);
 
-	assert (api->totem_mcast (&iovec, 1, TOTEM_AGREED) == 0);
+	assert (lck_totem_mcast (&iovec, 1, TOTEM_AGREED) == 0);
 }
 
 static void message_handler_req_lib_lck_resourceunlock (
@@ -3178,10 +5460,16 @@ static void message_handler_req_lib_lck_resourceunlock (
 	req_exec_lck_resourceunlock.lock_id =
 		req_lib_lck_resourceunlock->lock_id;
 
+	if (lck_cache_local (&req_exec_lck_resourceunlock.resource_name)) {
+		message_handler_req_exec_lck_resourceunlock (
+			&req_exec_lck_resourceunlock, api->totem_nodeid_get());
+		return;
+	}
+
 	iovec.iov_base = (void *)&req_exec_lck_resourceunlock;
 	iovec.iov_len = sizeof (struct req_exec_lck_resourceunlock);
 
-	assert (api->totem_mcast (&iovec, 1, TOTEM_AGREED) == 0);
+	assert (lck_totem_mcast (&iovec, 1, TOTEM_AGREED) == 0);
 }
 
 static void message_handler_req_lib_lck_resourceunlockasync (
@@ -3213,10 +5501,16 @@ static void message_handler_req_lib_lck_resourceunlockasync (
 	req_exec_lck_resourceunlockasync.invocation =
 		req_lib_lck_resourceunlockasync->invocation;
 
+	if (lck_cache_local (&req_exec_lck_resourceunlockasync.resource_name)) {
+		message_handler_req_exec_lck_resourceunlockasync (
+			&req_exec_lck_resourceunlockasync, api->totem_nodeid_get());
+		return;
+	}
+
 	iovec.iov_base = (void *)&req_exec_lck_resourceunlockasync;
 	iovec.iov_len = sizeof (struct req_exec_lck_resourceunlockasync);
 
-	assert (api->totem_mcast (&iovec, 1, TOTEM_AGREED) == 0);
+	assert (lck_totem_mcast (&iovec, 1, TOTEM_AGREED) == 0);
 }
 
 static void message_handler_req_lib_lck_lockpurge (
@@ -3244,7 +5538,7 @@ static void message_handler_req_lib_lck_lockpurge (
 	iovec.iov_base = (void *)&req_exec_lck_lockpurge;
 	iovec.iov_len = sizeof (struct req_exec_lck_lockpurge);
 
-	assert (api->totem_mcast (&iovec, 1, TOTEM_AGREED) == 0);
+	assert (lck_totem_mcast (&iovec, 1, TOTEM_AGREED) == 0);
 }
 
 static void message_handler_req_lib_lck_limitget (
@@ -3268,5 +5562,76 @@ static void message_handler_req_lib_lck_limitget (
 	iovec.iov_base = (void *)&req_exec_lck_limitget;
 	iovec.iov_len = sizeof (struct req_exec_lck_limitget);
 
-	assert (api->totem_mcast (&iovec, 1, TOTEM_AGREED) == 0);
+	assert (lck_totem_mcast (&iovec, 1, TOTEM_AGREED) == 0);
+}
+
+static void message_handler_req_lib_lck_locksetasync (
+	void *conn,
+	const void *msg)
+{
+	const struct req_lib_lck_locksetasync *req_lib_lck_locksetasync = msg;
+	const struct lck_lockset_entry *entry =
+		(const struct lck_lockset_entry *)(req_lib_lck_locksetasync + 1);
+	struct req_exec_lck_locksetasync req_exec_lck_locksetasync;
+	struct res_lib_lck_locksetasync res_lib_lck_locksetasync;
+	struct resource_instance *resource_instance;
+	struct iovec iovec[2];
+
+	/* DEBUG */
+	log_printf (LOGSYS_LEVEL_DEBUG, "LIB request: saLckResourceLockSetAsync\n");
+
+	if ((req_lib_lck_locksetasync->lock_count == 0) ||
+	    (req_lib_lck_locksetasync->lock_count > LCK_MAX_LOCKSET_SIZE) ||
+	    (req_lib_lck_locksetasync->header.size !=
+	     sizeof (struct req_lib_lck_locksetasync) +
+	     sizeof (struct lck_lockset_entry) * req_lib_lck_locksetasync->lock_count))
+	{
+		res_lib_lck_locksetasync.header.size =
+			sizeof (struct res_lib_lck_locksetasync);
+		res_lib_lck_locksetasync.header.id =
+			MESSAGE_RES_LCK_LOCKSETASYNC;
+		res_lib_lck_locksetasync.header.error = SA_AIS_ERR_INVALID_PARAM;
+
+		api->ipc_response_send (conn,
+			&res_lib_lck_locksetasync,
+			sizeof (struct res_lib_lck_locksetasync));
+		return;
+	}
+
+	req_exec_lck_locksetasync.header.size =
+		sizeof (struct req_exec_lck_locksetasync) +
+		sizeof (struct lck_lockset_entry) * req_lib_lck_locksetasync->lock_count;
+	req_exec_lck_locksetasync.header.id =
+		SERVICE_ID_MAKE (LCK_SERVICE, MESSAGE_REQ_EXEC_LCK_LOCKSETASYNC);
+
+	api->ipc_source_set (&req_exec_lck_locksetasync.source, conn);
+
+	req_exec_lck_locksetasync.invocation =
+		req_lib_lck_locksetasync->invocation;
+	req_exec_lck_locksetasync.lock_flags =
+		req_lib_lck_locksetasync->lock_flags;
+	req_exec_lck_locksetasync.lock_count =
+		req_lib_lck_locksetasync->lock_count;
+
+	/*
+	 * The library only accepts resources opened through one handle,
+	 * so the first resource gives the callback source of the set.
+	 */
+	hdb_handle_get (&resource_hdb, entry[0].resource_id,
+		(void *)&resource_instance);
+
+	memcpy (&req_exec_lck_locksetasync.callback_source,
+		&resource_instance->source, sizeof (mar_message_source_t));
+
+	hdb_handle_put (&resource_hdb, entry[0].resource_id);
+
+	lck_stats_lock_requests += req_lib_lck_locksetasync->lock_count;
+
+	iovec[0].iov_base = (void *)&req_exec_lck_locksetasync;
+	iovec[0].iov_len = sizeof (struct req_exec_lck_locksetasync);
+	iovec[1].iov_base = (void *)entry;
+	iovec[1].iov_len = sizeof (struct lck_lockset_entry) *
+		req_lib_lck_locksetasync->lock_count;
+
+	assert (lck_totem_mcast (iovec, 2, TOTEM_AGREED) == 0);
 }
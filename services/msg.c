@@ -45,6 +45,7 @@
 #include <fcntl.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <errno.h>
 #include <time.h>
 #include <arpa/inet.h>
@@ -67,6 +68,7 @@
 #include "../include/saAis.h"
 #include "../include/saMsg.h"
 #include "../include/ipc_msg.h"
+#include "refcount.h"
 
 LOGSYS_DECLARE_SUBSYS ("MSG");
 
@@ -105,6 +107,9 @@ enum msg_exec_message_req_types {
 	MESSAGE_REQ_EXEC_MSG_QUEUE_TIMEOUT = 31,
 	MESSAGE_REQ_EXEC_MSG_MESSAGEGET_TIMEOUT = 32,
 	MESSAGE_REQ_EXEC_MSG_SENDRECEIVE_TIMEOUT = 33,
+	MESSAGE_REQ_EXEC_MSG_MESSAGE_DELIVER = 34,
+	MESSAGE_REQ_EXEC_MSG_REPLY_RESULT = 35,
+	MESSAGE_REQ_EXEC_MSG_SYNC_PACKED = 36,
 };
 
 enum msg_sync_state {
@@ -112,7 +117,6 @@ enum msg_sync_state {
 	MSG_SYNC_STATE_STARTED,
 	MSG_SYNC_STATE_QUEUE,
 	MSG_SYNC_STATE_GROUP,
-	MSG_SYNC_STATE_REPLY,
 };
 
 enum msg_sync_iteration_state {
@@ -120,23 +124,13 @@ enum msg_sync_iteration_state {
 	MSG_SYNC_ITERATION_STATE_QUEUE_REFCOUNT,
 	MSG_SYNC_ITERATION_STATE_QUEUE_MESSAGE,
 	MSG_SYNC_ITERATION_STATE_GROUP,
-	MSG_SYNC_ITERATION_STATE_GROUP_MEMBER,
-	MSG_SYNC_ITERATION_STATE_REPLY
+	MSG_SYNC_ITERATION_STATE_GROUP_MEMBER
 };
 
-struct refcount_set {
-	unsigned int refcount;
-	unsigned int nodeid;
-};
-
-typedef struct {
-	unsigned int refcount __attribute__((aligned(8)));
-	unsigned int nodeid __attribute__((aligned(8)));
-} mar_refcount_set_t;
-
 struct message_entry {
 	mar_time_t send_time;
 	mar_msg_sender_id_t sender_id;
+	mar_uint32_t message_id;
 	mar_msg_message_t message;
 	struct list_head queue_list;
 	struct list_head message_list;
@@ -148,6 +142,20 @@ struct reply_entry {
 	mar_message_source_t source;
 	corosync_timer_handle_t timer_handle;
 	struct list_head reply_list;
+	struct list_head hash_list;
+};
+
+/*
+ * A reply whose requester is on another node. It is kept on the
+ * replier's node until the requester's node returns the result, so
+ * that the replier can still be answered if that node goes away.
+ */
+struct reply_result_entry {
+	mar_message_source_t source;
+	mar_uint8_t async;
+	mar_invocation_t invocation;
+	unsigned int nodeid;
+	struct list_head list;
 };
 
 struct track_entry {
@@ -155,6 +163,7 @@ struct track_entry {
 	mar_uint8_t track_flags;
 	mar_message_source_t source;
 	struct list_head track_list;
+	struct list_head hash_list;
 };
 
 struct cleanup_entry {
@@ -171,13 +180,18 @@ struct priority_area {
 	mar_size_t capacity_available;
 	mar_uint32_t number_of_messages;
 	struct list_head message_head;
+	char *ring;
+	mar_size_t ring_head;
+	mar_size_t ring_used;
 };
 
 struct pending_entry {
 	mar_name_t queue_name;
 	mar_message_source_t source;
+	mar_uint8_t packed;
 	corosync_timer_handle_t timer_handle;
 	struct list_head pending_list;
+	struct list_head hash_list;
 };
 
 struct queue_entry {
@@ -192,13 +206,17 @@ struct queue_entry {
 	mar_msg_queue_creation_attributes_t create_attrs;
 	mar_msg_queue_handle_t queue_handle;
 	corosync_timer_handle_t timer_handle;
+	unsigned int owner_nodeid;
+	unsigned int standby_nodeid;
+	mar_uint32_t message_id;
 	struct group_entry *group;
 	struct list_head queue_list;
 	struct list_head group_list;
+	struct list_head hash_list;
 	struct list_head message_head;
 	struct list_head pending_head;
 	struct priority_area priority[SA_MSG_MESSAGE_LOWEST_PRIORITY+1];
-	struct refcount_set refcount_set[PROCESSOR_COUNT_MAX];
+	struct refcount_vector refcount_set;
 };
 
 struct group_entry {
@@ -208,6 +226,7 @@ struct group_entry {
 	mar_msg_queue_group_policy_t policy;
 	struct queue_entry *next_queue;
 	struct list_head group_list;
+	struct list_head hash_list;
 	struct list_head queue_head;
 };
 
@@ -215,10 +234,84 @@ DECLARE_LIST_INIT(queue_list_head);
 DECLARE_LIST_INIT(group_list_head);
 DECLARE_LIST_INIT(track_list_head);
 DECLARE_LIST_INIT(reply_list_head);
+DECLARE_LIST_INIT(reply_result_list_head);
 
 DECLARE_LIST_INIT(sync_queue_list_head);
 DECLARE_LIST_INIT(sync_group_list_head);
-DECLARE_LIST_INIT(sync_reply_list_head);
+
+DECLARE_LIST_INIT(message_pool_head);
+
+/*
+ * Queues, groups and tracks are also hashed by name, replies by sender
+ * id and pending gets by source, so that requests are not resolved by
+ * scanning the lists above. Each list that is looked up has a hash
+ * table of its own.
+ */
+#define MSG_HASH_SIZE 4096
+
+static struct list_head queue_hash[MSG_HASH_SIZE];
+static struct list_head group_hash[MSG_HASH_SIZE];
+static struct list_head track_hash[MSG_HASH_SIZE];
+static struct list_head reply_hash[MSG_HASH_SIZE];
+static struct list_head pending_hash[MSG_HASH_SIZE];
+
+static struct list_head sync_queue_hash[MSG_HASH_SIZE];
+static struct list_head sync_group_hash[MSG_HASH_SIZE];
+
+static void msg_hash_init (
+	struct list_head *hash)
+{
+	int i;
+
+	for (i = 0; i < MSG_HASH_SIZE; i++) {
+		list_init (&hash[i]);
+	}
+}
+
+static void msg_hash_move (
+	struct list_head *hash,
+	struct list_head *sync_hash)
+{
+	int i;
+
+	for (i = 0; i < MSG_HASH_SIZE; i++) {
+		if (!list_empty (&sync_hash[i])) {
+			list_splice (&sync_hash[i], &hash[i]);
+		}
+		list_init (&sync_hash[i]);
+	}
+}
+
+static struct list_head *msg_hash_name (
+	struct list_head *hash,
+	const mar_name_t *name)
+{
+	unsigned int key = 2166136261U;
+	unsigned int i;
+
+	for (i = 0; i < name->length && i < SA_MAX_NAME_LENGTH; i++) {
+		key = (key ^ name->value[i]) * 16777619U;
+	}
+
+	return (&hash[key & (MSG_HASH_SIZE - 1)]);
+}
+
+static struct list_head *msg_hash_key (
+	struct list_head *hash,
+	mar_uint64_t value)
+{
+	unsigned int key = (unsigned int)(value ^ (value >> 32)) * 2654435761U;
+
+	return (&hash[(key >> 16) & (MSG_HASH_SIZE - 1)]);
+}
+
+static struct list_head *msg_hash_source (
+	const mar_message_source_t *source)
+{
+	return (msg_hash_key (pending_hash,
+		((mar_uint64_t)(source->nodeid) << 32) ^
+		(mar_uint64_t)(uintptr_t)(source->conn)));
+}
 
 static struct corosync_api_v1 *api;
 
@@ -229,6 +322,30 @@ static mar_uint32_t global_group_count = 0;
 static mar_uint32_t sync_queue_count = 0;
 static mar_uint32_t sync_group_count = 0;
 
+/*
+ * Messages sent by local clients and the totem traffic this node
+ * multicast, reported by msg_exec_dump_fn.
+ */
+static unsigned long long msg_stats_messages_sent = 0;
+static unsigned long long msg_stats_totem_messages = 0;
+static unsigned long long msg_stats_totem_bytes = 0;
+
+static int msg_totem_mcast (
+	const struct iovec *iovec,
+	unsigned int iov_len,
+	unsigned int guarantee)
+{
+	unsigned int i;
+
+	msg_stats_totem_messages += 1;
+
+	for (i = 0; i < iov_len; i++) {
+		msg_stats_totem_bytes += iovec[i].iov_len;
+	}
+
+	return (api->totem_mcast (iovec, iov_len, guarantee));
+}
+
 static void msg_exec_dump_fn (void);
 
 static int msg_exec_init_fn (struct corosync_api_v1 *);
@@ -371,6 +488,18 @@ static void message_handler_req_exec_msg_sendreceive_timeout (
 	const void *msg,
 	unsigned int nodeid);
 
+static void message_handler_req_exec_msg_message_deliver (
+	const void *msg,
+	unsigned int nodeid);
+
+static void message_handler_req_exec_msg_reply_result (
+	const void *msg,
+	unsigned int nodeid);
+
+static void message_handler_req_exec_msg_sync_packed (
+	const void *msg,
+	unsigned int nodeid);
+
 static void message_handler_req_lib_msg_queueopen (
 	void *conn,
 	const void *msg);
@@ -471,6 +600,10 @@ static void message_handler_req_lib_msg_limitget (
 	void *conn,
 	const void *msg);
 
+static void message_handler_req_lib_msg_messagegetmany (
+	void *conn,
+	const void *msg);
+
 static void exec_msg_queueopen_endian_convert (void *msg);
 static void exec_msg_queueopenasync_endian_convert (void *msg);
 static void exec_msg_queueclose_endian_convert (void *msg);
@@ -505,6 +638,9 @@ static void exec_msg_sync_reply_endian_convert (void *msg);
 static void exec_msg_queue_timeout_endian_convert (void *msg);
 static void exec_msg_messageget_timeout_endian_convert (void *msg);
 static void exec_msg_sendreceive_timeout_endian_convert (void *msg);
+static void exec_msg_message_deliver_endian_convert (void *msg);
+static void exec_msg_reply_result_endian_convert (void *msg);
+static void exec_msg_sync_packed_endian_convert (void *msg);
 
 static enum msg_sync_state msg_sync_state = MSG_SYNC_STATE_NOT_STARTED;
 static enum msg_sync_iteration_state msg_sync_iteration_state;
@@ -513,7 +649,26 @@ static struct list_head *msg_sync_iteration_queue;
 static struct list_head *msg_sync_iteration_queue_message;
 static struct list_head *msg_sync_iteration_group;
 static struct list_head *msg_sync_iteration_group_member;
-static struct list_head *msg_sync_iteration_reply;
+
+/*
+ * Sync records are packed into MESSAGE_REQ_EXEC_MSG_SYNC_PACKED
+ * messages of up to MSG_SYNC_PACKED_SIZE bytes.
+ */
+#define MSG_SYNC_PACKED_SIZE 65536
+#define MSG_SYNC_PROGRESS_INTERVAL 256
+
+static char msg_sync_packed_buffer[MSG_SYNC_PACKED_SIZE];
+static size_t msg_sync_packed_used = 0;
+static unsigned int msg_sync_packed_records = 0;
+
+static unsigned int msg_sync_members_known = 0;
+static unsigned int msg_sync_message_skip = 0;
+
+static unsigned int msg_sync_sent_records = 0;
+static unsigned int msg_sync_sent_packed = 0;
+static unsigned long long msg_sync_sent_bytes = 0;
+static unsigned int msg_sync_received_records = 0;
+static unsigned long long msg_sync_received_bytes = 0;
 
 static void msg_sync_init (
 	const unsigned int *member_list,
@@ -535,6 +690,8 @@ static unsigned int msg_member_list[PROCESSOR_COUNT_MAX];
 static unsigned int msg_member_list_entries = 0;
 static unsigned int lowest_nodeid = 0;
 
+static unsigned int msg_standby_enabled = 0;
+
 static struct memb_ring_id saved_ring_id;
 
 static int msg_find_member_nodeid (unsigned int nodeid);
@@ -546,6 +703,8 @@ static void msg_sendreceive_timeout (void *data);
 static void msg_queue_release (struct queue_entry *queue);
 static void msg_group_release (struct group_entry *group);
 static void msg_reply_release (struct reply_entry *reply);
+static void msg_reply_result_leave (
+	const unsigned int *left_list, size_t left_list_entries);
 
 static void msg_confchg_fn (
 	enum totem_configuration_type configuration_type,
@@ -661,6 +820,10 @@ struct corosync_lib_handler msg_lib_engine[] =
 		.lib_handler_fn		= message_handler_req_lib_msg_limitget,
 		.flow_control		= COROSYNC_LIB_FLOW_CONTROL_REQUIRED
 	},
+	{
+		.lib_handler_fn		= message_handler_req_lib_msg_messagegetmany,
+		.flow_control		= COROSYNC_LIB_FLOW_CONTROL_REQUIRED
+	},
 };
 
 static struct corosync_exec_handler msg_exec_engine[] =
@@ -801,6 +964,18 @@ static struct corosync_exec_handler msg_exec_engine[] =
 		.exec_handler_fn	= message_handler_req_exec_msg_sendreceive_timeout,
 		.exec_endian_convert_fn = exec_msg_sendreceive_timeout_endian_convert
 	},
+	{
+		.exec_handler_fn	= message_handler_req_exec_msg_message_deliver,
+		.exec_endian_convert_fn = exec_msg_message_deliver_endian_convert
+	},
+	{
+		.exec_handler_fn	= message_handler_req_exec_msg_reply_result,
+		.exec_endian_convert_fn = exec_msg_reply_result_endian_convert
+	},
+	{
+		.exec_handler_fn	= message_handler_req_exec_msg_sync_packed,
+		.exec_endian_convert_fn = exec_msg_sync_packed_endian_convert
+	},
 };
 
 struct corosync_service_engine msg_service_engine = {
@@ -875,6 +1050,7 @@ struct req_exec_msg_queueopen {
 	mar_msg_queue_creation_attributes_t create_attrs __attribute__((aligned(8)));
 	mar_msg_queue_open_flags_t open_flags __attribute__((aligned(8)));
 	mar_time_t timeout __attribute__((aligned(8)));
+	mar_uint32_t standby_nodeid __attribute__((aligned(8)));
 };
 
 struct req_exec_msg_queueopenasync {
@@ -886,6 +1062,7 @@ struct req_exec_msg_queueopenasync {
 	mar_msg_queue_creation_attributes_t create_attrs __attribute__((aligned(8)));
 	mar_msg_queue_open_flags_t open_flags __attribute__((aligned(8)));
 	mar_invocation_t invocation __attribute__((aligned(8)));
+	mar_uint32_t standby_nodeid __attribute__((aligned(8)));
 };
 
 struct req_exec_msg_queueclose {
@@ -983,6 +1160,9 @@ struct req_exec_msg_messageget {
 	mar_name_t queue_name __attribute__((aligned(8)));
 	mar_uint32_t queue_id __attribute__((aligned(8)));
 	mar_time_t timeout __attribute__((aligned(8)));
+	mar_uint32_t max_messages __attribute__((aligned(8)));
+	mar_size_t max_bytes __attribute__((aligned(8)));
+	mar_uint8_t packed __attribute__((aligned(8)));
 };
 
 struct req_exec_msg_messagedatafree {
@@ -1064,6 +1244,11 @@ struct req_exec_msg_sync_queue {
 	mar_msg_queue_open_flags_t open_flags __attribute__((aligned(8)));
 	mar_msg_queue_group_changes_t change_flag __attribute__((aligned(8)));
 	mar_msg_queue_creation_attributes_t create_attrs __attribute__((aligned(8)));
+	mar_uint32_t owner_nodeid __attribute__((aligned(8)));
+	mar_uint32_t standby_nodeid __attribute__((aligned(8)));
+	mar_uint32_t message_id __attribute__((aligned(8)));
+	mar_uint32_t message_count __attribute__((aligned(8)));
+	mar_uint8_t message_skip __attribute__((aligned(8)));
 };
 
 struct req_exec_msg_sync_queue_message {
@@ -1074,6 +1259,7 @@ struct req_exec_msg_sync_queue_message {
 	mar_time_t send_time __attribute__((aligned(8)));
 	mar_msg_message_t message __attribute__((aligned(8)));
 	mar_msg_sender_id_t sender_id __attribute__((aligned(8)));
+	mar_uint32_t message_id __attribute__((aligned(8)));
 };
 
 struct req_exec_msg_sync_queue_refcount {
@@ -1081,7 +1267,8 @@ struct req_exec_msg_sync_queue_refcount {
 	struct memb_ring_id ring_id __attribute__((aligned(8)));
 	mar_name_t queue_name __attribute__((aligned(8)));
 	mar_uint32_t queue_id __attribute__((aligned(8)));
-	struct refcount_set refcount_set[PROCESSOR_COUNT_MAX] __attribute__((aligned(8)));
+	mar_uint32_t refcount_set_count __attribute__((aligned(8)));
+	/* followed by refcount_set_count mar_refcount_set_t entries */
 };
 
 struct req_exec_msg_sync_group {
@@ -1106,6 +1293,16 @@ struct req_exec_msg_sync_reply {
 	mar_message_source_t source __attribute__((aligned(8)));
 };
 
+/*
+ * A packed sync message is followed by record_count sync records,
+ * each a complete req_exec_msg_sync_* message with its own header.
+ */
+struct req_exec_msg_sync_packed {
+	coroipc_request_header_t header __attribute__((aligned(8)));
+	struct memb_ring_id ring_id __attribute__((aligned(8)));
+	mar_uint32_t record_count __attribute__((aligned(8)));
+};
+
 struct req_exec_msg_queue_timeout {
 	coroipc_request_header_t header __attribute__((aligned(8)));
 	mar_message_source_t source __attribute__((aligned(8))); /* ? */
@@ -1124,6 +1321,25 @@ struct req_exec_msg_sendreceive_timeout {
 	mar_msg_sender_id_t sender_id __attribute__((aligned(8)));
 };
 
+struct req_exec_msg_message_deliver {
+	coroipc_request_header_t header __attribute__((aligned(8)));
+	mar_message_source_t source __attribute__((aligned(8)));
+	mar_name_t queue_name __attribute__((aligned(8)));
+	mar_uint32_t queue_id __attribute__((aligned(8)));
+	mar_uint32_t error __attribute__((aligned(8)));
+	mar_uint32_t number_of_messages __attribute__((aligned(8)));
+	mar_uint8_t packed __attribute__((aligned(8)));
+};
+
+struct req_exec_msg_reply_result {
+	coroipc_request_header_t header __attribute__((aligned(8)));
+	mar_message_source_t source __attribute__((aligned(8)));
+	mar_uint32_t error __attribute__((aligned(8)));
+	mar_invocation_t invocation __attribute__((aligned(8)));
+	mar_msg_ack_flags_t ack_flags __attribute__((aligned(8)));
+	mar_uint8_t async __attribute__((aligned(8)));
+};
+
 static void exec_msg_queueopen_endian_convert (void *msg)
 {
 	struct req_exec_msg_queueopen *to_swab =
@@ -1137,6 +1353,7 @@ static void exec_msg_queueopen_endian_convert (void *msg)
 	swab_mar_msg_queue_creation_attributes_t (&to_swab->create_attrs);
 	swab_mar_queue_open_flags_t (&to_swab->open_flags);
 	swab_mar_time_t (&to_swab->timeout);
+	swab_mar_uint32_t (&to_swab->standby_nodeid);
 
 	return;
 }
@@ -1155,6 +1372,7 @@ static void exec_msg_queueopenasync_endian_convert (void *msg)
 	swab_mar_msg_queue_creation_attributes_t (&to_swab->create_attrs);
 	swab_mar_queue_open_flags_t (&to_swab->open_flags);
 	swab_mar_invocation_t (&to_swab->invocation);
+	swab_mar_uint32_t (&to_swab->standby_nodeid);
 
 	return;
 }
@@ -1321,6 +1539,7 @@ static void exec_msg_messagesendasync_endian_convert (void *msg)
 	swab_mar_name_t (&to_swab->destination);
 	swab_mar_invocation_t (&to_swab->invocation);
 	swab_mar_msg_message_t (&to_swab->message);
+	swab_mar_uint32_t (&to_swab->ack_flags);
 
 	return;
 }
@@ -1335,6 +1554,9 @@ static void exec_msg_messageget_endian_convert (void *msg)
 	swab_mar_name_t (&to_swab->queue_name);
 	swab_mar_uint32_t (&to_swab->queue_id);
 	swab_mar_time_t (&to_swab->timeout);
+	swab_mar_uint32_t (&to_swab->max_messages);
+	swab_mar_size_t (&to_swab->max_bytes);
+	swab_mar_uint8_t (&to_swab->packed);
 
 	return;
 }
@@ -1403,6 +1625,7 @@ static void exec_msg_messagereplyasync_endian_convert (void *msg)
 	swab_mar_msg_message_t (&to_swab->reply_message);
 	swab_mar_msg_sender_id_t (&to_swab->sender_id);
 	swab_mar_invocation_t (&to_swab->invocation);
+	swab_mar_uint32_t (&to_swab->ack_flags);
 
 	return;
 }
@@ -1541,6 +1764,96 @@ static void exec_msg_sendreceive_timeout_endian_convert (void *msg)
 	return;
 }
 
+static void exec_msg_message_deliver_endian_convert (void *msg)
+{
+	struct req_exec_msg_message_deliver *to_swab =
+		(struct req_exec_msg_message_deliver *)msg;
+	struct res_lib_msg_messagegetmany_entry *entry;
+	char *record;
+	unsigned int i;
+
+	swab_coroipc_request_header_t (&to_swab->header);
+	swab_mar_message_source_t (&to_swab->source);
+	swab_mar_name_t (&to_swab->queue_name);
+	swab_mar_uint32_t (&to_swab->queue_id);
+	swab_mar_uint32_t (&to_swab->error);
+	swab_mar_uint32_t (&to_swab->number_of_messages);
+	swab_mar_uint8_t (&to_swab->packed);
+
+	/*
+	 * The messages follow the header as packed entries, each padded
+	 * to 8 bytes, so the size must be swabbed before the next entry
+	 * can be found.
+	 */
+	record = (char *)(to_swab + 1);
+
+	for (i = 0; i < to_swab->number_of_messages; i++) {
+		if (record + sizeof (struct res_lib_msg_messagegetmany_entry) >
+		    (char *)(to_swab) + to_swab->header.size)
+		{
+			break;
+		}
+
+		entry = (struct res_lib_msg_messagegetmany_entry *)record;
+
+		swab_mar_time_t (&entry->send_time);
+		swab_mar_msg_sender_id_t (&entry->sender_id);
+		swab_mar_msg_message_t (&entry->message);
+
+		record += sizeof (struct res_lib_msg_messagegetmany_entry) +
+			MSG_GET_MANY_ALIGN (entry->message.size);
+	}
+
+	return;
+}
+
+static void exec_msg_reply_result_endian_convert (void *msg)
+{
+	struct req_exec_msg_reply_result *to_swab =
+		(struct req_exec_msg_reply_result *)msg;
+
+	swab_coroipc_request_header_t (&to_swab->header);
+	swab_mar_message_source_t (&to_swab->source);
+	swab_mar_uint32_t (&to_swab->error);
+	swab_mar_invocation_t (&to_swab->invocation);
+	swab_mar_uint32_t (&to_swab->ack_flags);
+	swab_mar_uint8_t (&to_swab->async);
+
+	return;
+}
+
+static void exec_msg_sync_packed_endian_convert (void *msg)
+{
+	struct req_exec_msg_sync_packed *to_swab =
+		(struct req_exec_msg_sync_packed *)msg;
+	coroipc_request_header_t *header;
+	char *record;
+	unsigned int id;
+	unsigned int size;
+	unsigned int i;
+
+	swab_coroipc_request_header_t (&to_swab->header);
+	swab_mar_uint32_t (&to_swab->record_count);
+
+	record = (char *)(to_swab + 1);
+
+	for (i = 0; i < to_swab->record_count; i++) {
+		header = (coroipc_request_header_t *)record;
+
+		id = swab32 (header->id);
+		size = swab32 (header->size);
+
+		msg_exec_engine[id & 0xffff].exec_endian_convert_fn (record);
+
+		header->id = id;
+		header->size = size;
+
+		record += size;
+	}
+
+	return;
+}
+
 static void msg_queue_list_print (
 	struct list_head *queue_head)
 {
@@ -1656,55 +1969,59 @@ static int msg_find_member_nodeid (
 	return (0);
 }
 
-void msg_sync_refcount_increment (
-	struct queue_entry *queue,
-	unsigned int nodeid)
+/*
+ * Pick the node that keeps a second copy of the message bodies of a
+ * queue created on this node. This is the member that follows the local
+ * node in the membership list, or none if standby copies are disabled.
+ */
+static unsigned int msg_standby_select (void)
 {
+	unsigned int local_nodeid = api->totem_nodeid_get ();
 	unsigned int i;
 
-	for (i = 0; i < PROCESSOR_COUNT_MAX; i++) {
-		if (queue->refcount_set[i].nodeid == 0) {
-			queue->refcount_set[i].nodeid = nodeid;
-			queue->refcount_set[i].refcount = 1;
-			break;
-		}
-		if (queue->refcount_set[i].nodeid == nodeid) {
-			queue->refcount_set[i].refcount += 1;
-			break;
+	if ((msg_standby_enabled == 0) || (msg_member_list_entries < 2)) {
+		return (0);
+	}
+
+	for (i = 0; i < msg_member_list_entries; i++) {
+		if (msg_member_list[i] == local_nodeid) {
+			return (msg_member_list[(i + 1) % msg_member_list_entries]);
 		}
 	}
+	return (0);
 }
 
-void msg_sync_refcount_decrement (
+/*
+ * Message metadata is replicated on every node, but the message bodies
+ * of a queue are only kept on its owner node and its standby node.
+ */
+static int msg_queue_body_local (
+	struct queue_entry *queue)
+{
+	unsigned int local_nodeid = api->totem_nodeid_get ();
+
+	return ((queue->owner_nodeid == local_nodeid) ||
+		(queue->standby_nodeid == local_nodeid));
+}
+
+void msg_sync_refcount_increment (
 	struct queue_entry *queue,
 	unsigned int nodeid)
 {
-	unsigned int i;
+	refcount_vector_increment (&queue->refcount_set, nodeid);
+}
 
-	for (i = 0; i < PROCESSOR_COUNT_MAX; i++) {
-		if (queue->refcount_set[i].nodeid == 0) {
-			break;
-		}
-		if (queue->refcount_set[i].nodeid == nodeid) {
-			queue->refcount_set[i].refcount -= 1;
-			break;
-		}
-	}
+void msg_sync_refcount_decrement (
+	struct queue_entry *queue,
+	unsigned int nodeid)
+{
+	refcount_vector_decrement (&queue->refcount_set, nodeid);
 }
 
 void msg_sync_refcount_calculate (
 	struct queue_entry *queue)
 {
-	unsigned int i;
-
-	queue->refcount = 0;
-
-	for (i = 0; i < PROCESSOR_COUNT_MAX; i++) {
-		if (queue->refcount_set[i].nodeid == 0) {
-			break;
-		}
-		queue->refcount += queue->refcount_set[i].refcount;
-	}
+	queue->refcount = refcount_vector_total (&queue->refcount_set);
 }
 
 /* ! */
@@ -1818,7 +2135,25 @@ static void msg_queue_close (
 	iov.iov_base = (void *)&req_exec_msg_queueclose;
 	iov.iov_len = sizeof (struct req_exec_msg_queueclose);
 
-	assert (api->totem_mcast (&iov, 1, TOTEM_AGREED) == 0);
+	assert (msg_totem_mcast (&iov, 1, TOTEM_AGREED) == 0);
+}
+
+static void msg_queue_owner_restore (
+	struct list_head *queue_head)
+{
+	struct queue_entry *queue;
+	struct list_head *queue_list;
+
+	for (queue_list = queue_head->next;
+	     queue_list != queue_head;
+	     queue_list = queue_list->next)
+	{
+		queue = list_entry (queue_list, struct queue_entry, queue_list);
+
+		if (queue->owner_nodeid == 0) {
+			queue->owner_nodeid = lowest_nodeid;
+		}
+	}
 }
 
 static void msg_queue_timer_restart (
@@ -1864,6 +2199,17 @@ static void msg_confchg_fn (
 	if (configuration_type != TOTEM_CONFIGURATION_REGULAR) {
 		return;
 	}
+
+	msg_reply_result_leave (left_list, left_list_entries);
+
+	/*
+	 * If no node has joined since the last completed synchronization,
+	 * every member already holds the queued messages.
+	 */
+	if (joined_list_entries != 0) {
+		msg_sync_members_known = 0;
+	}
+
 	if (msg_sync_state != MSG_SYNC_STATE_NOT_STARTED) {
 		return;
 	}
@@ -1886,6 +2232,89 @@ static void msg_confchg_fn (
 	return;
 }
 
+static int msg_sync_packed_flush (void)
+{
+	struct req_exec_msg_sync_packed req_exec_msg_sync_packed;
+	struct iovec iov[2];
+	int result;
+
+	if (msg_sync_packed_records == 0) {
+		return (0);
+	}
+
+	req_exec_msg_sync_packed.header.size =
+		sizeof (struct req_exec_msg_sync_packed) + msg_sync_packed_used;
+	req_exec_msg_sync_packed.header.id =
+		SERVICE_ID_MAKE (MSG_SERVICE, MESSAGE_REQ_EXEC_MSG_SYNC_PACKED);
+
+	memcpy (&req_exec_msg_sync_packed.ring_id,
+		&saved_ring_id, sizeof (struct memb_ring_id));
+
+	req_exec_msg_sync_packed.record_count = msg_sync_packed_records;
+
+	iov[0].iov_base = (void *)&req_exec_msg_sync_packed;
+	iov[0].iov_len = sizeof (struct req_exec_msg_sync_packed);
+	iov[1].iov_base = (void *)msg_sync_packed_buffer;
+	iov[1].iov_len = msg_sync_packed_used;
+
+	result = msg_totem_mcast (iov, 2, TOTEM_AGREED);
+	if (result != 0) {
+		return (result);
+	}
+
+	msg_sync_sent_records += msg_sync_packed_records;
+	msg_sync_sent_bytes += req_exec_msg_sync_packed.header.size;
+	msg_sync_sent_packed += 1;
+
+	if ((msg_sync_sent_packed % MSG_SYNC_PROGRESS_INTERVAL) == 0) {
+		log_printf (LOGSYS_LEVEL_NOTICE,
+			"Msg sync in progress: %u records in %u messages (%llu bytes) sent\n",
+			msg_sync_sent_records, msg_sync_sent_packed,
+			msg_sync_sent_bytes);
+	}
+
+	msg_sync_packed_used = 0;
+	msg_sync_packed_records = 0;
+
+	return (0);
+}
+
+/*
+ * Append a sync record to the packed sync message, sending the packed
+ * message first if the record does not fit. Returns nonzero if totem
+ * could not take the packed message, in which case the record has not
+ * been added and the caller retries it later.
+ */
+static int msg_sync_record_add (
+	const struct iovec *iovec,
+	unsigned int iov_len)
+{
+	size_t size = 0;
+	unsigned int i;
+	int result;
+
+	for (i = 0; i < iov_len; i++) {
+		size += iovec[i].iov_len;
+	}
+
+	if (msg_sync_packed_used + size > MSG_SYNC_PACKED_SIZE) {
+		result = msg_sync_packed_flush ();
+		if (result != 0) {
+			return (result);
+		}
+	}
+
+	for (i = 0; i < iov_len; i++) {
+		memcpy (msg_sync_packed_buffer + msg_sync_packed_used,
+			iovec[i].iov_base, iovec[i].iov_len);
+		msg_sync_packed_used += iovec[i].iov_len;
+	}
+
+	msg_sync_packed_records += 1;
+
+	return (0);
+}
+
 static int msg_sync_queue_transmit (
 	struct queue_entry *queue)
 {
@@ -1922,16 +2351,21 @@ static int msg_sync_queue_transmit (
 	req_exec_msg_sync_queue.open_flags = queue->open_flags;
 	req_exec_msg_sync_queue.change_flag = queue->change_flag;
 	req_exec_msg_sync_queue.queue_handle = queue->queue_handle;
+	req_exec_msg_sync_queue.owner_nodeid = queue->owner_nodeid;
+	req_exec_msg_sync_queue.standby_nodeid = queue->standby_nodeid;
+	req_exec_msg_sync_queue.message_id = queue->message_id;
+	req_exec_msg_sync_queue.message_skip = msg_sync_message_skip;
 
 	for (i = SA_MSG_MESSAGE_HIGHEST_PRIORITY; i <= SA_MSG_MESSAGE_LOWEST_PRIORITY; i++) {
 		req_exec_msg_sync_queue.capacity_available[i] =	queue->priority[i].capacity_available;
 		req_exec_msg_sync_queue.capacity_reached[i] = queue->priority[i].capacity_reached;
+		req_exec_msg_sync_queue.message_count += queue->priority[i].number_of_messages;
 	}
 
 	iov.iov_base = (void *)&req_exec_msg_sync_queue;
 	iov.iov_len = sizeof (struct req_exec_msg_sync_queue);
 
-	return (api->totem_mcast (&iov, 1, TOTEM_AGREED));
+	return (msg_sync_record_add (&iov, 1));
 }
 
 static int msg_sync_queue_message_transmit (
@@ -1939,7 +2373,7 @@ static int msg_sync_queue_message_transmit (
 	struct message_entry *message)
 {
 	struct req_exec_msg_sync_queue_message req_exec_msg_sync_queue_message;
-	struct iovec iov[2];
+	struct iovec iov;
 
 	/* DEBUG */
 	log_printf (LOGSYS_LEVEL_DEBUG, "[DEBUG]: msg_sync_queue_message_transmit { queue=%s id=%u}\n",
@@ -1961,23 +2395,24 @@ static int msg_sync_queue_message_transmit (
 	req_exec_msg_sync_queue_message.queue_id = queue->queue_id;
 	req_exec_msg_sync_queue_message.send_time = message->send_time;
 	req_exec_msg_sync_queue_message.sender_id = message->sender_id;
+	req_exec_msg_sync_queue_message.message_id = message->message_id;
 
-	iov[0].iov_base = (void *)&req_exec_msg_sync_queue_message;
-	iov[0].iov_len = sizeof (struct req_exec_msg_sync_queue_message);
-
-	iov[1].iov_base = (void *)message->message.data;
-	iov[1].iov_len = message->message.size;
+	/*
+	 * Only the message metadata is sent. The owner and standby nodes
+	 * keep the message bodies they already hold.
+	 */
+	iov.iov_base = (void *)&req_exec_msg_sync_queue_message;
+	iov.iov_len = sizeof (struct req_exec_msg_sync_queue_message);
 
-	return (api->totem_mcast (iov, 2, TOTEM_AGREED));
+	return (msg_sync_record_add (&iov, 1));
 }
 
 static int msg_sync_queue_refcount_transmit (
 	struct queue_entry *queue)
 {
 	struct req_exec_msg_sync_queue_refcount req_exec_msg_sync_queue_refcount;
-	struct iovec iov;
-
-	int i;
+	mar_refcount_set_t refcount_set[PROCESSOR_COUNT_MAX];
+	struct iovec iov[2];
 
 	/* DEBUG */
 	log_printf (LOGSYS_LEVEL_DEBUG, "[DEBUG]: msg_sync_queue_refcount_transmit { queue=%s id=%u }\n",
@@ -1987,8 +2422,11 @@ static int msg_sync_queue_refcount_transmit (
 	memset (&req_exec_msg_sync_queue_refcount, 0,
 		sizeof (struct req_exec_msg_sync_queue_refcount));
 
+	assert (queue->refcount_set.count <= PROCESSOR_COUNT_MAX);
+
 	req_exec_msg_sync_queue_refcount.header.size =
-		sizeof (struct req_exec_msg_sync_queue_refcount);
+		sizeof (struct req_exec_msg_sync_queue_refcount) +
+		sizeof (mar_refcount_set_t) * queue->refcount_set.count;
 	req_exec_msg_sync_queue_refcount.header.id =
 		SERVICE_ID_MAKE (MSG_SERVICE, MESSAGE_REQ_EXEC_MSG_SYNC_QUEUE_REFCOUNT);
 
@@ -1998,16 +2436,17 @@ static int msg_sync_queue_refcount_transmit (
 		&queue->queue_name, sizeof (mar_name_t));
 
 	req_exec_msg_sync_queue_refcount.queue_id = queue->queue_id;
+	req_exec_msg_sync_queue_refcount.refcount_set_count =
+		queue->refcount_set.count;
 
-	for (i = 0; i < PROCESSOR_COUNT_MAX; i++) {
-		req_exec_msg_sync_queue_refcount.refcount_set[i].refcount = queue->refcount_set[i].refcount;
-		req_exec_msg_sync_queue_refcount.refcount_set[i].nodeid = queue->refcount_set[i].nodeid;
-	}
+	marshall_to_mar_refcount_set_t_all (refcount_set, &queue->refcount_set);
 
-	iov.iov_base = (void *)&req_exec_msg_sync_queue_refcount;
-	iov.iov_len = sizeof (struct req_exec_msg_sync_queue_refcount);
+	iov[0].iov_base = (void *)&req_exec_msg_sync_queue_refcount;
+	iov[0].iov_len = sizeof (struct req_exec_msg_sync_queue_refcount);
+	iov[1].iov_base = (void *)refcount_set;
+	iov[1].iov_len = sizeof (mar_refcount_set_t) * queue->refcount_set.count;
 
-	return (api->totem_mcast (&iov, 1, TOTEM_AGREED));
+	return (msg_sync_record_add (iov, 2));
 }
 
 static int msg_sync_group_transmit (
@@ -2038,7 +2477,7 @@ static int msg_sync_group_transmit (
 	iov.iov_base = (void *)&req_exec_msg_sync_group;
 	iov.iov_len = sizeof (struct req_exec_msg_sync_group);
 
-	return (api->totem_mcast (&iov, 1, TOTEM_AGREED));
+	return (msg_sync_record_add (&iov, 1));
 }
 
 static int msg_sync_group_member_transmit (
@@ -2073,40 +2512,10 @@ static int msg_sync_group_member_transmit (
 	iov.iov_base = (void *)&req_exec_msg_sync_group_member;
 	iov.iov_len = sizeof (struct req_exec_msg_sync_group_member);
 
-	return (api->totem_mcast (&iov, 1, TOTEM_AGREED));
+	return (msg_sync_record_add (&iov, 1));
 }
 
-static int msg_sync_reply_transmit (
-	struct reply_entry *reply)
-{
-	struct req_exec_msg_sync_reply req_exec_msg_sync_reply;
-	struct iovec iov;
-
-	/* DEBUG */
-	log_printf (LOGSYS_LEVEL_DEBUG, "[DEBUG]: msg_sync_reply_transmit\n");
-
-	memset (&req_exec_msg_sync_reply, 0,
-		sizeof (struct req_exec_msg_sync_reply));
-
-	req_exec_msg_sync_reply.header.size =
-		sizeof (struct req_exec_msg_sync_reply);
-	req_exec_msg_sync_reply.header.id =
-		SERVICE_ID_MAKE (MSG_SERVICE, MESSAGE_REQ_EXEC_MSG_SYNC_REPLY);
-
-	memcpy (&req_exec_msg_sync_reply.ring_id,
-		&saved_ring_id, sizeof (struct memb_ring_id));
-	memcpy (&req_exec_msg_sync_reply.source,
-		&reply->source, sizeof (mar_message_source_t));
-
-	req_exec_msg_sync_reply.sender_id = reply->sender_id;
-
-	iov.iov_base = (void *)&req_exec_msg_sync_reply;
-	iov.iov_len = sizeof (struct req_exec_msg_sync_reply);
-
-	return (api->totem_mcast (&iov, 1, TOTEM_AGREED));
-}
-
-static int msg_sync_queue_iterate (void)
+static int msg_sync_queue_iterate (void)
 {
 	struct queue_entry *queue;
 	struct list_head *queue_list;
@@ -2150,7 +2559,11 @@ static int msg_sync_queue_iterate (void)
 			if (result != 0) {
 				return (-1);
 			}
-			msg_sync_iteration_queue_message = queue->message_head.next;
+			if (msg_sync_message_skip) {
+				msg_sync_iteration_queue_message = &queue->message_head;
+			} else {
+				msg_sync_iteration_queue_message = queue->message_head.next;
+			}
 			msg_sync_iteration_state = MSG_SYNC_ITERATION_STATE_QUEUE_MESSAGE;
 		}
 
@@ -2229,39 +2642,6 @@ static int msg_sync_group_iterate (void)
 	return (0);
 }
 
-static int msg_sync_reply_iterate (void)
-{
-	struct reply_entry *reply;
-	struct list_head *reply_list;
-
-	int result;
-
-	/* DEBUG */
-	log_printf (LOGSYS_LEVEL_DEBUG, "[DEBUG]: msg_sync_reply_iterate\n");
-
-	for (reply_list = msg_sync_iteration_reply;
-	     reply_list != &reply_list_head;
-	     reply_list = reply_list->next)
-	{
-		reply = list_entry (reply_list, struct reply_entry, reply_list);
-
-		if (msg_sync_iteration_state == MSG_SYNC_ITERATION_STATE_REPLY)
-		{
-			if (msg_find_member_nodeid (reply->sender_id >> 32)) {
-				result = msg_sync_reply_transmit (reply);
-				if (result != 0) {
-					return (-1);
-				}
-			}
-		}
-
-		msg_sync_iteration_state = MSG_SYNC_ITERATION_STATE_REPLY;
-		msg_sync_iteration_reply = reply_list->next;
-	}
-
-	return (0);
-}
-
 static void msg_sync_queue_enter (void)
 {
 	struct queue_entry *queue;
@@ -2298,22 +2678,6 @@ static void msg_sync_group_enter (void)
 	sync_group_count = 0;
 }
 
-static void msg_sync_reply_enter (void)
-{
-	struct reply_entry *reply;
-
-	/* DEBUG */
-	log_printf (LOGSYS_LEVEL_DEBUG, "[DEBUG]: msg_sync_reply_enter\n");
-
-	reply = list_entry (reply_list_head.next, struct reply_entry, reply_list);
-
-	msg_sync_state = MSG_SYNC_STATE_REPLY;
-	msg_sync_iteration_state = MSG_SYNC_ITERATION_STATE_REPLY;
-
-	msg_sync_iteration_reply = reply_list_head.next;
-	/* ? */
-}
-
 static inline void msg_sync_queue_free (
 	struct list_head *queue_head)
 {
@@ -2356,27 +2720,6 @@ static inline void msg_sync_group_free (
 	list_init (group_head);	/* ? */
 }
 
-static inline void msg_sync_reply_free (
-	struct list_head *reply_head)
-{
-	struct reply_entry *reply;
-	struct list_head *reply_list;
-
-	/* DEBUG */
-	log_printf (LOGSYS_LEVEL_DEBUG, "[DEBUG]: msg_sync_reply_free\n");
-
-	reply_list = reply_head->next;
-
-	while (reply_list != reply_head) {
-		reply = list_entry (reply_list, struct reply_entry, reply_list);
-		reply_list = reply_list->next;
-
-		msg_reply_release (reply);
-	}
-
-	list_init (reply_head);	/* ? */
-}
-
 static void msg_sync_init (
 	const unsigned int *member_list,
 	size_t member_list_entries,
@@ -2385,6 +2728,15 @@ static void msg_sync_init (
 	/* DEBUG */
 	log_printf (LOGSYS_LEVEL_DEBUG, "[DEBUG]: msg_sync_init\n");
 
+	msg_sync_message_skip = msg_sync_members_known;
+
+	msg_sync_packed_used = 0;
+	msg_sync_packed_records = 0;
+
+	msg_sync_sent_records = 0;
+	msg_sync_sent_packed = 0;
+	msg_sync_sent_bytes = 0;
+
 	msg_sync_queue_enter();
 
 	return;
@@ -2409,9 +2761,19 @@ static int msg_sync_process (void)
 			TRACE1 ("transmit queue list because lowest member in old configuration.\n");
 
 			iterate_result = msg_sync_queue_iterate ();
+			if (iterate_result == 0) {
+				iterate_result = msg_sync_packed_flush ();
+			}
 			if (iterate_result != 0) {
 				iterate_finish = 0;
 			}
+			else {
+				log_printf (LOGSYS_LEVEL_NOTICE,
+					"Msg sync sent %u queues: %u records in %u messages (%llu bytes)%s\n",
+					global_queue_count, msg_sync_sent_records,
+					msg_sync_sent_packed, msg_sync_sent_bytes,
+					msg_sync_message_skip ? ", queued messages skipped" : "");
+			}
 		}
 
 		if (iterate_finish == 1) {
@@ -2428,28 +2790,18 @@ static int msg_sync_process (void)
 			TRACE1 ("transmit group list because lowest member in old configuration.\n");
 
 			iterate_result = msg_sync_group_iterate ();
-			if (iterate_result != 0) {
-				iterate_finish = 0;
+			if (iterate_result == 0) {
+				iterate_result = msg_sync_packed_flush ();
 			}
-		}
-
-		if (iterate_finish == 1) {
-			msg_sync_reply_enter ();
-		}
-
-		break;
-
-	case MSG_SYNC_STATE_REPLY:
-		iterate_finish = 1;
-		continue_process = 1;
-
-		if (lowest_nodeid == api->totem_nodeid_get()) {
-			TRACE1 ("transmit reply list because lowest member in old configuration.\n");
-
-			iterate_result = msg_sync_reply_iterate ();
 			if (iterate_result != 0) {
 				iterate_finish = 0;
 			}
+			else {
+				log_printf (LOGSYS_LEVEL_NOTICE,
+					"Msg sync sent %u groups: %u records in %u messages (%llu bytes) in total\n",
+					global_group_count, msg_sync_sent_records,
+					msg_sync_sent_packed, msg_sync_sent_bytes);
+			}
 		}
 
 		if (iterate_finish == 1) {
@@ -2472,7 +2824,6 @@ static void msg_sync_activate (void)
 
 	msg_sync_queue_free (&queue_list_head);
 	msg_sync_group_free (&group_list_head);
-	msg_sync_reply_free (&reply_list_head);
 
 	if (!list_empty (&sync_queue_list_head)) {
 		list_splice (&sync_queue_list_head, &queue_list_head);
@@ -2482,13 +2833,11 @@ static void msg_sync_activate (void)
 		list_splice (&sync_group_list_head, &group_list_head);
 	}
 
-	if (!list_empty (&sync_reply_list_head)) {
-		list_splice (&sync_reply_list_head, &reply_list_head);
-	}
+	msg_hash_move (queue_hash, sync_queue_hash);
+	msg_hash_move (group_hash, sync_group_hash);
 
 	list_init (&sync_queue_list_head);
 	list_init (&sync_group_list_head);
-	list_init (&sync_reply_list_head);
 
 	/*
 	 * Now that synchronization is complete, we must
@@ -2497,9 +2846,21 @@ static void msg_sync_activate (void)
 	 */
 	msg_queue_timer_restart (&queue_list_head);
 
+	msg_queue_owner_restore (&queue_list_head);
+
 	global_queue_count = sync_queue_count;
 	global_group_count = sync_group_count;
 
+	log_printf (LOGSYS_LEVEL_NOTICE,
+		"Msg sync received %u records (%llu bytes): %u queues, %u groups\n",
+		msg_sync_received_records, msg_sync_received_bytes,
+		global_queue_count, global_group_count);
+
+	msg_sync_received_records = 0;
+	msg_sync_received_bytes = 0;
+
+	msg_sync_members_known = 1;
+
 	msg_sync_state = MSG_SYNC_STATE_NOT_STARTED;
 
 	return;
@@ -2510,6 +2871,9 @@ static void msg_sync_abort (void)
 	/* DEBUG */
 	log_printf (LOGSYS_LEVEL_DEBUG, "[DEBUG]: msg_sync_abort\n");
 
+	msg_sync_received_records = 0;
+	msg_sync_received_bytes = 0;
+
 	return;
 }
 
@@ -2518,11 +2882,24 @@ static void msg_exec_dump_fn (void)
 	/* DEBUG */
 	log_printf (LOGSYS_LEVEL_DEBUG, "[DEBUG]: msg_exec_dump_fn\n");
 
+	log_printf (LOGSYS_LEVEL_NOTICE,
+		"msg: %llu messages sent by local clients\n",
+		msg_stats_messages_sent);
+	log_printf (LOGSYS_LEVEL_NOTICE,
+		"msg: %llu totem messages sent, %llu bytes, %.0f bytes per message sent\n",
+		msg_stats_totem_messages, msg_stats_totem_bytes,
+		(msg_stats_messages_sent != 0) ?
+			(double)(msg_stats_totem_bytes) / msg_stats_messages_sent : 0.0);
+
 	return;
 }
 
 static int msg_exec_init_fn (struct corosync_api_v1 *corosync_api)
 {
+	hdb_handle_t object_service_handle;
+	hdb_handle_t object_find_handle;
+	char *value;
+
 #ifdef OPENAIS_SOLARIS
 	logsys_subsys_init();
 #endif
@@ -2531,6 +2908,42 @@ static int msg_exec_init_fn (struct corosync_api_v1 *corosync_api)
 
 	api = corosync_api;
 
+	msg_hash_init (queue_hash);
+	msg_hash_init (group_hash);
+	msg_hash_init (track_hash);
+	msg_hash_init (reply_hash);
+	msg_hash_init (pending_hash);
+
+	msg_hash_init (sync_queue_hash);
+	msg_hash_init (sync_group_hash);
+
+	api->object_find_create (
+		OBJECT_PARENT_HANDLE,
+		"msg",
+		strlen ("msg"),
+		&object_find_handle);
+
+	if (api->object_find_next (
+		object_find_handle,
+		&object_service_handle) == 0) {
+
+		value = NULL;
+		if (!api->object_key_get (object_service_handle,
+					  "standby",
+					  strlen ("standby"),
+					  (void *)&value,
+					  NULL) && value) {
+			if (strcmp (value, "on") == 0) {
+				msg_standby_enabled = 1;
+			}
+			log_printf (LOGSYS_LEVEL_NOTICE,
+				"msg standby set to %s\n",
+				(msg_standby_enabled) ? "on" : "off");
+		}
+	}
+
+	api->object_find_destroy (object_find_handle);
+
 	return (0);
 }
 
@@ -2555,6 +2968,10 @@ static int msg_lib_exit_fn (void *conn)
 	struct track_entry *track;
 	struct list_head *track_list;
 
+	struct reply_entry *reply;
+	struct reply_result_entry *reply_result;
+	struct list_head *reply_list;
+
 	struct msg_pd *msg_pd = (struct msg_pd *)(api->ipc_private_data_get(conn));
 
 	/* DEBUG */
@@ -2590,9 +3007,34 @@ static int msg_lib_exit_fn (void *conn)
 		track_list = track_list->next;
 
 		list_del (&track->track_list);
+		list_del (&track->hash_list);
 		free (track);
 	}
 
+	reply_list = reply_list_head.next;
+
+	while (reply_list != &reply_list_head) {
+		reply = list_entry (reply_list, struct reply_entry, reply_list);
+		reply_list = reply_list->next;
+
+		if (reply->source.conn == conn) {
+			api->timer_delete (reply->timer_handle);
+			msg_reply_release (reply);
+		}
+	}
+
+	reply_list = reply_result_list_head.next;
+
+	while (reply_list != &reply_result_list_head) {
+		reply_result = list_entry (reply_list, struct reply_result_entry, list);
+		reply_list = reply_list->next;
+
+		if (reply_result->source.conn == conn) {
+			list_del (&reply_result->list);
+			free (reply_result);
+		}
+	}
+
 	return (0);
 }
 
@@ -2623,7 +3065,7 @@ static void msg_queue_timeout (void *data)
 	iovec.iov_base = (void *)&req_exec_msg_queue_timeout;
 	iovec.iov_len = sizeof (struct req_exec_msg_queue_timeout);
 
-	assert (api->totem_mcast (&iovec, 1, TOTEM_AGREED) == 0);
+	assert (msg_totem_mcast (&iovec, 1, TOTEM_AGREED) == 0);
 }
 
 static void msg_messageget_timeout (void *data)
@@ -2653,13 +3095,13 @@ static void msg_messageget_timeout (void *data)
 	iovec.iov_base = (void *)&req_exec_msg_messageget_timeout;
 	iovec.iov_len = sizeof (struct req_exec_msg_messageget_timeout);
 
-	assert (api->totem_mcast (&iovec, 1, TOTEM_AGREED) == 0);
+	assert (msg_totem_mcast (&iovec, 1, TOTEM_AGREED) == 0);
 }
 
 static void msg_sendreceive_timeout (void *data)
 {
-	struct req_exec_msg_sendreceive_timeout req_exec_msg_sendreceive_timeout;
-	struct iovec iovec;
+	struct res_lib_msg_messagesendreceive res_lib_msg_messagesendreceive;
+	struct iovec iov;
 
 	struct reply_entry *reply = (struct reply_entry *)data;
 
@@ -2668,21 +3110,20 @@ static void msg_sendreceive_timeout (void *data)
 	log_printf (LOGSYS_LEVEL_DEBUG, "\t sender_id=%llx\n",
 		    (unsigned long long)(reply->sender_id));
 
-	req_exec_msg_sendreceive_timeout.header.size =
-		sizeof (struct req_exec_msg_sendreceive_timeout);
-	req_exec_msg_sendreceive_timeout.header.id =
-		SERVICE_ID_MAKE (MSG_SERVICE, MESSAGE_REQ_EXEC_MSG_SENDRECEIVE_TIMEOUT);
+	res_lib_msg_messagesendreceive.header.size =
+		sizeof (struct res_lib_msg_messagesendreceive);
+	res_lib_msg_messagesendreceive.header.id =
+		MESSAGE_RES_MSG_MESSAGESENDRECEIVE;
+	res_lib_msg_messagesendreceive.header.error = SA_AIS_ERR_TIMEOUT;
 
-	memcpy (&req_exec_msg_sendreceive_timeout.source,
-		&reply->source,
-		sizeof (mar_message_source_t));
+	res_lib_msg_messagesendreceive.reply_time = 0;
 
-	req_exec_msg_sendreceive_timeout.sender_id = reply->sender_id;
+	iov.iov_base = (void *)&res_lib_msg_messagesendreceive;
+	iov.iov_len = sizeof (struct res_lib_msg_messagesendreceive);
 
-	iovec.iov_base = (void *)&req_exec_msg_sendreceive_timeout;
-	iovec.iov_len = sizeof (struct req_exec_msg_sendreceive_timeout);
+	api->ipc_response_iov_send (reply->source.conn, &iov, 1);
 
-	assert (api->totem_mcast (&iovec, 1, TOTEM_AGREED) == 0);
+	msg_reply_release (reply);
 }
 
 static void msg_pending_cancel (
@@ -2714,35 +3155,330 @@ static void msg_pending_cancel (
 	api->ipc_response_iov_send (pending->source.conn, &iov, 1);
 }
 
-static void msg_pending_deliver (
-	struct pending_entry *pending,
+/*
+ * Message headers are taken from a free list that grows in chunks and
+ * is never returned to the allocator, so queueing and dequeueing a
+ * message does not malloc or free.
+ */
+#define MSG_MESSAGE_POOL_GROW 64
+
+static struct message_entry *msg_message_alloc (void)
+{
+	struct message_entry *message;
+	int i;
+
+	if (list_empty (&message_pool_head)) {
+		message = malloc (sizeof (struct message_entry) * MSG_MESSAGE_POOL_GROW);
+		if (message == NULL) {
+			return (NULL);
+		}
+		for (i = 0; i < MSG_MESSAGE_POOL_GROW; i++) {
+			list_add_tail (&message[i].queue_list, &message_pool_head);
+		}
+	}
+
+	message = list_entry (message_pool_head.next, struct message_entry, queue_list);
+	list_del (&message->queue_list);
+
+	memset (message, 0, sizeof (struct message_entry));
+
+	return (message);
+}
+
+/*
+ * Message bodies are stored in one ring buffer per priority area, of
+ * exactly queue_size bytes. Messages leave a priority area in the order
+ * they were added, so a body is always written at the tail of the ring
+ * and released from its head, and a body that does not fit before the
+ * end of the buffer wraps around to the start. The ring is allocated
+ * the first time a body is stored, so nodes that do not keep the
+ * bodies for a queue never allocate it.
+ */
+static char *msg_ring_write (
+	struct priority_area *area,
+	const char *data,
+	mar_size_t size)
+{
+	mar_size_t ring_size = (area->queue_size != 0) ? area->queue_size : 1;
+	mar_size_t tail;
+	mar_size_t first;
+
+	if (area->ring == NULL) {
+		area->ring = malloc (ring_size);
+		if (area->ring == NULL) {
+			return (NULL);
+		}
+		area->ring_head = 0;
+		area->ring_used = 0;
+	}
+
+	if (area->queue_size - area->ring_used < size) {
+		return (NULL);
+	}
+
+	tail = (area->ring_head + area->ring_used) % ring_size;
+	first = ring_size - tail;
+	if (first > size) {
+		first = size;
+	}
+
+	memcpy (area->ring + tail, data, first);
+	memcpy (area->ring, data + first, size - first);
+
+	area->ring_used += size;
+
+	return (area->ring + tail);
+}
+
+/*
+ * Return how many bytes of a body are stored before the end of its
+ * ring. The rest of the body, if any, is at the start of the ring.
+ */
+static mar_size_t msg_ring_contiguous (
+	const struct priority_area *area,
+	const char *body,
+	mar_size_t size)
+{
+	if ((area->ring != NULL) &&
+	    (body >= area->ring) && (body < area->ring + area->queue_size) &&
+	    (size > (mar_size_t)(area->ring + area->queue_size - body)))
+	{
+		return (area->ring + area->queue_size - body);
+	}
+
+	return (size);
+}
+
+static void msg_ring_read (
+	const struct priority_area *area,
+	const char *body,
+	mar_size_t size,
+	char *buffer)
+{
+	mar_size_t first = msg_ring_contiguous (area, body, size);
+
+	memcpy (buffer, body, first);
+	memcpy (buffer + first, area->ring, size - first);
+}
+
+static void msg_message_free (
+	struct queue_entry *queue,
 	struct message_entry *message)
+{
+	struct priority_area *area = &queue->priority[message->message.priority];
+
+	if ((message->message.data != NULL) && (area->ring != NULL) &&
+	    (area->ring_used >= message->message.size))
+	{
+		area->ring_head = (area->queue_size != 0) ?
+			(area->ring_head + message->message.size) % area->queue_size : 0;
+		area->ring_used -= message->message.size;
+	}
+
+	list_add (&message->queue_list, &message_pool_head);
+}
+
+/*
+ * Answer a get. The messages are packed as a sequence of
+ * res_lib_msg_messagegetmany_entry headers, each followed by the
+ * message data padded to 8 bytes. A packed get receives them as they
+ * are; saMsgMessageGet receives the first one as res_lib_msg_messageget.
+ */
+static void msg_message_respond (
+	void *conn,
+	mar_uint8_t packed,
+	SaAisErrorT error,
+	const void *buffer,
+	size_t buffer_size,
+	unsigned int count)
 {
 	struct res_lib_msg_messageget res_lib_msg_messageget;
+	struct res_lib_msg_messagegetmany res_lib_msg_messagegetmany;
+	const struct res_lib_msg_messagegetmany_entry *entry = buffer;
 	struct iovec iov[2];
 
 	/* DEBUG */
-	log_printf (LOGSYS_LEVEL_DEBUG, "[DEBUG]: msg_pending_deliver\n");
+	log_printf (LOGSYS_LEVEL_DEBUG, "[DEBUG]: msg_message_respond\n");
+
+	if (packed) {
+		res_lib_msg_messagegetmany.header.size =
+			sizeof (struct res_lib_msg_messagegetmany);
+		res_lib_msg_messagegetmany.header.id =
+			MESSAGE_RES_MSG_MESSAGEGETMANY;
+		res_lib_msg_messagegetmany.header.error = error;
+		res_lib_msg_messagegetmany.number_of_messages = 0;
+
+		iov[0].iov_base = (void *)&res_lib_msg_messagegetmany;
+		iov[0].iov_len = sizeof (struct res_lib_msg_messagegetmany);
+
+		if (error == SA_AIS_OK) {
+			res_lib_msg_messagegetmany.header.size += buffer_size;
+			res_lib_msg_messagegetmany.number_of_messages = count;
+
+			iov[1].iov_base = (void *)buffer;
+			iov[1].iov_len = buffer_size;
+
+			api->ipc_response_iov_send (conn, iov, 2);
+		}
+		else {
+			api->ipc_response_iov_send (conn, iov, 1);
+		}
+		return;
+	}
 
 	res_lib_msg_messageget.header.size =
 		sizeof (struct res_lib_msg_messageget);
 	res_lib_msg_messageget.header.id =
 		MESSAGE_RES_MSG_MESSAGEGET;
-	res_lib_msg_messageget.header.error = SA_AIS_OK;
-
-	memcpy (&res_lib_msg_messageget.message, &message->message,
-		sizeof (mar_msg_message_t));
-
-	res_lib_msg_messageget.send_time = message->send_time;
-	res_lib_msg_messageget.sender_id = message->sender_id;
+	res_lib_msg_messageget.header.error = error;
 
 	iov[0].iov_base = (void *)&res_lib_msg_messageget;
 	iov[0].iov_len = sizeof (struct res_lib_msg_messageget);
 
-	iov[1].iov_base = (void *)message->message.data;
-	iov[1].iov_len = message->message.size;
+	if (error == SA_AIS_OK) {
+		memcpy (&res_lib_msg_messageget.message, &entry->message,
+			sizeof (mar_msg_message_t));
+
+		res_lib_msg_messageget.send_time = entry->send_time;
+		res_lib_msg_messageget.sender_id = entry->sender_id;
+
+		iov[1].iov_base = (void *)(entry + 1);
+		iov[1].iov_len = entry->message.size;
+
+		api->ipc_response_iov_send (conn, iov, 2);
+	}
+	else {
+		memset (&res_lib_msg_messageget.message, 0,
+			sizeof (mar_msg_message_t));
+
+		res_lib_msg_messageget.send_time = 0;
+		res_lib_msg_messageget.sender_id = 0;
+
+		api->ipc_response_iov_send (conn, iov, 1);
+	}
+}
+
+static void *msg_message_pack (
+	struct queue_entry *queue,
+	struct message_entry **messages,
+	unsigned int count,
+	size_t *size)
+{
+	struct res_lib_msg_messagegetmany_entry *entry;
+	char *buffer;
+	size_t offset = 0;
+	unsigned int i;
+
+	*size = 0;
+
+	for (i = 0; i < count; i++) {
+		if (messages[i]->message.data == NULL) {
+			return (NULL);
+		}
+		*size += sizeof (struct res_lib_msg_messagegetmany_entry) +
+			MSG_GET_MANY_ALIGN (messages[i]->message.size);
+	}
+
+	buffer = malloc (*size);
+	if (buffer == NULL) {
+		return (NULL);
+	}
+	memset (buffer, 0, *size);
+
+	for (i = 0; i < count; i++) {
+		entry = (struct res_lib_msg_messagegetmany_entry *)(buffer + offset);
+
+		memcpy (&entry->message, &messages[i]->message,
+			sizeof (mar_msg_message_t));
+
+		entry->send_time = messages[i]->send_time;
+		entry->sender_id = messages[i]->sender_id;
+
+		msg_ring_read (&queue->priority[messages[i]->message.priority],
+			messages[i]->message.data, messages[i]->message.size,
+			(char *)(entry + 1));
+
+		offset += sizeof (struct res_lib_msg_messagegetmany_entry) +
+			MSG_GET_MANY_ALIGN (messages[i]->message.size);
+	}
+
+	return (buffer);
+}
+
+/*
+ * Called on every node once messages have been taken off a queue for a
+ * getter. A getter on the owner or standby node is answered from the
+ * local copy of the bodies. Any other getter is answered by the owner,
+ * which multicasts the bodies to the getter's node.
+ */
+static void msg_message_deliver (
+	struct queue_entry *queue,
+	const mar_message_source_t *source,
+	mar_uint8_t packed,
+	struct message_entry **messages,
+	unsigned int count)
+{
+	struct req_exec_msg_message_deliver req_exec_msg_message_deliver;
+	struct iovec iov[2];
+	SaAisErrorT error = SA_AIS_OK;
+	void *buffer;
+	size_t buffer_size;
+
+	/* DEBUG */
+	log_printf (LOGSYS_LEVEL_DEBUG, "[DEBUG]: msg_message_deliver\n");
+
+	if (!msg_queue_body_local (queue)) {
+		return;
+	}
+
+	if ((source->nodeid == queue->owner_nodeid) ||
+	    (source->nodeid == queue->standby_nodeid))
+	{
+		if (!api->ipc_source_is_local (source)) {
+			return;
+		}
+	}
+	else if (queue->owner_nodeid != api->totem_nodeid_get ()) {
+		return;
+	}
+
+	buffer = msg_message_pack (queue, messages, count, &buffer_size);
+	if (buffer == NULL) {
+		error = SA_AIS_ERR_NO_RESOURCES;
+		buffer_size = 0;
+	}
+
+	if (api->ipc_source_is_local (source)) {
+		msg_message_respond (source->conn, packed, error,
+			buffer, buffer_size, count);
+		free (buffer);
+		return;
+	}
+
+	req_exec_msg_message_deliver.header.size =
+		sizeof (struct req_exec_msg_message_deliver) + buffer_size;
+	req_exec_msg_message_deliver.header.id =
+		SERVICE_ID_MAKE (MSG_SERVICE, MESSAGE_REQ_EXEC_MSG_MESSAGE_DELIVER);
 
-	api->ipc_response_iov_send (pending->source.conn, iov, 2);
+	memcpy (&req_exec_msg_message_deliver.source,
+		source, sizeof (mar_message_source_t));
+	memcpy (&req_exec_msg_message_deliver.queue_name,
+		&queue->queue_name, sizeof (mar_name_t));
+
+	req_exec_msg_message_deliver.queue_id = queue->queue_id;
+	req_exec_msg_message_deliver.error = error;
+	req_exec_msg_message_deliver.number_of_messages = count;
+	req_exec_msg_message_deliver.packed = packed;
+
+	iov[0].iov_base = (void *)&req_exec_msg_message_deliver;
+	iov[0].iov_len = sizeof (struct req_exec_msg_message_deliver);
+
+	iov[1].iov_base = buffer;
+	iov[1].iov_len = buffer_size;
+
+	assert (msg_totem_mcast (iov, (buffer_size != 0) ? 2 : 1, TOTEM_AGREED) == 0);
+
+	free (buffer);
 }
 
 static void msg_message_cancel (
@@ -2768,6 +3504,7 @@ static void msg_message_cancel (
 		}
 
 		list_del (&pending->pending_list);
+		list_del (&pending->hash_list);
 		free (pending);
 	}
 }	
@@ -2794,14 +3531,15 @@ static void msg_message_release (
 		list_del (&message->queue_list);
 		list_del (&message->message_list);
 
-		free (message->message.data);
-		free (message);
+		msg_message_free (queue, message);
 	}
 
 	for (i = SA_MSG_MESSAGE_HIGHEST_PRIORITY; i <= SA_MSG_MESSAGE_LOWEST_PRIORITY; i++)
 	{
 		queue->priority[i].queue_used = 0;
 		queue->priority[i].number_of_messages = 0;
+		queue->priority[i].ring_head = 0;
+		queue->priority[i].ring_used = 0;
 	}
 }
 
@@ -2812,6 +3550,7 @@ static void msg_pending_release (
 	log_printf (LOGSYS_LEVEL_DEBUG, "[DEBUG]: msg_pending_release\n");
 
 	list_del (&pending->pending_list);
+	list_del (&pending->hash_list);
 	free (pending);
 }
 
@@ -2843,6 +3582,7 @@ static void msg_queue_release (
 		}
 
 		list_del (&pending->pending_list);
+		list_del (&pending->hash_list);
 		free (pending);
 	}
 
@@ -2855,13 +3595,15 @@ static void msg_queue_release (
 		list_del (&message->queue_list);
 		list_del (&message->message_list);
 
-		free (message->message.data);
-		free (message);
+		msg_message_free (queue, message);
 	}
 
 	for (i = SA_MSG_MESSAGE_HIGHEST_PRIORITY; i <= SA_MSG_MESSAGE_LOWEST_PRIORITY; i++) {
 		queue->priority[i].queue_used = 0;
 		queue->priority[i].number_of_messages = 0;
+
+		free (queue->priority[i].ring);
+		queue->priority[i].ring = NULL;
 	}
 
 	if (queue->group != NULL) {
@@ -2871,6 +3613,8 @@ static void msg_queue_release (
 	global_queue_count -= 1;
 
 	list_del (&queue->queue_list);
+	list_del (&queue->hash_list);
+	refcount_vector_free (&queue->refcount_set);
 	free (queue);
 }
 
@@ -2908,6 +3652,7 @@ static void msg_group_release (
 
 		if (mar_name_match (&track->group_name, &group->group_name)) {
 			list_del (&track->track_list);
+			list_del (&track->hash_list);
 			free (track);
 		}
 	}
@@ -2915,6 +3660,7 @@ static void msg_group_release (
 	global_group_count -= 1;
 
 	list_del (&group->group_list);
+	list_del (&group->hash_list);
 	free (group);
 }
 
@@ -2925,6 +3671,7 @@ static void msg_reply_release (
 	log_printf (LOGSYS_LEVEL_DEBUG, "[DEBUG]: msg_reply_release\n");
 
 	list_del (&reply->reply_list);
+	list_del (&reply->hash_list);
 
 	free (reply);
 }
@@ -2937,11 +3684,13 @@ static struct track_entry *msg_track_find (
 	struct track_entry *track;
 	struct list_head *track_list;
 
+	track_head = msg_hash_name (track_head, group_name);
+
 	for (track_list = track_head->next;
 	     track_list != track_head;
 	     track_list = track_list->next)
 	{
-		track = list_entry (track_list, struct track_entry, track_list);
+		track = list_entry (track_list, struct track_entry, hash_list);
 
 		if ((mar_name_match (group_name, &track->group_name)) && (conn == track->source.conn)) {
 			return (track);
@@ -2957,11 +3706,13 @@ static struct reply_entry *msg_reply_find (
 	struct reply_entry *reply;
 	struct list_head *reply_list;
 
+	reply_head = msg_hash_key (reply_head, sender_id);
+
 	for (reply_list = reply_head->next;
 	     reply_list != reply_head;
 	     reply_list = reply_list->next)
 	{
-		reply = list_entry (reply_list, struct reply_entry, reply_list);
+		reply = list_entry (reply_list, struct reply_entry, hash_list);
 
 		if (sender_id == reply->sender_id) {
 			return (reply);
@@ -2977,11 +3728,13 @@ static struct queue_entry *msg_queue_find (
 	struct queue_entry *queue;
 	struct list_head *queue_list;
 
+	queue_head = msg_hash_name (queue_head, queue_name);
+
 	for (queue_list = queue_head->next;
 	     queue_list != queue_head;
 	     queue_list = queue_list->next)
 	{
-		queue = list_entry (queue_list, struct queue_entry, queue_list);
+		queue = list_entry (queue_list, struct queue_entry, hash_list);
 
 		if (mar_name_match (queue_name, &queue->queue_name)) {
 			return (queue);
@@ -2998,11 +3751,13 @@ static struct queue_entry *msg_queue_find_id (
 	struct queue_entry *queue;
 	struct list_head *queue_list;
 
+	queue_head = msg_hash_name (queue_head, queue_name);
+
 	for (queue_list = queue_head->next;
 	     queue_list != queue_head;
 	     queue_list = queue_list->next)
 	{
-		queue = list_entry (queue_list, struct queue_entry, queue_list);
+		queue = list_entry (queue_list, struct queue_entry, hash_list);
 
 		if ((mar_name_match (queue_name, &queue->queue_name)) && (queue_id == queue->queue_id))	{
 			return (queue);
@@ -3037,12 +3792,33 @@ static struct message_entry *msg_queue_find_message (
 	return (0);
 }
 
-static struct pending_entry *msg_queue_find_pending (
+static struct message_entry *msg_queue_find_message_id (
+	struct queue_entry *queue,
+	mar_uint32_t message_id)
+{
+	struct message_entry *message;
+	struct list_head *message_list;
+
+	for (message_list = queue->message_head.next;
+	     message_list != &queue->message_head;
+	     message_list = message_list->next)
+	{
+		message = list_entry (message_list, struct message_entry, queue_list);
+
+		if (message->message_id == message_id) {
+			return (message);
+		}
+	}
+	return (0);
+}
+
+static struct pending_entry *msg_queue_find_pending (
 	struct queue_entry *queue,
 	const mar_message_source_t *source)
 {
 	struct pending_entry *pending;
 	struct list_head *pending_list;
+	struct list_head *pending_head;
 
 	/* DEBUG */
 	log_printf (LOGSYS_LEVEL_DEBUG, "[DEBUG]: msg_queue_find_pending\n");
@@ -3052,14 +3828,17 @@ static struct pending_entry *msg_queue_find_pending (
 		    (unsigned int)(source->nodeid),
 		    (void *)(source->conn));
 
-	for (pending_list = queue->pending_head.next;
-	     pending_list != &queue->pending_head;
+	pending_head = msg_hash_source (source);
+
+	for (pending_list = pending_head->next;
+	     pending_list != pending_head;
 	     pending_list = pending_list->next)
 	{
-		pending = list_entry (pending_list, struct pending_entry, pending_list);
+		pending = list_entry (pending_list, struct pending_entry, hash_list);
 
 		if ((source->nodeid == pending->source.nodeid) &&
-		    (source->conn == pending->source.conn))
+		    (source->conn == pending->source.conn) &&
+		    (mar_name_match (&queue->queue_name, &pending->queue_name)))
 		{
 			return (pending);
 		}
@@ -3096,11 +3875,13 @@ static struct group_entry *msg_group_find (
 	struct group_entry *group;
 	struct list_head *group_list;
 
+	group_head = msg_hash_name (group_head, group_name);
+
 	for (group_list = group_head->next;
 	     group_list != group_head;
 	     group_list = group_list->next)
 	{
-		group = list_entry (group_list, struct group_entry, group_list);
+		group = list_entry (group_list, struct group_entry, hash_list);
 
 		if (mar_name_match (group_name, &group->group_name)) {
 			return (group);
@@ -3130,22 +3911,90 @@ static struct queue_entry *msg_group_member_find (
 }
 
 static struct queue_entry *msg_group_member_next (
-	struct group_entry *group)
+	struct group_entry *group,
+	struct queue_entry *queue)
 {
-	struct queue_entry *queue;
-
-	if (group->next_queue->group_list.next == &group->queue_head) {
+	if (queue->group_list.next == &group->queue_head) {
 		queue = list_entry (group->queue_head.next,
 			struct queue_entry, group_list);
 	}
 	else {
-		queue = list_entry (group->next_queue->group_list.next,
+		queue = list_entry (queue->group_list.next,
 			struct queue_entry, group_list);
 	}
 
 	return (queue);
 }
 
+static int msg_queue_opened_on (
+	struct queue_entry *queue,
+	unsigned int nodeid)
+{
+	return (refcount_vector_get (&queue->refcount_set, nodeid) != 0);
+}
+
+/*
+ * Choose the member queue of a group that a message sent from nodeid
+ * goes to. The local policies prefer queues that are open on the
+ * sender's node and fall back to all member queues when there are none.
+ */
+static struct queue_entry *msg_group_member_select (
+	struct group_entry *group,
+	unsigned int nodeid,
+	unsigned int priority)
+{
+	struct queue_entry *queue;
+	struct queue_entry *best = NULL;
+	struct list_head *queue_list;
+	int local = 0;
+
+	if (group->next_queue == NULL) {
+		return (0);
+	}
+
+	switch (group->policy) {
+	case SA_MSG_QUEUE_GROUP_LOCAL_ROUND_ROBIN:
+		queue = group->next_queue;
+		do {
+			if (msg_queue_opened_on (queue, nodeid)) {
+				return (queue);
+			}
+			queue = msg_group_member_next (group, queue);
+		} while (queue != group->next_queue);
+
+		return (group->next_queue);
+
+	case SA_MSG_QUEUE_GROUP_LOCAL_BEST_QUEUE:
+		for (queue_list = group->queue_head.next;
+		     queue_list != &group->queue_head;
+		     queue_list = queue_list->next)
+		{
+			queue = list_entry (queue_list, struct queue_entry, group_list);
+
+			if (msg_queue_opened_on (queue, nodeid)) {
+				if (local == 0) {
+					best = NULL;
+					local = 1;
+				}
+			}
+			else if (local != 0) {
+				continue;
+			}
+
+			if ((best == NULL) ||
+			    (queue->priority[priority].queue_used <
+			     best->priority[priority].queue_used))
+			{
+				best = queue;
+			}
+		}
+		return (best);
+
+	default:
+		return (group->next_queue);
+	}
+}
+
 static void msg_queue_priority_area_init (
 	struct queue_entry *queue)
 {
@@ -3181,7 +4030,7 @@ static void message_handler_req_exec_msg_queueopen (
 	log_printf (LOGSYS_LEVEL_DEBUG, "\t queue=%s\n",
 		    (char *)(req_exec_msg_queueopen->queue_name.value));
 
-	queue = msg_queue_find (&queue_list_head,
+	queue = msg_queue_find (queue_hash,
 		&req_exec_msg_queueopen->queue_name);
 
 	if (queue == NULL) {
@@ -3274,6 +4123,8 @@ static void message_handler_req_exec_msg_queueopen (
 
 		queue->open_flags = req_exec_msg_queueopen->open_flags;
 		queue->queue_handle = req_exec_msg_queueopen->queue_handle;
+		queue->owner_nodeid = nodeid;
+		queue->standby_nodeid = req_exec_msg_queueopen->standby_nodeid;
 
 		msg_queue_priority_area_init (queue);
 
@@ -3283,6 +4134,7 @@ static void message_handler_req_exec_msg_queueopen (
 		list_init (&queue->pending_head);
 
 		list_add_tail (&queue->queue_list, &queue_list_head);
+		list_add (&queue->hash_list, msg_hash_name (queue_hash, &queue->queue_name));
 
 		queue->queue_id = global_queue_id;
 		queue->refcount = 0;
@@ -3363,7 +4215,7 @@ static void message_handler_req_exec_msg_queueopenasync (
 	log_printf (LOGSYS_LEVEL_DEBUG, "\t queue=%s\n",
 		    (char *)(req_exec_msg_queueopenasync->queue_name.value));
 
-	queue = msg_queue_find (&queue_list_head,
+	queue = msg_queue_find (queue_hash,
 		&req_exec_msg_queueopenasync->queue_name);
 
 	if (queue == NULL) {
@@ -3456,6 +4308,8 @@ static void message_handler_req_exec_msg_queueopenasync (
 
 		queue->open_flags = req_exec_msg_queueopenasync->open_flags;
 		queue->queue_handle = req_exec_msg_queueopenasync->queue_handle;
+		queue->owner_nodeid = nodeid;
+		queue->standby_nodeid = req_exec_msg_queueopenasync->standby_nodeid;
 
 		msg_queue_priority_area_init (queue);
 
@@ -3465,6 +4319,7 @@ static void message_handler_req_exec_msg_queueopenasync (
 		list_init (&queue->pending_head);
 
 		list_add_tail  (&queue->queue_list, &queue_list_head);
+		list_add (&queue->hash_list, msg_hash_name (queue_hash, &queue->queue_name));
 
 		queue->queue_id = global_queue_id;
 		queue->refcount = 0;
@@ -3558,7 +4413,7 @@ static void message_handler_req_exec_msg_queueclose (
 		    (char *)(req_exec_msg_queueclose->queue_name.value),
 		    (unsigned int)(req_exec_msg_queueclose->queue_id));
 
-	queue = msg_queue_find_id (&queue_list_head,
+	queue = msg_queue_find_id (queue_hash,
 		&req_exec_msg_queueclose->queue_name,
 		req_exec_msg_queueclose->queue_id);
 	if (queue == NULL) {
@@ -3638,7 +4493,7 @@ static void message_handler_req_exec_msg_queuestatusget (
 	log_printf (LOGSYS_LEVEL_DEBUG, "\t queue=%s\n",
 		    (char *)(req_exec_msg_queuestatusget->queue_name.value));
 
-	queue = msg_queue_find (&queue_list_head,
+	queue = msg_queue_find (queue_hash,
 		&req_exec_msg_queuestatusget->queue_name);
 	if (queue == NULL) {
 		error = SA_AIS_ERR_NOT_EXIST;
@@ -3694,7 +4549,7 @@ static void message_handler_req_exec_msg_queueretentiontimeset (
 	log_printf (LOGSYS_LEVEL_DEBUG, "\t queue=%s\n",
 		    (char *)(req_exec_msg_queueretentiontimeset->queue_name.value));
 
-	queue = msg_queue_find_id (&queue_list_head,
+	queue = msg_queue_find_id (queue_hash,
 		&req_exec_msg_queueretentiontimeset->queue_name,
 		req_exec_msg_queueretentiontimeset->queue_id);
 	if (queue == NULL) {
@@ -3743,7 +4598,7 @@ static void message_handler_req_exec_msg_queueunlink (
 	log_printf (LOGSYS_LEVEL_DEBUG, "\t queue=%s\n",
 		    (char *)(req_exec_msg_queueunlink->queue_name.value));
 
-	queue = msg_queue_find (&queue_list_head,
+	queue = msg_queue_find (queue_hash,
 		&req_exec_msg_queueunlink->queue_name);
 	if (queue == NULL) {
 		error = SA_AIS_ERR_NOT_EXIST;
@@ -3796,7 +4651,7 @@ static void message_handler_req_exec_msg_queuegroupcreate (
 		goto error_exit;
 	}
 
-	group = msg_group_find (&group_list_head,
+	group = msg_group_find (group_hash,
 		&req_exec_msg_queuegroupcreate->group_name);
 
 	if (group == NULL) {
@@ -3816,6 +4671,7 @@ static void message_handler_req_exec_msg_queuegroupcreate (
 		list_init (&group->group_list);
 
 		list_add_tail  (&group->group_list, &group_list_head);
+		list_add (&group->hash_list, msg_hash_name (group_hash, &group->group_name));
 
 		global_group_count += 1;
 	}
@@ -3864,7 +4720,7 @@ static void message_handler_req_exec_msg_queuegroupinsert (
 		    (char *)(req_exec_msg_queuegroupinsert->group_name.value),
 		    (char *)(req_exec_msg_queuegroupinsert->queue_name.value));
 
-	group = msg_group_find (&group_list_head,
+	group = msg_group_find (group_hash,
 		&req_exec_msg_queuegroupinsert->group_name);
 	if (group == NULL) {
 		error = SA_AIS_ERR_NOT_EXIST;
@@ -3878,7 +4734,7 @@ static void message_handler_req_exec_msg_queuegroupinsert (
 		goto error_exit;
 	}
 
-	queue = msg_queue_find (&queue_list_head,
+	queue = msg_queue_find (queue_hash,
 		&req_exec_msg_queuegroupinsert->queue_name);
 	if (queue == NULL) {
 		error = SA_AIS_ERR_NOT_EXIST;
@@ -3898,8 +4754,7 @@ static void message_handler_req_exec_msg_queuegroupinsert (
 		goto error_exit;
 	}
 
-	if ((group->policy == SA_MSG_QUEUE_GROUP_ROUND_ROBIN)
-	    && (group->next_queue == NULL)) {
+	if (group->next_queue == NULL) {
 		group->next_queue = queue;
 	}
 
@@ -3910,7 +4765,7 @@ static void message_handler_req_exec_msg_queuegroupinsert (
 	list_init (&queue->group_list);
 	list_add_tail (&queue->group_list, &group->queue_head);
 
-	track = msg_track_find (&track_list_head,
+	track = msg_track_find (track_hash,
 		&req_exec_msg_queuegroupinsert->group_name,
 		req_exec_msg_queuegroupinsert->source.conn);
 
@@ -4021,7 +4876,7 @@ static void message_handler_req_exec_msg_queuegroupremove (
 		    (char *)(req_exec_msg_queuegroupremove->group_name.value),
 		    (char *)(req_exec_msg_queuegroupremove->queue_name.value));
 
-	group = msg_group_find (&group_list_head,
+	group = msg_group_find (group_hash,
 		&req_exec_msg_queuegroupremove->group_name);
 	if (group == NULL) {
 		error = SA_AIS_ERR_NOT_EXIST;
@@ -4036,14 +4891,14 @@ static void message_handler_req_exec_msg_queuegroupremove (
 	}
 
 	if (group->next_queue == queue) {
-		group->next_queue = msg_group_member_next (group);
+		group->next_queue = msg_group_member_next (group, queue);
 	}
 
 	queue->group = NULL;
 	group->member_count -= 1;
 	queue->change_flag = SA_MSG_QUEUE_GROUP_REMOVED;
 
-	track = msg_track_find (&track_list_head,
+	track = msg_track_find (track_hash,
 		&req_exec_msg_queuegroupremove->group_name,
 		req_exec_msg_queuegroupremove->source.conn);
 
@@ -4144,7 +4999,7 @@ static void message_handler_req_exec_msg_queuegroupdelete (
 	log_printf (LOGSYS_LEVEL_DEBUG, "\t group=%s\n",
 		    (char *)(req_exec_msg_queuegroupdelete->group_name.value));
 
-	group = msg_group_find (&group_list_head,
+	group = msg_group_find (group_hash,
 		&req_exec_msg_queuegroupdelete->group_name);
 	if (group == NULL) {
 		error = SA_AIS_ERR_NOT_EXIST;
@@ -4185,7 +5040,7 @@ static void message_handler_req_exec_msg_queuegrouptrack (
 	log_printf (LOGSYS_LEVEL_DEBUG, "\t group=%s\n",
 		    (char *)(req_exec_msg_queuegrouptrack->group_name.value));
 
-	group = msg_group_find (&group_list_head,
+	group = msg_group_find (group_hash,
 		&req_exec_msg_queuegrouptrack->group_name);
 	if (group == NULL) {
 		error = SA_AIS_ERR_NOT_EXIST;
@@ -4224,7 +5079,7 @@ static void message_handler_req_exec_msg_queuegrouptrackstop (
 	log_printf (LOGSYS_LEVEL_DEBUG, "\t group=%s\n",
 		    (char *)(req_exec_msg_queuegrouptrackstop->group_name.value));
 
-	group = msg_group_find (&group_list_head,
+	group = msg_group_find (group_hash,
 		&req_exec_msg_queuegrouptrackstop->group_name);
 	if (group == NULL) {
 		error = SA_AIS_ERR_NOT_EXIST;
@@ -4274,129 +5129,98 @@ static void message_handler_req_exec_msg_queuegroupnotificationfree (
 	}
 }
 
-static void message_handler_req_exec_msg_messagesend (
-	const void *msg,
-	unsigned int nodeid)
+/*
+ * Append a message to a queue, or hand it straight to the oldest
+ * pending saMsgMessageGet on that queue.
+ */
+static SaAisErrorT msg_queue_message_add (
+	struct queue_entry *queue,
+	const mar_msg_message_t *msg_message,
+	const char *data,
+	mar_msg_sender_id_t sender_id)
 {
-	const struct req_exec_msg_messagesend
-		*req_exec_msg_messagesend = msg;
-	struct res_lib_msg_messagesend res_lib_msg_messagesend;
 	struct res_lib_msg_messagereceived_callback res_lib_msg_messagereceived_callback;
-	SaAisErrorT error = SA_AIS_OK;
-
-	struct group_entry *group = NULL;
-	struct queue_entry *queue = NULL;
+	struct message_entry delivered;
 	struct message_entry *message = NULL;
 	struct pending_entry *pending = NULL;
+	unsigned int priority = msg_message->priority;
 
-	char *data = ((char *)(req_exec_msg_messagesend) +
-		      sizeof (struct req_exec_msg_messagesend));
-	unsigned int priority = req_exec_msg_messagesend->message.priority;
+	if ((queue->priority[priority].queue_size -
+	     queue->priority[priority].queue_used) < msg_message->size) {
+		return (SA_AIS_ERR_QUEUE_FULL);
+	}
 
-	/* DEBUG */
-	log_printf (LOGSYS_LEVEL_DEBUG, "EXEC request: saMsgMessageSend\n");
-	log_printf (LOGSYS_LEVEL_DEBUG, "\t destination=%s\n",
-		    (char *)(req_exec_msg_messagesend->destination.value));
+	if (list_empty (&queue->pending_head)) {
+		message = msg_message_alloc ();
+		if (message == NULL) {
+			return (SA_AIS_ERR_NO_MEMORY);
+		}
+		memcpy (&message->message, msg_message, sizeof (mar_msg_message_t));
 
-	group = msg_group_find (&group_list_head,
-		&req_exec_msg_messagesend->destination);
-	if (group == NULL) {
-		queue = msg_queue_find (&queue_list_head,
-			&req_exec_msg_messagesend->destination);
-		if (queue == NULL) {
-			error = SA_AIS_ERR_NOT_EXIST;
-			goto error_exit;
+		message->message.data = NULL;
+
+		if (msg_queue_body_local (queue)) {
+			message->message.data = msg_ring_write (
+				&queue->priority[priority], data,
+				message->message.size);
+			if (message->message.data == NULL) {
+				msg_message_free (queue, message);
+				return (SA_AIS_ERR_NO_MEMORY);
+			}
 		}
 	}
 	else {
-		queue = group->next_queue;
-		if (queue == NULL) {
-			error = SA_AIS_ERR_QUEUE_NOT_AVAILABLE;
-			goto error_exit;
-		}
-	}
-
-	if (req_exec_msg_messagesend->message.size > MSG_MAX_MESSAGE_SIZE) {
-		error = SA_AIS_ERR_TOO_BIG;
-		goto error_exit;
-	}
+		/*
+		 * A pending getter means the queue is empty, so the message
+		 * is delivered straight from the request and never stored.
+		 */
+		message = &delivered;
 
-	if ((queue->priority[priority].queue_size -
-	     queue->priority[priority].queue_used) < req_exec_msg_messagesend->message.size) {
-		error = SA_AIS_ERR_QUEUE_FULL;
-		goto error_exit;
-	}
+		memset (message, 0, sizeof (struct message_entry));
+		memcpy (&message->message, msg_message, sizeof (mar_msg_message_t));
 
-	message = malloc (sizeof (struct message_entry));
-	if (message == NULL) {
-		error = SA_AIS_ERR_NO_MEMORY;
-		goto error_exit;
-	}
-	memset (message, 0, sizeof (struct message_entry));
-	memcpy (&message->message,
-		&req_exec_msg_messagesend->message,
-		sizeof (mar_msg_message_t));
+		message->message.data = NULL;
 
-	message->message.data = malloc (message->message.size);
-	if (message->message.data == NULL) {
-		error = SA_AIS_ERR_NO_MEMORY;
-		goto error_exit;
+		if (msg_queue_body_local (queue)) {
+			message->message.data = (void *)data;
+		}
 	}
-	memset (message->message.data, 0, message->message.size);
-	memcpy (message->message.data, (char *)(data), message->message.size);
 
-	message->sender_id = 0;
+	message->sender_id = sender_id;
 	message->send_time = api->timer_time_get();
+	message->message_id = queue->message_id;
 
-	if (list_empty (&queue->pending_head)) {
+	queue->message_id += 1;
+
+	if (message != &delivered) {
 		list_add_tail (&message->queue_list,
 			&queue->message_head);
 		list_add_tail (&message->message_list,
-			&queue->priority[(message->message.priority)].message_head);
+			&queue->priority[priority].message_head);
 
-		queue->priority[(message->message.priority)].queue_used += message->message.size;
-		queue->priority[(message->message.priority)].number_of_messages += 1;
+		queue->priority[priority].queue_used += message->message.size;
+		queue->priority[priority].number_of_messages += 1;
 	}
 	else {
 		pending = list_entry (queue->pending_head.next,	struct pending_entry, pending_list);
-		if (pending == NULL) {
-			error = SA_AIS_ERR_LIBRARY;
-			goto error_exit;
-		}
 
 		if (api->ipc_source_is_local (&pending->source)) {
 			api->timer_delete (pending->timer_handle);
-			msg_pending_deliver (pending, message);
 		}
 
+		msg_message_deliver (queue, &pending->source, pending->packed,
+			&message, 1);
+
 		list_del (&pending->pending_list);
+		list_del (&pending->hash_list);
 		free (pending);
 	}
 
-	if (group != NULL) {
-		group->next_queue = msg_group_member_next (group);
-	}
-
-error_exit:
-	if (api->ipc_source_is_local (&req_exec_msg_messagesend->source))
-	{
-		res_lib_msg_messagesend.header.size =
-			sizeof (struct res_lib_msg_messagesend);
-		res_lib_msg_messagesend.header.id =
-			MESSAGE_RES_MSG_MESSAGESEND;
-		res_lib_msg_messagesend.header.error = error;
-
-		api->ipc_response_send (
-			req_exec_msg_messagesend->source.conn,
-			&res_lib_msg_messagesend,
-			sizeof (struct res_lib_msg_messagesend));
-	}
-
-	if ((error == SA_AIS_OK) && (queue->open_flags & SA_MSG_QUEUE_RECEIVE_CALLBACK) &&
+	if ((queue->open_flags & SA_MSG_QUEUE_RECEIVE_CALLBACK) &&
 	    (api->ipc_source_is_local (&queue->source)))
 	{
 		res_lib_msg_messagereceived_callback.header.size =
-				sizeof (struct res_lib_msg_messagereceived_callback);
+			sizeof (struct res_lib_msg_messagereceived_callback);
 		res_lib_msg_messagereceived_callback.header.id =
 			MESSAGE_RES_MSG_MESSAGERECEIVED_CALLBACK;
 		res_lib_msg_messagereceived_callback.header.error = SA_AIS_OK;
@@ -4408,184 +5232,165 @@ error_exit:
 			sizeof (struct res_lib_msg_messagereceived_callback));
 	}
 
-	if ((error != SA_AIS_OK) && (message != NULL)) {
-		free (message->message.data);
-		free (message);
-	}
+	return (SA_AIS_OK);
 }
 
-static void message_handler_req_exec_msg_messagesendasync (
-	const void *msg,
-	unsigned int nodeid)
+/*
+ * Send a message to a queue or to a queue group. The destination is
+ * resolved in agreed order from replicated state only, so every node
+ * picks the same member queue(s).
+ */
+static SaAisErrorT msg_message_send (
+	const mar_name_t *destination,
+	unsigned int nodeid,
+	const mar_msg_message_t *msg_message,
+	const char *data,
+	mar_msg_sender_id_t sender_id)
 {
-	const struct req_exec_msg_messagesendasync
-		*req_exec_msg_messagesendasync = msg;
-	struct res_lib_msg_messagesendasync res_lib_msg_messagesendasync;
-	struct res_lib_msg_messagereceived_callback res_lib_msg_messagereceived_callback;
-	struct res_lib_msg_messagedelivered_callback res_lib_msg_messagedelivered_callback;
-	SaAisErrorT error = SA_AIS_OK;
-
 	struct group_entry *group = NULL;
 	struct queue_entry *queue = NULL;
-	struct message_entry *message = NULL;
-	struct pending_entry *pending = NULL;
-
-	char *data = ((char *)(req_exec_msg_messagesendasync) +
-		      sizeof (struct req_exec_msg_messagesendasync));
-	unsigned int priority = req_exec_msg_messagesendasync->message.priority;
+	struct list_head *queue_list;
+	SaAisErrorT error = SA_AIS_OK;
+	unsigned int delivered = 0;
 
-	/* DEBUG */
-	log_printf (LOGSYS_LEVEL_DEBUG, "EXEC request: saMsgMessageSendAsync\n");
-	log_printf (LOGSYS_LEVEL_DEBUG, "\t destination=%s\n",
-		    (char *)(req_exec_msg_messagesendasync->destination.value));
+	if (msg_message->size > MSG_MAX_MESSAGE_SIZE) {
+		return (SA_AIS_ERR_TOO_BIG);
+	}
 
-	group = msg_group_find (&group_list_head,
-		&req_exec_msg_messagesendasync->destination);
+	group = msg_group_find (group_hash, destination);
 	if (group == NULL) {
-		queue = msg_queue_find (&queue_list_head,
-			&req_exec_msg_messagesendasync->destination);
+		queue = msg_queue_find (queue_hash, destination);
 		if (queue == NULL) {
-			error = SA_AIS_ERR_NOT_EXIST;
-			goto error_exit;
+			return (SA_AIS_ERR_NOT_EXIST);
 		}
+		return (msg_queue_message_add (queue, msg_message, data, sender_id));
 	}
-	else {
-		queue = group->next_queue;
-		if (queue == NULL) {
-			error = SA_AIS_ERR_QUEUE_NOT_AVAILABLE;
-			goto error_exit;
+
+	if (group->policy == SA_MSG_QUEUE_GROUP_BROADCAST) {
+		if (group->member_count == 0) {
+			return (SA_AIS_ERR_QUEUE_NOT_AVAILABLE);
 		}
-	}
 
-	if (req_exec_msg_messagesendasync->message.size > MSG_MAX_MESSAGE_SIZE) {
-		error = SA_AIS_ERR_TOO_BIG;
-		goto error_exit;
-	}
+		/*
+		 * The message was multicast once; every member queue
+		 * with room for it takes its own copy.
+		 */
+		for (queue_list = group->queue_head.next;
+		     queue_list != &group->queue_head;
+		     queue_list = queue_list->next)
+		{
+			queue = list_entry (queue_list, struct queue_entry, group_list);
 
-	if ((queue->priority[priority].queue_size -
-	     queue->priority[priority].queue_used) < req_exec_msg_messagesendasync->message.size) {
-		error = SA_AIS_ERR_QUEUE_FULL;
-		goto error_exit;
+			error = msg_queue_message_add (queue, msg_message, data, sender_id);
+			if (error == SA_AIS_OK) {
+				delivered += 1;
+			}
+		}
+		return ((delivered != 0) ? SA_AIS_OK : error);
 	}
 
-	message = malloc (sizeof (struct message_entry));
-	if (message == NULL) {
-		error = SA_AIS_ERR_NO_MEMORY;
-		goto error_exit;
+	queue = msg_group_member_select (group, nodeid, msg_message->priority);
+	if (queue == NULL) {
+		return (SA_AIS_ERR_QUEUE_NOT_AVAILABLE);
 	}
-	memset (message, 0, sizeof (struct message_entry));
-	memcpy (&message->message,
-		&req_exec_msg_messagesendasync->message,
-		sizeof (mar_msg_message_t));
 
-	message->message.data = malloc (message->message.size);
-	if (message->message.data == NULL) {
-		error = SA_AIS_ERR_NO_MEMORY;
-		goto error_exit;
+	error = msg_queue_message_add (queue, msg_message, data, sender_id);
+	if (error == SA_AIS_OK) {
+		group->next_queue = msg_group_member_next (group, queue);
 	}
-	memset (message->message.data, 0, message->message.size);
-	memcpy (message->message.data, (char *)(data), message->message.size);
 
-	message->sender_id = 0;
-	message->send_time = api->timer_time_get();
-
-	if (list_empty (&queue->pending_head)) {
-		list_add_tail (&message->queue_list,
-			&queue->message_head);
-		list_add_tail (&message->message_list,
-			&queue->priority[(message->message.priority)].message_head);
+	return (error);
+}
 
-		queue->priority[(message->message.priority)].queue_used += message->message.size;
-		queue->priority[(message->message.priority)].number_of_messages += 1;
-	}
-	else {
-		pending = list_entry (queue->pending_head.next,	struct pending_entry, pending_list);
-		if (pending == NULL) {
-			error = SA_AIS_ERR_LIBRARY;
-			goto error_exit;
-		}
+static void message_handler_req_exec_msg_messagesend (
+	const void *msg,
+	unsigned int nodeid)
+{
+	const struct req_exec_msg_messagesend
+		*req_exec_msg_messagesend = msg;
+	struct res_lib_msg_messagesend res_lib_msg_messagesend;
+	SaAisErrorT error = SA_AIS_OK;
 
-		if (api->ipc_source_is_local (&pending->source)) {
-			api->timer_delete (pending->timer_handle);
-			msg_pending_deliver (pending, message);
-		}
+	char *data = ((char *)(req_exec_msg_messagesend) +
+		      sizeof (struct req_exec_msg_messagesend));
 
-		list_del (&pending->pending_list);
-		free (pending);
-	}
+	/* DEBUG */
+	log_printf (LOGSYS_LEVEL_DEBUG, "EXEC request: saMsgMessageSend\n");
+	log_printf (LOGSYS_LEVEL_DEBUG, "\t destination=%s\n",
+		    (char *)(req_exec_msg_messagesend->destination.value));
 
-	if (group != NULL) {
-		group->next_queue = msg_group_member_next (group);
-	}
+	error = msg_message_send (
+		&req_exec_msg_messagesend->destination,
+		req_exec_msg_messagesend->source.nodeid,
+		&req_exec_msg_messagesend->message, data, 0);
 
-error_exit:
-	if (api->ipc_source_is_local (&req_exec_msg_messagesendasync->source))
+	if (api->ipc_source_is_local (&req_exec_msg_messagesend->source))
 	{
-		res_lib_msg_messagesendasync.header.size =
-			sizeof (struct res_lib_msg_messagesendasync);
-		res_lib_msg_messagesendasync.header.id =
-			MESSAGE_RES_MSG_MESSAGESENDASYNC;
-		res_lib_msg_messagesendasync.header.error = error;
+		res_lib_msg_messagesend.header.size =
+			sizeof (struct res_lib_msg_messagesend);
+		res_lib_msg_messagesend.header.id =
+			MESSAGE_RES_MSG_MESSAGESEND;
+		res_lib_msg_messagesend.header.error = error;
 
 		api->ipc_response_send (
-			req_exec_msg_messagesendasync->source.conn,
-			&res_lib_msg_messagesendasync,
-			sizeof (struct res_lib_msg_messagesendasync));
-
-		if (req_exec_msg_messagesendasync->ack_flags & SA_MSG_MESSAGE_DELIVERED_ACK)
-		{
-			res_lib_msg_messagedelivered_callback.header.size =
-				sizeof (struct res_lib_msg_messagedelivered_callback);
-			res_lib_msg_messagedelivered_callback.header.id =
-				MESSAGE_RES_MSG_MESSAGEDELIVERED_CALLBACK;
-			res_lib_msg_messagedelivered_callback.header.error = error;
+			req_exec_msg_messagesend->source.conn,
+			&res_lib_msg_messagesend,
+			sizeof (struct res_lib_msg_messagesend));
+	}
+}
 
-			res_lib_msg_messagedelivered_callback.invocation =
-				req_exec_msg_messagesendasync->invocation;
+static void message_handler_req_exec_msg_messagesendasync (
+	const void *msg,
+	unsigned int nodeid)
+{
+	const struct req_exec_msg_messagesendasync
+		*req_exec_msg_messagesendasync = msg;
+	struct res_lib_msg_messagesendasync res_lib_msg_messagesendasync;
+	struct res_lib_msg_messagedelivered_callback res_lib_msg_messagedelivered_callback;
+	SaAisErrorT error = SA_AIS_OK;
 
-			api->ipc_dispatch_send (
-				req_exec_msg_messagesendasync->source.conn,
-				&res_lib_msg_messagedelivered_callback,
-				sizeof (struct res_lib_msg_messagedelivered_callback));
-		}
-	}
+	char *data = ((char *)(req_exec_msg_messagesendasync) +
+		      sizeof (struct req_exec_msg_messagesendasync));
 
 	/* DEBUG */
-	if (error == SA_AIS_OK) {
-		log_printf (LOGSYS_LEVEL_DEBUG, "[DEBUG]: error ok\n");
-	}
-	if (queue->open_flags & SA_MSG_QUEUE_RECEIVE_CALLBACK) {
-		log_printf (LOGSYS_LEVEL_DEBUG, "[DEBUG]: flags ok\n");
-	}
-
-	log_printf (LOGSYS_LEVEL_DEBUG, "[DEBUG]: nodeid=%x conn=%p\n",
-		    (unsigned int)(queue->source.nodeid),
-		    (void *)(queue->source.conn));
+	log_printf (LOGSYS_LEVEL_DEBUG, "EXEC request: saMsgMessageSendAsync\n");
+	log_printf (LOGSYS_LEVEL_DEBUG, "\t destination=%s\n",
+		    (char *)(req_exec_msg_messagesendasync->destination.value));
 
-	if (api->ipc_source_is_local (&queue->source)) {
-		log_printf (LOGSYS_LEVEL_DEBUG, "[DEBUG]: local ok\n");
-	}
-	/* ----- */
+	error = msg_message_send (
+		&req_exec_msg_messagesendasync->destination,
+		req_exec_msg_messagesendasync->source.nodeid,
+		&req_exec_msg_messagesendasync->message, data, 0);
 
-	if ((error == SA_AIS_OK) && (queue->open_flags & SA_MSG_QUEUE_RECEIVE_CALLBACK) &&
-	    (api->ipc_source_is_local (&queue->source)))
+	if (api->ipc_source_is_local (&req_exec_msg_messagesendasync->source))
 	{
-		res_lib_msg_messagereceived_callback.header.size =
-			sizeof (struct res_lib_msg_messagereceived_callback);
-		res_lib_msg_messagereceived_callback.header.id =
-			MESSAGE_RES_MSG_MESSAGERECEIVED_CALLBACK;
-		res_lib_msg_messagereceived_callback.header.error = SA_AIS_OK;
-		res_lib_msg_messagereceived_callback.queue_handle = queue->queue_handle;
+		res_lib_msg_messagesendasync.header.size =
+			sizeof (struct res_lib_msg_messagesendasync);
+		res_lib_msg_messagesendasync.header.id =
+			MESSAGE_RES_MSG_MESSAGESENDASYNC;
+		res_lib_msg_messagesendasync.header.error = error;
 
-		api->ipc_dispatch_send (
-			queue->source.conn,
-			&res_lib_msg_messagereceived_callback,
-			sizeof (struct res_lib_msg_messagereceived_callback));
-	}
+		api->ipc_response_send (
+			req_exec_msg_messagesendasync->source.conn,
+			&res_lib_msg_messagesendasync,
+			sizeof (struct res_lib_msg_messagesendasync));
+
+		if (req_exec_msg_messagesendasync->ack_flags & SA_MSG_MESSAGE_DELIVERED_ACK)
+		{
+			res_lib_msg_messagedelivered_callback.header.size =
+				sizeof (struct res_lib_msg_messagedelivered_callback);
+			res_lib_msg_messagedelivered_callback.header.id =
+				MESSAGE_RES_MSG_MESSAGEDELIVERED_CALLBACK;
+			res_lib_msg_messagedelivered_callback.header.error = error;
 
-	if ((error != SA_AIS_OK) && (message != NULL)) {
-		free (message->message.data);
-		free (message);
+			res_lib_msg_messagedelivered_callback.invocation =
+				req_exec_msg_messagesendasync->invocation;
+
+			api->ipc_dispatch_send (
+				req_exec_msg_messagesendasync->source.conn,
+				&res_lib_msg_messagedelivered_callback,
+				sizeof (struct res_lib_msg_messagedelivered_callback));
+		}
 	}
 }
 
@@ -4595,21 +5400,26 @@ static void message_handler_req_exec_msg_messageget (
 {
 	const struct req_exec_msg_messageget
 		*req_exec_msg_messageget = msg;
-	struct res_lib_msg_messageget res_lib_msg_messageget;
 	SaAisErrorT error = SA_AIS_OK;
 
-	struct iovec iov[2];
-
 	struct queue_entry *queue = NULL;
 	struct message_entry *message = NULL;
 	struct pending_entry *pending = NULL;
+	struct message_entry *messages[MSG_MAX_GET_MANY_MESSAGES];
+
+	unsigned int max_messages = req_exec_msg_messageget->max_messages;
+	size_t max_bytes = req_exec_msg_messageget->max_bytes;
+	size_t bytes = 0;
+	size_t entry_size;
+	unsigned int count = 0;
+	unsigned int i;
 
 	/* DEBUG */
 	log_printf (LOGSYS_LEVEL_DEBUG, "EXEC request: saMsgMessageGet\n");
 	log_printf (LOGSYS_LEVEL_DEBUG, "\t queue=%s\n",
 		    (char *)(req_exec_msg_messageget->queue_name.value));
 
-	queue = msg_queue_find_id (&queue_list_head,
+	queue = msg_queue_find_id (queue_hash,
 		&req_exec_msg_messageget->queue_name,
 		req_exec_msg_messageget->queue_id);
 	if (queue == NULL) {
@@ -4631,7 +5441,10 @@ static void message_handler_req_exec_msg_messageget (
 			&req_exec_msg_messageget->queue_name,
 			sizeof (mar_name_t));
 
+		pending->packed = req_exec_msg_messageget->packed;
+
 		list_add_tail (&pending->pending_list, &queue->pending_head);
+		list_add (&pending->hash_list, msg_hash_source (&pending->source));
 
 		/* DEBUG */
 		log_printf (LOGSYS_LEVEL_DEBUG, "\t pending { nodeid=%x conn=%p }\n",
@@ -4647,43 +5460,52 @@ static void message_handler_req_exec_msg_messageget (
 		return;
 	}
 
-	res_lib_msg_messageget.send_time = message->send_time;
-	res_lib_msg_messageget.sender_id = message->sender_id;
+	if ((max_messages == 0) || (max_messages > MSG_MAX_GET_MANY_MESSAGES)) {
+		max_messages = MSG_MAX_GET_MANY_MESSAGES;
+	}
+	if ((max_bytes == 0) || (max_bytes > MSG_MAX_GET_MANY_SIZE)) {
+		max_bytes = MSG_MAX_GET_MANY_SIZE;
+	}
 
-	list_del (&message->message_list);
-	list_del (&message->queue_list);
+	/*
+	 * Take messages in priority order until either limit is reached.
+	 * The first message is always taken.
+	 */
+	while ((message != NULL) && (count < max_messages)) {
+		entry_size = sizeof (struct res_lib_msg_messagegetmany_entry) +
+			MSG_GET_MANY_ALIGN (message->message.size);
+		if ((count != 0) && (bytes + entry_size > max_bytes)) {
+			break;
+		}
 
-	queue->priority[message->message.priority].queue_used -= message->message.size;
-	queue->priority[message->message.priority].number_of_messages -= 1;
+		list_del (&message->message_list);
+		list_del (&message->queue_list);
 
-error_exit:
-	if (api->ipc_source_is_local (&req_exec_msg_messageget->source))
-	{
-		res_lib_msg_messageget.header.size =
-			sizeof (struct res_lib_msg_messageget);
-		res_lib_msg_messageget.header.id =
-			MESSAGE_RES_MSG_MESSAGEGET;
-		res_lib_msg_messageget.header.error = error;
+		queue->priority[message->message.priority].queue_used -= message->message.size;
+		queue->priority[message->message.priority].number_of_messages -= 1;
 
-		iov[0].iov_base = (void *)&res_lib_msg_messageget;
-		iov[0].iov_len = sizeof (struct res_lib_msg_messageget);
+		messages[count] = message;
+		count += 1;
+		bytes += entry_size;
 
-		if (error == SA_AIS_OK) {
-			iov[1].iov_base = message->message.data;
-			iov[1].iov_len = message->message.size;
+		message = msg_queue_find_message (queue);
+	}
 
-			memcpy (&res_lib_msg_messageget.message,
-				&message->message,
-				sizeof (mar_msg_message_t));
+	msg_message_deliver (queue, &req_exec_msg_messageget->source,
+		req_exec_msg_messageget->packed, messages, count);
 
-			api->ipc_response_iov_send (req_exec_msg_messageget->source.conn, iov, 2);
-		}
-		else {
-			api->ipc_response_iov_send (req_exec_msg_messageget->source.conn, iov, 1);
-		}
+	for (i = 0; i < count; i++) {
+		msg_message_free (queue, messages[i]);
 	}
 
-	free (message);
+	return;
+
+error_exit:
+	if (api->ipc_source_is_local (&req_exec_msg_messageget->source))
+	{
+		msg_message_respond (req_exec_msg_messageget->source.conn,
+			req_exec_msg_messageget->packed, error, NULL, 0, 0);
+	}
 }
 
 static void message_handler_req_exec_msg_messagedatafree (
@@ -4729,7 +5551,7 @@ static void message_handler_req_exec_msg_messagecancel (
 	log_printf (LOGSYS_LEVEL_DEBUG, "\t queue=%s\n",
 		    (char *)(req_exec_msg_messagecancel->queue_name.value));
 
-	queue = msg_queue_find_id (&queue_list_head,
+	queue = msg_queue_find_id (queue_hash,
 		&req_exec_msg_messagecancel->queue_name,
 		req_exec_msg_messagecancel->queue_id);
 	if (queue == NULL) {
@@ -4760,6 +5582,246 @@ error_exit:
 	}
 }
 
+/*
+ * The state of a saMsgMessageSendReceive call is kept only on the
+ * requester's node, which is the node id in the upper half of the
+ * sender id. A reply is completed there: locally, straight from the
+ * library request, when the replier is on the same node, or from the
+ * one multicast reply message otherwise.
+ */
+static SaAisErrorT msg_reply_complete (
+	mar_msg_sender_id_t sender_id,
+	const mar_msg_message_t *reply_message,
+	const void *data)
+{
+	struct res_lib_msg_messagesendreceive res_lib_msg_messagesendreceive;
+	struct reply_entry *reply = NULL;
+	struct iovec iov[2];
+
+	reply = msg_reply_find (reply_hash, sender_id);
+	if (reply == NULL) {
+		return (SA_AIS_ERR_NOT_EXIST);
+	}
+
+	if ((reply->reply_size != 0) &&
+	    (reply->reply_size < reply_message->size)) {
+		return (SA_AIS_ERR_NO_SPACE);
+	}
+
+	api->timer_delete (reply->timer_handle);
+
+	res_lib_msg_messagesendreceive.header.size =
+		sizeof (struct res_lib_msg_messagesendreceive);
+	res_lib_msg_messagesendreceive.header.id =
+		MESSAGE_RES_MSG_MESSAGESENDRECEIVE;
+	res_lib_msg_messagesendreceive.header.error = SA_AIS_OK;
+
+	res_lib_msg_messagesendreceive.reply_time = api->timer_time_get();
+
+	memcpy (&res_lib_msg_messagesendreceive.message,
+		reply_message, sizeof (mar_msg_message_t));
+
+	iov[0].iov_base = (void *)&res_lib_msg_messagesendreceive;
+	iov[0].iov_len = sizeof (struct res_lib_msg_messagesendreceive);
+
+	iov[1].iov_base = (void *)data;
+	iov[1].iov_len = reply_message->size;
+
+	api->ipc_response_iov_send (reply->source.conn, iov, 2);
+
+	msg_reply_release (reply);
+
+	return (SA_AIS_OK);
+}
+
+static void msg_reply_result_send (
+	void *conn,
+	mar_uint8_t async,
+	SaAisErrorT error,
+	mar_invocation_t invocation,
+	mar_msg_ack_flags_t ack_flags)
+{
+	struct res_lib_msg_messagereply res_lib_msg_messagereply;
+	struct res_lib_msg_messagereplyasync res_lib_msg_messagereplyasync;
+	struct res_lib_msg_messagedelivered_callback res_lib_msg_messagedelivered_callback;
+
+	if (!async) {
+		res_lib_msg_messagereply.header.size =
+			sizeof (struct res_lib_msg_messagereply);
+		res_lib_msg_messagereply.header.id =
+			MESSAGE_RES_MSG_MESSAGEREPLY;
+		res_lib_msg_messagereply.header.error = error;
+
+		api->ipc_response_send (conn,
+			&res_lib_msg_messagereply,
+			sizeof (struct res_lib_msg_messagereply));
+		return;
+	}
+
+	res_lib_msg_messagereplyasync.header.size =
+		sizeof (struct res_lib_msg_messagereplyasync);
+	res_lib_msg_messagereplyasync.header.id =
+		MESSAGE_RES_MSG_MESSAGEREPLYASYNC;
+	res_lib_msg_messagereplyasync.header.error = error;
+
+	api->ipc_response_send (conn,
+		&res_lib_msg_messagereplyasync,
+		sizeof (struct res_lib_msg_messagereplyasync));
+
+	if ((error == SA_AIS_OK) && (ack_flags & SA_MSG_MESSAGE_DELIVERED_ACK)) {
+		res_lib_msg_messagedelivered_callback.header.size =
+			sizeof (struct res_lib_msg_messagedelivered_callback);
+		res_lib_msg_messagedelivered_callback.header.id =
+			MESSAGE_RES_MSG_MESSAGEDELIVERED_CALLBACK;
+		res_lib_msg_messagedelivered_callback.header.error = error;
+
+		res_lib_msg_messagedelivered_callback.invocation = invocation;
+
+		api->ipc_dispatch_send (conn,
+			&res_lib_msg_messagedelivered_callback,
+			sizeof (struct res_lib_msg_messagedelivered_callback));
+	}
+}
+
+/*
+ * Return the result of a reply to the replier. A replier on another
+ * node is told with a multicast that only its node acts on.
+ */
+static void msg_reply_result (
+	const mar_message_source_t *source,
+	mar_uint8_t async,
+	SaAisErrorT error,
+	mar_invocation_t invocation,
+	mar_msg_ack_flags_t ack_flags)
+{
+	struct req_exec_msg_reply_result req_exec_msg_reply_result;
+	struct iovec iov;
+
+	if (api->ipc_source_is_local (source)) {
+		msg_reply_result_send (source->conn, async, error,
+			invocation, ack_flags);
+		return;
+	}
+
+	req_exec_msg_reply_result.header.size =
+		sizeof (struct req_exec_msg_reply_result);
+	req_exec_msg_reply_result.header.id =
+		SERVICE_ID_MAKE (MSG_SERVICE, MESSAGE_REQ_EXEC_MSG_REPLY_RESULT);
+
+	memcpy (&req_exec_msg_reply_result.source,
+		source, sizeof (mar_message_source_t));
+
+	req_exec_msg_reply_result.error = error;
+	req_exec_msg_reply_result.invocation = invocation;
+	req_exec_msg_reply_result.ack_flags = ack_flags;
+	req_exec_msg_reply_result.async = async;
+
+	iov.iov_base = (void *)&req_exec_msg_reply_result;
+	iov.iov_len = sizeof (struct req_exec_msg_reply_result);
+
+	assert (msg_totem_mcast (&iov, 1, TOTEM_AGREED) == 0);
+}
+
+/*
+ * Called on every node for a reply that the requester's node
+ * completes. The replier's node waits for the result, or answers
+ * SA_AIS_ERR_NOT_EXIST itself when the requester's node is gone.
+ */
+static void msg_reply_result_wait (
+	const mar_message_source_t *source,
+	mar_uint8_t async,
+	mar_invocation_t invocation,
+	unsigned int nodeid)
+{
+	struct reply_result_entry *reply_result;
+
+	if (!api->ipc_source_is_local (source)) {
+		return;
+	}
+
+	if (!msg_find_member_nodeid (nodeid)) {
+		msg_reply_result_send (source->conn, async,
+			SA_AIS_ERR_NOT_EXIST, invocation, 0);
+		return;
+	}
+
+	reply_result = malloc (sizeof (struct reply_result_entry));
+	if (reply_result == NULL) {
+		api->error_memory_failure ();
+	}
+
+	memcpy (&reply_result->source, source, sizeof (mar_message_source_t));
+
+	reply_result->async = async;
+	reply_result->invocation = invocation;
+	reply_result->nodeid = nodeid;
+
+	list_init (&reply_result->list);
+	list_add_tail (&reply_result->list, &reply_result_list_head);
+}
+
+static void msg_reply_result_done (
+	const mar_message_source_t *source,
+	mar_uint8_t async,
+	mar_invocation_t invocation)
+{
+	struct reply_result_entry *reply_result;
+	struct list_head *list;
+
+	for (list = reply_result_list_head.next;
+	     list != &reply_result_list_head;
+	     list = list->next)
+	{
+		reply_result = list_entry (list, struct reply_result_entry, list);
+
+		if ((reply_result->source.conn == source->conn) &&
+		    (reply_result->async == async) &&
+		    (reply_result->invocation == invocation))
+		{
+			list_del (&reply_result->list);
+			free (reply_result);
+			return;
+		}
+	}
+}
+
+/*
+ * The result of a reply is multicast by the requester's node before
+ * that node leaves, or never. Replies still waiting for a node that
+ * left are answered here.
+ */
+static void msg_reply_result_leave (
+	const unsigned int *left_list,
+	size_t left_list_entries)
+{
+	struct reply_result_entry *reply_result;
+	struct list_head *list;
+	size_t i;
+
+	list = reply_result_list_head.next;
+
+	while (list != &reply_result_list_head) {
+		reply_result = list_entry (list, struct reply_result_entry, list);
+		list = list->next;
+
+		for (i = 0; i < left_list_entries; i++) {
+			if (reply_result->nodeid == left_list[i]) {
+				break;
+			}
+		}
+		if (i == left_list_entries) {
+			continue;
+		}
+
+		msg_reply_result_send (reply_result->source.conn,
+			reply_result->async, SA_AIS_ERR_NOT_EXIST,
+			reply_result->invocation, 0);
+
+		list_del (&reply_result->list);
+		free (reply_result);
+	}
+}
+
 static void message_handler_req_exec_msg_messagesendreceive (
 	const void *msg,
 	unsigned int nodeid)
@@ -4767,66 +5829,60 @@ static void message_handler_req_exec_msg_messagesendreceive (
 	const struct req_exec_msg_messagesendreceive
 		*req_exec_msg_messagesendreceive = msg;
 	struct res_lib_msg_messagesendreceive res_lib_msg_messagesendreceive;
-	struct res_lib_msg_messagereceived_callback res_lib_msg_messagereceived_callback;
 	SaAisErrorT error = SA_AIS_OK;
 
 	struct iovec iov;
 
 	struct group_entry *group = NULL;
-	struct queue_entry *queue = NULL;
 	struct reply_entry *reply = NULL;
-	struct message_entry *message = NULL;
-	struct pending_entry *pending = NULL;
 
 	char *data = ((char *)(req_exec_msg_messagesendreceive) +
 		      sizeof (struct req_exec_msg_messagesendreceive));
-	unsigned int priority = req_exec_msg_messagesendreceive->message.priority;
 
 	/* DEBUG */
 	log_printf (LOGSYS_LEVEL_DEBUG, "EXEC request: saMsgMessageSendReceive\n");
 	log_printf (LOGSYS_LEVEL_DEBUG, "\t destination=%s\n",
 		    (char *)(req_exec_msg_messagesendreceive->destination.value));
 
-	group = msg_group_find (&group_list_head,
+	/*
+	 * A broadcast would hand the same sender_id to every member
+	 * queue, and only one reply can be returned to the caller.
+	 */
+	group = msg_group_find (group_hash,
 		&req_exec_msg_messagesendreceive->destination);
-	if (group == NULL) {
-		queue = msg_queue_find (&queue_list_head,
-			&req_exec_msg_messagesendreceive->destination);
-		if (queue == NULL) {
-			error = SA_AIS_ERR_NOT_EXIST;
-			goto error_exit;
-		}
-	}
-	else {
-		queue = group->next_queue;
-		if (queue == NULL) {
-			error = SA_AIS_ERR_QUEUE_NOT_AVAILABLE;
-			goto error_exit;
-		}
-	}
-
-	if (req_exec_msg_messagesendreceive->message.size > MSG_MAX_MESSAGE_SIZE) {
-		error = SA_AIS_ERR_TOO_BIG;
+	if ((group != NULL) && (group->policy == SA_MSG_QUEUE_GROUP_BROADCAST)) {
+		error = SA_AIS_ERR_INVALID_PARAM;
 		goto error_exit;
 	}
 
 	/*
-	 * Verify that sufficient space is available for this message.
+	 * Create reply entry to map sender_id to ipc connection. It is
+	 * kept only on the requester's node, which is the only node that
+	 * completes the call.
 	 */
-	if ((queue->priority[priority].queue_size -
-	     queue->priority[priority].queue_used) < req_exec_msg_messagesendreceive->message.size) {
-		error = SA_AIS_ERR_QUEUE_FULL;
+	if (api->ipc_source_is_local (&req_exec_msg_messagesendreceive->source)) {
+		reply = malloc (sizeof (struct reply_entry));
+		if (reply == NULL) {
+			error = SA_AIS_ERR_NO_MEMORY;
+		}
+	}
+
+	if (error == SA_AIS_OK) {
+		error = msg_message_send (
+			&req_exec_msg_messagesendreceive->destination,
+			req_exec_msg_messagesendreceive->source.nodeid,
+			&req_exec_msg_messagesendreceive->message, data,
+			req_exec_msg_messagesendreceive->sender_id);
+	}
+	if (error != SA_AIS_OK) {
+		free (reply);
 		goto error_exit;
 	}
 
-	/*
-	 * Create reply entry to map sender_id to ipc connection.
-	 */
-	reply = malloc (sizeof (struct reply_entry));
 	if (reply == NULL) {
-		error = SA_AIS_ERR_NO_MEMORY;
-		goto error_exit;
+		return;
 	}
+
 	memset (reply, 0, sizeof (struct reply_entry));
 	memcpy (&reply->source,
 		&req_exec_msg_messagesendreceive->source,
@@ -4836,71 +5892,16 @@ static void message_handler_req_exec_msg_messagesendreceive (
 	reply->reply_size = req_exec_msg_messagesendreceive->reply_size;
 
 	list_add (&reply->reply_list, &reply_list_head);
-
-	/*
-	 * Create message entry to be added to the queue.
-	 */
-	message = malloc (sizeof (struct message_entry));
-	if (message == NULL) {
-		error = SA_AIS_ERR_NO_MEMORY;
-		goto error_exit;
-	}
-	memset (message, 0, sizeof (struct message_entry));
-	memcpy (&message->message,
-		&req_exec_msg_messagesendreceive->message,
-		sizeof (mar_msg_message_t));
-
-	message->message.data = malloc (message->message.size);
-	if (message->message.data == NULL) {
-		error = SA_AIS_ERR_NO_MEMORY;
-		goto error_exit;
-	}
-	memset (message->message.data, 0, message->message.size);
-	memcpy (message->message.data, (char *)(data), message->message.size);
-
-	message->sender_id = req_exec_msg_messagesendreceive->sender_id;
-	message->send_time = api->timer_time_get();
-
-	if (list_empty (&queue->pending_head)) {
-		list_add_tail (&message->queue_list,
-			&queue->message_head);
-		list_add_tail (&message->message_list,
-			&queue->priority[(message->message.priority)].message_head);
-
-		queue->priority[(message->message.priority)].queue_used += message->message.size;
-		queue->priority[(message->message.priority)].number_of_messages += 1;
-	}
-	else {
-		pending = list_entry (queue->pending_head.next,	struct pending_entry, pending_list);
-		if (pending == NULL) {
-			error = SA_AIS_ERR_LIBRARY;
-			goto error_exit;
-		}
-
-		if (api->ipc_source_is_local (&pending->source)) {
-			api->timer_delete (pending->timer_handle);
-			msg_pending_deliver (pending, message);
-		}
-
-		list_del (&pending->pending_list);
-
-		free (pending);
-	}
-
-	if (group != NULL) {
-		group->next_queue = msg_group_member_next (group);
-	}
+	list_add (&reply->hash_list, msg_hash_key (reply_hash, reply->sender_id));
 
 	/*
 	 * Create timer for this call to saMsgMessageSendReceive. If a reply is not
 	 * received before this timer expires, SA_AIS_ERR_TIMEOUT will be returned
 	 * to the caller. See msg_sendreceive_timeout function.
 	 */
-	if (api->ipc_source_is_local (&req_exec_msg_messagesendreceive->source)) {
-		api->timer_add_duration (
-			req_exec_msg_messagesendreceive->timeout, (void *)(reply),
-			msg_sendreceive_timeout, &reply->timer_handle);
-	}
+	api->timer_add_duration (
+		req_exec_msg_messagesendreceive->timeout, (void *)(reply),
+		msg_sendreceive_timeout, &reply->timer_handle);
 
 	return;
 
@@ -4921,22 +5922,6 @@ error_exit:
 		api->ipc_response_iov_send (
 			req_exec_msg_messagesendreceive->source.conn, &iov, 1);
 	}
-
-	if ((error == SA_AIS_OK) && (queue->open_flags & SA_MSG_QUEUE_RECEIVE_CALLBACK) &&
-	    (api->ipc_source_is_local (&queue->source)))
-	{
-		res_lib_msg_messagereceived_callback.header.size =
-				sizeof (struct res_lib_msg_messagereceived_callback);
-		res_lib_msg_messagereceived_callback.header.id =
-			MESSAGE_RES_MSG_MESSAGERECEIVED_CALLBACK;
-		res_lib_msg_messagereceived_callback.header.error = SA_AIS_OK;
-		res_lib_msg_messagereceived_callback.queue_handle = queue->queue_handle;
-
-		api->ipc_dispatch_send (
-			queue->source.conn,
-			&res_lib_msg_messagereceived_callback,
-			sizeof (struct res_lib_msg_messagereceived_callback));
-	}
 }
 
 static void message_handler_req_exec_msg_messagereply (
@@ -4945,78 +5930,26 @@ static void message_handler_req_exec_msg_messagereply (
 {
 	const struct req_exec_msg_messagereply
 		*req_exec_msg_messagereply = msg;
-	struct res_lib_msg_messagereply res_lib_msg_messagereply;
-	struct res_lib_msg_messagesendreceive res_lib_msg_messagesendreceive;
-	SaAisErrorT error = SA_AIS_OK;
-
-	struct iovec iov[2];
-
-	struct reply_entry *reply = NULL;
-
-	char *data = ((char *)(req_exec_msg_messagereply) +
-		      sizeof (struct req_exec_msg_messagereply));
-
-	/* DEBUG */
-	log_printf (LOGSYS_LEVEL_DEBUG, "EXEC request: saMsgMessageReply\n");
-	log_printf (LOGSYS_LEVEL_DEBUG, "\t sender_id=%llx\n",
-		    (unsigned long long)(req_exec_msg_messagereply->sender_id));
-
-	reply = msg_reply_find (&reply_list_head,
-		req_exec_msg_messagereply->sender_id);
-	if (reply == NULL) {
-		error = SA_AIS_ERR_NOT_EXIST;
-		goto error_exit;
-	}
-
-	if ((reply->reply_size != 0) &&
-	    (reply->reply_size < req_exec_msg_messagereply->reply_message.size)) {
-		error = SA_AIS_ERR_NO_SPACE;
-		goto error_exit;
-	}
-
-	if (api->totem_nodeid_get() == (req_exec_msg_messagereply->sender_id >> 32))
-	{
-		api->timer_delete (reply->timer_handle);
-
-		res_lib_msg_messagesendreceive.header.size =
-			sizeof (struct res_lib_msg_messagesendreceive);
-		res_lib_msg_messagesendreceive.header.id =
-			MESSAGE_RES_MSG_MESSAGESENDRECEIVE;
-		res_lib_msg_messagesendreceive.header.error = SA_AIS_OK;
-
-		res_lib_msg_messagesendreceive.reply_time = api->timer_time_get();
-
-		memcpy (&res_lib_msg_messagesendreceive.message,
-			&req_exec_msg_messagereply->reply_message,
-			sizeof (mar_msg_message_t));
+	SaAisErrorT error = SA_AIS_OK;
 
-		iov[0].iov_base = (void *)&res_lib_msg_messagesendreceive;
-		iov[0].iov_len = sizeof (struct res_lib_msg_messagesendreceive);
+	char *data = ((char *)(req_exec_msg_messagereply) +
+		      sizeof (struct req_exec_msg_messagereply));
 
-		iov[1].iov_base = (void *)data;
-		iov[1].iov_len = req_exec_msg_messagereply->reply_message.size;
+	/* DEBUG */
+	log_printf (LOGSYS_LEVEL_DEBUG, "EXEC request: saMsgMessageReply\n");
+	log_printf (LOGSYS_LEVEL_DEBUG, "\t sender_id=%llx\n",
+		    (unsigned long long)(req_exec_msg_messagereply->sender_id));
 
-		api->ipc_response_iov_send (reply->source.conn, iov, 2);
+	if (api->totem_nodeid_get() != (req_exec_msg_messagereply->sender_id >> 32)) {
+		msg_reply_result_wait (&req_exec_msg_messagereply->source, 0, 0,
+			(unsigned int)(req_exec_msg_messagereply->sender_id >> 32));
+		return;
 	}
 
-	list_del (&reply->reply_list);
-
-	free (reply);
-
-error_exit:
-	if (api->ipc_source_is_local (&req_exec_msg_messagereply->source))
-	{
-		res_lib_msg_messagereply.header.size =
-			sizeof (struct res_lib_msg_messagereply);
-		res_lib_msg_messagereply.header.id =
-			MESSAGE_RES_MSG_MESSAGEREPLY;
-		res_lib_msg_messagereply.header.error = error;
+	error = msg_reply_complete (req_exec_msg_messagereply->sender_id,
+		&req_exec_msg_messagereply->reply_message, data);
 
-		api->ipc_response_send (
-			req_exec_msg_messagereply->source.conn,
-			&res_lib_msg_messagereply,
-			sizeof (struct res_lib_msg_messagereply));
-	}
+	msg_reply_result (&req_exec_msg_messagereply->source, 0, error, 0, 0);
 }
 
 static void message_handler_req_exec_msg_messagereplyasync (
@@ -5025,15 +5958,8 @@ static void message_handler_req_exec_msg_messagereplyasync (
 {
 	const struct req_exec_msg_messagereplyasync
 		*req_exec_msg_messagereplyasync = msg;
-	struct res_lib_msg_messagereplyasync res_lib_msg_messagereplyasync;
-	struct res_lib_msg_messagesendreceive res_lib_msg_messagesendreceive;
-	struct res_lib_msg_messagedelivered_callback res_lib_msg_messagedelivered_callback;
 	SaAisErrorT error = SA_AIS_OK;
 
-	struct iovec iov[2];
-
-	struct reply_entry *reply = NULL;
-
 	char *data = ((char *)(req_exec_msg_messagereplyasync) +
 		      sizeof (struct req_exec_msg_messagereplyasync));
 
@@ -5042,80 +5968,19 @@ static void message_handler_req_exec_msg_messagereplyasync (
 	log_printf (LOGSYS_LEVEL_DEBUG, "\t sender_id=%llx\n",
 		    (unsigned long long)(req_exec_msg_messagereplyasync->sender_id));
 
-	reply = msg_reply_find (&reply_list_head,
-		req_exec_msg_messagereplyasync->sender_id);
-	if (reply == NULL) {
-		error = SA_AIS_ERR_NOT_EXIST;
-		goto error_exit;
-	}
-
-	if ((reply->reply_size != 0) &&
-	    (reply->reply_size < req_exec_msg_messagereplyasync->reply_message.size)) {
-		error = SA_AIS_ERR_NO_SPACE;
-		goto error_exit;
-	}
-
-	if (api->totem_nodeid_get() == (req_exec_msg_messagereplyasync->sender_id >> 32))
-	{
-		api->timer_delete (reply->timer_handle);
-
-		res_lib_msg_messagesendreceive.header.size =
-			sizeof (struct res_lib_msg_messagesendreceive);
-		res_lib_msg_messagesendreceive.header.id =
-			MESSAGE_RES_MSG_MESSAGESENDRECEIVE;
-		res_lib_msg_messagesendreceive.header.error = SA_AIS_OK;
-
-		res_lib_msg_messagesendreceive.reply_time = api->timer_time_get();
-
-		memcpy (&res_lib_msg_messagesendreceive.message,
-			&req_exec_msg_messagereplyasync->reply_message,
-			sizeof (mar_msg_message_t));
-
-		iov[0].iov_base = (void *)&res_lib_msg_messagesendreceive;
-		iov[0].iov_len = sizeof (struct res_lib_msg_messagesendreceive);
-
-		iov[1].iov_base = (void *)data;
-		iov[1].iov_len = req_exec_msg_messagereplyasync->reply_message.size;
-
-		api->ipc_response_iov_send (reply->source.conn, iov, 2);
+	if (api->totem_nodeid_get() != (req_exec_msg_messagereplyasync->sender_id >> 32)) {
+		msg_reply_result_wait (&req_exec_msg_messagereplyasync->source, 1,
+			req_exec_msg_messagereplyasync->invocation,
+			(unsigned int)(req_exec_msg_messagereplyasync->sender_id >> 32));
+		return;
 	}
 
-	list_del (&reply->reply_list);
-
-	free (reply);
-
-error_exit:
-	if (api->ipc_source_is_local (&req_exec_msg_messagereplyasync->source))
-	{
-		res_lib_msg_messagereplyasync.header.size =
-			sizeof (struct res_lib_msg_messagereplyasync);
-		res_lib_msg_messagereplyasync.header.id =
-			MESSAGE_RES_MSG_MESSAGEREPLYASYNC;
-		res_lib_msg_messagereplyasync.header.error = error;
-
-		api->ipc_response_send (
-			req_exec_msg_messagereplyasync->source.conn,
-			&res_lib_msg_messagereplyasync,
-			sizeof (struct res_lib_msg_messagereplyasync));
-
-		if ((error == SA_AIS_OK) &&
-		    (req_exec_msg_messagereplyasync->ack_flags & SA_MSG_MESSAGE_DELIVERED_ACK))
-		{
-			res_lib_msg_messagedelivered_callback.header.size =
-				sizeof (struct res_lib_msg_messagedelivered_callback);
-			res_lib_msg_messagedelivered_callback.header.id =
-				MESSAGE_RES_MSG_MESSAGEDELIVERED_CALLBACK;
-			res_lib_msg_messagedelivered_callback.header.error = error;
-
-			res_lib_msg_messagedelivered_callback.invocation =
-				req_exec_msg_messagereplyasync->invocation;
+	error = msg_reply_complete (req_exec_msg_messagereplyasync->sender_id,
+		&req_exec_msg_messagereplyasync->reply_message, data);
 
-			api->ipc_dispatch_send (
-				req_exec_msg_messagereplyasync->source.conn,
-				&res_lib_msg_messagedelivered_callback,
-				sizeof (struct res_lib_msg_messagedelivered_callback));
-		}
-	}
+	msg_reply_result (&req_exec_msg_messagereplyasync->source, 1, error,
+		req_exec_msg_messagereplyasync->invocation,
+		req_exec_msg_messagereplyasync->ack_flags);
 }
 
 static void message_handler_req_exec_msg_queuecapacitythresholdsset (
@@ -5135,7 +6000,7 @@ static void message_handler_req_exec_msg_queuecapacitythresholdsset (
 	log_printf (LOGSYS_LEVEL_DEBUG, "\t queue=%s\n",
 		    (char *)(req_exec_msg_queuecapacitythresholdsset->queue_name.value));
 
-	queue = msg_queue_find_id (&queue_list_head,
+	queue = msg_queue_find_id (queue_hash,
 		&req_exec_msg_queuecapacitythresholdsset->queue_name,
 		req_exec_msg_queuecapacitythresholdsset->queue_id);
 	if (queue == NULL) {
@@ -5183,7 +6048,7 @@ static void message_handler_req_exec_msg_queuecapacitythresholdsget (
 	log_printf (LOGSYS_LEVEL_DEBUG, "\t queue=%s\n",
 		    (char *)(req_exec_msg_queuecapacitythresholdsget->queue_name.value));
 
-	queue = msg_queue_find_id (&queue_list_head,
+	queue = msg_queue_find_id (queue_hash,
 		&req_exec_msg_queuecapacitythresholdsget->queue_name,
 		req_exec_msg_queuecapacitythresholdsget->queue_id);
 	if (queue == NULL) {
@@ -5234,6 +6099,13 @@ static void message_handler_req_exec_msg_metadatasizeget (
 			MESSAGE_RES_MSG_METADATASIZEGET;
 		res_lib_msg_metadatasizeget.header.error = error;
 
+		/*
+		 * Each message is multicast as a req_exec_msg_messagesend
+		 * followed by the message data.
+		 */
+		res_lib_msg_metadatasizeget.metadata_size =
+			sizeof (struct req_exec_msg_messagesend);
+
 		api->ipc_response_send (
 			req_exec_msg_metadatasizeget->source.conn,
 			&res_lib_msg_metadatasizeget,
@@ -5268,6 +6140,79 @@ static void message_handler_req_exec_msg_limitget (
 	}
 }
 
+/*
+ * The sync leader skips the messages of a queue when every member was
+ * already part of the previous configuration. Each member then moves
+ * the messages it holds from the queue list that is replaced when
+ * synchronization completes, once the queue's message sequence number
+ * and message count match the leader's.
+ */
+static void msg_sync_queue_message_keep (
+	struct queue_entry *queue,
+	mar_uint32_t message_count)
+{
+	struct queue_entry *old_queue;
+	struct priority_area *area;
+	struct priority_area *old_area;
+	mar_uint32_t old_count = 0;
+	int i;
+
+	old_queue = msg_queue_find_id (queue_hash,
+		&queue->queue_name, queue->queue_id);
+
+	if (old_queue != NULL) {
+		for (i = SA_MSG_MESSAGE_HIGHEST_PRIORITY; i <= SA_MSG_MESSAGE_LOWEST_PRIORITY; i++) {
+			old_count += old_queue->priority[i].number_of_messages;
+		}
+	}
+
+	if (message_count == 0) {
+		return;
+	}
+
+	if (queue->owner_nodeid == 0) {
+		log_printf (LOGSYS_LEVEL_NOTICE,
+			"Dropping %u messages on queue %s: owner and standby have left\n",
+			(unsigned int)(message_count),
+			(char *)(queue->queue_name.value));
+		return;
+	}
+
+	if ((old_queue == NULL) ||
+	    (old_queue->message_id != queue->message_id) ||
+	    (old_count != message_count))
+	{
+		log_printf (LOGSYS_LEVEL_WARNING,
+			"Dropping %u messages on queue %s: out of step with the sync leader\n",
+			(unsigned int)(message_count),
+			(char *)(queue->queue_name.value));
+		return;
+	}
+
+	list_splice (&old_queue->message_head, &queue->message_head);
+	list_init (&old_queue->message_head);
+
+	for (i = SA_MSG_MESSAGE_HIGHEST_PRIORITY; i <= SA_MSG_MESSAGE_LOWEST_PRIORITY; i++) {
+		area = &queue->priority[i];
+		old_area = &old_queue->priority[i];
+
+		list_splice (&old_area->message_head, &area->message_head);
+		list_init (&old_area->message_head);
+
+		area->queue_used = old_area->queue_used;
+		area->number_of_messages = old_area->number_of_messages;
+		area->ring = old_area->ring;
+		area->ring_head = old_area->ring_head;
+		area->ring_used = old_area->ring_used;
+
+		old_area->queue_used = 0;
+		old_area->number_of_messages = 0;
+		old_area->ring = NULL;
+		old_area->ring_head = 0;
+		old_area->ring_used = 0;
+	}
+}
+
 static void message_handler_req_exec_msg_sync_queue (
 	const void *msg,
 	unsigned int nodeid)
@@ -5287,7 +6232,7 @@ static void message_handler_req_exec_msg_sync_queue (
 		return;
 	}
 
-	queue = msg_queue_find_id (&sync_queue_list_head,
+	queue = msg_queue_find_id (sync_queue_hash,
 		&req_exec_msg_sync_queue->queue_name,
 		req_exec_msg_sync_queue->queue_id);
 
@@ -5318,6 +6263,28 @@ static void message_handler_req_exec_msg_sync_queue (
 	queue->open_flags = req_exec_msg_sync_queue->open_flags;
 	queue->change_flag = req_exec_msg_sync_queue->change_flag;
 	queue->queue_handle = req_exec_msg_sync_queue->queue_handle;
+	queue->owner_nodeid = req_exec_msg_sync_queue->owner_nodeid;
+	queue->standby_nodeid = req_exec_msg_sync_queue->standby_nodeid;
+	queue->message_id = req_exec_msg_sync_queue->message_id;
+
+	/*
+	 * If the owner has left, the standby takes over the queue. If both
+	 * have left, the message bodies are gone: owner_nodeid is cleared
+	 * so that the queued messages are dropped, and a new owner is
+	 * picked once synchronization is complete.
+	 */
+	if (!msg_find_member_nodeid (queue->owner_nodeid)) {
+		if (msg_find_member_nodeid (queue->standby_nodeid)) {
+			queue->owner_nodeid = queue->standby_nodeid;
+		}
+		else {
+			queue->owner_nodeid = 0;
+		}
+		queue->standby_nodeid = 0;
+	}
+	else if (!msg_find_member_nodeid (queue->standby_nodeid)) {
+		queue->standby_nodeid = 0;
+	}
 
 	msg_queue_priority_area_init (queue);
 
@@ -5327,6 +6294,12 @@ static void message_handler_req_exec_msg_sync_queue (
 	list_init (&queue->pending_head);
 
 	list_add_tail (&queue->queue_list, &sync_queue_list_head);
+	list_add (&queue->hash_list, msg_hash_name (sync_queue_hash, &queue->queue_name));
+
+	if (req_exec_msg_sync_queue->message_skip) {
+		msg_sync_queue_message_keep (queue,
+			req_exec_msg_sync_queue->message_count);
+	}
 
 	sync_queue_count += 1;
 
@@ -5344,10 +6317,12 @@ static void message_handler_req_exec_msg_sync_queue_message (
 	const struct req_exec_msg_sync_queue_message
 		*req_exec_msg_sync_queue_message = msg;
 	struct queue_entry *queue = NULL;
+	struct queue_entry *old_queue = NULL;
 	struct message_entry *message = NULL;
-
-	char *data = ((char *)(req_exec_msg_sync_queue_message) +
-		      sizeof (struct req_exec_msg_sync_queue_message));
+	struct message_entry *old_message = NULL;
+	struct priority_area *area;
+	struct priority_area *old_area;
+	mar_size_t first;
 
 	/* DEBUG */
 	log_printf (LOGSYS_LEVEL_DEBUG, "EXEC request: sync_queue_message\n");
@@ -5360,7 +6335,7 @@ static void message_handler_req_exec_msg_sync_queue_message (
 		return;
 	}
 
-	queue = msg_queue_find_id (&sync_queue_list_head,
+	queue = msg_queue_find_id (sync_queue_hash,
 		&req_exec_msg_sync_queue_message->queue_name,
 		req_exec_msg_sync_queue_message->queue_id);
 
@@ -5369,24 +6344,57 @@ static void message_handler_req_exec_msg_sync_queue_message (
 	 */
 	assert (queue != NULL);
 
-	message = malloc (sizeof (struct message_entry));
+	if (queue->owner_nodeid == 0) {
+		log_printf (LOGSYS_LEVEL_NOTICE,
+			"Dropping message on queue %s: owner and standby have left\n",
+			(char *)(queue->queue_name.value));
+		return;
+	}
+
+	message = msg_message_alloc ();
 	if (message == NULL) {
 		corosync_fatal_error (COROSYNC_OUT_OF_MEMORY);
 	}
-	memset (message, 0, sizeof (struct message_entry));
 	memcpy (&message->message,
 		&req_exec_msg_sync_queue_message->message,
 		sizeof (mar_msg_message_t));
 
-	message->message.data = malloc (message->message.size);
-	if (message->message.data == NULL) {
-		corosync_fatal_error (COROSYNC_OUT_OF_MEMORY);
-	}
-	memset (message->message.data, 0, message->message.size);
-	memcpy (message->message.data, (char *)(data), message->message.size);
-
+	message->message.data = NULL;
 	message->sender_id = req_exec_msg_sync_queue_message->sender_id;
 	message->send_time = req_exec_msg_sync_queue_message->send_time;
+	message->message_id = req_exec_msg_sync_queue_message->message_id;
+
+	/*
+	 * The message body is not part of the sync message. If this node
+	 * keeps the bodies for this queue, copy the body into the new
+	 * queue's ring from the queue list that is replaced when
+	 * synchronization completes.
+	 */
+	if (msg_queue_body_local (queue)) {
+		old_queue = msg_queue_find_id (queue_hash,
+			&queue->queue_name, queue->queue_id);
+		if (old_queue != NULL) {
+			old_message = msg_queue_find_message_id (old_queue,
+				message->message_id);
+		}
+		if ((old_message != NULL) && (old_message->message.data != NULL)) {
+			area = &queue->priority[message->message.priority];
+			old_area = &old_queue->priority[message->message.priority];
+
+			first = msg_ring_contiguous (old_area,
+				old_message->message.data, message->message.size);
+
+			message->message.data = msg_ring_write (area,
+				old_message->message.data, first);
+			if (message->message.data == NULL) {
+				corosync_fatal_error (COROSYNC_OUT_OF_MEMORY);
+			}
+			if (first < message->message.size) {
+				msg_ring_write (area, old_area->ring,
+					message->message.size - first);
+			}
+		}
+	}
 
 	list_add_tail (&message->queue_list, &queue->message_head);
 	list_add_tail (&message->message_list, &queue->priority[(message->message.priority)].message_head);
@@ -5403,10 +6411,11 @@ static void message_handler_req_exec_msg_sync_queue_refcount (
 {
 	const struct req_exec_msg_sync_queue_refcount
 		*req_exec_msg_sync_queue_refcount = msg;
+	const mar_refcount_set_t *refcount_set =
+		(const mar_refcount_set_t *)(req_exec_msg_sync_queue_refcount + 1);
 	struct queue_entry *queue = NULL;
 
 	unsigned int i;
-	unsigned int j;
 
 	/* DEBUG */
 	log_printf (LOGSYS_LEVEL_DEBUG, "EXEC request: sync_queue_refcount\n");
@@ -5419,7 +6428,7 @@ static void message_handler_req_exec_msg_sync_queue_refcount (
 		return;
 	}
 
-	queue = msg_queue_find_id (&sync_queue_list_head,
+	queue = msg_queue_find_id (sync_queue_hash,
 		&req_exec_msg_sync_queue_refcount->queue_name,
 		req_exec_msg_sync_queue_refcount->queue_id);
 
@@ -5428,32 +6437,13 @@ static void message_handler_req_exec_msg_sync_queue_refcount (
 	 */
 	assert (queue != NULL);
 
-	for (i = 0; i < PROCESSOR_COUNT_MAX; i++) {
-		if (req_exec_msg_sync_queue_refcount->refcount_set[i].nodeid == 0) {
-			break;
-		}
-
-		if (msg_find_member_nodeid (req_exec_msg_sync_queue_refcount->refcount_set[i].nodeid) == 0) {
+	for (i = 0; i < req_exec_msg_sync_queue_refcount->refcount_set_count; i++) {
+		if (msg_find_member_nodeid (refcount_set[i].nodeid) == 0) {
 			continue;
 		}
 
-		for (j = 0; j < PROCESSOR_COUNT_MAX; j++) {
-			if (queue->refcount_set[j].nodeid == 0)
-			{
-				queue->refcount_set[j].nodeid =
-					req_exec_msg_sync_queue_refcount->refcount_set[i].nodeid;
-				queue->refcount_set[j].refcount =
-					req_exec_msg_sync_queue_refcount->refcount_set[i].refcount;
-				break;
-			}
-
-			if (req_exec_msg_sync_queue_refcount->refcount_set[i].nodeid == queue->refcount_set[j].nodeid)
-			{
-				queue->refcount_set[j].refcount +=
-					req_exec_msg_sync_queue_refcount->refcount_set[i].refcount;
-				break;
-			}
-		}
+		refcount_vector_add (&queue->refcount_set,
+			refcount_set[i].nodeid, refcount_set[i].refcount);
 	}
 
 	msg_sync_refcount_calculate (queue);
@@ -5484,7 +6474,7 @@ static void message_handler_req_exec_msg_sync_group (
 		return;
 	}
 
-	group = msg_group_find (&sync_group_list_head,
+	group = msg_group_find (sync_group_hash,
 		&req_exec_msg_sync_group->group_name);
 
 	/*
@@ -5507,6 +6497,7 @@ static void message_handler_req_exec_msg_sync_group (
 	list_init (&group->group_list);
 
 	list_add_tail (&group->group_list, &sync_group_list_head);
+	list_add (&group->hash_list, msg_hash_name (sync_group_hash, &group->group_name));
 
 	sync_group_count += 1;
 
@@ -5534,12 +6525,12 @@ static void message_handler_req_exec_msg_sync_group_member (
 		return;
 	}
 
-	group = msg_group_find (&sync_group_list_head,
+	group = msg_group_find (sync_group_hash,
 		&req_exec_msg_sync_group_member->group_name);
 
 	assert (group != NULL);
 
-	queue = msg_queue_find_id (&sync_queue_list_head,
+	queue = msg_queue_find_id (sync_queue_hash,
 		&req_exec_msg_sync_group_member->queue_name,
 		req_exec_msg_sync_group_member->queue_id);
 
@@ -5550,6 +6541,10 @@ static void message_handler_req_exec_msg_sync_group_member (
 	list_init (&queue->group_list);
 	list_add_tail (&queue->group_list, &group->queue_head);
 
+	if (group->next_queue == NULL) {
+		group->next_queue = queue;
+	}
+
 	group->member_count += 1;
 
 	return;
@@ -5559,43 +6554,11 @@ static void message_handler_req_exec_msg_sync_reply (
 	const void *msg,
 	unsigned int nodeid)
 {
-	const struct req_exec_msg_sync_reply
-		*req_exec_msg_sync_reply = msg;
-	struct reply_entry *reply = NULL;
-
-	/* DEBUG */
-	log_printf (LOGSYS_LEVEL_DEBUG, "EXEC request: sync_reply\n");
-	log_printf (LOGSYS_LEVEL_DEBUG, "\t sender_id=%llx\n",
-		    (unsigned long long)(req_exec_msg_sync_reply->sender_id));
-
-	if (memcmp (&req_exec_msg_sync_reply->ring_id,
-		    &saved_ring_id, sizeof (struct memb_ring_id)) != 0)
-	{
-		return;
-	}
-
-	reply = msg_reply_find (&sync_reply_list_head,
-		req_exec_msg_sync_reply->sender_id);
-
 	/*
-	 * This reply should not exist.
+	 * Replies are kept only on the requester's node and are no longer
+	 * synchronized. The message id is kept so that the exec ids of the
+	 * messages after it do not change.
 	 */
-	assert (reply == NULL);
-
-	reply = malloc (sizeof (struct reply_entry));
-	if (reply == NULL) {
-		corosync_fatal_error (COROSYNC_OUT_OF_MEMORY);
-	}
-	memset (reply, 0, sizeof (struct reply_entry));
-	memcpy (&reply->source,
-		&req_exec_msg_sync_reply->source,
-		sizeof (mar_message_source_t));
-
-	reply->sender_id = req_exec_msg_sync_reply->sender_id;
-
-	list_init (&reply->reply_list);
-	list_add_tail (&reply->reply_list, &sync_reply_list_head);
-
 	return;
 }
 
@@ -5612,7 +6575,7 @@ static void message_handler_req_exec_msg_queue_timeout (
 	log_printf (LOGSYS_LEVEL_DEBUG, "\t queue=%s\n",
 		    (char *)(req_exec_msg_queue_timeout->queue_name.value));
 
-	queue = msg_queue_find (&queue_list_head,
+	queue = msg_queue_find (queue_hash,
 		&req_exec_msg_queue_timeout->queue_name);
 
 	assert (queue != NULL);
@@ -5639,7 +6602,7 @@ static void message_handler_req_exec_msg_messageget_timeout (
 	log_printf (LOGSYS_LEVEL_DEBUG, "\t queue=%s\n",
 		    (char *)(req_exec_msg_messageget_timeout->queue_name.value));
 
-	queue = msg_queue_find (&queue_list_head,
+	queue = msg_queue_find (queue_hash,
 		&req_exec_msg_messageget_timeout->queue_name);
 
 	assert (queue != NULL);
@@ -5673,43 +6636,104 @@ static void message_handler_req_exec_msg_sendreceive_timeout (
 	const void *msg,
 	unsigned int nodeid)
 {
-	const struct req_exec_msg_sendreceive_timeout
-		*req_exec_msg_sendreceive_timeout = msg;
-	struct reply_entry *reply = NULL;
-	struct iovec iov;
+	/*
+	 * A saMsgMessageSendReceive timeout is handled on the requester's
+	 * node by msg_sendreceive_timeout and is no longer multicast.
+	 */
+	return;
+}
 
-	struct res_lib_msg_messagesendreceive res_lib_msg_messagesendreceive;
+static void message_handler_req_exec_msg_message_deliver (
+	const void *msg,
+	unsigned int nodeid)
+{
+	const struct req_exec_msg_message_deliver
+		*req_exec_msg_message_deliver = msg;
+
+	char *data = ((char *)(req_exec_msg_message_deliver) +
+		      sizeof (struct req_exec_msg_message_deliver));
 
 	/* DEBUG */
-	log_printf (LOGSYS_LEVEL_DEBUG, "[DEBUG]: sendreceive_timeout\n");
-	log_printf (LOGSYS_LEVEL_DEBUG, "\t sender_id=%llx\n",
-		    (unsigned long long)(req_exec_msg_sendreceive_timeout->sender_id));
+	log_printf (LOGSYS_LEVEL_DEBUG, "EXEC request: message_deliver\n");
+	log_printf (LOGSYS_LEVEL_DEBUG, "\t queue=%s\n",
+		    (char *)(req_exec_msg_message_deliver->queue_name.value));
+
+	if (api->ipc_source_is_local (&req_exec_msg_message_deliver->source))
+	{
+		msg_message_respond (
+			req_exec_msg_message_deliver->source.conn,
+			req_exec_msg_message_deliver->packed,
+			req_exec_msg_message_deliver->error, data,
+			req_exec_msg_message_deliver->header.size -
+			sizeof (struct req_exec_msg_message_deliver),
+			req_exec_msg_message_deliver->number_of_messages);
+	}
+}
 
-	reply = msg_reply_find (&reply_list_head,
-		req_exec_msg_sendreceive_timeout->sender_id);
+static void message_handler_req_exec_msg_reply_result (
+	const void *msg,
+	unsigned int nodeid)
+{
+	const struct req_exec_msg_reply_result
+		*req_exec_msg_reply_result = msg;
 
-	assert (reply != NULL);
+	/* DEBUG */
+	log_printf (LOGSYS_LEVEL_DEBUG, "EXEC request: reply_result\n");
 
-	if (api->ipc_source_is_local (&req_exec_msg_sendreceive_timeout->source))
+	if (api->ipc_source_is_local (&req_exec_msg_reply_result->source))
 	{
-		res_lib_msg_messagesendreceive.header.size =
-			sizeof (struct res_lib_msg_messagesendreceive);
-		res_lib_msg_messagesendreceive.header.id =
-			MESSAGE_RES_MSG_MESSAGESENDRECEIVE;
-		res_lib_msg_messagesendreceive.header.error = SA_AIS_ERR_TIMEOUT;
+		msg_reply_result_done (
+			&req_exec_msg_reply_result->source,
+			req_exec_msg_reply_result->async,
+			req_exec_msg_reply_result->invocation);
 
-		/* ! */
+		msg_reply_result_send (
+			req_exec_msg_reply_result->source.conn,
+			req_exec_msg_reply_result->async,
+			req_exec_msg_reply_result->error,
+			req_exec_msg_reply_result->invocation,
+			req_exec_msg_reply_result->ack_flags);
+	}
+}
 
-		iov.iov_base = (void *)&res_lib_msg_messagesendreceive;
-		iov.iov_len = sizeof (struct res_lib_msg_messagesendreceive);
+static void message_handler_req_exec_msg_sync_packed (
+	const void *msg,
+	unsigned int nodeid)
+{
+	const struct req_exec_msg_sync_packed
+		*req_exec_msg_sync_packed = msg;
+	const coroipc_request_header_t *header;
+	const char *record;
+	unsigned int id;
+	unsigned int i;
 
-		api->ipc_response_iov_send (
-			req_exec_msg_sendreceive_timeout->source.conn, &iov, 1);
+	/* DEBUG */
+	log_printf (LOGSYS_LEVEL_DEBUG, "EXEC request: sync_packed\n");
+	log_printf (LOGSYS_LEVEL_DEBUG, "\t records=%u\n",
+		    (unsigned int)(req_exec_msg_sync_packed->record_count));
+
+	if (memcmp (&req_exec_msg_sync_packed->ring_id,
+		    &saved_ring_id, sizeof (struct memb_ring_id)) != 0)
+	{
+		return;
 	}
 
-	msg_reply_release (reply);
+	record = (const char *)(req_exec_msg_sync_packed + 1);
 
-	return;
+	for (i = 0; i < req_exec_msg_sync_packed->record_count; i++) {
+		header = (const coroipc_request_header_t *)record;
+		id = header->id & 0xffff;
+
+		assert ((id >= MESSAGE_REQ_EXEC_MSG_SYNC_QUEUE) &&
+			(id <= MESSAGE_REQ_EXEC_MSG_SYNC_GROUP_MEMBER));
+
+		msg_exec_engine[id].exec_handler_fn (record, nodeid);
+
+		record += header->size;
+	}
+
+	msg_sync_received_records += req_exec_msg_sync_packed->record_count;
+	msg_sync_received_bytes += req_exec_msg_sync_packed->header.size;
 }
 
 static void message_handler_req_lib_msg_queueopen (
@@ -5734,6 +6758,8 @@ static void message_handler_req_lib_msg_queueopen (
 
 	req_exec_msg_queueopen.queue_handle =
 		req_lib_msg_queueopen->queue_handle;
+	req_exec_msg_queueopen.standby_nodeid =
+		msg_standby_select ();
 	req_exec_msg_queueopen.open_flags =
 		req_lib_msg_queueopen->open_flags;
 	req_exec_msg_queueopen.create_attrs_flag =
@@ -5751,7 +6777,7 @@ static void message_handler_req_lib_msg_queueopen (
 	iovec.iov_base = (void *)&req_exec_msg_queueopen;
 	iovec.iov_len = sizeof (req_exec_msg_queueopen);
 
-	assert (api->totem_mcast (&iovec, 1, TOTEM_AGREED) == 0);
+	assert (msg_totem_mcast (&iovec, 1, TOTEM_AGREED) == 0);
 }
 
 static void message_handler_req_lib_msg_queueopenasync (
@@ -5776,6 +6802,8 @@ static void message_handler_req_lib_msg_queueopenasync (
 
 	req_exec_msg_queueopenasync.queue_handle =
 		req_lib_msg_queueopenasync->queue_handle;
+	req_exec_msg_queueopenasync.standby_nodeid =
+		msg_standby_select ();
 	req_exec_msg_queueopenasync.open_flags =
 		req_lib_msg_queueopenasync->open_flags;
 	req_exec_msg_queueopenasync.create_attrs_flag =
@@ -5793,7 +6821,7 @@ static void message_handler_req_lib_msg_queueopenasync (
 	iovec.iov_base = (void *)&req_exec_msg_queueopenasync;
 	iovec.iov_len = sizeof (req_exec_msg_queueopenasync);
 
-	assert (api->totem_mcast (&iovec, 1, TOTEM_AGREED) == 0);
+	assert (msg_totem_mcast (&iovec, 1, TOTEM_AGREED) == 0);
 }
 
 static void message_handler_req_lib_msg_queueclose (
@@ -5825,7 +6853,7 @@ static void message_handler_req_lib_msg_queueclose (
 	iovec.iov_base = (void *)&req_exec_msg_queueclose;
 	iovec.iov_len = sizeof (req_exec_msg_queueclose);
 
-	assert (api->totem_mcast (&iovec, 1, TOTEM_AGREED) == 0);
+	assert (msg_totem_mcast (&iovec, 1, TOTEM_AGREED) == 0);
 }
 
 static void message_handler_req_lib_msg_queuestatusget (
@@ -5855,7 +6883,7 @@ static void message_handler_req_lib_msg_queuestatusget (
 	iovec.iov_base = (void *)&req_exec_msg_queuestatusget;
 	iovec.iov_len = sizeof (req_exec_msg_queuestatusget);
 
-	assert (api->totem_mcast (&iovec, 1, TOTEM_AGREED) == 0);
+	assert (msg_totem_mcast (&iovec, 1, TOTEM_AGREED) == 0);
 }
 
 static void message_handler_req_lib_msg_queueretentiontimeset (
@@ -5883,7 +6911,7 @@ static void message_handler_req_lib_msg_queueretentiontimeset (
 	iovec.iov_base = (void *)&req_exec_msg_queueretentiontimeset;
 	iovec.iov_len = sizeof (req_exec_msg_queueretentiontimeset);
 
-	assert (api->totem_mcast (&iovec, 1, TOTEM_AGREED) == 0);
+	assert (msg_totem_mcast (&iovec, 1, TOTEM_AGREED) == 0);
 }
 
 static void message_handler_req_lib_msg_queueunlink (
@@ -5911,7 +6939,7 @@ static void message_handler_req_lib_msg_queueunlink (
 	iovec.iov_base = (void *)&req_exec_msg_queueunlink;
 	iovec.iov_len = sizeof (req_exec_msg_queueunlink);
 
-	assert (api->totem_mcast (&iovec, 1, TOTEM_AGREED) == 0);
+	assert (msg_totem_mcast (&iovec, 1, TOTEM_AGREED) == 0);
 }
 
 static void message_handler_req_lib_msg_queuegroupcreate (
@@ -5944,7 +6972,7 @@ static void message_handler_req_lib_msg_queuegroupcreate (
 	iovec.iov_base = (void *)&req_exec_msg_queuegroupcreate;
 	iovec.iov_len = sizeof (req_exec_msg_queuegroupcreate);
 
-	assert (api->totem_mcast (&iovec, 1, TOTEM_AGREED) == 0);
+	assert (msg_totem_mcast (&iovec, 1, TOTEM_AGREED) == 0);
 }
 
 static void message_handler_req_lib_msg_queuegroupinsert (
@@ -5978,7 +7006,7 @@ static void message_handler_req_lib_msg_queuegroupinsert (
 	iovec.iov_base = (void *)&req_exec_msg_queuegroupinsert;
 	iovec.iov_len = sizeof (req_exec_msg_queuegroupinsert);
 
-	assert (api->totem_mcast (&iovec, 1, TOTEM_AGREED) == 0);
+	assert (msg_totem_mcast (&iovec, 1, TOTEM_AGREED) == 0);
 }
 
 static void message_handler_req_lib_msg_queuegroupremove (
@@ -6012,7 +7040,7 @@ static void message_handler_req_lib_msg_queuegroupremove (
 	iovec.iov_base = (void *)&req_exec_msg_queuegroupremove;
 	iovec.iov_len = sizeof (req_exec_msg_queuegroupremove);
 
-	assert (api->totem_mcast (&iovec, 1, TOTEM_AGREED) == 0);
+	assert (msg_totem_mcast (&iovec, 1, TOTEM_AGREED) == 0);
 }
 
 static void message_handler_req_lib_msg_queuegroupdelete (
@@ -6042,7 +7070,7 @@ static void message_handler_req_lib_msg_queuegroupdelete (
 	iovec.iov_base = (void *)&req_exec_msg_queuegroupdelete;
 	iovec.iov_len = sizeof (req_exec_msg_queuegroupdelete);
 
-	assert (api->totem_mcast (&iovec, 1, TOTEM_AGREED) == 0);
+	assert (msg_totem_mcast (&iovec, 1, TOTEM_AGREED) == 0);
 }
 
 static void message_handler_req_lib_msg_queuegrouptrack (
@@ -6066,7 +7094,7 @@ static void message_handler_req_lib_msg_queuegrouptrack (
 	log_printf (LOGSYS_LEVEL_DEBUG, "\t group=%s\n",
 		    (char *)(req_lib_msg_queuegrouptrack->group_name.value));
 
-	group = msg_group_find (&group_list_head,
+	group = msg_group_find (group_hash,
 		&req_lib_msg_queuegrouptrack->group_name);
 	if (group == NULL) {
 		error = SA_AIS_ERR_NOT_EXIST;
@@ -6104,7 +7132,7 @@ static void message_handler_req_lib_msg_queuegrouptrack (
 	if ((req_lib_msg_queuegrouptrack->track_flags & SA_TRACK_CHANGES) ||
 	    (req_lib_msg_queuegrouptrack->track_flags & SA_TRACK_CHANGES_ONLY))
 	{
-		track = msg_track_find (&track_list_head,
+		track = msg_track_find (track_hash,
 			&group->group_name, conn);
 		if (track == NULL) {
 			track = malloc (sizeof (struct track_entry));
@@ -6120,6 +7148,7 @@ static void message_handler_req_lib_msg_queuegrouptrack (
 
 			list_init (&track->track_list);
 			list_add_tail (&track->track_list, &track_list_head);
+			list_add (&track->hash_list, msg_hash_name (track_hash, &track->group_name));
 		}
 		track->track_flags = req_lib_msg_queuegrouptrack->track_flags;
 	}
@@ -6181,14 +7210,14 @@ static void message_handler_req_lib_msg_queuegrouptrackstop (
 	log_printf (LOGSYS_LEVEL_DEBUG, "\t group=%s\n",
 		    (char *)(req_lib_msg_queuegrouptrackstop->group_name.value));
 
-	group = msg_group_find (&group_list_head,
+	group = msg_group_find (group_hash,
 		&req_lib_msg_queuegrouptrackstop->group_name);
 	if (group == NULL) {
 		error = SA_AIS_ERR_NOT_EXIST;
 		goto error_exit;
 	}
 
-	track = msg_track_find (&track_list_head,
+	track = msg_track_find (track_hash,
 		&req_lib_msg_queuegrouptrackstop->group_name, conn);
 
 	if (track == NULL) {
@@ -6197,6 +7226,7 @@ static void message_handler_req_lib_msg_queuegrouptrackstop (
 	}
 
 	list_del (&track->track_list);
+	list_del (&track->hash_list);
 
 	free (track);
 
@@ -6233,7 +7263,7 @@ static void message_handler_req_lib_msg_queuegroupnotificationfree (
 	iovec.iov_base = (void *)&req_exec_msg_queuegroupnotificationfree;
 	iovec.iov_len = sizeof (req_exec_msg_queuegroupnotificationfree);
 
-	assert (api->totem_mcast (&iovec, 1, TOTEM_AGREED) == 0);
+	assert (msg_totem_mcast (&iovec, 1, TOTEM_AGREED) == 0);
 }
 
 static void message_handler_req_lib_msg_messagesend (
@@ -6247,6 +7277,8 @@ static void message_handler_req_lib_msg_messagesend (
 	/* DEBUG */
 	log_printf (LOGSYS_LEVEL_DEBUG, "LIB request: saMsgMessageSend\n");
 
+	msg_stats_messages_sent += 1;
+
 	req_exec_msg_messagesend.header.size =
 		sizeof (struct req_exec_msg_messagesend);
 	req_exec_msg_messagesend.header.id =
@@ -6276,7 +7308,7 @@ static void message_handler_req_lib_msg_messagesend (
 
 	req_exec_msg_messagesend.header.size += iovec[1].iov_len;
 
-	assert (api->totem_mcast (iovec, 2, TOTEM_AGREED) == 0);
+	assert (msg_totem_mcast (iovec, 2, TOTEM_AGREED) == 0);
 }
 
 static void message_handler_req_lib_msg_messagesendasync (
@@ -6290,6 +7322,8 @@ static void message_handler_req_lib_msg_messagesendasync (
 	/* DEBUG */
 	log_printf (LOGSYS_LEVEL_DEBUG, "LIB request: saMsgMessageSendAsync\n");
 
+	msg_stats_messages_sent += 1;
+
 	req_exec_msg_messagesendasync.header.size =
 		sizeof (struct req_exec_msg_messagesendasync);
 	req_exec_msg_messagesendasync.header.id =
@@ -6321,7 +7355,7 @@ static void message_handler_req_lib_msg_messagesendasync (
 
 	req_exec_msg_messagesendasync.header.size += iovec[1].iov_len;
 
-	assert (api->totem_mcast (iovec, 2, TOTEM_AGREED) == 0);
+	assert (msg_totem_mcast (iovec, 2, TOTEM_AGREED) == 0);
 }
 
 static void message_handler_req_lib_msg_messageget (
@@ -6346,6 +7380,9 @@ static void message_handler_req_lib_msg_messageget (
 		req_lib_msg_messageget->queue_id;
 	req_exec_msg_messageget.timeout =
 		req_lib_msg_messageget->timeout;
+	req_exec_msg_messageget.max_messages = 1;
+	req_exec_msg_messageget.max_bytes = 0;
+	req_exec_msg_messageget.packed = 0;
 
 	memcpy (&req_exec_msg_messageget.queue_name,
 		&req_lib_msg_messageget->queue_name,
@@ -6354,7 +7391,7 @@ static void message_handler_req_lib_msg_messageget (
 	iovec.iov_base = (void *)&req_exec_msg_messageget;
 	iovec.iov_len = sizeof (req_exec_msg_messageget);
 
-	assert (api->totem_mcast (&iovec, 1, TOTEM_AGREED) == 0);
+	assert (msg_totem_mcast (&iovec, 1, TOTEM_AGREED) == 0);
 }
 
 static void message_handler_req_lib_msg_messagedatafree (
@@ -6379,7 +7416,7 @@ static void message_handler_req_lib_msg_messagedatafree (
 	iovec.iov_base = (void *)&req_exec_msg_messagedatafree;
 	iovec.iov_len = sizeof (req_exec_msg_messagedatafree);
 
-	assert (api->totem_mcast (&iovec, 1, TOTEM_AGREED) == 0);
+	assert (msg_totem_mcast (&iovec, 1, TOTEM_AGREED) == 0);
 }
 
 static void message_handler_req_lib_msg_messagecancel (
@@ -6410,7 +7447,7 @@ static void message_handler_req_lib_msg_messagecancel (
 	iovec.iov_base = (void *)&req_exec_msg_messagecancel;
 	iovec.iov_len = sizeof (req_exec_msg_messagecancel);
 
-	assert (api->totem_mcast (&iovec, 1, TOTEM_AGREED) == 0);
+	assert (msg_totem_mcast (&iovec, 1, TOTEM_AGREED) == 0);
 }
 
 static void message_handler_req_lib_msg_messagesendreceive (
@@ -6424,6 +7461,8 @@ static void message_handler_req_lib_msg_messagesendreceive (
 	/* DEBUG */
 	log_printf (LOGSYS_LEVEL_DEBUG, "LIB request: saMsgMessageSendReceive\n");
 
+	msg_stats_messages_sent += 1;
+
 	req_exec_msg_messagesendreceive.header.size =
 		sizeof (struct req_exec_msg_messagesendreceive);
 	req_exec_msg_messagesendreceive.header.id =
@@ -6458,7 +7497,7 @@ static void message_handler_req_lib_msg_messagesendreceive (
 
 	req_exec_msg_messagesendreceive.header.size += iovec[1].iov_len;
 
-	assert (api->totem_mcast (iovec, 2, TOTEM_AGREED) == 0);
+	assert (msg_totem_mcast (iovec, 2, TOTEM_AGREED) == 0);
 }
 
 static void message_handler_req_lib_msg_messagereply (
@@ -6468,10 +7507,27 @@ static void message_handler_req_lib_msg_messagereply (
 	const struct req_lib_msg_messagereply *req_lib_msg_messagereply = msg;
 	struct req_exec_msg_messagereply req_exec_msg_messagereply;
 	struct iovec iovec[2];
+	SaAisErrorT error;
 
 	/* DEBUG */
 	log_printf (LOGSYS_LEVEL_DEBUG, "LIB request: saMsgMessageReply\n");
 
+	msg_stats_messages_sent += 1;
+
+	/*
+	 * A reply to a requester on this node completes the call at once,
+	 * without going through totem.
+	 */
+	if ((req_lib_msg_messagereply->sender_id >> 32) == api->totem_nodeid_get()) {
+		error = msg_reply_complete (req_lib_msg_messagereply->sender_id,
+			&req_lib_msg_messagereply->reply_message,
+			((char *)req_lib_msg_messagereply) +
+			sizeof (struct req_lib_msg_messagereply));
+
+		msg_reply_result_send (conn, 0, error, 0, 0);
+		return;
+	}
+
 	req_exec_msg_messagereply.header.size =
 		sizeof (struct req_exec_msg_messagereply);
 	req_exec_msg_messagereply.header.id =
@@ -6498,7 +7554,7 @@ static void message_handler_req_lib_msg_messagereply (
 
 	req_exec_msg_messagereply.header.size += iovec[1].iov_len;
 
-	assert (api->totem_mcast (iovec, 2, TOTEM_AGREED) == 0);
+	assert (msg_totem_mcast (iovec, 2, TOTEM_AGREED) == 0);
 }
 
 static void message_handler_req_lib_msg_messagereplyasync (
@@ -6508,10 +7564,25 @@ static void message_handler_req_lib_msg_messagereplyasync (
 	const struct req_lib_msg_messagereplyasync *req_lib_msg_messagereplyasync = msg;
 	struct req_exec_msg_messagereplyasync req_exec_msg_messagereplyasync;
 	struct iovec iovec[2];
+	SaAisErrorT error;
 
 	/* DEBUG */
 	log_printf (LOGSYS_LEVEL_DEBUG, "LIB request: saMsgMessageReplyAsync\n");
 
+	msg_stats_messages_sent += 1;
+
+	if ((req_lib_msg_messagereplyasync->sender_id >> 32) == api->totem_nodeid_get()) {
+		error = msg_reply_complete (req_lib_msg_messagereplyasync->sender_id,
+			&req_lib_msg_messagereplyasync->reply_message,
+			((char *)req_lib_msg_messagereplyasync) +
+			sizeof (struct req_lib_msg_messagereplyasync));
+
+		msg_reply_result_send (conn, 1, error,
+			req_lib_msg_messagereplyasync->invocation,
+			req_lib_msg_messagereplyasync->ack_flags);
+		return;
+	}
+
 	req_exec_msg_messagereplyasync.header.size =
 		sizeof (struct req_exec_msg_messagereplyasync);
 	req_exec_msg_messagereplyasync.header.id =
@@ -6540,7 +7611,7 @@ static void message_handler_req_lib_msg_messagereplyasync (
 
 	req_exec_msg_messagereplyasync.header.size += iovec[1].iov_len;
 
-	assert (api->totem_mcast (iovec, 2, TOTEM_AGREED) == 0);
+	assert (msg_totem_mcast (iovec, 2, TOTEM_AGREED) == 0);
 }
 
 static void message_handler_req_lib_msg_queuecapacitythresholdsset (
@@ -6568,7 +7639,7 @@ static void message_handler_req_lib_msg_queuecapacitythresholdsset (
 	iovec.iov_base = (void *)&req_exec_msg_queuecapacitythresholdsset;
 	iovec.iov_len = sizeof (req_exec_msg_queuecapacitythresholdsset);
 
-	assert (api->totem_mcast (&iovec, 1, TOTEM_AGREED) == 0);
+	assert (msg_totem_mcast (&iovec, 1, TOTEM_AGREED) == 0);
 }
 
 static void message_handler_req_lib_msg_queuecapacitythresholdsget (
@@ -6596,7 +7667,7 @@ static void message_handler_req_lib_msg_queuecapacitythresholdsget (
 	iovec.iov_base = (void *)&req_exec_msg_queuecapacitythresholdsget;
 	iovec.iov_len = sizeof (req_exec_msg_queuecapacitythresholdsget);
 
-	assert (api->totem_mcast (&iovec, 1, TOTEM_AGREED) == 0);
+	assert (msg_totem_mcast (&iovec, 1, TOTEM_AGREED) == 0);
 }
 
 static void message_handler_req_lib_msg_metadatasizeget (
@@ -6620,7 +7691,7 @@ static void message_handler_req_lib_msg_metadatasizeget (
 	iovec.iov_base = (void *)&req_exec_msg_metadatasizeget;
 	iovec.iov_len = sizeof (req_exec_msg_metadatasizeget);
 
-	assert (api->totem_mcast (&iovec, 1, TOTEM_AGREED) == 0);
+	assert (msg_totem_mcast (&iovec, 1, TOTEM_AGREED) == 0);
 }
 
 static void message_handler_req_lib_msg_limitget (
@@ -6644,5 +7715,43 @@ static void message_handler_req_lib_msg_limitget (
 	iovec.iov_base = (void *)&req_exec_msg_limitget;
 	iovec.iov_len = sizeof (req_exec_msg_limitget);
 
-	assert (api->totem_mcast (&iovec, 1, TOTEM_AGREED) == 0);
+	assert (msg_totem_mcast (&iovec, 1, TOTEM_AGREED) == 0);
+}
+
+static void message_handler_req_lib_msg_messagegetmany (
+	void *conn,
+	const void *msg)
+{
+	const struct req_lib_msg_messagegetmany *req_lib_msg_messagegetmany = msg;
+	struct req_exec_msg_messageget req_exec_msg_messageget;
+	struct iovec iovec;
+
+	/* DEBUG */
+	log_printf (LOGSYS_LEVEL_DEBUG, "LIB request: saMsgMessageGetMany\n");
+
+	req_exec_msg_messageget.header.size =
+		sizeof (struct req_exec_msg_messageget);
+	req_exec_msg_messageget.header.id =
+		SERVICE_ID_MAKE (MSG_SERVICE, MESSAGE_REQ_EXEC_MSG_MESSAGEGET);
+
+	api->ipc_source_set (&req_exec_msg_messageget.source, conn);
+
+	req_exec_msg_messageget.queue_id =
+		req_lib_msg_messagegetmany->queue_id;
+	req_exec_msg_messageget.timeout =
+		req_lib_msg_messagegetmany->timeout;
+	req_exec_msg_messageget.max_messages =
+		req_lib_msg_messagegetmany->max_messages;
+	req_exec_msg_messageget.max_bytes =
+		req_lib_msg_messagegetmany->max_bytes;
+	req_exec_msg_messageget.packed = 1;
+
+	memcpy (&req_exec_msg_messageget.queue_name,
+		&req_lib_msg_messagegetmany->queue_name,
+		sizeof (mar_name_t));
+
+	iovec.iov_base = (void *)&req_exec_msg_messageget;
+	iovec.iov_len = sizeof (req_exec_msg_messageget);
+
+	assert (msg_totem_mcast (&iovec, 1, TOTEM_AGREED) == 0);
 }
@@ -0,0 +1,209 @@
+/*
+ * Copyright (c) 2009 Red Hat, Inc.
+ *
+ * All rights reserved.
+ *
+ * This software licensed under BSD license, the text of which follows:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * - Neither the name of the MontaVista Software, Inc. nor the names of its
+ *   contributors may be used to endorse or promote products derived from this
+ *   software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include <corosync/mar_gen.h>
+#include <corosync/swab.h>
+#include <corosync/engine/coroapi.h>
+
+#ifndef REFCOUNT_H_DEFINED
+#define REFCOUNT_H_DEFINED
+
+/*
+ * Per-node reference counts of a checkpoint, queue or lock resource.
+ * Only the nodes that have the object open have an entry, kept in a
+ * vector sorted by nodeid.
+ */
+struct refcount_set {
+	unsigned int refcount;
+	unsigned int nodeid;
+};
+
+struct refcount_vector {
+	unsigned int count;
+	unsigned int allocated;
+	struct refcount_set *set;
+};
+
+/*
+ * Sync messages carry count entries of this type after the fixed
+ * part of the message.
+ */
+typedef struct {
+	mar_uint32_t refcount;
+	mar_uint32_t nodeid;
+} mar_refcount_set_t;
+
+#define REFCOUNT_VECTOR_GROW 4
+
+static inline void refcount_vector_init (
+	struct refcount_vector *vector)
+{
+	vector->count = 0;
+	vector->allocated = 0;
+	vector->set = NULL;
+}
+
+static inline void refcount_vector_free (
+	struct refcount_vector *vector)
+{
+	free (vector->set);
+	refcount_vector_init (vector);
+}
+
+/*
+ * Index of the entry for nodeid, or of the entry it would be
+ * inserted before.
+ */
+static inline unsigned int refcount_vector_index (
+	const struct refcount_vector *vector,
+	unsigned int nodeid)
+{
+	unsigned int low = 0;
+	unsigned int high = vector->count;
+	unsigned int mid;
+
+	while (low < high) {
+		mid = (low + high) / 2;
+		if (vector->set[mid].nodeid < nodeid) {
+			low = mid + 1;
+		} else {
+			high = mid;
+		}
+	}
+	return (low);
+}
+
+static inline unsigned int refcount_vector_get (
+	const struct refcount_vector *vector,
+	unsigned int nodeid)
+{
+	unsigned int i = refcount_vector_index (vector, nodeid);
+
+	if ((i < vector->count) && (vector->set[i].nodeid == nodeid)) {
+		return (vector->set[i].refcount);
+	}
+	return (0);
+}
+
+static inline void refcount_vector_add (
+	struct refcount_vector *vector,
+	unsigned int nodeid,
+	unsigned int refcount)
+{
+	struct refcount_set *set;
+	unsigned int i = refcount_vector_index (vector, nodeid);
+
+	if ((i < vector->count) && (vector->set[i].nodeid == nodeid)) {
+		vector->set[i].refcount += refcount;
+		return;
+	}
+
+	if (vector->count == vector->allocated) {
+		set = realloc (vector->set, sizeof (struct refcount_set) *
+			(vector->allocated + REFCOUNT_VECTOR_GROW));
+		if (set == NULL) {
+			corosync_fatal_error (COROSYNC_OUT_OF_MEMORY);
+		}
+		vector->set = set;
+		vector->allocated += REFCOUNT_VECTOR_GROW;
+	}
+
+	memmove (&vector->set[i + 1], &vector->set[i],
+		sizeof (struct refcount_set) * (vector->count - i));
+
+	vector->set[i].nodeid = nodeid;
+	vector->set[i].refcount = refcount;
+	vector->count += 1;
+}
+
+static inline void refcount_vector_increment (
+	struct refcount_vector *vector,
+	unsigned int nodeid)
+{
+	refcount_vector_add (vector, nodeid, 1);
+}
+
+/*
+ * The entry is removed once the node holds no more references.
+ */
+static inline void refcount_vector_decrement (
+	struct refcount_vector *vector,
+	unsigned int nodeid)
+{
+	unsigned int i = refcount_vector_index (vector, nodeid);
+
+	if ((i == vector->count) || (vector->set[i].nodeid != nodeid)) {
+		return;
+	}
+
+	vector->set[i].refcount -= 1;
+
+	if (vector->set[i].refcount == 0) {
+		vector->count -= 1;
+		memmove (&vector->set[i], &vector->set[i + 1],
+			sizeof (struct refcount_set) * (vector->count - i));
+	}
+}
+
+static inline unsigned int refcount_vector_total (
+	const struct refcount_vector *vector)
+{
+	unsigned int total = 0;
+	unsigned int i;
+
+	for (i = 0; i < vector->count; i++) {
+		total += vector->set[i].refcount;
+	}
+	return (total);
+}
+
+static inline void marshall_to_mar_refcount_set_t_all (
+	mar_refcount_set_t *dest,
+	const struct refcount_vector *src)
+{
+	unsigned int i;
+
+	for (i = 0; i < src->count; i++) {
+		dest[i].refcount = src->set[i].refcount;
+		dest[i].nodeid = src->set[i].nodeid;
+	}
+}
+
+static inline void swab_mar_refcount_set_t (mar_refcount_set_t *to_swab)
+{
+	swab_mar_uint32_t (&to_swab->refcount);
+	swab_mar_uint32_t (&to_swab->nodeid);
+}
+
+#endif /* REFCOUNT_H_DEFINED */
@@ -74,14 +74,16 @@ struct timer_instance {
 	SaUint64T expiration_count;
 	SaUint64T timer_skip;
 	SaTimeT call_time;
-	corosync_timer_handle_t timer_handle;
+	SaTimeT next_expiration;
+	unsigned long long wheel_tick;
 	mar_message_source_t source;
 	void *timer_data;
 	struct list_head cleanup_list;
+	struct list_head wheel_list;
+	unsigned int slab_index;
+	unsigned int generation;
 };
 
-DECLARE_HDB_DATABASE (timer_hdb,NULL);
-
 static struct corosync_api_v1 *api;
 
 static int tmr_exec_init_fn (struct corosync_api_v1 *);
@@ -122,11 +124,64 @@ static void message_handler_req_lib_tmr_clocktickget (
 
 static struct corosync_api_v1 *api;
 
+/*
+ * Expirations are not sent one by one.  They are gathered for every
+ * connection and sent in a single dispatch message once the timers
+ * due in this pass of the timing wheel have run.
+ */
+#define TMR_EXPIRATION_BATCH_MAX 128
+
 struct tmr_pd {
 	struct list_head timer_list;
 	struct list_head timer_cleanup_list;
+	struct list_head expiration_list;
+	void *conn;
+	unsigned int expiration_entries;
+	struct tmr_expiration expiration[TMR_EXPIRATION_BATCH_MAX];
 };
 
+DECLARE_LIST_INIT(tmr_expiration_list_head);
+
+/*
+ * Timers are kept in a hierarchical timing wheel of TMR_WHEEL_LEVELS
+ * levels of TMR_WHEEL_SIZE slots.  A slot of level 0 holds the timers
+ * due in one tick, a slot of level n those due in TMR_WHEEL_SIZE^n
+ * ticks, which move down a level when the wheel reaches the slot.
+ * Timers beyond the last level wait in the overflow list.  A single
+ * core timer is armed for the next slot that has work.  A timer
+ * expires at most one tick late; the tick matches the millisecond
+ * resolution of the core timers.
+ */
+#define TMR_WHEEL_BITS 6
+#define TMR_WHEEL_SIZE (1 << TMR_WHEEL_BITS)
+#define TMR_WHEEL_MASK (TMR_WHEEL_SIZE - 1)
+#define TMR_WHEEL_LEVELS 6
+#define TMR_WHEEL_TICK (SA_TIME_ONE_MILLISECOND)
+
+static struct list_head tmr_wheel[TMR_WHEEL_LEVELS][TMR_WHEEL_SIZE];
+
+DECLARE_LIST_INIT(tmr_wheel_overflow_list_head);
+
+static unsigned long long tmr_wheel_tick = 0;
+static unsigned int tmr_wheel_count = 0;
+static int tmr_wheel_running = 0;
+
+static corosync_timer_handle_t tmr_wheel_timer_handle = 0;
+static unsigned long long tmr_wheel_timer_tick = 0;
+
+/*
+ * Timer instances are allocated TMR_SLAB_SIZE at a time and never
+ * given back.  The low 32 bits of a timer id are the index of the
+ * instance, the high bits its generation, so that the id of a
+ * cancelled timer does not find the timer that reused its instance.
+ */
+#define TMR_SLAB_SIZE 1024
+
+static struct timer_instance **tmr_slabs = NULL;
+static unsigned int tmr_slab_count = 0;
+
+DECLARE_LIST_INIT(tmr_slab_free_list_head);
+
 static struct corosync_lib_handler tmr_lib_engine[] =
 {
 	{
@@ -227,14 +282,152 @@ __attribute__ ((constructor)) static void corosync_lcr_component_register (void)
 	lcr_component_register (&tmr_comp_ver0);
 }
 
+static struct timer_instance *tmr_timer_alloc (void)
+{
+	struct timer_instance **slabs;
+	struct timer_instance *slab;
+	struct timer_instance *timer_instance;
+	unsigned int slab_index;
+	unsigned int generation;
+	unsigned int i;
+
+	if (list_empty (&tmr_slab_free_list_head)) {
+		slabs = realloc (tmr_slabs,
+			sizeof (struct timer_instance *) * (tmr_slab_count + 1));
+		if (slabs == NULL) {
+			return (NULL);
+		}
+		tmr_slabs = slabs;
+
+		slab = malloc (sizeof (struct timer_instance) * TMR_SLAB_SIZE);
+		if (slab == NULL) {
+			return (NULL);
+		}
+		memset (slab, 0, sizeof (struct timer_instance) * TMR_SLAB_SIZE);
+
+		for (i = 0; i < TMR_SLAB_SIZE; i++) {
+			slab[i].slab_index = tmr_slab_count * TMR_SLAB_SIZE + i;
+			list_add_tail (&slab[i].wheel_list, &tmr_slab_free_list_head);
+		}
+
+		tmr_slabs[tmr_slab_count] = slab;
+		tmr_slab_count += 1;
+	}
+
+	timer_instance = list_entry (tmr_slab_free_list_head.next,
+		struct timer_instance, wheel_list);
+	list_del (&timer_instance->wheel_list);
+
+	slab_index = timer_instance->slab_index;
+	generation = timer_instance->generation + 1;
+	if (generation == 0) {
+		generation = 1;
+	}
+
+	memset (timer_instance, 0, sizeof (struct timer_instance));
+
+	timer_instance->slab_index = slab_index;
+	timer_instance->generation = generation;
+	timer_instance->timer_id =
+		((SaTmrTimerIdT)(generation) << 32) | slab_index;
+
+	list_init (&timer_instance->wheel_list);
+	list_init (&timer_instance->cleanup_list);
+
+	return (timer_instance);
+}
+
+static void tmr_timer_free (struct timer_instance *timer_instance)
+{
+	timer_instance->timer_id = 0;
+
+	list_add (&timer_instance->wheel_list, &tmr_slab_free_list_head);
+}
+
+static struct timer_instance *tmr_timer_find (SaTmrTimerIdT timer_id)
+{
+	unsigned int slab_index = (unsigned int)(timer_id & 0xffffffff);
+	struct timer_instance *timer_instance;
+
+	if (timer_id == 0 || slab_index >= tmr_slab_count * TMR_SLAB_SIZE) {
+		return (NULL);
+	}
+
+	timer_instance =
+		&tmr_slabs[slab_index / TMR_SLAB_SIZE][slab_index % TMR_SLAB_SIZE];
+
+	if (timer_instance->timer_id != timer_id) {
+		return (NULL);
+	}
+	return (timer_instance);
+}
+
+/*
+ * Put a timer in the slot of the lowest level whose higher bits it
+ * shares with the tick the wheel has reached, and return the tick at
+ * which the wheel has to look at that slot.
+ */
+static unsigned long long tmr_wheel_insert (struct timer_instance *timer_instance)
+{
+	unsigned long long tick = timer_instance->wheel_tick;
+	unsigned int shift;
+	unsigned int level;
+
+	if (tick < tmr_wheel_tick) {
+		tick = tmr_wheel_tick;
+	}
+
+	for (level = 0; level < TMR_WHEEL_LEVELS; level++) {
+		shift = level * TMR_WHEEL_BITS;
+
+		if ((tick >> (shift + TMR_WHEEL_BITS)) ==
+		    (tmr_wheel_tick >> (shift + TMR_WHEEL_BITS)))
+		{
+			list_add_tail (&timer_instance->wheel_list,
+				&tmr_wheel[level][(tick >> shift) & TMR_WHEEL_MASK]);
+
+			return ((tick >> shift) << shift);
+		}
+	}
+
+	list_add_tail (&timer_instance->wheel_list, &tmr_wheel_overflow_list_head);
+
+	shift = TMR_WHEEL_LEVELS * TMR_WHEEL_BITS;
+
+	return (((tmr_wheel_tick >> shift) + 1) << shift);
+}
+
+static void tmr_wheel_del (struct timer_instance *timer_instance)
+{
+	if (list_empty (&timer_instance->wheel_list)) {
+		return;
+	}
+
+	list_del (&timer_instance->wheel_list);
+	list_init (&timer_instance->wheel_list);
+
+	tmr_wheel_count -= 1;
+}
+
 static int tmr_exec_init_fn (struct corosync_api_v1 *corosync_api)
 {
+	unsigned int level;
+	unsigned int i;
+
 #ifdef OPENAIS_SOLARIS
 	logsys_subsys_init();
 #endif
 
 	api = corosync_api;
 
+	for (level = 0; level < TMR_WHEEL_LEVELS; level++) {
+		for (i = 0; i < TMR_WHEEL_SIZE; i++) {
+			list_init (&tmr_wheel[level][i]);
+		}
+	}
+
+	tmr_wheel_tick = api->timer_time_get () / TMR_WHEEL_TICK;
+
 	return (0);
 }
 
@@ -244,6 +437,10 @@ static int tmr_lib_init_fn (void *conn)
 
 	list_init (&tmr_pd->timer_list);
 	list_init (&tmr_pd->timer_cleanup_list);
+	list_init (&tmr_pd->expiration_list);
+
+	tmr_pd->conn = conn;
+	tmr_pd->expiration_entries = 0;
 
 	return (0);
 }
@@ -254,6 +451,14 @@ static int tmr_lib_exit_fn (void *conn)
 	struct list_head *cleanup_list;
 	struct tmr_pd *tmr_pd = (struct tmr_pd *) api->ipc_private_data_get (conn);
 
+	/*
+	 * Drop the expirations not yet sent to this connection.
+	 */
+	if (tmr_pd->expiration_entries != 0) {
+		list_del (&tmr_pd->expiration_list);
+		tmr_pd->expiration_entries = 0;
+	}
+
 	cleanup_list = tmr_pd->timer_cleanup_list.next;
 
 	while (!list_empty (&tmr_pd->timer_cleanup_list))
@@ -264,12 +469,11 @@ static int tmr_lib_exit_fn (void *conn)
 		log_printf (LOGSYS_LEVEL_DEBUG, "[DEBUG]: cleanup timer { id=0x%04x }\n",
 			    (unsigned int)(timer_instance->timer_id));
 
-		api->timer_delete (timer_instance->timer_handle);
+		tmr_wheel_del (timer_instance);
 
 		list_del (&timer_instance->cleanup_list);
 
-		hdb_handle_destroy (&timer_hdb, timer_instance->timer_id);
-		hdb_handle_put (&timer_hdb, timer_instance->timer_id);
+		tmr_timer_free (timer_instance);
 
 		cleanup_list = tmr_pd->timer_cleanup_list.next;
 	}
@@ -277,32 +481,242 @@ static int tmr_lib_exit_fn (void *conn)
 	return (0);
 }
 
-static void tmr_timer_expired (void *data)
+static void tmr_expiration_send (struct tmr_pd *tmr_pd)
 {
-	struct timer_instance *timer_instance = (struct timer_instance *)data;
 	struct res_lib_tmr_timerexpiredcallback res_lib_tmr_timerexpiredcallback;
+	struct iovec iov[2];
+
+	res_lib_tmr_timerexpiredcallback.header.size =
+		sizeof (struct res_lib_tmr_timerexpiredcallback) +
+		sizeof (struct tmr_expiration) * tmr_pd->expiration_entries;
+	res_lib_tmr_timerexpiredcallback.header.id =
+		MESSAGE_RES_TMR_TIMEREXPIREDCALLBACK;
+	res_lib_tmr_timerexpiredcallback.header.error = SA_AIS_OK; /* FIXME */
+
+	res_lib_tmr_timerexpiredcallback.expiration_entries =
+		tmr_pd->expiration_entries;
+
+	iov[0].iov_base = (void *)&res_lib_tmr_timerexpiredcallback;
+	iov[0].iov_len = sizeof (struct res_lib_tmr_timerexpiredcallback);
+	iov[1].iov_base = (void *)tmr_pd->expiration;
+	iov[1].iov_len = sizeof (struct tmr_expiration) * tmr_pd->expiration_entries;
+
+	api->ipc_dispatch_iov_send (tmr_pd->conn, iov, 2);
+
+	list_del (&tmr_pd->expiration_list);
+	tmr_pd->expiration_entries = 0;
+}
+
+static void tmr_expiration_flush (void)
+{
+	struct tmr_pd *tmr_pd;
+
+	while (!list_empty (&tmr_expiration_list_head)) {
+		tmr_pd = list_entry (tmr_expiration_list_head.next,
+			struct tmr_pd, expiration_list);
+
+		tmr_expiration_send (tmr_pd);
+	}
+}
+
+static void tmr_expiration_queue (struct timer_instance *timer_instance)
+{
+	struct tmr_pd *tmr_pd = (struct tmr_pd *)
+		api->ipc_private_data_get (timer_instance->source.conn);
+	struct tmr_expiration *expiration;
+
+	if (tmr_pd->expiration_entries == 0) {
+		list_add_tail (&tmr_pd->expiration_list, &tmr_expiration_list_head);
+	}
+
+	expiration = &tmr_pd->expiration[tmr_pd->expiration_entries];
+
+	expiration->timer_id = timer_instance->timer_id;
+	expiration->timer_data = timer_instance->timer_data;
+	expiration->expiration_count = timer_instance->expiration_count;
+	expiration->expiration_time = timer_instance->next_expiration;
+
+	tmr_pd->expiration_entries += 1;
+
+	if (tmr_pd->expiration_entries == TMR_EXPIRATION_BATCH_MAX) {
+		tmr_expiration_send (tmr_pd);
+	}
+}
+
+/*
+ * A cancelled timer must not call back, even if it expired before
+ * the cancel request arrived.
+ */
+static void tmr_expiration_cancel (struct timer_instance *timer_instance)
+{
+	struct tmr_pd *tmr_pd = (struct tmr_pd *)
+		api->ipc_private_data_get (timer_instance->source.conn);
+	unsigned int i;
+
+	for (i = 0; i < tmr_pd->expiration_entries; i++) {
+		if (tmr_pd->expiration[i].timer_id == timer_instance->timer_id) {
+			break;
+		}
+	}
+
+	if (i == tmr_pd->expiration_entries) {
+		return;
+	}
+
+	memmove (&tmr_pd->expiration[i], &tmr_pd->expiration[i + 1],
+		sizeof (struct tmr_expiration) * (tmr_pd->expiration_entries - i - 1));
+
+	tmr_pd->expiration_entries -= 1;
+
+	if (tmr_pd->expiration_entries == 0) {
+		list_del (&tmr_pd->expiration_list);
+	}
+}
+
+static void tmr_wheel_run (void *data);
+
+static void tmr_wheel_arm (unsigned long long tick)
+{
+	if (tmr_wheel_running) {
+		return;
+	}
+
+	if (tmr_wheel_timer_handle != 0) {
+		if (tmr_wheel_timer_tick <= tick) {
+			return;
+		}
+		api->timer_delete (tmr_wheel_timer_handle);
+	}
+
+	tmr_wheel_timer_tick = tick;
+
+	api->timer_add_absolute (tick * TMR_WHEEL_TICK, NULL,
+		tmr_wheel_run, &tmr_wheel_timer_handle);
+}
 
-	timer_instance->expiration_count += 1;
+static void tmr_wheel_add (struct timer_instance *timer_instance)
+{
+	unsigned long long now_tick;
+
+	/*
+	 * An empty wheel may have stood still for a long time.
+	 */
+	if (tmr_wheel_count == 0 && tmr_wheel_running == 0) {
+		now_tick = api->timer_time_get () / TMR_WHEEL_TICK;
+
+		if (tmr_wheel_tick < now_tick) {
+			tmr_wheel_tick = now_tick;
+		}
+	}
+
+	timer_instance->wheel_tick =
+		((unsigned long long)(timer_instance->next_expiration) +
+		 TMR_WHEEL_TICK - 1) / TMR_WHEEL_TICK;
+
+	tmr_wheel_count += 1;
+
+	tmr_wheel_arm (tmr_wheel_insert (timer_instance));
+}
+
+/*
+ * The first slot with timers at the lowest level is the earliest
+ * work in the wheel, since a level only holds timers due before the
+ * current slot of the level above it is left.
+ */
+static int tmr_wheel_next (unsigned long long *tick)
+{
+	unsigned long long base;
+	unsigned int shift;
+	unsigned int level;
+	unsigned int i;
+
+	for (level = 0; level < TMR_WHEEL_LEVELS; level++) {
+		shift = level * TMR_WHEEL_BITS;
+		base = (tmr_wheel_tick >> (shift + TMR_WHEEL_BITS)) <<
+			(shift + TMR_WHEEL_BITS);
+
+		i = (tmr_wheel_tick >> shift) & TMR_WHEEL_MASK;
+		if (level != 0) {
+			i += 1;
+		}
+
+		for (; i < TMR_WHEEL_SIZE; i++) {
+			if (!list_empty (&tmr_wheel[level][i])) {
+				*tick = base | ((unsigned long long)(i) << shift);
+				return (1);
+			}
+		}
+	}
+
+	if (!list_empty (&tmr_wheel_overflow_list_head)) {
+		shift = TMR_WHEEL_LEVELS * TMR_WHEEL_BITS;
+		*tick = ((tmr_wheel_tick >> shift) + 1) << shift;
+		return (1);
+	}
+
+	return (0);
+}
+
+static void tmr_wheel_take (struct list_head *slot, struct list_head *list)
+{
+	list_init (list);
+	list_splice (slot, list);
+	list_init (slot);
+}
+
+static void tmr_wheel_cascade (struct list_head *slot)
+{
+	struct timer_instance *timer_instance;
+	struct list_head list;
+
+	tmr_wheel_take (slot, &list);
+
+	while (!list_empty (&list)) {
+		timer_instance = list_entry (list.next,
+			struct timer_instance, wheel_list);
+		list_del (&timer_instance->wheel_list);
+
+		tmr_wheel_insert (timer_instance);
+	}
+}
+
+static void tmr_timer_expired (struct timer_instance *timer_instance)
+{
+	SaTimeT period = timer_instance->timer_attributes.timerPeriodDuration;
+	SaTimeT current_time;
+	SaUint64T expirations = 1;
+
+	/*
+	 * Periods that passed while the callback was delayed are
+	 * counted here rather than delivered as callbacks of their own.
+	 */
+	if (period > 0) {
+		current_time = (SaTimeT)(api->timer_time_get());
+
+		if (current_time > timer_instance->next_expiration) {
+			expirations += (current_time - timer_instance->next_expiration) / period;
+		}
+	}
+
+	timer_instance->expiration_count += expirations;
 
 	/* DEBUG */
 	log_printf (LOGSYS_LEVEL_DEBUG, "[DEBUG]: tmr_timer_expired { id=0x%04x }\n",
 		    (unsigned int)(timer_instance->timer_id));
 
-	res_lib_tmr_timerexpiredcallback.header.size =
-		sizeof (struct res_lib_tmr_timerexpiredcallback);
-	res_lib_tmr_timerexpiredcallback.header.id =
-		MESSAGE_RES_TMR_TIMEREXPIREDCALLBACK;
-	res_lib_tmr_timerexpiredcallback.header.error = SA_AIS_OK; /* FIXME */
+	/*
+	 * Periodic timers keep the phase of their first expiration,
+	 * so the next one is due at first + k * period whatever the
+	 * dispatch latency of this one was.
+	 */
+	if (period > 0) {
+		timer_instance->next_expiration += expirations * period;
 
-	res_lib_tmr_timerexpiredcallback.timer_id = timer_instance->timer_id;
-	res_lib_tmr_timerexpiredcallback.timer_data = timer_instance->timer_data;
-	res_lib_tmr_timerexpiredcallback.expiration_count = timer_instance->expiration_count;
+		tmr_wheel_add (timer_instance);
+	}
 
 	if (timer_instance->timer_skip == 0) {
-		api->ipc_dispatch_send (
-			timer_instance->source.conn,
-			&res_lib_tmr_timerexpiredcallback,
-			sizeof (struct res_lib_tmr_timerexpiredcallback));
+		tmr_expiration_queue (timer_instance);
 	}
 	else {
 		/* DEBUG */
@@ -312,31 +726,93 @@ static void tmr_timer_expired (void *data)
 		timer_instance->timer_skip -= 1;
 	}
 
-	if (timer_instance->timer_attributes.timerPeriodDuration > 0) {
-		switch (timer_instance->timer_attributes.type) {
+	return;
+}
+
+static void tmr_wheel_run (void *data)
+{
+	struct timer_instance *timer_instance;
+	struct list_head list;
+	unsigned long long now_tick;
+	unsigned long long tick;
+	unsigned long long mask;
+	unsigned int level;
+
+	tmr_wheel_timer_handle = 0;
+	tmr_wheel_running = 1;
+
+	now_tick = api->timer_time_get () / TMR_WHEEL_TICK;
+
+	while (tmr_wheel_next (&tick) && tick <= now_tick) {
+		tmr_wheel_tick = tick;
+
 		/*
-		 * We don't really need a switch statement here,
-		 * since periodic timers will always get recreated
-		 * as duration timers.
+		 * Slots that begin at this tick move down a level,
+		 * highest level first, before level 0 expires.
 		 */
-		case SA_TIME_ABSOLUTE:
-			api->timer_add_absolute (
-				timer_instance->timer_attributes.timerPeriodDuration,
-				(void *)(timer_instance), tmr_timer_expired,
-				&timer_instance->timer_handle);
-			break;
-		case SA_TIME_DURATION:
-			api->timer_add_duration (
-				timer_instance->timer_attributes.timerPeriodDuration,
-				(void *)(timer_instance), tmr_timer_expired,
-				&timer_instance->timer_handle);
-			break;
-		default:
-			break;
+		mask = (1ULL << (TMR_WHEEL_LEVELS * TMR_WHEEL_BITS)) - 1;
+		if ((tick & mask) == 0) {
+			tmr_wheel_cascade (&tmr_wheel_overflow_list_head);
+		}
+
+		for (level = TMR_WHEEL_LEVELS - 1; level > 0; level--) {
+			mask = (1ULL << (level * TMR_WHEEL_BITS)) - 1;
+			if ((tick & mask) == 0) {
+				tmr_wheel_cascade (&tmr_wheel[level]
+					[(tick >> (level * TMR_WHEEL_BITS)) & TMR_WHEEL_MASK]);
+			}
+		}
+
+		tmr_wheel_take (&tmr_wheel[0][tick & TMR_WHEEL_MASK], &list);
+
+		while (!list_empty (&list)) {
+			timer_instance = list_entry (list.next,
+				struct timer_instance, wheel_list);
+			list_del (&timer_instance->wheel_list);
+			list_init (&timer_instance->wheel_list);
+
+			tmr_wheel_count -= 1;
+
+			tmr_timer_expired (timer_instance);
 		}
 	}
 
-	return;
+	/*
+	 * Nothing is due up to now, so the wheel can skip ahead.
+	 */
+	if (tmr_wheel_tick < now_tick) {
+		tmr_wheel_tick = now_tick;
+	}
+
+	tmr_wheel_running = 0;
+
+	tmr_expiration_flush ();
+
+	if (tmr_wheel_next (&tick)) {
+		tmr_wheel_arm (tick);
+	}
+}
+
+static void tmr_timer_add (struct timer_instance *timer_instance)
+{
+	switch (timer_instance->timer_attributes.type)
+	{
+	case SA_TIME_ABSOLUTE:
+		timer_instance->next_expiration =
+			timer_instance->timer_attributes.initialExpirationTime;
+		break;
+	case SA_TIME_DURATION:
+		timer_instance->next_expiration = (SaTimeT)(api->timer_time_get()) +
+			timer_instance->timer_attributes.initialExpirationTime;
+		break;
+	default:
+		/*
+		 * This case is handled in the library.
+		 */
+		return;
+	}
+
+	tmr_wheel_add (timer_instance);
 }
 
 static void message_handler_req_lib_tmr_timerstart (
@@ -349,25 +825,19 @@ static void message_handler_req_lib_tmr_timerstart (
 	struct timer_instance *timer_instance = NULL;
 	SaAisErrorT error = SA_AIS_OK;
 
-	hdb_handle_t timer_id = 0;
+	SaTmrTimerIdT timer_id = 0;
 	struct tmr_pd *tmr_pd = (struct tmr_pd *) api->ipc_private_data_get (conn);
 
 	/* DEBUG */
 	log_printf (LOGSYS_LEVEL_DEBUG, "LIB request: saTmrTimerStart\n");
 
-	hdb_handle_create (&timer_hdb,
-		   sizeof (struct timer_instance),
-		   &timer_id);
-
-	hdb_handle_get (&timer_hdb, timer_id,
-		(void *)&timer_instance);
-
+	timer_instance = tmr_timer_alloc ();
 	if (timer_instance == NULL) {
 		error = SA_AIS_ERR_NO_MEMORY;
 		goto error_exit;
 	}
 
-	timer_instance->timer_id = timer_id;
+	timer_id = timer_instance->timer_id;
 	timer_instance->timer_data = req_lib_tmr_timerstart->timer_data;
 
 	memcpy (&timer_instance->timer_attributes,
@@ -376,28 +846,7 @@ static void message_handler_req_lib_tmr_timerstart (
 
 	api->ipc_source_set (&timer_instance->source, conn);
 
-	list_init (&timer_instance->cleanup_list);
-
-	switch (timer_instance->timer_attributes.type)
-	{
-	case SA_TIME_ABSOLUTE:
-		api->timer_add_absolute (
-			timer_instance->timer_attributes.initialExpirationTime,
-			(void *)(timer_instance), tmr_timer_expired,
-			&timer_instance->timer_handle);
-		break;
-	case SA_TIME_DURATION:
-		api->timer_add_duration (
-			timer_instance->timer_attributes.initialExpirationTime,
-			(void *)(timer_instance), tmr_timer_expired,
-			&timer_instance->timer_handle);
-		break;
-	default:
-		/*
-		 * This case is handled in the library.
-		 */
-		break;
-	}
+	tmr_timer_add (timer_instance);
 
 	list_add (&timer_instance->cleanup_list, &tmr_pd->timer_cleanup_list);
 
@@ -411,6 +860,8 @@ error_exit:
 
 	res_lib_tmr_timerstart.timer_id = timer_id;
 	res_lib_tmr_timerstart.call_time = (SaTimeT)(api->timer_time_get());
+	res_lib_tmr_timerstart.expiration_time =
+		(timer_instance != NULL) ? timer_instance->next_expiration : 0;
 
 	api->ipc_response_send (conn,
 		&res_lib_tmr_timerstart,
@@ -432,9 +883,7 @@ static void message_handler_req_lib_tmr_timerreschedule (
 	log_printf (LOGSYS_LEVEL_DEBUG, "LIB request: saTmrTimerReschedule { id=0x%04x }\n",
 		    (unsigned int)(req_lib_tmr_timerreschedule->timer_id));
 
-	hdb_handle_get (&timer_hdb,
-		(hdb_handle_t)(req_lib_tmr_timerreschedule->timer_id),
-		(void *)&timer_instance);
+	timer_instance = tmr_timer_find (req_lib_tmr_timerreschedule->timer_id);
 	if (timer_instance == NULL) {
 		error = SA_AIS_ERR_NOT_EXIST;
 		goto error_exit;
@@ -442,21 +891,23 @@ static void message_handler_req_lib_tmr_timerreschedule (
 
 	current_time = (SaTimeT)(api->timer_time_get());
 
-	if (current_time > req_lib_tmr_timerreschedule->timer_attributes.initialExpirationTime) {
+	if ((req_lib_tmr_timerreschedule->timer_attributes.type == SA_TIME_ABSOLUTE) &&
+	    (current_time > req_lib_tmr_timerreschedule->timer_attributes.initialExpirationTime))
+	{
 		error = SA_AIS_ERR_INVALID_PARAM;
-		goto error_put;
+		goto error_exit;
 	}
 
 	if (timer_instance->timer_attributes.timerPeriodDuration != 0) {
 		if (req_lib_tmr_timerreschedule->timer_attributes.timerPeriodDuration <= 0) {
 			error = SA_AIS_ERR_INVALID_PARAM;
-			goto error_put;
+			goto error_exit;
 		}
 	}
 	else {
 		if (req_lib_tmr_timerreschedule->timer_attributes.timerPeriodDuration != 0) {
 			error = SA_AIS_ERR_INVALID_PARAM;
-			goto error_put;
+			goto error_exit;
 		}
 	}
 
@@ -464,9 +915,12 @@ static void message_handler_req_lib_tmr_timerreschedule (
 		&req_lib_tmr_timerreschedule->timer_attributes,
 		sizeof (SaTmrTimerAttributesT));
 
-error_put:
+	tmr_wheel_del (timer_instance);
 
-	hdb_handle_put (&timer_hdb, (hdb_handle_t)(timer_instance->timer_id));
+	tmr_timer_add (timer_instance);
+
+	res_lib_tmr_timerreschedule.expiration_time =
+		timer_instance->next_expiration;
 
 error_exit:
 
@@ -476,6 +930,11 @@ error_exit:
 		MESSAGE_RES_TMR_TIMERRESCHEDULE;
 	res_lib_tmr_timerreschedule.header.error = error;
 
+	res_lib_tmr_timerreschedule.call_time = current_time;
+	if (error != SA_AIS_OK) {
+		res_lib_tmr_timerreschedule.expiration_time = 0;
+	}
+
 	api->ipc_response_send (conn,
 		&res_lib_tmr_timerreschedule,
 		sizeof (struct res_lib_tmr_timerreschedule));
@@ -495,9 +954,7 @@ static void message_handler_req_lib_tmr_timercancel (
 	log_printf (LOGSYS_LEVEL_DEBUG, "LIB request: saTmrTimerCancel { id=0x%04x }\n",
 		    (unsigned int)(req_lib_tmr_timercancel->timer_id));
 
-	hdb_handle_get (&timer_hdb,
-		(hdb_handle_t)(req_lib_tmr_timercancel->timer_id),
-		(void *)&timer_instance);
+	timer_instance = tmr_timer_find (req_lib_tmr_timercancel->timer_id);
 	if (timer_instance == NULL) {
 		error = SA_AIS_ERR_NOT_EXIST;
 		goto error_exit;
@@ -505,12 +962,13 @@ static void message_handler_req_lib_tmr_timercancel (
 
 	res_lib_tmr_timercancel.timer_data = timer_instance->timer_data;
 
-	api->timer_delete (timer_instance->timer_handle);
+	tmr_wheel_del (timer_instance);
+
+	tmr_expiration_cancel (timer_instance);
 
 	list_del (&timer_instance->cleanup_list);
 
-	hdb_handle_destroy (&timer_hdb, (hdb_handle_t)(timer_instance->timer_id));
-	hdb_handle_put (&timer_hdb, (hdb_handle_t)(timer_instance->timer_id));
+	tmr_timer_free (timer_instance);
 
 error_exit:
 
@@ -539,9 +997,7 @@ static void message_handler_req_lib_tmr_periodictimerskip (
 	log_printf (LOGSYS_LEVEL_DEBUG, "LIB request: saTmrPeriodicTimerSkip { id=0x%04x }\n",
 		    (unsigned int)(req_lib_tmr_periodictimerskip->timer_id));
 
-	hdb_handle_get (&timer_hdb,
-		(hdb_handle_t)(req_lib_tmr_periodictimerskip->timer_id),
-		(void *)&timer_instance);
+	timer_instance = tmr_timer_find (req_lib_tmr_periodictimerskip->timer_id);
 	if (timer_instance == NULL) {
 		error = SA_AIS_ERR_NOT_EXIST;
 		goto error_exit;
@@ -554,8 +1010,6 @@ static void message_handler_req_lib_tmr_periodictimerskip (
 
 	timer_instance->timer_skip += 1;
 
-	hdb_handle_put (&timer_hdb, (hdb_handle_t)(timer_instance->timer_id));
-
 error_exit:
 
 	res_lib_tmr_periodictimerskip.header.size =
@@ -578,24 +1032,26 @@ static void message_handler_req_lib_tmr_timerremainingtimeget (
 	struct res_lib_tmr_timerremainingtimeget res_lib_tmr_timerremainingtimeget;
 	struct timer_instance *timer_instance = NULL;
 	SaAisErrorT error = SA_AIS_OK;
+	SaTimeT current_time;
 
 	/* DEBUG */
 	log_printf (LOGSYS_LEVEL_DEBUG, "LIB request: saTmrTimerRemainingTimeGet { id=0x%04x }\n",
 		    (unsigned int)(req_lib_tmr_timerremainingtimeget->timer_id));
 
-	hdb_handle_get (&timer_hdb,
-		(hdb_handle_t)(req_lib_tmr_timerremainingtimeget->timer_id),
-		(void *)&timer_instance);
+	timer_instance = tmr_timer_find (req_lib_tmr_timerremainingtimeget->timer_id);
 	if (timer_instance == NULL) {
 		error = SA_AIS_ERR_NOT_EXIST;
 		goto error_exit;
 	}
 
-	res_lib_tmr_timerremainingtimeget.remaining_time =
-		(SaTimeT)((api->timer_expire_time_get(timer_instance->timer_handle)) -
-			  (api->timer_time_get()));
+	current_time = (SaTimeT)(api->timer_time_get());
 
-	hdb_handle_put (&timer_hdb, (hdb_handle_t)(timer_instance->timer_id));
+	if (timer_instance->next_expiration > current_time) {
+		res_lib_tmr_timerremainingtimeget.remaining_time =
+			timer_instance->next_expiration - current_time;
+	} else {
+		res_lib_tmr_timerremainingtimeget.remaining_time = 0;
+	}
 
 error_exit:
 
@@ -624,9 +1080,7 @@ static void message_handler_req_lib_tmr_timerattributesget (
 	log_printf (LOGSYS_LEVEL_DEBUG, "LIB request: saTmrTimerAttributesGet { id=0x%04x }\n",
 		    (unsigned int)(req_lib_tmr_timerattributesget->timer_id));
 
-	hdb_handle_get (&timer_hdb,
-		(hdb_handle_t)(req_lib_tmr_timerattributesget->timer_id),
-		(void *)&timer_instance);
+	timer_instance = tmr_timer_find (req_lib_tmr_timerattributesget->timer_id);
 	if (timer_instance == NULL) {
 		error = SA_AIS_ERR_NOT_EXIST;
 		goto error_exit;
@@ -636,8 +1090,6 @@ static void message_handler_req_lib_tmr_timerattributesget (
 		&timer_instance->timer_attributes,
 		sizeof (SaTmrTimerAttributesT));
 
-	hdb_handle_put (&timer_hdb, (hdb_handle_t)(timer_instance->timer_id));
-
 error_exit:
 
 	res_lib_tmr_timerattributesget.header.size =
@@ -689,7 +1141,10 @@ static void message_handler_req_lib_tmr_clocktickget (
 	/* DEBUG */
 	log_printf (LOGSYS_LEVEL_DEBUG, "LIB request: saTmrClockTickGet\n");
 
-	clock_tick = (SaTimeT)((1.0 / CLOCKS_PER_SEC) * 1000000000ULL);
+	/*
+	 * Timers expire on the ticks of the timing wheel.
+	 */
+	clock_tick = (SaTimeT)(TMR_WHEEL_TICK);
 
 	memcpy (&res_lib_tmr_clocktickget.clock_tick,
 		&clock_tick, sizeof (SaTimeT));
@@ -0,0 +1,662 @@
+/*
+ * Event service fan-out benchmark
+ *
+ * Starts a number of subscriber processes, each subscribing to every
+ * benchmark channel with a filter array of the requested size, then
+ * publishes at a series of fixed offered rates.  For every rate it
+ * reports end-to-end latency percentiles (publish time to receive time),
+ * the delivered rate and the number of SA_EVT_EVENTID_LOST events the
+ * subscribers received because their delivery queue overflowed.
+ *
+ * Publisher and subscribers run on the same node so that the publish
+ * time and receive time come from the same clock.
+ */
+
+#include <config.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/poll.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <fcntl.h>
+#ifndef OPENAIS_SOLARIS
+#include <stdint.h>
+#include <getopt.h>
+#else
+#include <sys/types.h>
+#endif
+#include <stdlib.h>
+#include <time.h>
+#include <sys/time.h>
+#include "saAis.h"
+#include "saEvt.h"
+
+#define TRY_WAIT 2
+
+#define MAX_RATES	32
+#define MAX_FILTERS	32
+#define PUB_NAME	"evtfanout"
+
+/*
+ * Latency histogram in microseconds: 1us buckets up to 1ms, 10us
+ * buckets up to 10ms, 100us buckets up to 100ms and 1ms buckets up
+ * to 10s.  The last bucket holds everything slower.
+ */
+#define HIST_BUCKETS	12701
+
+struct fanout_result {
+	unsigned int received;
+	unsigned int lost;
+	uint64_t first_receive;
+	uint64_t last_receive;
+	unsigned int hist[HIST_BUCKETS];
+};
+
+extern int get_sa_error(SaAisErrorT, char *, int);
+char result_buf[256];
+int result_buf_len = sizeof(result_buf);
+
+static int sub_count = 4;
+static int filter_count = 4;
+static int chan_count = 1;
+static int duration = 5;
+static int data_size = 256;
+static int settle_time = 2;
+static int rate_count = 0;
+static unsigned int rates[MAX_RATES];
+
+static struct fanout_result *results;
+static int current_phase = 0;
+
+SaVersionT version = { 'B', 0x01, 0x01 };
+
+void event_callback( SaEvtSubscriptionIdT subscriptionId,
+		const SaEvtEventHandleT eventHandle,
+		const SaSizeT eventDataSize);
+
+SaEvtCallbacksT callbacks = {
+	0,
+	event_callback
+};
+
+static char pattern_str[MAX_FILTERS][32];
+static SaEvtEventPatternT patterns[MAX_FILTERS];
+static SaEvtEventFilterT filters[MAX_FILTERS];
+
+char user_data[65536];
+
+static uint64_t clust_time_now(void)
+{
+	struct timeval tv;
+	uint64_t time_now;
+
+	if (gettimeofday(&tv, 0)) {
+		return 0ULL;
+	}
+
+	time_now = (uint64_t)(tv.tv_sec) * 1000000000ULL;
+	time_now += (uint64_t)(tv.tv_usec) * 1000ULL;
+
+	return time_now;
+}
+
+static unsigned int hist_bucket(uint64_t usec)
+{
+	if (usec < 1000) {
+		return usec;
+	}
+	if (usec < 10000) {
+		return 1000 + (usec - 1000) / 10;
+	}
+	if (usec < 100000) {
+		return 1900 + (usec - 10000) / 100;
+	}
+	if (usec < 10000000) {
+		return 2800 + (usec - 100000) / 1000;
+	}
+	return HIST_BUCKETS - 1;
+}
+
+static uint64_t hist_usec(unsigned int bucket)
+{
+	if (bucket < 1000) {
+		return bucket;
+	}
+	if (bucket < 1900) {
+		return 1000 + (bucket - 1000) * 10;
+	}
+	if (bucket < 2800) {
+		return 10000 + (bucket - 1900) * 100;
+	}
+	return 100000 + (uint64_t)(bucket - 2800) * 1000;
+}
+
+static uint64_t hist_percentile(const struct fanout_result *res, double pct)
+{
+	uint64_t target;
+	uint64_t seen = 0;
+	unsigned int i;
+
+	if (res->received == 0) {
+		return 0;
+	}
+	target = (uint64_t)(res->received * pct / 100.0);
+	if (target >= res->received) {
+		target = res->received - 1;
+	}
+	for (i = 0; i < HIST_BUCKETS; i++) {
+		seen += res->hist[i];
+		if (seen > target) {
+			return hist_usec(i);
+		}
+	}
+	return hist_usec(HIST_BUCKETS - 1);
+}
+
+static void chan_name_set(SaNameT *channel_name, int i)
+{
+	channel_name->length = sprintf((char *)channel_name->value,
+		"EVTFANOUT_CHANNEL_%d", i);
+}
+
+static void patterns_init(void)
+{
+	int i;
+
+	for (i = 0; i < filter_count; i++) {
+		sprintf(pattern_str[i], "fanout pattern %d", i);
+		patterns[i].pattern = (SaUint8T *)pattern_str[i];
+		patterns[i].patternSize = strlen(pattern_str[i]);
+		patterns[i].allocatedSize = patterns[i].patternSize;
+
+		filters[i].filterType = SA_EVT_EXACT_FILTER;
+		filters[i].filter = patterns[i];
+	}
+}
+
+static SaAisErrorT
+chans_open(SaEvtHandleT handle, SaEvtChannelHandleT *channel_handles,
+	SaEvtChannelOpenFlagsT flags)
+{
+	SaNameT channel_name;
+	SaAisErrorT result;
+	int i;
+
+	for (i = 0; i < chan_count; i++) {
+		chan_name_set(&channel_name, i);
+		do {
+			result = saEvtChannelOpen(handle, &channel_name, flags,
+					SA_TIME_MAX, &channel_handles[i]);
+		} while ((result == SA_AIS_ERR_TRY_AGAIN) && !sleep(TRY_WAIT));
+		if (result != SA_AIS_OK) {
+			get_sa_error(result, result_buf, result_buf_len);
+			printf("channel open %s result: %s\n",
+				channel_name.value, result_buf);
+			return(result);
+		}
+	}
+	return SA_AIS_OK;
+}
+
+void
+event_callback( SaEvtSubscriptionIdT subscription_id,
+		const SaEvtEventHandleT event_handle,
+		const SaSizeT event_data_size)
+{
+	struct fanout_result *res;
+	SaNameT publisher_name;
+	SaTimeT publish_time;
+	SaEvtEventIdT event_id;
+	SaAisErrorT result;
+	uint64_t now;
+	int phase;
+
+	now = clust_time_now();
+
+	result = saEvtEventAttributesGet(event_handle, NULL, NULL, NULL,
+		&publisher_name, &publish_time, &event_id);
+	if (result != SA_AIS_OK) {
+		goto evt_free;
+	}
+
+	/*
+	 * Lost event notifications come from the event service itself,
+	 * account them to the phase we are currently receiving.
+	 */
+	if (event_id == SA_EVT_EVENTID_LOST) {
+		results[current_phase].lost++;
+		goto evt_free;
+	}
+
+	if (publisher_name.length >= SA_MAX_NAME_LENGTH) {
+		goto evt_free;
+	}
+	publisher_name.value[publisher_name.length] = '\0';
+	if (sscanf((char *)publisher_name.value, PUB_NAME ":%d", &phase) != 1 ||
+		phase < 0 || phase >= rate_count) {
+		goto evt_free;
+	}
+	current_phase = phase;
+
+	res = &results[phase];
+	if (res->received == 0) {
+		res->first_receive = now;
+	}
+	res->last_receive = now;
+	res->received++;
+	if (now > publish_time) {
+		res->hist[hist_bucket((now - publish_time) / 1000)]++;
+	} else {
+		res->hist[0]++;
+	}
+
+evt_free:
+	saEvtEventFree(event_handle);
+}
+
+/*
+ * Subscriber process: subscribe, tell the parent we are ready, then
+ * dispatch until the parent closes the control pipe.
+ */
+static int subscriber_run(int result_fd, int control_fd)
+{
+	SaEvtEventFilterArrayT subscribe_filters;
+	SaEvtChannelHandleT *channel_handles;
+	SaEvtHandleT handle;
+	SaSelectionObjectT fd;
+	struct pollfd pfd[2];
+	SaAisErrorT result;
+	char ready = 1;
+	int i;
+
+	results = calloc(rate_count, sizeof(struct fanout_result));
+	channel_handles = malloc(sizeof(SaEvtChannelHandleT) * chan_count);
+	if (results == NULL || channel_handles == NULL) {
+		printf("Unable to allocate subscriber data\n");
+		return 1;
+	}
+
+	do {
+		result = saEvtInitialize (&handle, &callbacks, &version);
+	} while ((result == SA_AIS_ERR_TRY_AGAIN) && !sleep(TRY_WAIT));
+	if (result != SA_AIS_OK) {
+		get_sa_error(result, result_buf, result_buf_len);
+		printf("Event Initialize result: %s\n", result_buf);
+		return 1;
+	}
+
+	result = chans_open(handle, channel_handles,
+		SA_EVT_CHANNEL_SUBSCRIBER | SA_EVT_CHANNEL_CREATE);
+	if (result != SA_AIS_OK) {
+		return 1;
+	}
+
+	subscribe_filters.filtersNumber = filter_count;
+	subscribe_filters.filters = filters;
+	for (i = 0; i < chan_count; i++) {
+		do {
+			result = saEvtEventSubscribe(channel_handles[i],
+				&subscribe_filters, i);
+		} while ((result == SA_AIS_ERR_TRY_AGAIN) && !sleep(TRY_WAIT));
+		if (result != SA_AIS_OK) {
+			get_sa_error(result, result_buf, result_buf_len);
+			printf("event subscribe result: %s\n", result_buf);
+			return 1;
+		}
+	}
+
+	result = saEvtSelectionObjectGet(handle, &fd);
+	if (result != SA_AIS_OK) {
+		get_sa_error(result, result_buf, result_buf_len);
+		printf("saEvtSelectionObject get %s\n", result_buf);
+		return 1;
+	}
+
+	if (write(result_fd, &ready, 1) != 1) {
+		return 1;
+	}
+
+	for (;;) {
+		pfd[0].fd = fd;
+		pfd[0].events = POLLIN;
+		pfd[1].fd = control_fd;
+		pfd[1].events = POLLIN;
+		if (poll(pfd, 2, -1) < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			perror("poll error");
+			return 1;
+		}
+		if (pfd[0].revents) {
+			do {
+				result = saEvtDispatch(handle, SA_DISPATCH_ALL);
+			} while ((result == SA_AIS_ERR_TRY_AGAIN) && !sleep(TRY_WAIT));
+			if (result != SA_AIS_OK) {
+				get_sa_error(result, result_buf, result_buf_len);
+				printf("saEvtDispatch %s\n", result_buf);
+				return 1;
+			}
+		}
+		if (pfd[1].revents) {
+			break;
+		}
+	}
+
+	saEvtFinalize(handle);
+
+	for (i = 0; i < rate_count; i++) {
+		if (write(result_fd, &results[i], sizeof(struct fanout_result)) !=
+				sizeof(struct fanout_result)) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+static int read_all(int fd, void *buf, size_t len)
+{
+	char *p = buf;
+	ssize_t res;
+
+	while (len) {
+		res = read(fd, p, len);
+		if (res < 0 && errno == EINTR) {
+			continue;
+		}
+		if (res <= 0) {
+			return -1;
+		}
+		p += res;
+		len -= res;
+	}
+	return 0;
+}
+
+/*
+ * Publish at a fixed offered rate for the configured duration.
+ * Returns the number of events published.
+ */
+static unsigned int publish_phase(SaEvtChannelHandleT *channel_handles,
+	int phase, unsigned int rate, double *elapsed)
+{
+	SaEvtEventHandleT *event_handles;
+	SaEvtEventPatternArrayT pattern_array;
+	SaEvtEventIdT event_id;
+	SaNameT pub_name;
+	SaAisErrorT result;
+	struct timespec ts;
+	uint64_t start;
+	uint64_t next;
+	uint64_t now;
+	unsigned int published = 0;
+	unsigned int total;
+	int i;
+
+	event_handles = malloc(sizeof(SaEvtEventHandleT) * chan_count);
+	if (event_handles == NULL) {
+		return 0;
+	}
+
+	/*
+	 * Every event carries all the patterns so that it matches each
+	 * filter of every subscription.
+	 */
+	pattern_array.allocatedNumber = filter_count;
+	pattern_array.patternsNumber = filter_count;
+	pattern_array.patterns = patterns;
+	pub_name.length = sprintf((char *)pub_name.value, PUB_NAME ":%d", phase);
+	for (i = 0; i < chan_count; i++) {
+		event_handles[i] = 0;
+	}
+	for (i = 0; i < chan_count; i++) {
+		result = saEvtEventAllocate(channel_handles[i], &event_handles[i]);
+		if (result != SA_AIS_OK) {
+			get_sa_error(result, result_buf, result_buf_len);
+			printf("event Allocate result: %s\n", result_buf);
+			goto free_events;
+		}
+		result = saEvtEventAttributesSet(event_handles[i], &pattern_array,
+			1, 0, &pub_name);
+		if (result != SA_AIS_OK) {
+			get_sa_error(result, result_buf, result_buf_len);
+			printf("event set attr result: %s\n", result_buf);
+			goto free_events;
+		}
+	}
+
+	total = rate * duration;
+	start = clust_time_now();
+	while (published < total) {
+		next = start + (uint64_t)published * 1000000000ULL / rate;
+		now = clust_time_now();
+		if (next > now) {
+			ts.tv_sec = (next - now) / 1000000000ULL;
+			ts.tv_nsec = (next - now) % 1000000000ULL;
+			nanosleep(&ts, NULL);
+		}
+		do {
+			result = saEvtEventPublish(event_handles[published % chan_count],
+				user_data, data_size, &event_id);
+		} while (result == SA_AIS_ERR_TRY_AGAIN);
+		if (result != SA_AIS_OK) {
+			get_sa_error(result, result_buf, result_buf_len);
+			printf("event Publish result: %s\n", result_buf);
+			break;
+		}
+		published++;
+	}
+	*elapsed = (clust_time_now() - start) / 1000000000.0;
+
+free_events:
+	for (i = 0; i < chan_count; i++) {
+		if (event_handles[i]) {
+			saEvtEventFree(event_handles[i]);
+		}
+	}
+	free(event_handles);
+	return published;
+}
+
+static void usage(const char *prog)
+{
+	printf("usage: %s [-s subscribers] [-f filters] [-c channels] "
+		"[-r rate[,rate...]] [-d secs] [-b bytes]\n", prog);
+	printf("\t-s\tnumber of subscriber processes (default %d)\n", sub_count);
+	printf("\t-f\tfilters per subscription, max %d (default %d)\n",
+		MAX_FILTERS, filter_count);
+	printf("\t-c\tnumber of channels (default %d)\n", chan_count);
+	printf("\t-r\toffered publish rates in events/s\n");
+	printf("\t-d\tseconds to publish at each rate (default %d)\n", duration);
+	printf("\t-b\tevent data size (default %d)\n", data_size);
+}
+
+int main (int argc, char **argv)
+{
+	static const char opts[] = "s:f:c:r:d:b:h";
+	SaEvtChannelHandleT *channel_handles;
+	struct fanout_result *totals;
+	struct fanout_result res;
+	unsigned int *published;
+	double *elapsed;
+	SaEvtHandleT handle;
+	SaAisErrorT result;
+	int *result_fds;
+	int *control_fds;
+	int fds[2];
+	int cfds[2];
+	pid_t pid;
+	char ready;
+	char *rate;
+	int option;
+	int i, j, k;
+
+	while (1) {
+		option = getopt(argc, argv, opts);
+		if (option == -1)
+			break;
+
+		switch (option) {
+		case 's':
+			sub_count = strtoul(optarg, NULL, 0);
+			break;
+		case 'f':
+			filter_count = strtoul(optarg, NULL, 0);
+			break;
+		case 'c':
+			chan_count = strtoul(optarg, NULL, 0);
+			break;
+		case 'r':
+			for (rate = strtok(optarg, ","); rate && rate_count < MAX_RATES;
+					rate = strtok(NULL, ",")) {
+				rates[rate_count++] = strtoul(rate, NULL, 0);
+			}
+			break;
+		case 'd':
+			duration = strtoul(optarg, NULL, 0);
+			break;
+		case 'b':
+			data_size = strtoul(optarg, NULL, 0);
+			break;
+		case 'h':
+		default:
+			usage(argv[0]);
+			exit(1);
+		}
+	}
+
+	if (rate_count == 0) {
+		rates[rate_count++] = 100;
+		rates[rate_count++] = 1000;
+		rates[rate_count++] = 10000;
+	}
+	if (sub_count <= 0 || chan_count <= 0 || duration <= 0 ||
+			filter_count <= 0 || filter_count > MAX_FILTERS ||
+			data_size < 0 || data_size > sizeof(user_data)) {
+		usage(argv[0]);
+		exit(1);
+	}
+	for (i = 0; i < rate_count; i++) {
+		if (rates[i] == 0) {
+			usage(argv[0]);
+			exit(1);
+		}
+	}
+
+	patterns_init();
+
+	result_fds = malloc(sizeof(int) * sub_count);
+	control_fds = malloc(sizeof(int) * sub_count);
+	channel_handles = malloc(sizeof(SaEvtChannelHandleT) * chan_count);
+	totals = calloc(rate_count, sizeof(struct fanout_result));
+	published = calloc(rate_count, sizeof(unsigned int));
+	elapsed = calloc(rate_count, sizeof(double));
+	if (!result_fds || !control_fds || !channel_handles || !totals ||
+			!published || !elapsed) {
+		printf("Unable to allocate benchmark data\n");
+		exit(1);
+	}
+
+	for (i = 0; i < sub_count; i++) {
+		if (pipe(fds) || pipe(cfds)) {
+			perror("pipe");
+			exit(1);
+		}
+		pid = fork();
+		if (pid < 0) {
+			perror("fork");
+			exit(1);
+		}
+		if (pid == 0) {
+			close(fds[0]);
+			close(cfds[1]);
+			exit(subscriber_run(fds[1], cfds[0]));
+		}
+		close(fds[1]);
+		close(cfds[0]);
+		result_fds[i] = fds[0];
+		control_fds[i] = cfds[1];
+	}
+
+	for (i = 0; i < sub_count; i++) {
+		if (read_all(result_fds[i], &ready, 1)) {
+			printf("Subscriber %d failed to start\n", i);
+			exit(1);
+		}
+	}
+
+	do {
+		result = saEvtInitialize (&handle, &callbacks, &version);
+	} while ((result == SA_AIS_ERR_TRY_AGAIN) && !sleep(TRY_WAIT));
+	if (result != SA_AIS_OK) {
+		get_sa_error(result, result_buf, result_buf_len);
+		printf("Event Initialize result: %s\n", result_buf);
+		exit(1);
+	}
+	result = chans_open(handle, channel_handles,
+		SA_EVT_CHANNEL_PUBLISHER | SA_EVT_CHANNEL_CREATE);
+	if (result != SA_AIS_OK) {
+		exit(1);
+	}
+
+	for (i = 0; i < rate_count; i++) {
+		published[i] = publish_phase(channel_handles, i, rates[i],
+			&elapsed[i]);
+		sleep(settle_time);
+	}
+
+	saEvtFinalize(handle);
+
+	for (i = 0; i < sub_count; i++) {
+		close(control_fds[i]);
+	}
+	for (i = 0; i < sub_count; i++) {
+		for (j = 0; j < rate_count; j++) {
+			if (read_all(result_fds[i], &res, sizeof(res))) {
+				printf("Subscriber %d did not report results\n", i);
+				break;
+			}
+			totals[j].received += res.received;
+			totals[j].lost += res.lost;
+			if (totals[j].first_receive == 0 ||
+				(res.first_receive && res.first_receive < totals[j].first_receive)) {
+				totals[j].first_receive = res.first_receive;
+			}
+			if (res.last_receive > totals[j].last_receive) {
+				totals[j].last_receive = res.last_receive;
+			}
+			for (k = 0; k < HIST_BUCKETS; k++) {
+				totals[j].hist[k] += res.hist[k];
+			}
+		}
+		close(result_fds[i]);
+	}
+	while (wait(NULL) > 0);
+
+	printf("%d subscribers, %d filters, %d channels, %d bytes per event\n",
+		sub_count, filter_count, chan_count, data_size);
+	printf("%9s %9s %11s %11s %8s %8s %8s %8s %8s %8s %8s\n",
+		"offered/s", "pub/s", "expected", "delivered", "dlvr/s",
+		"lost", "p50 us", "p90 us", "p99 us", "p99.9 us", "max us");
+	for (i = 0; i < rate_count; i++) {
+		double span;
+
+		span = (totals[i].last_receive - totals[i].first_receive) / 1000000000.0;
+		printf("%9u %9.0f %11llu %11u %8.0f %8u %8llu %8llu %8llu %8llu %8llu\n",
+			rates[i],
+			elapsed[i] > 0 ? published[i] / elapsed[i] : 0.0,
+			(unsigned long long)published[i] * sub_count,
+			totals[i].received,
+			span > 0 ? totals[i].received / span : 0.0,
+			totals[i].lost,
+			(unsigned long long)hist_percentile(&totals[i], 50.0),
+			(unsigned long long)hist_percentile(&totals[i], 90.0),
+			(unsigned long long)hist_percentile(&totals[i], 99.0),
+			(unsigned long long)hist_percentile(&totals[i], 99.9),
+			(unsigned long long)hist_percentile(&totals[i], 100.0));
+	}
+
+	return 0;
+}
@@ -0,0 +1,502 @@
+/*
+ * Test program for event service recovery of retained events.
+ *
+ * Run with -p on one node to open a number of channels and publish
+ * retained events on them.  Then run with -w on the oldest node, which
+ * is the one that sends the retained events, and restart (or partition
+ * and merge) another node.  The -w run waits for the rejoin to complete
+ * and reads the recovery statistics the executive keeps in the
+ * runtime.evt object.  It checks that every retained event was either
+ * sent or skipped because all members held it, and that the number of
+ * recovery messages stays within what packing the events allows
+ * (override with -m).  Finally run without -p on the rejoined node: it
+ * subscribes to every channel and counts the retained events that were
+ * recovered.
+ */
+
+#include <config.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/poll.h>
+#include <unistd.h>
+#include <fcntl.h>
+#ifndef OPENAIS_SOLARIS
+#include <stdint.h>
+#include <getopt.h>
+#else
+#include <sys/types.h>
+#endif
+#include <stdlib.h>
+#include <sys/time.h>
+#include <corosync/corotypes.h>
+#include <corosync/confdb.h>
+#include "saAis.h"
+#include "saEvt.h"
+
+#define TRY_WAIT 2
+
+/*
+ * Bounds used to work out how many recovery messages a rejoin may take.
+ * RECOVERY_PACK_SIZE is EVT_RECOVERY_PACK_SIZE in services/evt.c, the
+ * overheads are generous upper bounds for the records in a pack.
+ */
+#define RECOVERY_PACK_SIZE	(128 * 1024)
+#define RECOVERY_EVENT_OVERHEAD	1024
+#define RECOVERY_OPEN_SIZE	512
+
+extern int get_sa_error(SaAisErrorT, char *, int);
+char result_buf[256];
+int result_buf_len = sizeof(result_buf);
+
+static int chan_count = 100;
+static int event_count = 1000;
+static int data_size = 64;
+static int quiet_time = 5000;
+static unsigned long long ret_time = 600000000000ULL; /* 10 minutes */
+static int received = 0;
+static int wait_time = 300;
+static unsigned int max_msgs = 0;
+
+struct recovery_stats {
+	unsigned int recovery_count;
+	unsigned int recovery_msgs_sent;
+	unsigned int recovery_events_sent;
+	unsigned int recovery_events_skipped;
+	unsigned int recovery_opens_sent;
+};
+
+SaVersionT version = { 'B', 0x01, 0x01 };
+
+void event_callback( SaEvtSubscriptionIdT subscriptionId,
+		const SaEvtEventHandleT eventHandle,
+		const SaSizeT eventDataSize);
+
+SaEvtCallbacksT callbacks = {
+	0,
+	event_callback
+};
+
+#define _patt1 "Recovery pattern"
+#define patt1 (SaUint8T *) _patt1
+#define patt1_size sizeof(_patt1)
+
+SaEvtEventFilterT filters[] = {
+	{SA_EVT_PASS_ALL_FILTER, {patt1_size, patt1_size, patt1}}
+};
+
+SaEvtEventFilterArrayT subscribe_filters = {
+	sizeof(filters)/sizeof(SaEvtEventFilterT),
+	filters
+};
+
+SaEvtEventPatternT patterns[] = {
+	{patt1_size, patt1_size, patt1}
+};
+
+SaEvtEventPatternArrayT evt_pat_set_array = {
+	sizeof(patterns)/sizeof(SaEvtEventPatternT),
+	sizeof(patterns)/sizeof(SaEvtEventPatternT),
+	patterns
+};
+
+char user_data[65536];
+
+static void chan_name_set(SaNameT *channel_name, int i)
+{
+	channel_name->length = sprintf((char *)channel_name->value,
+		"EVTSYNC_CHANNEL_%d", i);
+}
+
+static SaAisErrorT
+chans_open(SaEvtHandleT handle, SaEvtChannelHandleT *channel_handles,
+	SaEvtChannelOpenFlagsT flags)
+{
+	SaNameT channel_name;
+	SaAisErrorT result;
+	int i;
+
+	for (i = 0; i < chan_count; i++) {
+		chan_name_set(&channel_name, i);
+		do {
+			result = saEvtChannelOpen(handle, &channel_name, flags,
+					SA_TIME_MAX, &channel_handles[i]);
+		} while ((result == SA_AIS_ERR_TRY_AGAIN) && !sleep(TRY_WAIT));
+		if (result != SA_AIS_OK) {
+			get_sa_error(result, result_buf, result_buf_len);
+			printf("channel open %s result: %s\n",
+				channel_name.value, result_buf);
+			return(result);
+		}
+	}
+	return SA_AIS_OK;
+}
+
+static SaAisErrorT
+test_populate(SaEvtHandleT handle, SaEvtChannelHandleT *channel_handles)
+{
+	SaEvtEventHandleT event_handle;
+	SaEvtEventIdT event_id;
+	SaNameT pub_name;
+	SaAisErrorT result;
+	int i;
+
+	result = chans_open(handle, channel_handles,
+		SA_EVT_CHANNEL_PUBLISHER | SA_EVT_CHANNEL_CREATE);
+	if (result != SA_AIS_OK) {
+		return(result);
+	}
+
+	pub_name.length = sprintf((char *)pub_name.value, "evtsync");
+
+	for (i = 0; i < event_count; i++) {
+		do {
+			result = saEvtEventAllocate(channel_handles[i % chan_count],
+				&event_handle);
+		} while ((result == SA_AIS_ERR_TRY_AGAIN) && !sleep(TRY_WAIT));
+		if (result != SA_AIS_OK) {
+			get_sa_error(result, result_buf, result_buf_len);
+			printf("event Allocate result: %s\n", result_buf);
+			return(result);
+		}
+		do {
+			result = saEvtEventAttributesSet(event_handle,
+				&evt_pat_set_array, 1, ret_time, &pub_name);
+		} while ((result == SA_AIS_ERR_TRY_AGAIN) && !sleep(TRY_WAIT));
+		if (result != SA_AIS_OK) {
+			get_sa_error(result, result_buf, result_buf_len);
+			printf("event set attr result: %s\n", result_buf);
+			return(result);
+		}
+		do {
+			result = saEvtEventPublish(event_handle, user_data,
+					data_size, &event_id);
+		} while ((result == SA_AIS_ERR_TRY_AGAIN) && !sleep(TRY_WAIT));
+		if (result != SA_AIS_OK) {
+			get_sa_error(result, result_buf, result_buf_len);
+			printf("event Publish result: %s\n", result_buf);
+			return(result);
+		}
+		saEvtEventFree(event_handle);
+	}
+	printf("Published %d retained events on %d channels\n",
+		event_count, chan_count);
+	return SA_AIS_OK;
+}
+
+static SaAisErrorT
+test_verify(SaEvtHandleT handle, SaEvtChannelHandleT *channel_handles)
+{
+	SaSelectionObjectT fd;
+	struct pollfd pfd;
+	SaAisErrorT result;
+	int nfd;
+	int i;
+
+	result = chans_open(handle, channel_handles, SA_EVT_CHANNEL_SUBSCRIBER);
+	if (result != SA_AIS_OK) {
+		return(result);
+	}
+
+	for (i = 0; i < chan_count; i++) {
+		do {
+			result = saEvtEventSubscribe(channel_handles[i],
+				&subscribe_filters, i);
+		} while ((result == SA_AIS_ERR_TRY_AGAIN) && !sleep(TRY_WAIT));
+		if (result != SA_AIS_OK) {
+			get_sa_error(result, result_buf, result_buf_len);
+			printf("event subscribe result: %s\n", result_buf);
+			return(result);
+		}
+	}
+
+	result = saEvtSelectionObjectGet(handle, &fd);
+	if (result != SA_AIS_OK) {
+		get_sa_error(result, result_buf, result_buf_len);
+		printf("saEvtSelectionObject get %s\n", result_buf);
+		return(result);
+	}
+
+	/*
+	 * Retained events are delivered on subscribe, so collect until
+	 * nothing more arrives for a while.
+	 */
+	for (;;) {
+		pfd.fd = fd;
+		pfd.events = POLLIN;
+		nfd = poll(&pfd, 1, quiet_time);
+		if (nfd <= 0) {
+			if (nfd < 0) {
+				perror("poll error");
+			}
+			break;
+		}
+		do {
+			result = saEvtDispatch(handle, SA_DISPATCH_ALL);
+		} while ((result == SA_AIS_ERR_TRY_AGAIN) && !sleep(TRY_WAIT));
+		if (result != SA_AIS_OK) {
+			get_sa_error(result, result_buf, result_buf_len);
+			printf("saEvtDispatch %s\n", result_buf);
+			return(result);
+		}
+	}
+
+	printf("Recovered %d of %d retained events on %d channels\n",
+		received, event_count, chan_count);
+	return (received == event_count) ? SA_AIS_OK : SA_AIS_ERR_FAILED_OPERATION;
+}
+
+static int
+runtime_key_get(confdb_handle_t handle, hdb_handle_t evt_handle,
+	const char *key, unsigned int *value)
+{
+	size_t value_len;
+	cs_error_t res;
+
+	value_len = sizeof(*value);
+	res = confdb_key_get(handle, evt_handle, key, strlen(key),
+		value, &value_len);
+	if (res != CS_OK || value_len != sizeof(*value)) {
+		printf("Unable to read runtime.evt.%s (%d)\n", key, res);
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ * Read the recovery statistics of the last rejoin from the local
+ * executive.
+ */
+static int
+recovery_stats_get(confdb_handle_t handle, struct recovery_stats *stats)
+{
+	hdb_handle_t runtime_handle;
+	hdb_handle_t evt_handle;
+	cs_error_t res;
+
+	confdb_object_find_start(handle, OBJECT_PARENT_HANDLE);
+	res = confdb_object_find(handle, OBJECT_PARENT_HANDLE,
+		"runtime", strlen("runtime"), &runtime_handle);
+	confdb_object_find_destroy(handle, OBJECT_PARENT_HANDLE);
+	if (res != CS_OK) {
+		printf("Unable to find the runtime object (%d)\n", res);
+		return -1;
+	}
+	confdb_object_find_start(handle, runtime_handle);
+	res = confdb_object_find(handle, runtime_handle,
+		"evt", strlen("evt"), &evt_handle);
+	confdb_object_find_destroy(handle, runtime_handle);
+	if (res != CS_OK) {
+		printf("Unable to find the runtime.evt object (%d)\n", res);
+		return -1;
+	}
+
+	if (runtime_key_get(handle, evt_handle, "recovery_count",
+			&stats->recovery_count) ||
+		runtime_key_get(handle, evt_handle, "recovery_msgs_sent",
+			&stats->recovery_msgs_sent) ||
+		runtime_key_get(handle, evt_handle, "recovery_events_sent",
+			&stats->recovery_events_sent) ||
+		runtime_key_get(handle, evt_handle, "recovery_events_skipped",
+			&stats->recovery_events_skipped) ||
+		runtime_key_get(handle, evt_handle, "recovery_opens_sent",
+			&stats->recovery_opens_sent)) {
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ * Upper bound on the recovery messages this node sends for a rejoin:
+ * one pack of last seen IDs, the open count packs, the retained event
+ * packs and the two done messages.
+ */
+static unsigned int
+recovery_msgs_max(void)
+{
+	unsigned int events_per_pack;
+	unsigned int open_packs;
+	unsigned int event_packs;
+
+	events_per_pack = RECOVERY_PACK_SIZE /
+		(data_size + RECOVERY_EVENT_OVERHEAD);
+	if (events_per_pack == 0) {
+		events_per_pack = 1;
+	}
+	event_packs = (event_count + events_per_pack - 1) / events_per_pack;
+	open_packs = (chan_count * RECOVERY_OPEN_SIZE + RECOVERY_PACK_SIZE - 1) /
+		RECOVERY_PACK_SIZE;
+
+	return 1 + open_packs + event_packs + 2;
+}
+
+/*
+ * Wait for the next rejoin to complete and check the recovery messages
+ * this node sent for it.
+ */
+static SaAisErrorT
+test_rejoin(void)
+{
+	confdb_callbacks_t confdb_callbacks;
+	confdb_handle_t handle;
+	struct recovery_stats before;
+	struct recovery_stats stats;
+	unsigned int max;
+	cs_error_t res;
+	int i;
+
+	memset(&confdb_callbacks, 0, sizeof(confdb_callbacks));
+	res = confdb_initialize(&handle, &confdb_callbacks);
+	if (res != CS_OK) {
+		printf("confdb initialize result: %d\n", res);
+		return SA_AIS_ERR_LIBRARY;
+	}
+
+	if (recovery_stats_get(handle, &before)) {
+		confdb_finalize(handle);
+		return SA_AIS_ERR_NOT_EXIST;
+	}
+
+	printf("Waiting up to %d seconds for a rejoin\n", wait_time);
+	for (i = 0; i < wait_time; i++) {
+		sleep(1);
+		if (recovery_stats_get(handle, &stats)) {
+			confdb_finalize(handle);
+			return SA_AIS_ERR_NOT_EXIST;
+		}
+		if (stats.recovery_count != before.recovery_count) {
+			break;
+		}
+	}
+	confdb_finalize(handle);
+
+	if (i == wait_time) {
+		printf("No rejoin completed\n");
+		return SA_AIS_ERR_TIMEOUT;
+	}
+
+	max = max_msgs ? max_msgs : recovery_msgs_max();
+	printf("Recovery sent %u messages (max %u): %u retained events "
+		"(%u already held by all members), %u open counts\n",
+		stats.recovery_msgs_sent, max, stats.recovery_events_sent,
+		stats.recovery_events_skipped, stats.recovery_opens_sent);
+
+	if (stats.recovery_events_sent + stats.recovery_events_skipped <
+			event_count) {
+		printf("Expected at least %d retained events, "
+			"is this the oldest node?\n", event_count);
+		return SA_AIS_ERR_FAILED_OPERATION;
+	}
+	if (stats.recovery_msgs_sent > max) {
+		printf("Too many recovery messages\n");
+		return SA_AIS_ERR_FAILED_OPERATION;
+	}
+	return SA_AIS_OK;
+}
+
+void
+event_callback( SaEvtSubscriptionIdT subscription_id,
+		const SaEvtEventHandleT event_handle,
+		const SaSizeT event_data_size)
+{
+	received++;
+	saEvtEventFree(event_handle);
+}
+
+static void usage(const char *prog)
+{
+	printf("usage: %s [-p | -w] [-c channels] [-e events] [-s data size] "
+		"[-r retention secs] [-q quiet msecs] [-t wait secs] "
+		"[-m max messages]\n", prog);
+	printf("\t-p\tpublish the retained events instead of counting them\n");
+	printf("\t-w\twait for a rejoin and check its recovery messages\n");
+}
+
+int main (int argc, char **argv)
+{
+	static const char opts[] = "pwc:e:s:r:q:t:m:h";
+	SaEvtChannelHandleT *channel_handles;
+	SaEvtHandleT handle;
+	SaAisErrorT result;
+	int populate = 0;
+	int rejoin = 0;
+	int option;
+
+	while (1) {
+		option = getopt(argc, argv, opts);
+		if (option == -1)
+			break;
+
+		switch (option) {
+		case 'p':
+			populate = 1;
+			break;
+		case 'w':
+			rejoin = 1;
+			break;
+		case 'c':
+			chan_count = strtoul(optarg, NULL, 0);
+			break;
+		case 'e':
+			event_count = strtoul(optarg, NULL, 0);
+			break;
+		case 's':
+			data_size = strtoul(optarg, NULL, 0);
+			if (data_size > sizeof(user_data)) {
+				data_size = sizeof(user_data);
+			}
+			break;
+		case 'r':
+			ret_time = strtoull(optarg, NULL, 0) * 1000000000ULL;
+			break;
+		case 'q':
+			quiet_time = strtoul(optarg, NULL, 0);
+			break;
+		case 't':
+			wait_time = strtoul(optarg, NULL, 0);
+			break;
+		case 'm':
+			max_msgs = strtoul(optarg, NULL, 0);
+			break;
+		case 'h':
+		default:
+			usage(argv[0]);
+			exit(1);
+		}
+	}
+
+	if (chan_count <= 0 || (populate && rejoin)) {
+		usage(argv[0]);
+		exit(1);
+	}
+
+	if (rejoin) {
+		result = test_rejoin();
+		return (result == SA_AIS_OK) ? 0 : 1;
+	}
+
+	channel_handles = malloc(sizeof(SaEvtChannelHandleT) * chan_count);
+	if (channel_handles == NULL) {
+		printf("Unable to allocate channel handles\n");
+		exit(1);
+	}
+
+	do {
+		result = saEvtInitialize (&handle, &callbacks, &version);
+	} while ((result == SA_AIS_ERR_TRY_AGAIN) && !sleep(TRY_WAIT));
+	if (result != SA_AIS_OK) {
+		get_sa_error(result, result_buf, result_buf_len);
+		printf("Event Initialize result: %s\n", result_buf);
+		exit(1);
+	}
+
+	if (populate) {
+		result = test_populate(handle, channel_handles);
+	} else {
+		result = test_verify(handle, channel_handles);
+	}
+
+	saEvtFinalize(handle);
+	free(channel_handles);
+
+	return (result == SA_AIS_OK) ? 0 : 1;
+}
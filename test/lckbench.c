@@ -0,0 +1,497 @@
+/*
+ * Lock service benchmark
+ *
+ * A number of processes take and release locks on a set of resources
+ * and time every saLckResourceLock and saLckResourceUnlock, or with -a
+ * every saLckResourceLockAsync and saLckResourceUnlockAsync until its
+ * callback is dispatched.  The lock requests follow one of these
+ * distributions:
+ *
+ *   uncontended  every process locks resources of its own in EX mode
+ *   reader       shared resources, 90% PR and 10% EX locks
+ *   writer       shared resources, 10% PR and 90% EX locks
+ *   hotspot      80% of the locks go to one resource, half of them EX
+ *
+ * Lock and unlock latencies are reported as percentiles over all
+ * processes, along with the lock throughput.  The totem messages sent
+ * per lock request and the contention seen on every resource are
+ * logged by the executive when it dumps its state (SIGUSR2).
+ */
+
+#include <config.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/time.h>
+
+#include "saAis.h"
+#include "saLck.h"
+
+#define LCKBENCH_MAX_PROCESSES	64
+#define LCKBENCH_MAX_RESOURCES	1024
+
+enum lckbench_distribution {
+	LCKBENCH_UNCONTENDED,
+	LCKBENCH_READER,
+	LCKBENCH_WRITER,
+	LCKBENCH_HOTSPOT
+};
+
+static void lock_grant_callback (
+	SaInvocationT invocation,
+	SaLckLockStatusT lock_status,
+	SaAisErrorT error);
+
+static void resource_unlock_callback (
+	SaInvocationT invocation,
+	SaAisErrorT error);
+
+static SaLckCallbacksT callbacks = {
+	.saLckResourceOpenCallback	= NULL,
+	.saLckLockGrantCallback		= lock_grant_callback,
+	.saLckLockWaiterCallback	= NULL,
+	.saLckResourceUnlockCallback	= resource_unlock_callback
+};
+
+static SaVersionT version = { 'B', 1, 1 };
+
+static enum lckbench_distribution distribution = LCKBENCH_UNCONTENDED;
+static const char *distribution_name = "uncontended";
+static unsigned int iterations = 10000;
+static unsigned int processes = 1;
+static unsigned int resource_count = 16;
+static unsigned int hold_usec = 0;
+static int async = 0;
+
+static SaLckHandleT handle;
+static SaSelectionObjectT selection_object;
+static SaLckResourceHandleT resource_handles[LCKBENCH_MAX_RESOURCES];
+
+static int callback_done;
+static SaAisErrorT callback_error;
+static SaLckLockStatusT callback_status;
+
+static void setSaNameT (SaNameT *name, const char *str) {
+	name->length = strlen (str);
+	strcpy ((char *)name->value, str);
+}
+
+static unsigned long long time_usec (void)
+{
+	struct timeval tv;
+
+	gettimeofday (&tv, NULL);
+
+	return ((unsigned long long)(tv.tv_sec) * 1000000ULL + tv.tv_usec);
+}
+
+static int compare_usec (const void *a, const void *b)
+{
+	unsigned long long x = *(const unsigned long long *)a;
+	unsigned long long y = *(const unsigned long long *)b;
+
+	return ((x > y) - (x < y));
+}
+
+static void print_latency (const char *what,
+	unsigned long long *samples, unsigned int count)
+{
+	unsigned long long total = 0;
+	unsigned int i;
+
+	qsort (samples, count, sizeof (unsigned long long), compare_usec);
+
+	for (i = 0; i < count; i++) {
+		total += samples[i];
+	}
+
+	printf ("%-8s avg %6llu us  p50 %6llu us  p90 %6llu us  p99 %6llu us  max %6llu us\n",
+		what, total / count, samples[count / 2],
+		samples[(count * 90) / 100], samples[(count * 99) / 100],
+		samples[count - 1]);
+}
+
+static void lock_grant_callback (
+	SaInvocationT invocation,
+	SaLckLockStatusT lock_status,
+	SaAisErrorT error)
+{
+	callback_status = lock_status;
+	callback_error = error;
+	callback_done = 1;
+}
+
+static void resource_unlock_callback (
+	SaInvocationT invocation,
+	SaAisErrorT error)
+{
+	callback_error = error;
+	callback_done = 1;
+}
+
+static void callback_wait (void)
+{
+	struct pollfd pfd;
+	SaAisErrorT result;
+
+	pfd.fd = selection_object;
+	pfd.events = POLLIN;
+
+	while (callback_done == 0) {
+		poll (&pfd, 1, -1);
+
+		result = saLckDispatch (handle, SA_DISPATCH_ONE);
+		if (result != SA_AIS_OK) {
+			printf ("[ERROR]: (%d) saLckDispatch\n", result);
+			exit (1);
+		}
+	}
+}
+
+static void resources_open (unsigned int process)
+{
+	SaNameT name;
+	char str[64];
+	SaAisErrorT result;
+	unsigned int i;
+
+	result = saLckInitialize (&handle, &callbacks, &version);
+	if (result != SA_AIS_OK) {
+		printf ("[ERROR]: (%d) saLckInitialize\n", result);
+		exit (1);
+	}
+
+	result = saLckSelectionObjectGet (handle, &selection_object);
+	if (result != SA_AIS_OK) {
+		printf ("[ERROR]: (%d) saLckSelectionObjectGet\n", result);
+		exit (1);
+	}
+
+	for (i = 0; i < resource_count; i++) {
+		if (distribution == LCKBENCH_UNCONTENDED) {
+			sprintf (str, "lckbench_resource_%u_%u", process, i);
+		} else {
+			sprintf (str, "lckbench_resource_%u", i);
+		}
+		setSaNameT (&name, str);
+
+		result = saLckResourceOpen (handle, &name, SA_LCK_RESOURCE_CREATE,
+			SA_TIME_ONE_SECOND * 10, &resource_handles[i]);
+		if (result != SA_AIS_OK) {
+			printf ("[ERROR]: (%d) saLckResourceOpen { %s }\n", result, str);
+			exit (1);
+		}
+	}
+}
+
+static void resources_close (void)
+{
+	unsigned int i;
+
+	for (i = 0; i < resource_count; i++) {
+		saLckResourceClose (resource_handles[i]);
+	}
+
+	saLckFinalize (handle);
+}
+
+static unsigned int resource_select (unsigned int i)
+{
+	switch (distribution) {
+	case LCKBENCH_UNCONTENDED:
+		return (i % resource_count);
+	case LCKBENCH_HOTSPOT:
+		if ((rand () % 100) < 80) {
+			return (0);
+		}
+		return (rand () % resource_count);
+	default:
+		return (rand () % resource_count);
+	}
+}
+
+static SaLckLockModeT mode_select (void)
+{
+	unsigned int ex_percent;
+
+	switch (distribution) {
+	case LCKBENCH_READER:
+		ex_percent = 10;
+		break;
+	case LCKBENCH_WRITER:
+		ex_percent = 90;
+		break;
+	case LCKBENCH_HOTSPOT:
+		ex_percent = 50;
+		break;
+	default:
+		ex_percent = 100;
+		break;
+	}
+
+	return (((unsigned int)(rand () % 100) < ex_percent) ?
+		SA_LCK_EX_LOCK_MODE : SA_LCK_PR_LOCK_MODE);
+}
+
+static void lock_take (SaLckResourceHandleT resource_handle,
+	SaLckLockModeT lock_mode, SaInvocationT invocation,
+	SaLckLockIdT *lock_id)
+{
+	SaLckLockStatusT status = 0;
+	SaAisErrorT result;
+
+	if (async == 0) {
+		result = saLckResourceLock (resource_handle, lock_id, lock_mode,
+			0, 0, SA_TIME_ONE_SECOND * 60, &status);
+	}
+	else {
+		callback_done = 0;
+
+		result = saLckResourceLockAsync (resource_handle, invocation,
+			lock_id, lock_mode, 0, 0);
+		if (result == SA_AIS_OK) {
+			callback_wait ();
+			result = callback_error;
+			status = callback_status;
+		}
+	}
+
+	if (result != SA_AIS_OK || status != SA_LCK_LOCK_GRANTED) {
+		printf ("[ERROR]: (%d) saLckResourceLock%s [ status=%d ]\n",
+			result, (async == 0) ? "" : "Async", status);
+		exit (1);
+	}
+}
+
+static void lock_release (SaLckLockIdT lock_id, SaInvocationT invocation)
+{
+	SaAisErrorT result;
+
+	if (async == 0) {
+		result = saLckResourceUnlock (lock_id, SA_TIME_ONE_SECOND * 10);
+	}
+	else {
+		callback_done = 0;
+
+		result = saLckResourceUnlockAsync (invocation, lock_id);
+		if (result == SA_AIS_OK) {
+			callback_wait ();
+			result = callback_error;
+		}
+	}
+
+	if (result != SA_AIS_OK) {
+		printf ("[ERROR]: (%d) saLckResourceUnlock%s\n",
+			result, (async == 0) ? "" : "Async");
+		exit (1);
+	}
+}
+
+/*
+ * Every process sends its elapsed time followed by its lock and
+ * unlock samples to the parent through the pipe.
+ */
+static void process_run (unsigned int process, int fd)
+{
+	SaLckLockIdT lock_id;
+	unsigned long long *samples;
+	unsigned long long start;
+	unsigned long long begin;
+	unsigned long long locked;
+	unsigned long long unlock_start;
+	unsigned int i;
+
+	samples = malloc (sizeof (unsigned long long) * (iterations * 2 + 1));
+	if (samples == NULL) {
+		printf ("[ERROR]: out of memory\n");
+		exit (1);
+	}
+
+	srand (getpid ());
+
+	resources_open (process);
+
+	begin = time_usec ();
+
+	for (i = 0; i < iterations; i++) {
+		start = time_usec ();
+
+		lock_take (resource_handles[resource_select (i)], mode_select (),
+			i, &lock_id);
+
+		locked = time_usec ();
+
+		if (hold_usec != 0) {
+			usleep (hold_usec);
+		}
+
+		unlock_start = time_usec ();
+
+		lock_release (lock_id, i);
+
+		samples[i + 1] = locked - start;
+		samples[iterations + i + 1] = time_usec () - unlock_start;
+	}
+
+	samples[0] = time_usec () - begin;
+
+	resources_close ();
+
+	if (write (fd, samples, sizeof (unsigned long long) * (iterations * 2 + 1)) !=
+	    sizeof (unsigned long long) * (iterations * 2 + 1))
+	{
+		printf ("[ERROR]: write\n");
+		exit (1);
+	}
+
+	exit (0);
+}
+
+static void samples_read (int fd, unsigned long long *samples, size_t size)
+{
+	char *buffer = (char *)samples;
+	ssize_t bytes;
+
+	while (size > 0) {
+		bytes = read (fd, buffer, size);
+		if (bytes <= 0) {
+			printf ("[ERROR]: read\n");
+			exit (1);
+		}
+		buffer += bytes;
+		size -= bytes;
+	}
+}
+
+static void usage (const char *name)
+{
+	printf ("usage: %s [-d uncontended|reader|writer|hotspot] [-a]\n", name);
+	printf ("\t[-p processes] [-n iterations] [-r resources] [-h hold usec]\n");
+	exit (1);
+}
+
+int main (int argc, char *argv[])
+{
+	pid_t pids[LCKBENCH_MAX_PROCESSES];
+	int fds[LCKBENCH_MAX_PROCESSES][2];
+	unsigned long long *lock_samples;
+	unsigned long long *unlock_samples;
+	unsigned long long *samples;
+	unsigned long long elapsed = 0;
+	unsigned int count;
+	unsigned int i;
+	int c;
+
+	while ((c = getopt (argc, argv, "d:ap:n:r:h:")) != -1) {
+		switch (c) {
+		case 'd':
+			distribution_name = optarg;
+			if (strcmp (optarg, "uncontended") == 0) {
+				distribution = LCKBENCH_UNCONTENDED;
+			} else
+			if (strcmp (optarg, "reader") == 0) {
+				distribution = LCKBENCH_READER;
+			} else
+			if (strcmp (optarg, "writer") == 0) {
+				distribution = LCKBENCH_WRITER;
+			} else
+			if (strcmp (optarg, "hotspot") == 0) {
+				distribution = LCKBENCH_HOTSPOT;
+			} else {
+				usage (argv[0]);
+			}
+			break;
+		case 'a':
+			async = 1;
+			break;
+		case 'p':
+			processes = atoi (optarg);
+			break;
+		case 'n':
+			iterations = atoi (optarg);
+			break;
+		case 'r':
+			resource_count = atoi (optarg);
+			break;
+		case 'h':
+			hold_usec = atoi (optarg);
+			break;
+		default:
+			usage (argv[0]);
+		}
+	}
+
+	if (iterations == 0 ||
+	    processes == 0 || processes > LCKBENCH_MAX_PROCESSES ||
+	    resource_count == 0 || resource_count > LCKBENCH_MAX_RESOURCES)
+	{
+		usage (argv[0]);
+	}
+
+	count = iterations * processes;
+
+	samples = malloc (sizeof (unsigned long long) * (iterations * 2 + 1));
+	lock_samples = malloc (sizeof (unsigned long long) * count);
+	unlock_samples = malloc (sizeof (unsigned long long) * count);
+	if (samples == NULL || lock_samples == NULL || unlock_samples == NULL) {
+		printf ("[ERROR]: out of memory\n");
+		exit (1);
+	}
+
+	for (i = 0; i < processes; i++) {
+		if (pipe (fds[i]) != 0) {
+			printf ("[ERROR]: pipe\n");
+			exit (1);
+		}
+
+		pids[i] = fork ();
+		if (pids[i] == 0) {
+			close (fds[i][0]);
+			process_run (i, fds[i][1]);
+		}
+		if (pids[i] < 0) {
+			printf ("[ERROR]: fork\n");
+			exit (1);
+		}
+
+		close (fds[i][1]);
+	}
+
+	for (i = 0; i < processes; i++) {
+		samples_read (fds[i][0], samples,
+			sizeof (unsigned long long) * (iterations * 2 + 1));
+		close (fds[i][0]);
+
+		waitpid (pids[i], NULL, 0);
+
+		if (samples[0] > elapsed) {
+			elapsed = samples[0];
+		}
+		memcpy (&lock_samples[i * iterations], &samples[1],
+			sizeof (unsigned long long) * iterations);
+		memcpy (&unlock_samples[i * iterations], &samples[iterations + 1],
+			sizeof (unsigned long long) * iterations);
+	}
+
+	if (elapsed == 0) {
+		elapsed = 1;
+	}
+
+	printf ("%s, %s, %u processes, %u resources, %u locks\n",
+		distribution_name, (async == 0) ? "sync" : "async",
+		processes, resource_count, count);
+	print_latency ("lock", lock_samples, count);
+	print_latency ("unlock", unlock_samples, count);
+	printf ("%-8s %10.0f locks/s\n", "total",
+		(double)(count) * 1000000.0 / elapsed);
+
+	free (samples);
+	free (lock_samples);
+	free (unlock_samples);
+
+	return (0);
+}
@@ -0,0 +1,246 @@
+/*
+ * Measure how long exclusive lock requests wait while a group of readers
+ * keeps shared locks on the same resource busy.  The resource is created
+ * with the grant policy given on the command line, so the reader
+ * preference, writer preference and FIFO policies can be compared by
+ * their EX wait-time percentiles.
+ */
+
+#include <config.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/time.h>
+
+#include "saAis.h"
+#include "saLck.h"
+
+static SaLckCallbacksT callbacks = {
+	.saLckResourceOpenCallback	= NULL,
+	.saLckLockGrantCallback		= NULL,
+	.saLckLockWaiterCallback	= NULL,
+	.saLckResourceUnlockCallback	= NULL
+};
+
+static SaVersionT version = { 'B', 1, 1 };
+
+static SaNameT resource_name;
+static SaLckResourceOpenFlagsT open_flags = SA_LCK_RESOURCE_CREATE;
+static unsigned int hold_usec = 1000;
+static volatile int stop = 0;
+
+struct reader {
+	pthread_t thread;
+	unsigned int locks;
+};
+
+static void setSaNameT (SaNameT *name, const char *str) {
+	name->length = strlen (str);
+	strcpy ((char *)name->value, str);
+}
+
+static unsigned long long time_usec (void)
+{
+	struct timeval tv;
+
+	gettimeofday (&tv, NULL);
+
+	return ((unsigned long long)(tv.tv_sec) * 1000000ULL + tv.tv_usec);
+}
+
+static int compare_usec (const void *a, const void *b)
+{
+	unsigned long long x = *(const unsigned long long *)a;
+	unsigned long long y = *(const unsigned long long *)b;
+
+	return ((x > y) - (x < y));
+}
+
+static void resource_open (SaLckHandleT *handle,
+	SaLckResourceHandleT *resource_handle)
+{
+	SaAisErrorT result;
+
+	result = saLckInitialize (handle, &callbacks, &version);
+	if (result != SA_AIS_OK) {
+		printf ("[ERROR]: (%d) saLckInitialize\n", result);
+		exit (1);
+	}
+
+	result = saLckResourceOpen (*handle, &resource_name, open_flags,
+		SA_TIME_ONE_SECOND * 10, resource_handle);
+	if (result != SA_AIS_OK) {
+		printf ("[ERROR]: (%d) saLckResourceOpen { %s }\n",
+			result, (char *)(resource_name.value));
+		exit (1);
+	}
+}
+
+static void *reader_run (void *arg)
+{
+	struct reader *reader = (struct reader *)arg;
+	SaLckHandleT handle;
+	SaLckResourceHandleT resource_handle;
+	SaLckLockIdT lock_id;
+	SaLckLockStatusT status;
+	SaAisErrorT result;
+
+	resource_open (&handle, &resource_handle);
+
+	while (stop == 0) {
+		result = saLckResourceLock (resource_handle, &lock_id,
+			SA_LCK_PR_LOCK_MODE, 0, 0, SA_TIME_ONE_SECOND * 60, &status);
+		if (result != SA_AIS_OK || status != SA_LCK_LOCK_GRANTED) {
+			printf ("[ERROR]: (%d) saLckResourceLock PR [ status=%d ]\n",
+				result, status);
+			exit (1);
+		}
+
+		usleep (hold_usec);
+
+		saLckResourceUnlock (lock_id, SA_TIME_ONE_SECOND * 10);
+
+		reader->locks += 1;
+	}
+
+	saLckResourceClose (resource_handle);
+	saLckFinalize (handle);
+
+	return (NULL);
+}
+
+int main (int argc, char *argv[])
+{
+	SaLckHandleT handle;
+	SaLckResourceHandleT resource_handle;
+	SaLckLockIdT lock_id;
+	SaLckLockStatusT status;
+	SaAisErrorT result;
+
+	struct reader *readers;
+	unsigned long long *wait_usec;
+	unsigned long long start;
+	unsigned long long total = 0;
+	unsigned int reader_locks = 0;
+	unsigned int reader_count = 4;
+	unsigned int iterations = 200;
+	const char *policy = "reader";
+	char str[64];
+	unsigned int i;
+	int c;
+
+	while ((c = getopt (argc, argv, "p:r:n:h:")) != -1) {
+		switch (c) {
+		case 'p':
+			policy = optarg;
+			break;
+		case 'r':
+			reader_count = atoi (optarg);
+			break;
+		case 'n':
+			iterations = atoi (optarg);
+			break;
+		case 'h':
+			hold_usec = atoi (optarg);
+			break;
+		default:
+			printf ("usage: %s [-p reader|writer|fifo] [-r readers] [-n writer iterations] [-h hold usec]\n",
+				argv[0]);
+			exit (1);
+		}
+	}
+
+	if (strcmp (policy, "writer") == 0) {
+		open_flags |= SA_LCK_RESOURCE_WRITER_PREFERENCE;
+	} else
+	if (strcmp (policy, "fifo") == 0) {
+		open_flags |= SA_LCK_RESOURCE_FIFO;
+	} else
+	if (strcmp (policy, "reader") != 0) {
+		printf ("[ERROR]: unknown policy %s\n", policy);
+		exit (1);
+	}
+
+	if (iterations == 0) {
+		printf ("[ERROR]: iterations must be greater than zero\n");
+		exit (1);
+	}
+
+	readers = malloc (sizeof (struct reader) * (reader_count + 1));
+	wait_usec = malloc (sizeof (unsigned long long) * iterations);
+	if (readers == NULL || wait_usec == NULL) {
+		printf ("[ERROR]: out of memory\n");
+		exit (1);
+	}
+	memset (readers, 0, sizeof (struct reader) * (reader_count + 1));
+
+	/*
+	 * The policy is fixed by the open that creates the resource,
+	 * so every policy gets a resource of its own.
+	 */
+	sprintf (str, "lckfair_resource_%s", policy);
+	setSaNameT (&resource_name, str);
+
+	resource_open (&handle, &resource_handle);
+
+	for (i = 0; i < reader_count; i++) {
+		pthread_create (&readers[i].thread, NULL, reader_run, &readers[i]);
+	}
+
+	/*
+	 * Let the readers overlap before the first writer arrives.
+	 */
+	usleep (hold_usec * 10);
+
+	for (i = 0; i < iterations; i++) {
+		start = time_usec ();
+
+		result = saLckResourceLock (resource_handle, &lock_id,
+			SA_LCK_EX_LOCK_MODE, 0, 0, SA_TIME_ONE_SECOND * 60, &status);
+		if (result != SA_AIS_OK || status != SA_LCK_LOCK_GRANTED) {
+			printf ("[ERROR]: (%d) saLckResourceLock EX [ status=%d ]\n",
+				result, status);
+			exit (1);
+		}
+
+		wait_usec[i] = time_usec () - start;
+
+		usleep (hold_usec);
+
+		saLckResourceUnlock (lock_id, SA_TIME_ONE_SECOND * 10);
+
+		usleep (hold_usec);
+	}
+
+	stop = 1;
+
+	for (i = 0; i < reader_count; i++) {
+		pthread_join (readers[i].thread, NULL);
+		reader_locks += readers[i].locks;
+	}
+
+	qsort (wait_usec, iterations, sizeof (unsigned long long), compare_usec);
+
+	for (i = 0; i < iterations; i++) {
+		total += wait_usec[i];
+	}
+
+	printf ("policy %s, %u readers, %u PR locks, %u EX locks\n",
+		policy, reader_count, reader_locks, iterations);
+	printf ("EX wait  avg %8llu us  p50 %8llu us  p90 %8llu us  p99 %8llu us  max %8llu us\n",
+		total / iterations, wait_usec[iterations / 2],
+		wait_usec[(iterations * 90) / 100],
+		wait_usec[(iterations * 99) / 100],
+		wait_usec[iterations - 1]);
+
+	saLckResourceClose (resource_handle);
+	saLckFinalize (handle);
+
+	free (readers);
+	free (wait_usec);
+
+	return (0);
+}
@@ -0,0 +1,174 @@
+/*
+ * Measure the round-trip latency of uncontended saLckResourceLock and
+ * saLckResourceUnlock calls.  Run it against an old and a new libSaLck
+ * to compare the cost of the synchronous lock path.
+ */
+
+#include <config.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/time.h>
+
+#include "saAis.h"
+#include "saLck.h"
+
+static SaLckCallbacksT callbacks = {
+	.saLckResourceOpenCallback	= NULL,
+	.saLckLockGrantCallback		= NULL,
+	.saLckLockWaiterCallback	= NULL,
+	.saLckResourceUnlockCallback	= NULL
+};
+
+static SaVersionT version = { 'B', 1, 1 };
+
+static void setSaNameT (SaNameT *name, const char *str) {
+	strncpy ((char *)name->value, str, SA_MAX_NAME_LENGTH);
+	if (strlen ((char *)name->value) > SA_MAX_NAME_LENGTH) {
+		name->length = SA_MAX_NAME_LENGTH;
+	} else {
+		name->length = strlen (str);
+	}
+}
+
+static unsigned long long time_usec (void)
+{
+	struct timeval tv;
+
+	gettimeofday (&tv, NULL);
+
+	return ((unsigned long long)(tv.tv_sec) * 1000000ULL + tv.tv_usec);
+}
+
+static int compare_usec (const void *a, const void *b)
+{
+	unsigned long long x = *(const unsigned long long *)a;
+	unsigned long long y = *(const unsigned long long *)b;
+
+	return ((x > y) - (x < y));
+}
+
+static void print_latency (const char *what, unsigned long long *samples,
+	unsigned int count)
+{
+	unsigned long long total = 0;
+	unsigned int i;
+
+	qsort (samples, count, sizeof (unsigned long long), compare_usec);
+
+	for (i = 0; i < count; i++) {
+		total += samples[i];
+	}
+
+	printf ("%-12s avg %6llu us  min %6llu us  p50 %6llu us  p99 %6llu us  max %6llu us\n",
+		what, total / count, samples[0], samples[count / 2],
+		samples[(count * 99) / 100], samples[count - 1]);
+}
+
+int main (int argc, char *argv[])
+{
+	SaLckHandleT handle;
+	SaLckLockIdT lock_id;
+	SaLckLockStatusT status;
+	SaLckResourceHandleT resource_handle;
+	SaNameT resource_name;
+	SaAisErrorT result;
+
+	unsigned long long *lock_usec;
+	unsigned long long *unlock_usec;
+	unsigned long long *rtt_usec;
+	unsigned long long start;
+	unsigned long long locked;
+	unsigned int iterations = 10000;
+	unsigned int warmup = 100;
+	unsigned int i;
+	int c;
+
+	while ((c = getopt (argc, argv, "n:w:")) != -1) {
+		switch (c) {
+		case 'n':
+			iterations = atoi (optarg);
+			break;
+		case 'w':
+			warmup = atoi (optarg);
+			break;
+		default:
+			printf ("usage: %s [-n iterations] [-w warmup]\n", argv[0]);
+			exit (1);
+		}
+	}
+
+	if (iterations == 0) {
+		printf ("[ERROR]: iterations must be greater than zero\n");
+		exit (1);
+	}
+
+	lock_usec = malloc (sizeof (unsigned long long) * iterations);
+	unlock_usec = malloc (sizeof (unsigned long long) * iterations);
+	rtt_usec = malloc (sizeof (unsigned long long) * iterations);
+	if (lock_usec == NULL || unlock_usec == NULL || rtt_usec == NULL) {
+		printf ("[ERROR]: out of memory\n");
+		exit (1);
+	}
+
+	result = saLckInitialize (&handle, &callbacks, &version);
+	if (result != SA_AIS_OK) {
+		printf ("[ERROR]: (%d) saLckInitialize\n", result);
+		exit (1);
+	}
+
+	setSaNameT (&resource_name, "lcklatency_resource");
+
+	result = saLckResourceOpen (handle, &resource_name,
+				    SA_LCK_RESOURCE_CREATE, SA_TIME_ONE_SECOND,
+				    &resource_handle);
+	if (result != SA_AIS_OK) {
+		printf ("[ERROR]: (%d) saLckResourceOpen { %s }\n",
+			result, (char *)(resource_name.value));
+		exit (1);
+	}
+
+	for (i = 0; i < warmup + iterations; i++) {
+		start = time_usec ();
+
+		result = saLckResourceLock (resource_handle, &lock_id,
+					    SA_LCK_EX_LOCK_MODE, 0, 0,
+					    SA_TIME_ONE_SECOND, &status);
+		if (result != SA_AIS_OK || status != SA_LCK_LOCK_GRANTED) {
+			printf ("[ERROR]: (%d) saLckResourceLock [ status=%d ]\n",
+				result, status);
+			exit (1);
+		}
+
+		locked = time_usec ();
+
+		result = saLckResourceUnlock (lock_id, SA_TIME_ONE_SECOND);
+		if (result != SA_AIS_OK) {
+			printf ("[ERROR]: (%d) saLckResourceUnlock\n", result);
+			exit (1);
+		}
+
+		if (i >= warmup) {
+			lock_usec[i - warmup] = locked - start;
+			unlock_usec[i - warmup] = time_usec () - locked;
+			rtt_usec[i - warmup] = lock_usec[i - warmup] +
+				unlock_usec[i - warmup];
+		}
+	}
+
+	printf ("%u lock/unlock round trips (%u warmup)\n", iterations, warmup);
+	print_latency ("lock", lock_usec, iterations);
+	print_latency ("unlock", unlock_usec, iterations);
+	print_latency ("round trip", rtt_usec, iterations);
+
+	saLckResourceClose (resource_handle);
+	saLckFinalize (handle);
+
+	free (lock_usec);
+	free (unlock_usec);
+	free (rtt_usec);
+
+	return (0);
+}
@@ -0,0 +1,227 @@
+/*
+ * Measure how the cost of saLckResourceLock and saLckResourceUnlock
+ * grows with the size of the lock table.  The number of open resources
+ * and the number of shared locks held on a probe resource are raised
+ * step by step, and at every step the probe resource is timed with
+ * lock/unlock round trips.  With hashed resource and lock lookups in
+ * the executive the per-request cost should stay flat as the tables
+ * grow.
+ */
+
+#include <config.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/time.h>
+
+#include "saAis.h"
+#include "saLck.h"
+
+static SaLckCallbacksT callbacks = {
+	.saLckResourceOpenCallback	= NULL,
+	.saLckLockGrantCallback		= NULL,
+	.saLckLockWaiterCallback	= NULL,
+	.saLckResourceUnlockCallback	= NULL
+};
+
+static SaVersionT version = { 'B', 1, 1 };
+
+static void setSaNameT (SaNameT *name, const char *str) {
+	name->length = strlen (str);
+	strcpy ((char *)name->value, str);
+}
+
+static unsigned long long time_usec (void)
+{
+	struct timeval tv;
+
+	gettimeofday (&tv, NULL);
+
+	return ((unsigned long long)(tv.tv_sec) * 1000000ULL + tv.tv_usec);
+}
+
+static void resources_open (SaLckHandleT handle,
+	SaLckResourceHandleT *resource_handles, unsigned int from, unsigned int to)
+{
+	SaNameT name;
+	char str[64];
+	SaAisErrorT result;
+	unsigned int i;
+
+	for (i = from; i < to; i++) {
+		sprintf (str, "lckscale_resource_%u", i);
+		setSaNameT (&name, str);
+
+		result = saLckResourceOpen (handle, &name, SA_LCK_RESOURCE_CREATE,
+			SA_TIME_ONE_SECOND * 10, &resource_handles[i]);
+		if (result != SA_AIS_OK) {
+			printf ("[ERROR]: (%d) saLckResourceOpen { %s }\n", result, str);
+			exit (1);
+		}
+	}
+}
+
+static void locks_take (SaLckResourceHandleT probe_handle,
+	SaLckLockIdT *lock_ids, unsigned int from, unsigned int to)
+{
+	SaLckLockStatusT status;
+	SaAisErrorT result;
+	unsigned int i;
+
+	for (i = from; i < to; i++) {
+		result = saLckResourceLock (probe_handle, &lock_ids[i],
+			SA_LCK_PR_LOCK_MODE, 0, 0, SA_TIME_ONE_SECOND * 10, &status);
+		if (result != SA_AIS_OK || status != SA_LCK_LOCK_GRANTED) {
+			printf ("[ERROR]: (%d) saLckResourceLock { held } [ status=%d ]\n",
+				result, status);
+			exit (1);
+		}
+	}
+}
+
+int main (int argc, char *argv[])
+{
+	SaLckHandleT handle;
+	SaLckResourceHandleT probe_handle;
+	SaLckResourceHandleT *resource_handles;
+	SaLckLockIdT *lock_ids;
+	SaLckLockIdT lock_id;
+	SaLckLockStatusT status;
+	SaNameT probe_name;
+	SaAisErrorT result;
+
+	unsigned long long start;
+	unsigned long long locked;
+	unsigned long long lock_usec;
+	unsigned long long unlock_usec;
+	unsigned int max_resources = 100000;
+	unsigned int max_locks = 4000;
+	unsigned int iterations = 1000;
+	unsigned int resources = 0;
+	unsigned int locks = 0;
+	unsigned int target;
+	unsigned int step;
+	unsigned int i;
+	int c;
+
+	while ((c = getopt (argc, argv, "o:l:n:")) != -1) {
+		switch (c) {
+		case 'o':
+			max_resources = atoi (optarg);
+			break;
+		case 'l':
+			max_locks = atoi (optarg);
+			break;
+		case 'n':
+			iterations = atoi (optarg);
+			break;
+		default:
+			printf ("usage: %s [-o max resources] [-l max held locks] [-n iterations]\n",
+				argv[0]);
+			exit (1);
+		}
+	}
+
+	if (iterations == 0) {
+		printf ("[ERROR]: iterations must be greater than zero\n");
+		exit (1);
+	}
+
+	resource_handles = malloc (sizeof (SaLckResourceHandleT) * (max_resources + 1));
+	lock_ids = malloc (sizeof (SaLckLockIdT) * (max_locks + 1));
+	if (resource_handles == NULL || lock_ids == NULL) {
+		printf ("[ERROR]: out of memory\n");
+		exit (1);
+	}
+
+	result = saLckInitialize (&handle, &callbacks, &version);
+	if (result != SA_AIS_OK) {
+		printf ("[ERROR]: (%d) saLckInitialize\n", result);
+		exit (1);
+	}
+
+	setSaNameT (&probe_name, "lckscale_probe_resource");
+
+	result = saLckResourceOpen (handle, &probe_name, SA_LCK_RESOURCE_CREATE,
+		SA_TIME_ONE_SECOND * 10, &probe_handle);
+	if (result != SA_AIS_OK) {
+		printf ("[ERROR]: (%d) saLckResourceOpen { probe }\n", result);
+		exit (1);
+	}
+
+	printf ("%10s %10s %16s %16s\n", "resources", "locks", "lock (us)", "unlock (us)");
+
+	for (step = 0; ; step = (step == 0) ? 1000 : step * 2) {
+		if (step > max_resources) {
+			step = max_resources;
+		}
+
+		resources_open (handle, resource_handles, resources, step);
+		resources = step;
+
+		/*
+		 * One held lock for every 25 resources, bounded by the
+		 * executive's lock limit.
+		 */
+		target = step / 25;
+		if (target > max_locks) {
+			target = max_locks;
+		}
+		if (target > locks) {
+			locks_take (probe_handle, lock_ids, locks, target);
+			locks = target;
+		}
+
+		lock_usec = 0;
+		unlock_usec = 0;
+
+		for (i = 0; i < iterations; i++) {
+			start = time_usec ();
+
+			result = saLckResourceLock (probe_handle, &lock_id,
+				SA_LCK_PR_LOCK_MODE, 0, 0, SA_TIME_ONE_SECOND, &status);
+			if (result != SA_AIS_OK || status != SA_LCK_LOCK_GRANTED) {
+				printf ("[ERROR]: (%d) saLckResourceLock [ status=%d ]\n",
+					result, status);
+				exit (1);
+			}
+
+			locked = time_usec ();
+
+			result = saLckResourceUnlock (lock_id, SA_TIME_ONE_SECOND);
+			if (result != SA_AIS_OK) {
+				printf ("[ERROR]: (%d) saLckResourceUnlock\n", result);
+				exit (1);
+			}
+
+			lock_usec += locked - start;
+			unlock_usec += time_usec () - locked;
+		}
+
+		printf ("%10u %10u %16.1f %16.1f\n", resources, locks,
+			(double)(lock_usec) / iterations,
+			(double)(unlock_usec) / iterations);
+
+		if (resources == max_resources) {
+			break;
+		}
+	}
+
+	for (i = 0; i < locks; i++) {
+		saLckResourceUnlock (lock_ids[i], SA_TIME_ONE_SECOND);
+	}
+
+	for (i = 0; i < resources; i++) {
+		saLckResourceClose (resource_handles[i]);
+	}
+
+	saLckResourceClose (probe_handle);
+	saLckFinalize (handle);
+
+	free (resource_handles);
+	free (lock_ids);
+
+	return (0);
+}
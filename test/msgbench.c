@@ -0,0 +1,647 @@
+/*
+ * Message service benchmark
+ *
+ * For a series of message sizes up to the service's message size
+ * limit, measures:
+ *
+ *   send+get     latency of saMsgMessageSend followed by saMsgMessageGet
+ *   sendasync    throughput of saMsgMessageSendAsync drained by gets
+ *   sendreceive  latency of saMsgMessageSendReceive answered by a
+ *                replier process
+ *   producers    throughput of concurrent producer processes sending
+ *                to the benchmark queues by name, or to a queue group
+ *                with the selected policy, drained by one consumer
+ *
+ * Latencies are reported as percentiles.  Producers, consumer and
+ * replier run on the same node.  The totem messages and bytes
+ * multicast per message sent are logged by the executive when it
+ * dumps its state (SIGUSR2).
+ */
+
+#include <config.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/time.h>
+
+#include "saAis.h"
+#include "saMsg.h"
+
+#define MSGBENCH_MAX_QUEUES	32
+#define MSGBENCH_MAX_PRODUCERS	64
+#define MSGBENCH_STOP		0xffff
+
+static SaMsgCallbacksT callbacks = {
+	.saMsgQueueOpenCallback		= NULL,
+	.saMsgQueueGroupTrackCallback	= NULL,
+	.saMsgMessageDeliveredCallback	= NULL,
+	.saMsgMessageReceivedCallback	= NULL
+};
+
+static SaVersionT version = { 'B', 1, 1 };
+
+static SaMsgQueueCreationAttributesT creation_attributes = {
+	0,
+	{ 0, 0, 0, 0 },
+	0
+};
+
+static unsigned int iterations = 10000;
+static unsigned int producers = 2;
+static unsigned int queue_count = 1;
+static unsigned int priority = SA_MSG_MESSAGE_HIGHEST_PRIORITY;
+static SaMsgQueueGroupPolicyT policy = 0;
+static SaSizeT max_size = 0;
+static SaUint32T metadata_size = 0;
+
+static char *send_buffer;
+static char *receive_buffer;
+
+static void setSaNameT (SaNameT *name, const char *str) {
+	name->length = strlen (str);
+	strcpy ((char *)name->value, str);
+}
+
+static void queue_name_set (SaNameT *name, unsigned int i)
+{
+	char str[64];
+
+	sprintf (str, "msgbench_queue_%u", i);
+	setSaNameT (name, str);
+}
+
+static unsigned long long time_usec (void)
+{
+	struct timeval tv;
+
+	gettimeofday (&tv, NULL);
+
+	return ((unsigned long long)(tv.tv_sec) * 1000000ULL + tv.tv_usec);
+}
+
+static int compare_usec (const void *a, const void *b)
+{
+	unsigned long long x = *(const unsigned long long *)a;
+	unsigned long long y = *(const unsigned long long *)b;
+
+	return ((x > y) - (x < y));
+}
+
+static void print_latency (const char *what, SaSizeT size,
+	unsigned long long *samples, unsigned int count)
+{
+	unsigned long long total = 0;
+	unsigned int i;
+
+	qsort (samples, count, sizeof (unsigned long long), compare_usec);
+
+	for (i = 0; i < count; i++) {
+		total += samples[i];
+	}
+
+	printf ("%-12s %6llu B  avg %6llu us  p50 %6llu us  p99 %6llu us  max %6llu us\n",
+		what, (unsigned long long)(size), total / count,
+		samples[count / 2], samples[(count * 99) / 100],
+		samples[count - 1]);
+}
+
+static void print_throughput (const char *what, SaSizeT size,
+	unsigned int count, unsigned long long usec)
+{
+	if (usec == 0) {
+		usec = 1;
+	}
+
+	printf ("%-12s %6llu B  %10.0f msg/s  %8.2f MB/s\n",
+		what, (unsigned long long)(size),
+		(double)(count) * 1000000.0 / usec,
+		(double)(count) * size / usec);
+}
+
+static void message_init (SaMsgMessageT *message, SaSizeT size)
+{
+	message->type = 1;
+	message->version = 1;
+	message->size = size;
+	message->senderName = NULL;
+	message->data = send_buffer;
+	message->priority = priority;
+}
+
+static SaAisErrorT message_get (SaMsgQueueHandleT queue_handle,
+	SaTimeT timeout)
+{
+	SaMsgMessageT received;
+	SaMsgSenderIdT sender_id;
+
+	received.size = max_size;
+	received.data = receive_buffer;
+	received.senderName = NULL;
+
+	return (saMsgMessageGet (queue_handle, &received, NULL,
+		&sender_id, timeout));
+}
+
+static SaAisErrorT message_send (SaMsgHandleT handle,
+	const SaNameT *destination, const SaMsgMessageT *message)
+{
+	SaAisErrorT result;
+
+	do {
+		result = saMsgMessageSend (handle, destination, message,
+			SA_TIME_ONE_SECOND);
+		if (result == SA_AIS_ERR_QUEUE_FULL ||
+		    result == SA_AIS_ERR_TRY_AGAIN) {
+			usleep (100);
+		}
+	} while (result == SA_AIS_ERR_QUEUE_FULL ||
+		 result == SA_AIS_ERR_TRY_AGAIN);
+
+	return (result);
+}
+
+static void bench_send_get (SaMsgHandleT handle,
+	SaMsgQueueHandleT queue_handle, SaSizeT size,
+	unsigned long long *samples)
+{
+	SaMsgMessageT message;
+	SaNameT queue_name;
+	SaAisErrorT result;
+	unsigned long long start;
+	unsigned int i;
+
+	queue_name_set (&queue_name, 0);
+	message_init (&message, size);
+
+	for (i = 0; i < iterations; i++) {
+		start = time_usec ();
+
+		result = saMsgMessageSend (handle, &queue_name, &message,
+			SA_TIME_ONE_SECOND);
+		if (result != SA_AIS_OK) {
+			printf ("[ERROR]: (%d) saMsgMessageSend\n", result);
+			exit (1);
+		}
+
+		result = message_get (queue_handle, SA_TIME_ONE_SECOND);
+		if (result != SA_AIS_OK) {
+			printf ("[ERROR]: (%d) saMsgMessageGet\n", result);
+			exit (1);
+		}
+
+		samples[i] = time_usec () - start;
+	}
+
+	print_latency ("send+get", size, samples, iterations);
+}
+
+/*
+ * Asynchronous sends are not acknowledged, so they are issued in
+ * windows that fit in the priority area and drained before the next
+ * window is sent.
+ */
+static void bench_send_async (SaMsgHandleT handle,
+	SaMsgQueueHandleT queue_handle, SaSizeT size)
+{
+	SaMsgMessageT message;
+	SaNameT queue_name;
+	SaAisErrorT result;
+	unsigned long long start;
+	unsigned int window;
+	unsigned int sent;
+	unsigned int i;
+
+	queue_name_set (&queue_name, 0);
+	message_init (&message, size);
+
+	window = creation_attributes.size[priority] / (size ? size : 1) / 2;
+	if (window == 0) {
+		window = 1;
+	}
+
+	start = time_usec ();
+	for (sent = 0; sent < iterations; sent += i) {
+		for (i = 0; i < window && sent + i < iterations; i++) {
+			result = saMsgMessageSendAsync (handle, sent + i,
+				&queue_name, &message, 0);
+			if (result != SA_AIS_OK) {
+				printf ("[ERROR]: (%d) saMsgMessageSendAsync\n", result);
+				exit (1);
+			}
+		}
+		for (i = 0; i < window && sent + i < iterations; i++) {
+			result = message_get (queue_handle, SA_TIME_ONE_SECOND * 10);
+			if (result != SA_AIS_OK) {
+				printf ("[ERROR]: (%d) saMsgMessageGet { async }\n", result);
+				exit (1);
+			}
+		}
+	}
+
+	print_throughput ("sendasync", size, iterations, time_usec () - start);
+}
+
+static void replier_run (int ready_fd)
+{
+	SaMsgHandleT handle;
+	SaMsgQueueHandleT queue_handle;
+	SaMsgMessageT received;
+	SaMsgMessageT reply;
+	SaMsgSenderIdT sender_id;
+	SaNameT queue_name;
+	SaAisErrorT result;
+	char ready = 1;
+
+	result = saMsgInitialize (&handle, &callbacks, &version);
+	if (result != SA_AIS_OK) {
+		printf ("[ERROR]: (%d) saMsgInitialize { replier }\n", result);
+		exit (1);
+	}
+
+	setSaNameT (&queue_name, "msgbench_replier");
+
+	result = saMsgQueueOpen (handle, &queue_name, &creation_attributes,
+		SA_MSG_QUEUE_CREATE, SA_TIME_ONE_SECOND * 10, &queue_handle);
+	if (result != SA_AIS_OK) {
+		printf ("[ERROR]: (%d) saMsgQueueOpen { replier }\n", result);
+		exit (1);
+	}
+
+	if (write (ready_fd, &ready, 1) != 1) {
+		exit (1);
+	}
+	close (ready_fd);
+
+	for (;;) {
+		received.size = max_size;
+		received.data = receive_buffer;
+		received.senderName = NULL;
+
+		result = saMsgMessageGet (queue_handle, &received, NULL,
+			&sender_id, SA_TIME_ONE_MINUTE);
+		if (result != SA_AIS_OK || received.type == MSGBENCH_STOP) {
+			break;
+		}
+
+		reply = received;
+
+		result = saMsgMessageReply (handle, &reply, &sender_id,
+			SA_TIME_ONE_SECOND);
+		if (result != SA_AIS_OK) {
+			printf ("[ERROR]: (%d) saMsgMessageReply\n", result);
+			break;
+		}
+	}
+
+	saMsgQueueClose (queue_handle);
+	saMsgFinalize (handle);
+
+	exit (0);
+}
+
+static void bench_send_receive (SaMsgHandleT handle, SaSizeT size,
+	unsigned long long *samples)
+{
+	SaMsgMessageT message;
+	SaMsgMessageT received;
+	SaTimeT reply_time;
+	SaNameT queue_name;
+	SaAisErrorT result;
+	unsigned long long start;
+	unsigned int i;
+	int fds[2];
+	char ready;
+	pid_t pid;
+
+	if (pipe (fds) != 0) {
+		printf ("[ERROR]: pipe\n");
+		exit (1);
+	}
+
+	pid = fork ();
+	if (pid == 0) {
+		close (fds[0]);
+		replier_run (fds[1]);
+	}
+	close (fds[1]);
+
+	if (pid < 0 || read (fds[0], &ready, 1) != 1) {
+		printf ("[ERROR]: replier did not start\n");
+		exit (1);
+	}
+	close (fds[0]);
+
+	setSaNameT (&queue_name, "msgbench_replier");
+	message_init (&message, size);
+
+	for (i = 0; i < iterations; i++) {
+		received.size = max_size;
+		received.data = receive_buffer;
+		received.senderName = NULL;
+
+		start = time_usec ();
+
+		result = saMsgMessageSendReceive (handle, &queue_name, &message,
+			&received, &reply_time, SA_TIME_ONE_SECOND * 10);
+		if (result != SA_AIS_OK) {
+			printf ("[ERROR]: (%d) saMsgMessageSendReceive\n", result);
+			kill (pid, SIGTERM);
+			exit (1);
+		}
+
+		samples[i] = time_usec () - start;
+	}
+
+	message.type = MSGBENCH_STOP;
+	message_send (handle, &queue_name, &message);
+	waitpid (pid, NULL, 0);
+
+	print_latency ("sendreceive", size, samples, iterations);
+}
+
+static void producer_run (SaSizeT size, const SaNameT *group_name,
+	unsigned int count)
+{
+	SaMsgHandleT handle;
+	SaMsgMessageT message;
+	SaNameT queue_name;
+	SaAisErrorT result;
+	unsigned int i;
+
+	result = saMsgInitialize (&handle, &callbacks, &version);
+	if (result != SA_AIS_OK) {
+		printf ("[ERROR]: (%d) saMsgInitialize { producer }\n", result);
+		exit (1);
+	}
+
+	message_init (&message, size);
+
+	for (i = 0; i < count; i++) {
+		if (group_name != NULL) {
+			result = message_send (handle, group_name, &message);
+		} else {
+			queue_name_set (&queue_name, i % queue_count);
+			result = message_send (handle, &queue_name, &message);
+		}
+		if (result != SA_AIS_OK) {
+			printf ("[ERROR]: (%d) saMsgMessageSend { producer }\n", result);
+			exit (1);
+		}
+	}
+
+	saMsgFinalize (handle);
+
+	exit (0);
+}
+
+/*
+ * The consumer polls the queues in turn, since group policies such as
+ * SA_MSG_QUEUE_GROUP_LOCAL_BEST_QUEUE do not spread messages evenly.
+ */
+static void bench_producers (SaMsgQueueHandleT *queue_handles,
+	SaSizeT size, const SaNameT *group_name)
+{
+	pid_t pids[MSGBENCH_MAX_PRODUCERS];
+	SaAisErrorT result;
+	unsigned long long start;
+	unsigned long long deadline;
+	unsigned int count;
+	unsigned int expected;
+	unsigned int received = 0;
+	unsigned int i;
+
+	count = ((iterations + queue_count - 1) / queue_count) * queue_count;
+	expected = count * producers;
+	if (group_name != NULL && policy == SA_MSG_QUEUE_GROUP_BROADCAST) {
+		expected *= queue_count;
+	}
+
+	start = time_usec ();
+	deadline = start + 60000000ULL;
+
+	for (i = 0; i < producers; i++) {
+		pids[i] = fork ();
+		if (pids[i] == 0) {
+			producer_run (size, group_name, count);
+		}
+		if (pids[i] < 0) {
+			printf ("[ERROR]: fork\n");
+			exit (1);
+		}
+	}
+
+	for (i = 0; received < expected; i++) {
+		result = message_get (queue_handles[i % queue_count],
+			SA_TIME_ONE_MILLISECOND);
+		if (result == SA_AIS_OK) {
+			received += 1;
+		}
+		else if (result != SA_AIS_ERR_TIMEOUT) {
+			printf ("[ERROR]: (%d) saMsgMessageGet { consumer }\n", result);
+			exit (1);
+		}
+		if (time_usec () > deadline) {
+			printf ("[ERROR]: consumer received %u of %u messages\n",
+				received, expected);
+			exit (1);
+		}
+	}
+
+	for (i = 0; i < producers; i++) {
+		waitpid (pids[i], NULL, 0);
+	}
+
+	print_throughput ("producers", size, received, time_usec () - start);
+}
+
+static SaUint64T limit_get (SaMsgHandleT handle, SaMsgLimitIdT limit_id)
+{
+	SaLimitValueT limit;
+	SaAisErrorT result;
+
+	result = saMsgLimitGet (handle, limit_id, &limit);
+	if (result != SA_AIS_OK) {
+		printf ("[ERROR]: (%d) saMsgLimitGet { %d }\n", result, limit_id);
+		exit (1);
+	}
+
+	return (limit.uint64Value);
+}
+
+static void usage (const char *name)
+{
+	printf ("usage: %s [-n iterations] [-p producers] [-q queues]\n", name);
+	printf ("\t[-P priority 0-3] [-g none|rr|lrr|lbq|bc]\n");
+	exit (1);
+}
+
+int main (int argc, char *argv[])
+{
+	SaMsgHandleT handle;
+	SaMsgQueueHandleT queue_handles[MSGBENCH_MAX_QUEUES];
+	SaNameT queue_name;
+	SaNameT group_name;
+	SaAisErrorT result;
+	SaSizeT area_size;
+	SaSizeT size;
+	unsigned long long *samples;
+	unsigned int i;
+	int c;
+
+	while ((c = getopt (argc, argv, "n:p:q:P:g:")) != -1) {
+		switch (c) {
+		case 'n':
+			iterations = atoi (optarg);
+			break;
+		case 'p':
+			producers = atoi (optarg);
+			break;
+		case 'q':
+			queue_count = atoi (optarg);
+			break;
+		case 'P':
+			priority = atoi (optarg);
+			break;
+		case 'g':
+			if (strcmp (optarg, "none") == 0) {
+				policy = 0;
+			} else if (strcmp (optarg, "rr") == 0) {
+				policy = SA_MSG_QUEUE_GROUP_ROUND_ROBIN;
+			} else if (strcmp (optarg, "lrr") == 0) {
+				policy = SA_MSG_QUEUE_GROUP_LOCAL_ROUND_ROBIN;
+			} else if (strcmp (optarg, "lbq") == 0) {
+				policy = SA_MSG_QUEUE_GROUP_LOCAL_BEST_QUEUE;
+			} else if (strcmp (optarg, "bc") == 0) {
+				policy = SA_MSG_QUEUE_GROUP_BROADCAST;
+			} else {
+				usage (argv[0]);
+			}
+			break;
+		default:
+			usage (argv[0]);
+		}
+	}
+
+	if (iterations == 0 || producers == 0 || queue_count == 0 ||
+	    producers > MSGBENCH_MAX_PRODUCERS ||
+	    priority > SA_MSG_MESSAGE_LOWEST_PRIORITY) {
+		usage (argv[0]);
+	}
+
+	result = saMsgInitialize (&handle, &callbacks, &version);
+	if (result != SA_AIS_OK) {
+		printf ("[ERROR]: (%d) saMsgInitialize\n", result);
+		exit (1);
+	}
+
+	result = saMsgMetadataSizeGet (handle, &metadata_size);
+	if (result != SA_AIS_OK) {
+		printf ("[ERROR]: (%d) saMsgMetadataSizeGet\n", result);
+		exit (1);
+	}
+
+	/*
+	 * Keep within the service limits. One queue is left for the
+	 * replier.
+	 */
+	max_size = limit_get (handle, SA_MSG_MAX_MESSAGE_SIZE_ID);
+
+	area_size = limit_get (handle, SA_MSG_MAX_QUEUE_SIZE_ID) /
+		(SA_MSG_MESSAGE_LOWEST_PRIORITY + 1);
+	if (area_size > limit_get (handle, SA_MSG_MAX_PRIORITY_AREA_SIZE_ID)) {
+		area_size = limit_get (handle, SA_MSG_MAX_PRIORITY_AREA_SIZE_ID);
+	}
+	for (i = 0; i <= SA_MSG_MESSAGE_LOWEST_PRIORITY; i++) {
+		creation_attributes.size[i] = area_size;
+	}
+
+	if (queue_count > limit_get (handle, SA_MSG_MAX_NUM_QUEUES_ID) - 1) {
+		queue_count = limit_get (handle, SA_MSG_MAX_NUM_QUEUES_ID) - 1;
+	}
+	if (policy != 0 &&
+	    queue_count > limit_get (handle, SA_MSG_MAX_NUM_QUEUES_PER_GROUP_ID)) {
+		queue_count = limit_get (handle, SA_MSG_MAX_NUM_QUEUES_PER_GROUP_ID);
+	}
+	if (queue_count > MSGBENCH_MAX_QUEUES) {
+		queue_count = MSGBENCH_MAX_QUEUES;
+	}
+
+	send_buffer = malloc (max_size + 1);
+	receive_buffer = malloc (max_size + 1);
+	samples = malloc (sizeof (unsigned long long) * iterations);
+	if (send_buffer == NULL || receive_buffer == NULL || samples == NULL) {
+		printf ("[ERROR]: out of memory\n");
+		exit (1);
+	}
+	memset (send_buffer, 0x5a, max_size + 1);
+
+	for (i = 0; i < queue_count; i++) {
+		queue_name_set (&queue_name, i);
+
+		result = saMsgQueueOpen (handle, &queue_name, &creation_attributes,
+			SA_MSG_QUEUE_CREATE, SA_TIME_ONE_SECOND * 10,
+			&queue_handles[i]);
+		if (result != SA_AIS_OK) {
+			printf ("[ERROR]: (%d) saMsgQueueOpen { %s }\n",
+				result, (char *)(queue_name.value));
+			exit (1);
+		}
+	}
+
+	setSaNameT (&group_name, "msgbench_group");
+
+	if (policy != 0) {
+		result = saMsgQueueGroupCreate (handle, &group_name, policy);
+		if (result != SA_AIS_OK) {
+			printf ("[ERROR]: (%d) saMsgQueueGroupCreate\n", result);
+			exit (1);
+		}
+		for (i = 0; i < queue_count; i++) {
+			queue_name_set (&queue_name, i);
+
+			result = saMsgQueueGroupInsert (handle, &group_name, &queue_name);
+			if (result != SA_AIS_OK) {
+				printf ("[ERROR]: (%d) saMsgQueueGroupInsert\n", result);
+				exit (1);
+			}
+		}
+	}
+
+	printf ("%u iterations, %u producers, %u queues, priority %u, group policy %d, metadata %u B\n",
+		iterations, producers, queue_count, priority, policy,
+		(unsigned int)(metadata_size));
+
+	for (size = 8; ; size *= 4) {
+		if (size > max_size) {
+			size = max_size;
+		}
+
+		bench_send_get (handle, queue_handles[0], size, samples);
+		bench_send_async (handle, queue_handles[0], size);
+		bench_send_receive (handle, size, samples);
+		bench_producers (queue_handles, size,
+			(policy != 0) ? &group_name : NULL);
+
+		if (size == max_size) {
+			break;
+		}
+	}
+
+	if (policy != 0) {
+		saMsgQueueGroupDelete (handle, &group_name);
+	}
+	for (i = 0; i < queue_count; i++) {
+		saMsgQueueClose (queue_handles[i]);
+	}
+	saMsgFinalize (handle);
+
+	free (send_buffer);
+	free (receive_buffer);
+	free (samples);
+
+	return (0);
+}
@@ -0,0 +1,249 @@
+/*
+ * Measure how the cost of message service requests grows with the
+ * number of queues and queue groups in the cluster.  The object count
+ * is raised step by step, and at every step a probe queue is timed
+ * with saMsgMessageSend/saMsgMessageGet round trips, sent once to the
+ * queue by name and once through a probe group.  With indexed lookups
+ * in the executive the per-request cost should stay flat as the count
+ * grows.
+ */
+
+#include <config.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/time.h>
+
+#include "saAis.h"
+#include "saMsg.h"
+
+static SaMsgCallbacksT callbacks = {
+	.saMsgQueueOpenCallback		= NULL,
+	.saMsgQueueGroupTrackCallback	= NULL,
+	.saMsgMessageDeliveredCallback	= NULL,
+	.saMsgMessageReceivedCallback	= NULL
+};
+
+static SaVersionT version = { 'B', 1, 1 };
+
+static SaMsgQueueCreationAttributesT creation_attributes = {
+	0,
+	{ 4096, 4096, 4096, 4096 },
+	0
+};
+
+static void setSaNameT (SaNameT *name, const char *str) {
+	name->length = strlen (str);
+	strcpy ((char *)name->value, str);
+}
+
+static unsigned long long time_usec (void)
+{
+	struct timeval tv;
+
+	gettimeofday (&tv, NULL);
+
+	return ((unsigned long long)(tv.tv_sec) * 1000000ULL + tv.tv_usec);
+}
+
+static void objects_create (SaMsgHandleT handle,
+	SaMsgQueueHandleT *queue_handles, unsigned int from, unsigned int to)
+{
+	SaNameT name;
+	char str[64];
+	SaAisErrorT result;
+	unsigned int i;
+
+	for (i = from; i < to; i++) {
+		sprintf (str, "msgscale_queue_%u", i);
+		setSaNameT (&name, str);
+
+		result = saMsgQueueOpen (handle, &name, &creation_attributes,
+			SA_MSG_QUEUE_CREATE, SA_TIME_ONE_SECOND * 10,
+			&queue_handles[i]);
+		if (result != SA_AIS_OK) {
+			printf ("[ERROR]: (%d) saMsgQueueOpen { %s }\n", result, str);
+			exit (1);
+		}
+
+		sprintf (str, "msgscale_group_%u", i);
+		setSaNameT (&name, str);
+
+		result = saMsgQueueGroupCreate (handle, &name,
+			SA_MSG_QUEUE_GROUP_ROUND_ROBIN);
+		if (result != SA_AIS_OK) {
+			printf ("[ERROR]: (%d) saMsgQueueGroupCreate { %s }\n", result, str);
+			exit (1);
+		}
+	}
+}
+
+static void objects_delete (SaMsgHandleT handle, unsigned int count)
+{
+	SaNameT name;
+	char str[64];
+	unsigned int i;
+
+	for (i = 0; i < count; i++) {
+		sprintf (str, "msgscale_group_%u", i);
+		setSaNameT (&name, str);
+
+		saMsgQueueGroupDelete (handle, &name);
+	}
+}
+
+int main (int argc, char *argv[])
+{
+	SaMsgHandleT handle;
+	SaMsgQueueHandleT probe_handle;
+	SaMsgQueueHandleT *queue_handles;
+	SaMsgMessageT message;
+	SaMsgMessageT received;
+	SaMsgSenderIdT sender_id;
+	SaNameT probe_queue;
+	SaNameT probe_group;
+	SaAisErrorT result;
+	char data[16];
+	char buffer[16];
+
+	unsigned long long start;
+	unsigned long long queue_usec;
+	unsigned long long group_usec;
+	unsigned int max_objects = 20000;
+	unsigned int iterations = 1000;
+	unsigned int objects = 0;
+	unsigned int step;
+	unsigned int i;
+	int c;
+
+	while ((c = getopt (argc, argv, "o:n:")) != -1) {
+		switch (c) {
+		case 'o':
+			max_objects = atoi (optarg);
+			break;
+		case 'n':
+			iterations = atoi (optarg);
+			break;
+		default:
+			printf ("usage: %s [-o max objects] [-n iterations]\n", argv[0]);
+			exit (1);
+		}
+	}
+
+	if (iterations == 0) {
+		printf ("[ERROR]: iterations must be greater than zero\n");
+		exit (1);
+	}
+
+	queue_handles = malloc (sizeof (SaMsgQueueHandleT) * (max_objects + 1));
+	if (queue_handles == NULL) {
+		printf ("[ERROR]: out of memory\n");
+		exit (1);
+	}
+
+	result = saMsgInitialize (&handle, &callbacks, &version);
+	if (result != SA_AIS_OK) {
+		printf ("[ERROR]: (%d) saMsgInitialize\n", result);
+		exit (1);
+	}
+
+	setSaNameT (&probe_queue, "msgscale_probe_queue");
+	setSaNameT (&probe_group, "msgscale_probe_group");
+
+	result = saMsgQueueOpen (handle, &probe_queue, &creation_attributes,
+		SA_MSG_QUEUE_CREATE, SA_TIME_ONE_SECOND * 10, &probe_handle);
+	if (result != SA_AIS_OK) {
+		printf ("[ERROR]: (%d) saMsgQueueOpen { probe }\n", result);
+		exit (1);
+	}
+
+	result = saMsgQueueGroupCreate (handle, &probe_group,
+		SA_MSG_QUEUE_GROUP_ROUND_ROBIN);
+	if (result == SA_AIS_OK) {
+		result = saMsgQueueGroupInsert (handle, &probe_group, &probe_queue);
+	}
+	if (result != SA_AIS_OK) {
+		printf ("[ERROR]: (%d) saMsgQueueGroupCreate { probe }\n", result);
+		exit (1);
+	}
+
+	memset (data, 0, sizeof (data));
+	strcpy (data, "msgscale");
+
+	message.type = 1;
+	message.version = 1;
+	message.size = sizeof (data);
+	message.senderName = NULL;
+	message.data = data;
+	message.priority = 0;
+
+	printf ("%10s %16s %16s\n", "objects", "send+get (us)", "group s+g (us)");
+
+	for (step = 0; ; step = (step == 0) ? 1000 : step * 2) {
+		if (step > max_objects) {
+			step = max_objects;
+		}
+
+		objects_create (handle, queue_handles, objects, step);
+		objects = step;
+
+		start = time_usec ();
+		for (i = 0; i < iterations; i++) {
+			result = saMsgMessageSend (handle, &probe_queue, &message,
+				SA_TIME_ONE_SECOND);
+			if (result != SA_AIS_OK) {
+				printf ("[ERROR]: (%d) saMsgMessageSend\n", result);
+				exit (1);
+			}
+
+			received.size = sizeof (buffer);
+			received.data = buffer;
+			received.senderName = NULL;
+
+			result = saMsgMessageGet (probe_handle, &received, NULL,
+				&sender_id, SA_TIME_ONE_SECOND);
+			if (result != SA_AIS_OK) {
+				printf ("[ERROR]: (%d) saMsgMessageGet\n", result);
+				exit (1);
+			}
+		}
+		queue_usec = time_usec () - start;
+
+		start = time_usec ();
+		for (i = 0; i < iterations; i++) {
+			result = saMsgMessageSend (handle, &probe_group, &message,
+				SA_TIME_ONE_SECOND);
+			if (result != SA_AIS_OK) {
+				printf ("[ERROR]: (%d) saMsgMessageSend { group }\n", result);
+				exit (1);
+			}
+
+			received.size = sizeof (buffer);
+			received.data = buffer;
+			received.senderName = NULL;
+
+			saMsgMessageGet (probe_handle, &received, NULL,
+				&sender_id, SA_TIME_ONE_SECOND);
+		}
+		group_usec = time_usec () - start;
+
+		printf ("%10u %16.1f %16.1f\n", objects,
+			(double)(queue_usec) / iterations,
+			(double)(group_usec) / iterations);
+
+		if (objects == max_objects) {
+			break;
+		}
+	}
+
+	objects_delete (handle, objects);
+
+	saMsgQueueGroupDelete (handle, &probe_group);
+	saMsgFinalize (handle);
+
+	free (queue_handles);
+
+	return (0);
+}
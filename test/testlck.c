@@ -51,6 +51,11 @@
 SaNameT resource_name_async;
 SaLckResourceHandleT resource_handle_async;
 
+#define LOCK_SET_INVOCATION 0x58
+
+static int lock_set_grants = 0;
+static SaLckLockStatusT lock_set_status;
+
 static void testLckResourceOpenCallback (
 	SaInvocationT invocation,
 	SaLckResourceHandleT lockResourceHandle,
@@ -68,6 +73,11 @@ static void testLckLockGrantCallback (
 {
 	printf ("testLckLockGrantCallback invocation %llu status %d error %d\n",
 		(unsigned long long)invocation, lockStatus, error);
+
+	if (invocation == LOCK_SET_INVOCATION) {
+		lock_set_grants += 1;
+		lock_set_status = lockStatus;
+	}
 }
 
 static SaLckLockIdT pr_lock_id;
@@ -133,11 +143,47 @@ static void sigintr_handler (int signum) {
 	exit (0);
 }
 
+/*
+ * Returns 1 when another owner can not get an exclusive lock on
+ * the resource, that is when a lock is held on it.
+ */
+static int lock_held (SaLckResourceHandleT resource_handle)
+{
+	SaLckLockIdT lock_id;
+	SaLckLockStatusT status;
+	SaAisErrorT result;
+
+	result = saLckResourceLock (
+		resource_handle,
+		&lock_id,
+		SA_LCK_EX_LOCK_MODE,
+		SA_LCK_LOCK_NO_QUEUE,
+		55,
+		SA_TIME_END,
+		&status);
+	if (result != SA_AIS_OK) {
+		printf ("[ERROR]: (%d) saLckResourceLock EX no queue\n", result);
+		exit (1);
+	}
+	if (status == SA_LCK_LOCK_GRANTED) {
+		saLckResourceUnlock (lock_id, SA_TIME_END);
+		return (0);
+	}
+	return (status == SA_LCK_LOCK_NOT_QUEUED);
+}
+
 int main (void) {
 	SaLckHandleT handle;
 	SaLckResourceHandleT resource_handle;
 	int result;
 	SaLckLockIdT ex_lock_id;
+	SaLckLockSetEntryT lock_set[2];
+	SaLckHandleT handle_2;
+	SaLckLockIdT blocker_lock_id;
+	SaLckResourceHandleT set_a;
+	SaLckResourceHandleT set_b;
+	SaLckResourceHandleT set_a_2;
+	SaLckResourceHandleT set_b_2;
 	SaLckLockStatusT status;
 	SaNameT resource_name;
 	pthread_t dispatch_thread;
@@ -234,6 +280,93 @@ int main (void) {
 		55);
 	printf ("saLckResourceLockAsync PR %d (should be 1)\n", result);
 	printf ("status %d\n", status);
+
+	lock_set[0].lckResourceHandle = resource_handle;
+	lock_set[0].lockMode = SA_LCK_PR_LOCK_MODE;
+	lock_set[1].lckResourceHandle = resource_handle_async;
+	lock_set[1].lockMode = SA_LCK_PR_LOCK_MODE;
+
+	result = saLckResourceLockSetAsync (
+		0x57,
+		lock_set,
+		2,
+		0);
+	printf ("saLckResourceLockSetAsync PR %d (should be 1)\n", result);
+
+	/*
+	 * A lock set that waits behind an exclusive lock held by
+	 * another owner is granted as a whole, with one callback,
+	 * once that lock is released.
+	 */
+	result = saLckInitialize (&handle_2, &callbacks, &version);
+	if (result != SA_AIS_OK) {
+		printf ("Could not initialize Lock Service API instance error %d\n", result);
+		exit (1);
+	}
+
+	setSaNameT (&resource_name, "test_resource_set_a");
+	saLckResourceOpen (handle, &resource_name, SA_LCK_RESOURCE_CREATE,
+		SA_TIME_ONE_SECOND, &set_a);
+	saLckResourceOpen (handle_2, &resource_name, SA_LCK_RESOURCE_CREATE,
+		SA_TIME_ONE_SECOND, &set_a_2);
+
+	setSaNameT (&resource_name, "test_resource_set_b");
+	saLckResourceOpen (handle, &resource_name, SA_LCK_RESOURCE_CREATE,
+		SA_TIME_ONE_SECOND, &set_b);
+	saLckResourceOpen (handle_2, &resource_name, SA_LCK_RESOURCE_CREATE,
+		SA_TIME_ONE_SECOND, &set_b_2);
+
+	result = saLckResourceLock (
+		set_a_2,
+		&blocker_lock_id,
+		SA_LCK_EX_LOCK_MODE,
+		0,
+		55,
+		SA_TIME_END,
+		&status);
+	printf ("saLckResourceLock EX %d status %d (should be 1 1)\n", result, status);
+
+	lock_set[0].lckResourceHandle = set_b;
+	lock_set[0].lockMode = SA_LCK_EX_LOCK_MODE;
+	lock_set[1].lckResourceHandle = set_a;
+	lock_set[1].lockMode = SA_LCK_EX_LOCK_MODE;
+
+	result = saLckResourceLockSetAsync (
+		LOCK_SET_INVOCATION,
+		lock_set,
+		2,
+		0);
+	printf ("saLckResourceLockSetAsync EX %d (should be 1)\n", result);
+
+	sleep (1);
+
+	if (lock_set_grants != 0) {
+		printf ("[ERROR]: lock set granted while blocked\n");
+		exit (1);
+	}
+
+	result = saLckResourceUnlock (blocker_lock_id, SA_TIME_END);
+	printf ("saLckResourceUnlock result %d (should be 1)\n", result);
+
+	sleep (1);
+
+	if ((lock_set_grants != 1) || (lock_set_status != SA_LCK_LOCK_GRANTED)) {
+		printf ("[ERROR]: %d lock set grant callbacks, status %d (should be 1 1)\n",
+			lock_set_grants, lock_set_status);
+		exit (1);
+	}
+
+	if ((lock_held (set_a_2) == 0) || (lock_held (set_b_2) == 0)) {
+		printf ("[ERROR]: not every lock of the lock set is held\n");
+		exit (1);
+	}
+	printf ("lock set granted once with every lock held\n");
+
+	saLckResourceUnlock (lock_set[0].lockId, SA_TIME_END);
+	saLckResourceUnlock (lock_set[1].lockId, SA_TIME_END);
+
+	saLckFinalize (handle_2);
+
 	printf ("press the enter key to exit\n");
 	FD_ZERO (&read_fds);
 	do {
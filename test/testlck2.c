@@ -43,6 +43,7 @@
 #include <sys/socket.h>
 #include <sys/select.h>
 #include <sys/un.h>
+#include <sys/time.h>
 
 #include "saAis.h"
 #include "saLck.h"
@@ -97,6 +98,47 @@ static void setSaNameT (SaNameT *name, const char *str) {
 	}
 }
 
+static SaLckResourceHandleT resource_handle_f_3;
+static SaAisErrorT pr_result;
+static SaLckLockStatusT pr_status;
+static unsigned long long pr_wait_usec;
+
+static unsigned long long time_usec (void)
+{
+	struct timeval tv;
+
+	gettimeofday (&tv, NULL);
+
+	return ((unsigned long long)(tv.tv_sec) * 1000000ULL + tv.tv_usec);
+}
+
+/*
+ * The executive expires lock timeouts on a 10 ms tick.  Allow that
+ * tick plus the time to deliver the request and the timeout.
+ */
+#define TIMEOUT_LATE_MAX_USEC 50000ULL
+
+/*
+ * Ask for a shared lock once the exclusive request is queued.
+ */
+static void *th_pr_lock (void *arg)
+{
+	SaLckLockIdT lock_id;
+	unsigned long long start;
+
+	usleep (200000);
+
+	start = time_usec ();
+
+	pr_result = saLckResourceLock (resource_handle_f_3, &lock_id,
+				       SA_LCK_PR_LOCK_MODE, 0,
+				       55, SA_TIME_ONE_SECOND * 5, &pr_status);
+
+	pr_wait_usec = time_usec () - start;
+
+	return (NULL);
+}
+
 int main (void)
 {
 	int result;
@@ -112,6 +154,28 @@ int main (void)
 	SaNameT resource_name_a;
 	SaNameT resource_name_b;
 	SaNameT resource_name_c;
+	SaNameT resource_name_d;
+	SaNameT resource_name_e;
+
+	SaLckHandleT handle_2;
+	SaLckResourceHandleT resource_handle_d;
+	SaLckResourceHandleT resource_handle_e;
+	SaLckResourceHandleT resource_handle_d_2;
+	SaLckResourceHandleT resource_handle_e_2;
+
+	SaNameT resource_name_f;
+	SaLckHandleT handle_3;
+	SaLckResourceHandleT resource_handle_f;
+	SaLckResourceHandleT resource_handle_f_2;
+	pthread_t pr_thread;
+
+	SaNameT resource_name_g;
+	SaLckResourceHandleT resource_handle_g;
+	SaLckResourceHandleT resource_handle_g_2;
+	SaTimeT timeout;
+	unsigned long long start;
+	unsigned long long wait_usec;
+	unsigned int i;
 
 	result = saLckInitialize (&handle, &callbacks, &version);
 
@@ -208,6 +272,151 @@ int main (void)
 	printf ("[DEBUG]: (%d) saLckResourceLock { %s } [ id=%x status=%d ]\n",
 		result, (char *)(resource_name_c.value), (unsigned int)(lock_id), status);
 
+	/*
+	 * Two handles each hold one of resources "D" and "E" and
+	 * request the other one. The second request closes the
+	 * cycle and fails at once instead of waiting for its timeout.
+	 */
+	result = saLckInitialize (&handle_2, &callbacks, &version);
+	if (result != SA_AIS_OK) {
+		printf ("[ERROR]: (%d) saLckInitialize\n", result);
+		exit (1);
+	}
+
+	setSaNameT (&resource_name_d, "test_resource_d");
+	setSaNameT (&resource_name_e, "test_resource_e");
+
+	saLckResourceOpen (handle, &resource_name_d,
+			   SA_LCK_RESOURCE_CREATE, SA_TIME_ONE_SECOND,
+			   &resource_handle_d);
+	saLckResourceOpen (handle, &resource_name_e,
+			   SA_LCK_RESOURCE_CREATE, SA_TIME_ONE_SECOND,
+			   &resource_handle_e);
+	saLckResourceOpen (handle_2, &resource_name_d,
+			   SA_LCK_RESOURCE_CREATE, SA_TIME_ONE_SECOND,
+			   &resource_handle_d_2);
+	saLckResourceOpen (handle_2, &resource_name_e,
+			   SA_LCK_RESOURCE_CREATE, SA_TIME_ONE_SECOND,
+			   &resource_handle_e_2);
+
+	result = saLckResourceLock (resource_handle_d, &lock_id,
+				   SA_LCK_EX_LOCK_MODE, 0,
+				   55, SA_TIME_END, &status);
+	printf ("[DEBUG]: (%d) saLckResourceLock { %s } [ id=%x status=%d ]\n",
+		result, (char *)(resource_name_d.value), (unsigned int)(lock_id), status);
+
+	result = saLckResourceLock (resource_handle_e_2, &lock_id,
+				   SA_LCK_EX_LOCK_MODE, 0,
+				   55, SA_TIME_END, &status);
+	printf ("[DEBUG]: (%d) saLckResourceLock { %s } [ id=%x status=%d ]\n",
+		result, (char *)(resource_name_e.value), (unsigned int)(lock_id), status);
+
+	result = saLckResourceLockAsync (resource_handle_d_2, 0x44, &lock_id,
+					SA_LCK_EX_LOCK_MODE, 0, 55);
+	printf ("[DEBUG]: (%d) saLckResourceLockAsync { %s } [ id=%x ]\n",
+		result, (char *)(resource_name_d.value), (unsigned int)(lock_id));
+
+	result = saLckResourceLock (resource_handle_e, &lock_id,
+				   SA_LCK_EX_LOCK_MODE, 0,
+				   55, SA_TIME_ONE_SECOND * 30, &status);
+	printf ("[DEBUG]: (%d) saLckResourceLock { %s } [ id=%x status=%d ] (status should be 2)\n",
+		result, (char *)(resource_name_e.value), (unsigned int)(lock_id), status);
+
+	/*
+	 * Resource "F" prefers writers. A shared lock is held, an
+	 * exclusive request waits for it and a second shared request
+	 * waits behind the exclusive one. When the exclusive request
+	 * times out, the shared request is granted right away instead
+	 * of waiting for an unlock or for its own timeout.
+	 */
+	result = saLckInitialize (&handle_3, &callbacks, &version);
+	if (result != SA_AIS_OK) {
+		printf ("[ERROR]: (%d) saLckInitialize\n", result);
+		exit (1);
+	}
+
+	setSaNameT (&resource_name_f, "test_resource_f");
+
+	saLckResourceOpen (handle, &resource_name_f,
+			   SA_LCK_RESOURCE_CREATE | SA_LCK_RESOURCE_WRITER_PREFERENCE,
+			   SA_TIME_ONE_SECOND, &resource_handle_f);
+	saLckResourceOpen (handle_2, &resource_name_f,
+			   SA_LCK_RESOURCE_CREATE | SA_LCK_RESOURCE_WRITER_PREFERENCE,
+			   SA_TIME_ONE_SECOND, &resource_handle_f_2);
+	saLckResourceOpen (handle_3, &resource_name_f,
+			   SA_LCK_RESOURCE_CREATE | SA_LCK_RESOURCE_WRITER_PREFERENCE,
+			   SA_TIME_ONE_SECOND, &resource_handle_f_3);
+
+	result = saLckResourceLock (resource_handle_f, &lock_id,
+				   SA_LCK_PR_LOCK_MODE, 0,
+				   55, SA_TIME_END, &status);
+	printf ("[DEBUG]: (%d) saLckResourceLock { %s } [ id=%x status=%d ]\n",
+		result, (char *)(resource_name_f.value), (unsigned int)(lock_id), status);
+
+	pthread_create (&pr_thread, NULL, th_pr_lock, NULL);
+
+	result = saLckResourceLock (resource_handle_f_2, &lock_id,
+				   SA_LCK_EX_LOCK_MODE, 0,
+				   55, SA_TIME_ONE_SECOND, &status);
+	printf ("[DEBUG]: (%d) saLckResourceLock { %s } [ id=%x status=%d ] (result should be %d)\n",
+		result, (char *)(resource_name_f.value), (unsigned int)(lock_id), status,
+		SA_AIS_ERR_TIMEOUT);
+
+	pthread_join (pr_thread, NULL);
+
+	printf ("[DEBUG]: (%d) saLckResourceLock { %s } [ status=%d wait=%llu ms ] (status should be 1, wait about 800 ms)\n",
+		pr_result, (char *)(resource_name_f.value), pr_status,
+		pr_wait_usec / 1000);
+
+	if ((pr_result != SA_AIS_OK) || (pr_status != SA_LCK_LOCK_GRANTED) ||
+	    (pr_wait_usec > 3000000ULL))
+	{
+		printf ("[ERROR]: shared lock not granted after the exclusive request timed out\n");
+		exit (1);
+	}
+
+	/*
+	 * Resource "G" is held exclusively.  Exclusive requests with
+	 * timeouts that start at different points of a 10 ms tick must
+	 * all time out within one tick of the requested time.
+	 */
+	setSaNameT (&resource_name_g, "test_resource_g");
+
+	saLckResourceOpen (handle, &resource_name_g, SA_LCK_RESOURCE_CREATE,
+			   SA_TIME_ONE_SECOND, &resource_handle_g);
+	saLckResourceOpen (handle_2, &resource_name_g, SA_LCK_RESOURCE_CREATE,
+			   SA_TIME_ONE_SECOND, &resource_handle_g_2);
+
+	result = saLckResourceLock (resource_handle_g, &lock_id,
+				   SA_LCK_EX_LOCK_MODE, 0,
+				   55, SA_TIME_END, &status);
+	printf ("[DEBUG]: (%d) saLckResourceLock { %s } [ id=%x status=%d ]\n",
+		result, (char *)(resource_name_g.value), (unsigned int)(lock_id), status);
+
+	for (i = 0; i < 10; i++) {
+		timeout = SA_TIME_ONE_MILLISECOND * (200 + i);
+
+		start = time_usec ();
+
+		result = saLckResourceLock (resource_handle_g_2, &lock_id,
+					   SA_LCK_EX_LOCK_MODE, 0,
+					   55, timeout, &status);
+
+		wait_usec = time_usec () - start;
+
+		printf ("[DEBUG]: (%d) saLckResourceLock { %s } [ timeout=%llu ms wait=%llu ms ] (result should be %d)\n",
+			result, (char *)(resource_name_g.value),
+			(unsigned long long)(timeout / SA_TIME_ONE_MILLISECOND),
+			wait_usec / 1000, SA_AIS_ERR_TIMEOUT);
+
+		if ((result != SA_AIS_ERR_TIMEOUT) ||
+		    (wait_usec > timeout / SA_TIME_ONE_MICROSECOND + TIMEOUT_LATE_MAX_USEC))
+		{
+			printf ("[ERROR]: lock timeout not delivered within one tick\n");
+			exit (1);
+		}
+	}
+
 	sleep (30);
 
 	return (0);
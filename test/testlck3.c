@@ -0,0 +1,189 @@
+/*
+ * Deadlock detection across a cached resource.  Needs two nodes.
+ *
+ * Node A runs "testlck3 a", node B runs "testlck3 b".  Resource S is
+ * opened on node A only, so node A caches it, while X and Y are open on
+ * both nodes.  The owners G and H live on node A and the owner O on
+ * node B:
+ *
+ *   O holds Y, G holds S, H holds X
+ *   H waits for S (held by G)
+ *   G waits for Y (held by O)
+ *   O asks for X (held by H)
+ *
+ * The last request closes a cycle through S, which only node A can
+ * see.  Node B holds a frozen copy of S, so the request must be queued
+ * on every node and time out, instead of failing with
+ * SA_LCK_LOCK_DEADLOCK on node A only.
+ */
+
+#include <config.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+
+#include "saAis.h"
+#include "saLck.h"
+
+static SaLckCallbacksT callbacks = {
+	.saLckResourceOpenCallback	= NULL,
+	.saLckLockGrantCallback		= NULL,
+	.saLckLockWaiterCallback	= NULL,
+	.saLckResourceUnlockCallback	= NULL
+};
+
+static SaVersionT version = { 'B', 1, 1 };
+
+static void setSaNameT (SaNameT *name, const char *str) {
+	name->length = strlen (str);
+	strcpy ((char *)name->value, str);
+}
+
+static void owner_init (SaLckHandleT *handle)
+{
+	SaAisErrorT result;
+
+	result = saLckInitialize (handle, &callbacks, &version);
+	if (result != SA_AIS_OK) {
+		printf ("[ERROR]: (%d) saLckInitialize\n", result);
+		exit (1);
+	}
+}
+
+static void resource_open (SaLckHandleT handle, const char *str,
+	SaLckResourceHandleT *resource_handle)
+{
+	SaNameT name;
+	SaAisErrorT result;
+
+	setSaNameT (&name, str);
+
+	result = saLckResourceOpen (handle, &name, SA_LCK_RESOURCE_CREATE,
+		SA_TIME_ONE_SECOND * 10, resource_handle);
+	if (result != SA_AIS_OK) {
+		printf ("[ERROR]: (%d) saLckResourceOpen { %s }\n", result, str);
+		exit (1);
+	}
+}
+
+static void resource_lock (SaLckResourceHandleT resource_handle,
+	const char *str)
+{
+	SaLckLockIdT lock_id;
+	SaLckLockStatusT status;
+	SaAisErrorT result;
+
+	result = saLckResourceLock (resource_handle, &lock_id,
+		SA_LCK_EX_LOCK_MODE, 0, 0, SA_TIME_ONE_SECOND * 10, &status);
+	if (result != SA_AIS_OK || status != SA_LCK_LOCK_GRANTED) {
+		printf ("[ERROR]: (%d) saLckResourceLock { %s } [ status=%d ]\n",
+			result, str, status);
+		exit (1);
+	}
+}
+
+static void resource_lock_async (SaLckResourceHandleT resource_handle,
+	const char *str)
+{
+	SaLckLockIdT lock_id;
+	SaAisErrorT result;
+
+	result = saLckResourceLockAsync (resource_handle, 0, &lock_id,
+		SA_LCK_EX_LOCK_MODE, 0, 0);
+	if (result != SA_AIS_OK) {
+		printf ("[ERROR]: (%d) saLckResourceLockAsync { %s }\n", result, str);
+		exit (1);
+	}
+}
+
+static void wait_enter (const char *message)
+{
+	printf ("%s, then press enter\n", message);
+	getchar ();
+}
+
+static int node_a (void)
+{
+	SaLckHandleT handle_g;
+	SaLckHandleT handle_h;
+	SaLckResourceHandleT s_g;
+	SaLckResourceHandleT y_g;
+	SaLckResourceHandleT s_h;
+	SaLckResourceHandleT x_h;
+
+	owner_init (&handle_g);
+	owner_init (&handle_h);
+
+	resource_open (handle_g, "testlck3_s", &s_g);
+	resource_open (handle_g, "testlck3_y", &y_g);
+	resource_open (handle_h, "testlck3_s", &s_h);
+	resource_open (handle_h, "testlck3_x", &x_h);
+
+	resource_lock (s_g, "testlck3_s");
+	resource_lock (x_h, "testlck3_x");
+
+	resource_lock_async (s_h, "testlck3_s");
+	resource_lock_async (y_g, "testlck3_y");
+
+	wait_enter ("[DEBUG]: G holds S, H holds X, H waits for S, G waits for Y.\n"
+		"Continue on node B and wait for its result");
+
+	saLckFinalize (handle_h);
+	saLckFinalize (handle_g);
+
+	return (0);
+}
+
+static int node_b (void)
+{
+	SaLckHandleT handle_o;
+	SaLckResourceHandleT x_o;
+	SaLckResourceHandleT y_o;
+	SaLckLockIdT lock_id;
+	SaLckLockStatusT status;
+	SaAisErrorT result;
+
+	owner_init (&handle_o);
+
+	resource_open (handle_o, "testlck3_x", &x_o);
+	resource_open (handle_o, "testlck3_y", &y_o);
+
+	resource_lock (y_o, "testlck3_y");
+
+	wait_enter ("[DEBUG]: O holds Y. Start \"testlck3 a\" on node A");
+
+	result = saLckResourceLock (x_o, &lock_id,
+		SA_LCK_EX_LOCK_MODE, 0, 0, SA_TIME_ONE_SECOND * 5, &status);
+
+	saLckFinalize (handle_o);
+
+	if (result == SA_AIS_OK && status == SA_LCK_LOCK_DEADLOCK) {
+		printf ("[ERROR]: deadlock seen through the cached resource S\n");
+		return (1);
+	}
+	if (result != SA_AIS_ERR_TIMEOUT) {
+		printf ("[ERROR]: (%d) saLckResourceLock { testlck3_x } [ status=%d ] (should time out)\n",
+			result, status);
+		return (1);
+	}
+
+	printf ("[DEBUG]: request on X queued on every node and timed out\n");
+
+	return (0);
+}
+
+int main (int argc, char *argv[])
+{
+	if (argc == 2 && strcmp (argv[1], "a") == 0) {
+		return (node_a ());
+	}
+	if (argc == 2 && strcmp (argv[1], "b") == 0) {
+		return (node_b ());
+	}
+
+	printf ("usage: %s a|b\n", argv[0]);
+
+	return (1);
+}
@@ -139,10 +139,15 @@ int main (void) {
 	SaMsgMessageT msg_a;
 	SaMsgMessageT msg_b;
 	SaMsgMessageT msg_c;
+	SaMsgMessageT msg_many[4];
+	SaMsgSenderIdT id_many[4];
+	SaUint32T count;
+	SaUint32T i;
 
 	memset (&msg_a, 0, sizeof (SaMsgMessageT));
 	memset (&msg_b, 0, sizeof (SaMsgMessageT));
 	memset (&msg_c, 0, sizeof (SaMsgMessageT));
+	memset (msg_many, 0, sizeof (msg_many));
 
 	signal (SIGINT, sigintr_handler);
 
@@ -249,6 +254,17 @@ int main (void) {
 	printf ("saMsgMessageGet { (b) data = %s }\n", (char *)(msg_b.data));
 	printf ("saMsgMessageGet { (c) data = %s }\n", (char *)(msg_c.data));
 
+	result = saMsgMessageGetMany (queue_handle, msg_many, NULL, id_many,
+		4, 0, &count, SA_TIME_ONE_MINUTE);
+	printf ("saMsgMessageGetMany result is %d (should be 1)\n", result);
+	printf ("saMsgMessageGetMany { count = %u } (should be 2)\n", count);
+
+	for (i = 0; (result == SA_AIS_OK) && (i < count); i++) {
+		printf ("saMsgMessageGetMany { (%u) data = %s }\n", i,
+			(char *)(msg_many[i].data));
+		saMsgMessageDataFree (handle, msg_many[i].data);
+	}
+
 	result = saMsgQueueGroupRemove (handle,	&queue_group_name, &queue_name);
 	printf ("saMsgQueueGroupRemove result is %d (should be 1)\n", result);
 
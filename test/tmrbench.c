@@ -0,0 +1,285 @@
+/*
+ * Measure the cost of the timer service as the number of running timers
+ * grows.  At every step from the minimum to the maximum count (ten times
+ * more each step) that many one-shot timers are started far in the
+ * future, rescheduled and finally cancelled, and the throughput of each
+ * operation is reported.  While they run, a set of absolute timers due
+ * within the next second is started and the lateness of their expiration
+ * callbacks against the requested expiration time is reported as the
+ * expiry jitter.  With the timing wheel in the executive the cost of an
+ * operation and the jitter should not depend on the number of timers.
+ */
+
+#include <config.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/time.h>
+
+#include "saAis.h"
+#include "saTmr.h"
+
+static SaTmrHandleT handle;
+static SaTimeT *expected;
+static unsigned long long *lateness_usec;
+static unsigned int callbacks = 0;
+static unsigned int samples = 1000;
+
+static unsigned long long time_usec (void)
+{
+	struct timeval tv;
+
+	gettimeofday (&tv, NULL);
+
+	return ((unsigned long long)(tv.tv_sec) * 1000000ULL + tv.tv_usec);
+}
+
+static int compare_usec (const void *a, const void *b)
+{
+	unsigned long long x = *(const unsigned long long *)a;
+	unsigned long long y = *(const unsigned long long *)b;
+
+	return ((x > y) - (x < y));
+}
+
+static void TimerExpiredCallback (
+	SaTmrTimerIdT timerId,
+	const void *timerData,
+	SaUint64T expirationCount)
+{
+	unsigned long sample = (unsigned long)timerData;
+	SaTimeT now;
+
+	if (sample >= samples) {
+		return;
+	}
+
+	saTmrTimeGet (handle, &now);
+
+	lateness_usec[callbacks] = (now > expected[sample]) ?
+		(unsigned long long)(now - expected[sample]) / 1000ULL : 0;
+	callbacks += 1;
+}
+
+static SaTmrCallbacksT callbacks_tmr = {
+	.saTmrTimerExpiredCallback = TimerExpiredCallback
+};
+
+static SaVersionT version = { 'A', 1, 1 };
+
+static double rate (unsigned int count, unsigned long long usec)
+{
+	if (usec == 0) {
+		usec = 1;
+	}
+	return ((double)(count) * 1000000.0 / (double)(usec));
+}
+
+int main (int argc, char *argv[])
+{
+	SaSelectionObjectT select_obj;
+	SaTmrTimerAttributesT attrs;
+	SaTmrTimerIdT *timer_ids;
+	SaTmrTimerIdT *sample_ids;
+	SaTimeT call_time;
+	SaTimeT now;
+	SaAisErrorT result;
+	struct pollfd pfd;
+	void *timer_data;
+
+	unsigned long long start;
+	unsigned long long start_usec;
+	unsigned long long reschedule_usec;
+	unsigned long long cancel_usec;
+	unsigned long long total;
+	unsigned long long deadline;
+	unsigned int min_timers = 1000;
+	unsigned int max_timers = 1000000;
+	unsigned int timers;
+	unsigned int i;
+	int c;
+
+	while ((c = getopt (argc, argv, "s:m:j:")) != -1) {
+		switch (c) {
+		case 's':
+			min_timers = atoi (optarg);
+			break;
+		case 'm':
+			max_timers = atoi (optarg);
+			break;
+		case 'j':
+			samples = atoi (optarg);
+			break;
+		default:
+			printf ("usage: %s [-s min timers] [-m max timers] [-j jitter samples]\n",
+				argv[0]);
+			exit (1);
+		}
+	}
+
+	if (min_timers == 0 || max_timers < min_timers || samples == 0) {
+		printf ("[ERROR]: need 0 < min timers <= max timers and jitter samples > 0\n");
+		exit (1);
+	}
+
+	timer_ids = malloc (sizeof (SaTmrTimerIdT) * max_timers);
+	sample_ids = malloc (sizeof (SaTmrTimerIdT) * samples);
+	expected = malloc (sizeof (SaTimeT) * samples);
+	lateness_usec = malloc (sizeof (unsigned long long) * samples);
+	if (timer_ids == NULL || sample_ids == NULL ||
+	    expected == NULL || lateness_usec == NULL)
+	{
+		printf ("[ERROR]: out of memory\n");
+		exit (1);
+	}
+
+	result = saTmrInitialize (&handle, &callbacks_tmr, &version);
+	if (result != SA_AIS_OK) {
+		printf ("[ERROR]: (%d) saTmrInitialize\n", result);
+		exit (1);
+	}
+
+	result = saTmrSelectionObjectGet (handle, &select_obj);
+	if (result != SA_AIS_OK) {
+		printf ("[ERROR]: (%d) saTmrSelectionObjectGet\n", result);
+		exit (1);
+	}
+
+	pfd.fd = select_obj;
+	pfd.events = POLLIN;
+
+	printf ("%8s %12s %12s %12s %10s %10s %10s %10s\n",
+		"timers", "start/s", "resched/s", "cancel/s",
+		"jit avg", "jit p50", "jit p99", "jit max");
+
+	for (timers = min_timers; ; timers *= 10) {
+		if (timers > max_timers) {
+			timers = max_timers;
+		}
+
+		/*
+		 * Background timers, due long after the step is over.
+		 */
+		attrs.type = SA_TIME_DURATION;
+		attrs.initialExpirationTime = SA_TIME_ONE_HOUR;
+		attrs.timerPeriodDuration = 0;
+
+		start = time_usec ();
+
+		for (i = 0; i < timers; i++) {
+			result = saTmrTimerStart (handle, &attrs,
+				(void *)(unsigned long)(samples), &timer_ids[i],
+				&call_time);
+			if (result != SA_AIS_OK) {
+				printf ("[ERROR]: (%d) saTmrTimerStart { %u }\n", result, i);
+				exit (1);
+			}
+		}
+
+		start_usec = time_usec () - start;
+
+		attrs.initialExpirationTime = SA_TIME_ONE_HOUR * 2;
+
+		start = time_usec ();
+
+		for (i = 0; i < timers; i++) {
+			result = saTmrTimerReschedule (handle, timer_ids[i],
+				&attrs, &call_time);
+			if (result != SA_AIS_OK) {
+				printf ("[ERROR]: (%d) saTmrTimerReschedule { %u }\n", result, i);
+				exit (1);
+			}
+		}
+
+		reschedule_usec = time_usec () - start;
+
+		/*
+		 * Jitter samples, spread over the next second.
+		 */
+		callbacks = 0;
+
+		saTmrTimeGet (handle, &now);
+
+		attrs.type = SA_TIME_ABSOLUTE;
+
+		for (i = 0; i < samples; i++) {
+			expected[i] = now + SA_TIME_ONE_MILLISECOND * 100 +
+				(SA_TIME_ONE_SECOND / samples) * i;
+			attrs.initialExpirationTime = expected[i];
+
+			result = saTmrTimerStart (handle, &attrs,
+				(void *)(unsigned long)(i), &sample_ids[i], &call_time);
+			if (result != SA_AIS_OK) {
+				printf ("[ERROR]: (%d) saTmrTimerStart { sample %u }\n", result, i);
+				exit (1);
+			}
+		}
+
+		deadline = time_usec () + 10000000ULL;
+
+		while (callbacks < samples && time_usec () < deadline) {
+			poll (&pfd, 1, 100);
+
+			result = saTmrDispatch (handle, SA_DISPATCH_ALL);
+			if (result != SA_AIS_OK) {
+				printf ("[ERROR]: (%d) saTmrDispatch\n", result);
+				exit (1);
+			}
+		}
+
+		if (callbacks < samples) {
+			printf ("[ERROR]: only %u of %u sample timers expired\n",
+				callbacks, samples);
+			exit (1);
+		}
+
+		for (i = 0; i < samples; i++) {
+			saTmrTimerCancel (handle, sample_ids[i], &timer_data);
+		}
+
+		start = time_usec ();
+
+		for (i = 0; i < timers; i++) {
+			result = saTmrTimerCancel (handle, timer_ids[i], &timer_data);
+			if (result != SA_AIS_OK) {
+				printf ("[ERROR]: (%d) saTmrTimerCancel { %u }\n", result, i);
+				exit (1);
+			}
+		}
+
+		cancel_usec = time_usec () - start;
+
+		qsort (lateness_usec, samples, sizeof (unsigned long long), compare_usec);
+
+		total = 0;
+		for (i = 0; i < samples; i++) {
+			total += lateness_usec[i];
+		}
+
+		printf ("%8u %12.0f %12.0f %12.0f %7llu us %7llu us %7llu us %7llu us\n",
+			timers,
+			rate (timers, start_usec),
+			rate (timers, reschedule_usec),
+			rate (timers, cancel_usec),
+			total / samples,
+			lateness_usec[samples / 2],
+			lateness_usec[(samples * 99) / 100],
+			lateness_usec[samples - 1]);
+
+		if (timers == max_timers) {
+			break;
+		}
+	}
+
+	saTmrFinalize (handle);
+
+	free (timer_ids);
+	free (sample_ids);
+	free (expected);
+	free (lateness_usec);
+
+	return (0);
+}
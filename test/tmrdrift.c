@@ -0,0 +1,182 @@
+/*
+ * Measure the drift of a periodic timer.  A duration timer is started
+ * with the given period and its expiration callbacks are timed for
+ * the given number of periods.  The lateness of every callback is
+ * taken against the ideal schedule start + expirationCount * period,
+ * so a timer that keeps its phase shows the same lateness at the end
+ * of the run as at its start, while a timer re-armed from its
+ * callback drifts by the accumulated dispatch latency.  The test
+ * fails when the timer drifted by more than one period.
+ */
+
+#include <config.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/time.h>
+
+#include "saAis.h"
+#include "saTmr.h"
+
+static unsigned long long *arrival_usec;
+static SaUint64T *arrival_count;
+static unsigned int callbacks = 0;
+static unsigned int iterations = 1000;
+
+static unsigned long long time_usec (void)
+{
+	struct timeval tv;
+
+	gettimeofday (&tv, NULL);
+
+	return ((unsigned long long)(tv.tv_sec) * 1000000ULL + tv.tv_usec);
+}
+
+static void TimerExpiredCallback (
+	SaTmrTimerIdT timerId,
+	const void *timerData,
+	SaUint64T expirationCount)
+{
+	if (callbacks < iterations) {
+		arrival_usec[callbacks] = time_usec ();
+		arrival_count[callbacks] = expirationCount;
+		callbacks += 1;
+	}
+}
+
+static SaTmrCallbacksT callbacks_tmr = {
+	.saTmrTimerExpiredCallback = TimerExpiredCallback
+};
+
+static SaVersionT version = { 'A', 1, 1 };
+
+/*
+ * Average lateness of the callbacks in [from, to).
+ */
+static long long lateness_avg (unsigned long long start,
+	unsigned long long period_usec, unsigned int from, unsigned int to)
+{
+	long long total = 0;
+	unsigned int i;
+
+	for (i = from; i < to; i++) {
+		total += (long long)(arrival_usec[i] -
+			(start + arrival_count[i] * period_usec));
+	}
+
+	return (total / (long long)(to - from));
+}
+
+int main (int argc, char *argv[])
+{
+	SaTmrHandleT handle;
+	SaSelectionObjectT select_obj;
+	SaTmrTimerAttributesT attrs = { SA_TIME_DURATION, 0, 0 };
+	SaTmrTimerIdT timer_id;
+	SaTimeT call_time;
+	SaAisErrorT result;
+	struct pollfd pfd;
+	void *timer_data;
+
+	unsigned long long period_usec = 10000;
+	unsigned long long start;
+	unsigned int window;
+	long long first;
+	long long last;
+	long long drift;
+	int c;
+
+	while ((c = getopt (argc, argv, "p:n:")) != -1) {
+		switch (c) {
+		case 'p':
+			period_usec = atoi (optarg);
+			break;
+		case 'n':
+			iterations = atoi (optarg);
+			break;
+		default:
+			printf ("usage: %s [-p period usec] [-n periods]\n", argv[0]);
+			exit (1);
+		}
+	}
+
+	if (iterations < 10 || period_usec == 0) {
+		printf ("[ERROR]: at least 10 periods of at least 1 usec are needed\n");
+		exit (1);
+	}
+
+	arrival_usec = malloc (sizeof (unsigned long long) * iterations);
+	arrival_count = malloc (sizeof (SaUint64T) * iterations);
+	if (arrival_usec == NULL || arrival_count == NULL) {
+		printf ("[ERROR]: out of memory\n");
+		exit (1);
+	}
+
+	result = saTmrInitialize (&handle, &callbacks_tmr, &version);
+	if (result != SA_AIS_OK) {
+		printf ("[ERROR]: (%d) saTmrInitialize\n", result);
+		exit (1);
+	}
+
+	result = saTmrSelectionObjectGet (handle, &select_obj);
+	if (result != SA_AIS_OK) {
+		printf ("[ERROR]: (%d) saTmrSelectionObjectGet\n", result);
+		exit (1);
+	}
+
+	attrs.initialExpirationTime = (SaTimeT)(period_usec * 1000ULL);
+	attrs.timerPeriodDuration = (SaTimeT)(period_usec * 1000ULL);
+
+	start = time_usec ();
+
+	result = saTmrTimerStart (handle, &attrs, NULL, &timer_id, &call_time);
+	if (result != SA_AIS_OK) {
+		printf ("[ERROR]: (%d) saTmrTimerStart\n", result);
+		exit (1);
+	}
+
+	pfd.fd = select_obj;
+	pfd.events = POLLIN;
+
+	while (callbacks < iterations) {
+		poll (&pfd, 1, -1);
+
+		result = saTmrDispatch (handle, SA_DISPATCH_ALL);
+		if (result != SA_AIS_OK) {
+			printf ("[ERROR]: (%d) saTmrDispatch\n", result);
+			exit (1);
+		}
+	}
+
+	saTmrTimerCancel (handle, timer_id, &timer_data);
+	saTmrFinalize (handle);
+
+	/*
+	 * Compare the first and the last tenth of the run, so that the
+	 * constant IPC latency cancels out.
+	 */
+	window = iterations / 10;
+
+	first = lateness_avg (start, period_usec, 0, window);
+	last = lateness_avg (start, period_usec, iterations - window, iterations);
+	drift = last - first;
+
+	printf ("%u callbacks, %llu expirations of %llu us\n",
+		iterations, (unsigned long long)(arrival_count[iterations - 1]),
+		period_usec);
+	printf ("lateness  first %8lld us  last %8lld us  drift %8lld us\n",
+		first, last, drift);
+
+	free (arrival_usec);
+	free (arrival_count);
+
+	if (drift > (long long)(period_usec) || drift < -(long long)(period_usec)) {
+		printf ("[ERROR]: timer drifted by more than one period\n");
+		return (1);
+	}
+
+	return (0);
+}